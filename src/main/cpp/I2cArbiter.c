@@ -0,0 +1,394 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // F_OFD_SETLK and F_OFD_GETLK on glibc; bionic always has them
+#endif
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <time.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <syslog.h>
+
+#include "I2cArbiter.h"
+
+#define I2C_ARBITER_MAX_HANDLES 16
+// Waiters wake up at least this often to check whether the owner died
+#define I2C_ARBITER_POLL_NS 50000000L
+
+struct i2c_arbiter_handle {
+    int in_use;
+    int refs;       // opens, plus calls in progress, so close cannot unmap under them
+    char bus[64];
+    int fd;
+    uint32_t id;    // session id
+    struct i2c_arbiter_segment *seg;
+    int held;
+};
+
+static struct i2c_arbiter_handle handles[I2C_ARBITER_MAX_HANDLES];
+static pthread_mutex_t handles_lock = PTHREAD_MUTEX_INITIALIZER;
+static char arbiter_dir[192];
+
+static inline uint64_t arbiter_now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+}
+
+static void arbiter_log(const char *fmt, const char *arg, int err)
+{
+    openlog("i2c_arbiter", LOG_PID | LOG_CONS, LOG_USER);
+    syslog(LOG_ERR, fmt, arg, strerror(err));
+    closelog();
+}
+
+static inline struct i2c_arbiter_handle *handle_at(int handle)
+{
+    if (handle < 0 || handle >= I2C_ARBITER_MAX_HANDLES || !handles[handle].in_use) {
+        return NULL;
+    }
+    return &handles[handle];
+}
+
+// Takes a reference on a handle for the duration of a call. Returns NULL if unknown.
+static struct i2c_arbiter_handle *pin_handle(int handle)
+{
+    pthread_mutex_lock(&handles_lock);
+    struct i2c_arbiter_handle *h = handle_at(handle);
+    if (h != NULL) {
+        h->refs++;
+    }
+    pthread_mutex_unlock(&handles_lock);
+    return h;
+}
+
+static void release_segment(struct i2c_arbiter_handle *h);
+
+// Drops a reference; the last one releases the bus if still held and unmaps the segment
+static void unpin_handle(struct i2c_arbiter_handle *h)
+{
+    pthread_mutex_lock(&handles_lock);
+    if (--h->refs == 0) {
+        if (h->held) {
+            release_segment(h);
+        }
+        munmap(h->seg, sizeof(*h->seg));
+        close(h->fd);
+        h->in_use = 0;
+    }
+    pthread_mutex_unlock(&handles_lock);
+}
+
+static int futex_wait(uint32_t *word, uint32_t expected, long timeout_ns)
+{
+    struct timespec ts = {timeout_ns / 1000000000L, timeout_ns % 1000000000L};
+    // Not FUTEX_PRIVATE: the word lives in memory shared between processes
+    return (int) syscall(SYS_futex, word, FUTEX_WAIT, expected, &ts, NULL, 0);
+}
+
+static void futex_wake_one(uint32_t *word)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+static inline void alive_range(struct flock *range, uint32_t session, short type)
+{
+    memset(range, 0, sizeof(*range));
+    range->l_type = type;
+    range->l_whence = SEEK_SET;
+    range->l_start = (off_t) I2C_ARBITER_ALIVE_BASE + (off_t) session;
+    range->l_len = 1;
+}
+
+// Whether the process holding session still has the segment mapped
+static int session_alive(int fd, uint32_t session)
+{
+    struct flock probe;
+    alive_range(&probe, session, F_WRLCK);
+    if (fcntl(fd, F_OFD_GETLK, &probe) < 0) {
+        // Cannot tell, so never take the lock from a process that may be alive
+        return 1;
+    }
+    return probe.l_type != F_UNLCK;
+}
+
+// Takes a session id and locks its liveness byte. Returns the id, or 0.
+static uint32_t join_segment(struct i2c_arbiter_segment *seg, int fd)
+{
+    uint32_t session = __atomic_fetch_add(&seg->next_session, 1, __ATOMIC_RELAXED)
+                       % I2C_ARBITER_SESSION_MAX + 1;
+    struct flock alive;
+    alive_range(&alive, session, F_WRLCK);
+    return fcntl(fd, F_OFD_SETLK, &alive) == 0 ? session : 0;
+}
+
+int i2c_arbiter_set_dir(const char *dir)
+{
+    if (strlen(dir) >= sizeof(arbiter_dir)) {
+        return -1;
+    }
+    pthread_mutex_lock(&handles_lock);
+    strcpy(arbiter_dir, dir);
+    pthread_mutex_unlock(&handles_lock);
+    return 0;
+}
+
+int i2c_arbiter_open(const char *bus_path)
+{
+    pthread_mutex_lock(&handles_lock);
+
+    if (arbiter_dir[0] == '\0') {
+        arbiter_log("No lock directory set for %s: %s", bus_path, ENOENT);
+        pthread_mutex_unlock(&handles_lock);
+        errno = ENOENT;
+        return -1;
+    }
+
+    int free_slot = -1;
+    for (int i = 0; i < I2C_ARBITER_MAX_HANDLES; i++) {
+        if (handles[i].in_use && strcmp(handles[i].bus, bus_path) == 0) {
+            handles[i].refs++;
+            pthread_mutex_unlock(&handles_lock);
+            return i;
+        }
+        if (!handles[i].in_use && free_slot < 0) {
+            free_slot = i;
+        }
+    }
+    if (free_slot < 0 || strlen(bus_path) >= sizeof(handles[0].bus)) {
+        pthread_mutex_unlock(&handles_lock);
+        return -1;
+    }
+
+    const char *base = strrchr(bus_path, '/');
+    base = base != NULL ? base + 1 : bus_path;
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s.lock", arbiter_dir, base);
+
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        arbiter_log("Failed to open lock file %s: %s", path, errno);
+        pthread_mutex_unlock(&handles_lock);
+        return -1;
+    }
+    // The creator's umask must not lock other users out of the file
+    fchmod(fd, 0666);
+
+    struct i2c_arbiter_segment *seg = NULL;
+    uint32_t session = 0;
+    int err = EPROTO;  // for a segment of another protocol
+    struct stat st;
+    if (fstat(fd, &st) == 0 && (st.st_size >= (off_t) sizeof(*seg) ||
+                                ftruncate(fd, sizeof(*seg)) == 0)) {
+        void *map = mmap(NULL, sizeof(*seg), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map != MAP_FAILED) {
+            seg = map;
+            // A freshly truncated file is zero-filled, which is an unlocked segment
+            uint32_t zero = 0;
+            __atomic_compare_exchange_n(&seg->magic, &zero, I2C_ARBITER_MAGIC, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+            if (seg->magic == I2C_ARBITER_MAGIC) {
+                seg->version = I2C_ARBITER_VERSION;
+                session = join_segment(seg, fd);
+            }
+            if (session == 0) {
+                if (seg->magic == I2C_ARBITER_MAGIC) {
+                    err = errno;
+                }
+                munmap(map, sizeof(*seg));
+                seg = NULL;
+            }
+        } else {
+            err = errno;
+        }
+    } else {
+        err = errno;
+    }
+    if (seg == NULL) {
+        // Holders of any other kind of lock would not exclude ours, so do without
+        arbiter_log("Shared lock segment unavailable for %s, arbitration off: %s", path, err);
+        close(fd);
+        pthread_mutex_unlock(&handles_lock);
+        errno = err;
+        return -1;
+    }
+
+    struct i2c_arbiter_handle *h = &handles[free_slot];
+    memset(h, 0, sizeof(*h));
+    h->in_use = 1;
+    h->refs = 1;
+    strcpy(h->bus, bus_path);
+    h->fd = fd;
+    h->id = session;
+    h->seg = seg;
+
+    pthread_mutex_unlock(&handles_lock);
+    return free_slot;
+}
+
+static int acquire_futex(struct i2c_arbiter_handle *h, int64_t timeout_ns, int *stolen)
+{
+    uint32_t *word = &h->seg->lock;
+    uint32_t expected = 0;
+
+    // Fast path: free lock, no system call
+    if (__atomic_compare_exchange_n(word, &expected, h->id, 0,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+
+    uint64_t start = arbiter_now_ns();
+    for (;;) {
+        uint32_t v = __atomic_load_n(word, __ATOMIC_RELAXED);
+        if (v == 0) {
+            // Keep the waiters bit: others may still be sleeping
+            if (__atomic_compare_exchange_n(word, &v, h->id | I2C_ARBITER_WAITERS, 0,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                return 1;
+            }
+            continue;
+        }
+
+        uint32_t owner = v & I2C_ARBITER_OWNER_MASK;
+        if (owner == h->id) {
+            // The lock is per process; the Kotlin bus lock serialises threads
+            errno = EDEADLK;
+            return -1;
+        }
+        if (!session_alive(h->fd, owner)) {
+            if (__atomic_compare_exchange_n(word, &v, h->id | I2C_ARBITER_WAITERS, 0,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                *stolen = 1;
+                return 1;
+            }
+            continue;
+        }
+        if (!(v & I2C_ARBITER_WAITERS)) {
+            uint32_t flagged = v | I2C_ARBITER_WAITERS;
+            if (!__atomic_compare_exchange_n(word, &v, flagged, 0,
+                                             __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                continue;
+            }
+            v = flagged;
+        }
+
+        long slice = I2C_ARBITER_POLL_NS;
+        if (timeout_ns > 0) {
+            int64_t remaining = timeout_ns - (int64_t) (arbiter_now_ns() - start);
+            if (remaining <= 0) {
+                errno = ETIMEDOUT;
+                return -1;
+            }
+            if (remaining < slice) {
+                slice = (long) remaining;
+            }
+        }
+        futex_wait(word, v, slice);
+    }
+}
+
+int i2c_arbiter_acquire(int handle, int64_t timeout_ns)
+{
+    struct i2c_arbiter_handle *h = pin_handle(handle);
+    if (h == NULL) {
+        return -1;
+    }
+
+    uint64_t start = arbiter_now_ns();
+    int stolen = 0;
+    int waited = acquire_futex(h, timeout_ns, &stolen);
+    if (waited < 0) {
+        int err = errno;
+        unpin_handle(h);
+        errno = err;
+        return -1;
+    }
+
+    uint64_t now = arbiter_now_ns();
+    struct i2c_arbiter_segment *s = h->seg;
+    uint32_t previous = s->last_owner;
+    s->last_owner = h->id;
+    s->acquired_ns = now;
+    s->acquisitions++;
+    if (waited) {
+        s->contended++;
+        s->total_wait_ns += now - start;
+    }
+    if (stolen) {
+        s->steals++;
+    }
+    h->held = 1;
+
+    unpin_handle(h);
+    return (previous != 0 && previous != h->id) ? 1 : 0;
+}
+
+static void release_segment(struct i2c_arbiter_handle *h)
+{
+    struct i2c_arbiter_segment *s = h->seg;
+    uint64_t held = arbiter_now_ns() - s->acquired_ns;
+    s->total_hold_ns += held;
+    if (held > s->max_hold_ns) {
+        s->max_hold_ns = held;
+    }
+    h->held = 0;
+
+    uint32_t v = __atomic_exchange_n(&s->lock, 0, __ATOMIC_RELEASE);
+    if (v & I2C_ARBITER_WAITERS) {
+        futex_wake_one(&s->lock);
+    }
+}
+
+int i2c_arbiter_release(int handle)
+{
+    struct i2c_arbiter_handle *h = pin_handle(handle);
+    if (h == NULL) {
+        return -1;
+    }
+    int result = -1;
+    if (h->held) {
+        release_segment(h);
+        result = 0;
+    }
+    unpin_handle(h);
+    return result;
+}
+
+int i2c_arbiter_close(int handle)
+{
+    pthread_mutex_lock(&handles_lock);
+    struct i2c_arbiter_handle *h = handle_at(handle);
+    pthread_mutex_unlock(&handles_lock);
+    if (h == NULL) {
+        return -1;
+    }
+    // Calls still in progress keep the segment mapped until they return
+    unpin_handle(h);
+    return 0;
+}
+
+int i2c_arbiter_stats(int handle, int64_t stats[I2C_ARBITER_STATS_COUNT])
+{
+    struct i2c_arbiter_handle *h = pin_handle(handle);
+    if (h == NULL) {
+        return -1;
+    }
+    struct i2c_arbiter_segment *s = h->seg;
+    stats[0] = (int64_t) s->acquisitions;
+    stats[1] = (int64_t) s->contended;
+    stats[2] = (int64_t) s->steals;
+    stats[3] = (int64_t) s->total_wait_ns;
+    stats[4] = (int64_t) s->total_hold_ns;
+    stats[5] = (int64_t) s->max_hold_ns;
+    unpin_handle(h);
+    return 0;
+}
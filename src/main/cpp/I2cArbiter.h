@@ -0,0 +1,107 @@
+#ifndef I2C_ARBITER_H
+#define I2C_ARBITER_H
+
+#include <stdint.h>
+
+/*
+ * Cross-process I2C bus arbitration.
+ *
+ * Every process that wants to share /dev/i2c-N maps the same small file,
+ * <dir>/i2c-N.lock, and takes the lock word in it around each transaction.
+ * Other tools can take part by mapping the file and following the protocol
+ * described for struct i2c_arbiter_segment. The directory is set by the
+ * caller, e.g. to the app's files directory, and must be writable by every
+ * participating process.
+ *
+ * There is no fallback when the file cannot be mapped or joined: a process
+ * using another kind of lock would not exclude the ones using the segment,
+ * so i2c_arbiter_open fails and the caller runs without arbitration.
+ */
+
+#define I2C_ARBITER_MAGIC   0x49324341u /* "I2CA" */
+#define I2C_ARBITER_VERSION 2
+
+// Set in the lock word while at least one process may be sleeping on it.
+#define I2C_ARBITER_WAITERS 0x80000000u
+#define I2C_ARBITER_OWNER_MASK 0x7FFFFFFFu
+// Session ids run from 1 to this value, then wrap
+#define I2C_ARBITER_SESSION_MAX 0x3FFFFFFFu
+// File offset of the liveness byte of session 0
+#define I2C_ARBITER_ALIVE_BASE 4096
+
+/**
+ * Layout of the shared segment.
+ *
+ * A process joins by incrementing next_session, which gives it a session id
+ * (next_session % I2C_ARBITER_SESSION_MAX + 1). It then holds an F_OFD_SETLK
+ * write lock on the byte at I2C_ARBITER_ALIVE_BASE + session of the file for
+ * as long as it has the segment mapped; the kernel drops that lock when the
+ * process dies.
+ *
+ * lock: 0 when free, otherwise the owner's session id, plus
+ * I2C_ARBITER_WAITERS when someone is waiting. Acquire with a compare-and-swap
+ * 0 -> session. If that fails, set the waiters bit and FUTEX_WAIT (not
+ * private) on the word. Release by exchanging the word with 0, and FUTEX_WAKE
+ * one waiter if the waiters bit was set. A waiter that finds the owner's
+ * liveness byte unlocked (F_OFD_GETLK) takes the lock over. Unlike a pid, a
+ * session id is not handed to another process when the owner dies.
+ *
+ * The statistics are updated by the owner while it holds the lock.
+ * Times use CLOCK_MONOTONIC.
+ */
+struct i2c_arbiter_segment {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t lock;
+    uint32_t last_owner;     // session of the most recent holder
+    uint64_t acquired_ns;    // when the current holder took the lock
+    uint64_t acquisitions;
+    uint64_t contended;      // acquisitions that had to wait
+    uint64_t steals;         // lock taken over from a dead owner
+    uint64_t total_wait_ns;
+    uint64_t total_hold_ns;
+    uint64_t max_hold_ns;
+    uint32_t next_session;
+    uint32_t reserved;
+};
+
+#define I2C_ARBITER_STATS_COUNT 6
+
+/**
+ * Sets the directory holding the lock files; there is no default, and
+ * i2c_arbiter_open fails until it is set. Returns 0, or -1 if the path is too
+ * long.
+ */
+int i2c_arbiter_set_dir(const char *dir);
+
+/**
+ * Opens the arbiter for a bus path such as "/dev/i2c-1". Returns a handle, or
+ * -1 with errno set if the shared segment cannot be opened, mapped or joined.
+ */
+int i2c_arbiter_open(const char *bus_path);
+
+/**
+ * Acquires the bus for this process.
+ * timeout_ns: 0 waits indefinitely.
+ * Returns 0 if acquired, 1 if acquired and the previous holder was another
+ * process (bus state such as mux channel masks may have changed), or -1 on
+ * timeout or error.
+ */
+int i2c_arbiter_acquire(int handle, int64_t timeout_ns);
+
+/** Releases the bus. Returns 0, or -1 if this process does not hold it. */
+int i2c_arbiter_release(int handle);
+
+/**
+ * Closes the arbiter, releasing the bus if still held. Calls in progress on
+ * other threads keep the handle until they return.
+ */
+int i2c_arbiter_close(int handle);
+
+/**
+ * Copies acquisitions, contended, steals, total_wait_ns, total_hold_ns and
+ * max_hold_ns into stats.
+ */
+int i2c_arbiter_stats(int handle, int64_t stats[I2C_ARBITER_STATS_COUNT]);
+
+#endif //I2C_ARBITER_H
@@ -0,0 +1,441 @@
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <syslog.h>
+
+#include "I2cClient.h"
+
+#define I2C_CLIENT_MAX_LOCKS 16
+
+static int client_socket = -1;
+static int client_id = 0;
+static char socket_path_used[108];
+static pthread_mutex_t client_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// LOCK_BUS waits in the daemon, so every lock has its own connection, attached to
+// the main one; a waiting lock then holds up neither other buses nor transfers.
+static char lock_paths[I2C_CLIENT_MAX_LOCKS][I2CD_PATH_LEN];
+static int lock_sockets[I2C_CLIENT_MAX_LOCKS] = {[0 ... I2C_CLIENT_MAX_LOCKS - 1] = -1};
+static pthread_mutex_t lock_mutexes[I2C_CLIENT_MAX_LOCKS] = {
+        [0 ... I2C_CLIENT_MAX_LOCKS - 1] = PTHREAD_MUTEX_INITIALIZER};
+
+static __thread int64_t thread_last_transfer_ns = 0;
+
+static const struct i2cd_ring_header *ring = NULL;
+static size_t ring_size = 0;
+static uint64_t ring_cursor = 0;
+static uint64_t ring_lost = 0;
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void copy_path(char *dst, const char *src)
+{
+    strncpy(dst, src, I2CD_PATH_LEN - 1);
+    dst[I2CD_PATH_LEN - 1] = '\0';
+}
+
+static int connect_socket(const char *path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    if (connect(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        int err = errno;
+        openlog("I2cClient", LOG_PID | LOG_CONS, LOG_USER);
+        syslog(LOG_WARNING, "Cannot connect to i2cd at %s: %s", addr.sun_path, strerror(err));
+        closelog();
+        close(sock);
+        errno = err;
+        return -1;
+    }
+    return sock;
+}
+
+static void close_lock_sockets(void)
+{
+    for (int i = 0; i < I2C_CLIENT_MAX_LOCKS; i++) {
+        pthread_mutex_lock(&lock_mutexes[i]);
+        if (lock_sockets[i] >= 0) {
+            close(lock_sockets[i]);
+            lock_sockets[i] = -1;
+        }
+        pthread_mutex_unlock(&lock_mutexes[i]);
+    }
+}
+
+int i2c_client_connect(const char *socket_path)
+{
+    const char *path = socket_path != NULL ? socket_path : I2CD_DEFAULT_SOCKET;
+    int sock = connect_socket(path);
+    if (sock < 0) {
+        return -1;
+    }
+
+    close_lock_sockets();
+    pthread_mutex_lock(&client_lock);
+    if (client_socket >= 0) {
+        close(client_socket);
+    }
+    client_socket = sock;
+    strncpy(socket_path_used, path, sizeof(socket_path_used) - 1);
+    memset(lock_paths, 0, sizeof(lock_paths));
+    pthread_mutex_unlock(&client_lock);
+
+    int version = i2c_client_op(I2CD_OP_HELLO, -1, 0, 0, I2CD_PROTOCOL_VERSION);
+    if (version != I2CD_PROTOCOL_VERSION) {
+        openlog("I2cClient", LOG_PID | LOG_CONS, LOG_USER);
+        syslog(LOG_ERR, "i2cd protocol version %d, expected %d", version, I2CD_PROTOCOL_VERSION);
+        closelog();
+        i2c_client_disconnect();
+        errno = EPROTO;
+        return -1;
+    }
+    client_id = i2c_client_op(I2CD_OP_CLIENT_ID, -1, 0, 0, 0);
+    if (client_id <= 0) {
+        i2c_client_disconnect();
+        return -1;
+    }
+    return 0;
+}
+
+void i2c_client_disconnect(void)
+{
+    pthread_mutex_lock(&client_lock);
+    if (client_socket >= 0) {
+        close(client_socket);
+        client_socket = -1;
+    }
+    memset(lock_paths, 0, sizeof(lock_paths));
+    pthread_mutex_unlock(&client_lock);
+    close_lock_sockets();
+
+    pthread_mutex_lock(&ring_lock);
+    if (ring != NULL) {
+        munmap((void *) ring, ring_size);
+        ring = NULL;
+    }
+    pthread_mutex_unlock(&ring_lock);
+}
+
+int i2c_client_connected(void)
+{
+    return __atomic_load_n(&client_socket, __ATOMIC_RELAXED) >= 0;
+}
+
+// One request and its response on sock; the caller serialises use of the socket
+static ssize_t exchange(int sock, const struct i2cd_request *request, struct i2cd_response *response,
+                        struct msghdr *msg)
+{
+    ssize_t received = -1;
+    if (send(sock, request, sizeof(*request), MSG_NOSIGNAL) == (ssize_t) sizeof(*request)) {
+        do {
+            received = recvmsg(sock, msg, MSG_CMSG_CLOEXEC);
+        } while (received < 0 && errno == EINTR);
+    }
+    if (received >= 0 && received < (ssize_t) I2CD_RESPONSE_HEADER_SIZE) {
+        errno = received == 0 ? ECONNRESET : EPROTO;
+        return -1;
+    }
+    if (received >= 0 && response->result < 0) {
+        errno = response->error;
+    }
+    return received;
+}
+
+int i2c_client_call(const struct i2cd_request *request, struct i2cd_response *response, int *fd_out)
+{
+    char control[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = {response, sizeof(*response)};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (fd_out != NULL) {
+        *fd_out = -1;
+    }
+
+    pthread_mutex_lock(&client_lock);
+    if (client_socket < 0) {
+        pthread_mutex_unlock(&client_lock);
+        errno = ENOTCONN;
+        return -1;
+    }
+    ssize_t received = exchange(client_socket, request, response, &msg);
+    int err = errno;
+    pthread_mutex_unlock(&client_lock);
+
+    if (received < 0) {
+        errno = err;
+        return -1;
+    }
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            int fd;
+            memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+            if (fd_out != NULL) {
+                *fd_out = fd;
+            } else {
+                close(fd);
+            }
+        }
+    }
+    if (response->timestamp_ns != 0) {
+        thread_last_transfer_ns = response->timestamp_ns;
+    }
+    errno = err;
+    return response->result;
+}
+
+int64_t i2c_client_last_transfer_ns(void)
+{
+    return thread_last_transfer_ns;
+}
+
+int i2c_client_op(uint32_t op, int handle, int addr, int reg, int value)
+{
+    struct i2cd_request request;
+    struct i2cd_response response;
+    memset(&request, 0, sizeof(request));
+    request.op = op;
+    request.handle = handle;
+    request.addr = addr;
+    request.reg = reg;
+    request.value = value;
+    return i2c_client_call(&request, &response, NULL);
+}
+
+int i2c_client_read(uint32_t op, int handle, int reg, uint8_t *values, int length)
+{
+    struct i2cd_request request;
+    struct i2cd_response response;
+    memset(&request, 0, sizeof(request));
+    request.op = op;
+    request.handle = handle;
+    request.reg = reg;
+    request.length = length;
+    if (i2c_client_call(&request, &response, NULL) < 0) {
+        return -1;
+    }
+    int count = response.length < length ? response.length : length;
+    memcpy(values, response.data, count);
+    return count;
+}
+
+int i2c_client_open(const char *path, int deviceAddress)
+{
+    struct i2cd_request request;
+    struct i2cd_response response;
+    memset(&request, 0, sizeof(request));
+    request.op = I2CD_OP_OPEN_BUS;
+    request.addr = deviceAddress;
+    copy_path(request.path, path);
+    return i2c_client_call(&request, &response, NULL);
+}
+
+int i2c_client_lock_open(const char *path)
+{
+    pthread_mutex_lock(&client_lock);
+    int lock = -1;
+    for (int i = 0; i < I2C_CLIENT_MAX_LOCKS; i++) {
+        if (strncmp(lock_paths[i], path, I2CD_PATH_LEN - 1) == 0) {
+            lock = i;
+            break;
+        }
+        if (lock < 0 && lock_paths[i][0] == '\0') {
+            lock = i;
+        }
+    }
+    if (lock >= 0) {
+        copy_path(lock_paths[lock], path);
+    }
+    char socket_path[sizeof(socket_path_used)];
+    memcpy(socket_path, socket_path_used, sizeof(socket_path));
+    int owner = client_id;
+    pthread_mutex_unlock(&client_lock);
+    if (lock < 0) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&lock_mutexes[lock]);
+    if (lock_sockets[lock] < 0) {
+        int sock = connect_socket(socket_path);
+        struct i2cd_request request;
+        struct i2cd_response response;
+        struct msghdr msg;
+        struct iovec iov = {&response, sizeof(response)};
+        memset(&request, 0, sizeof(request));
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        request.op = I2CD_OP_ATTACH;
+        request.value = owner;
+        if (sock >= 0 && (exchange(sock, &request, &response, &msg) < 0 || response.result < 0)) {
+            close(sock);
+            sock = -1;
+        }
+        lock_sockets[lock] = sock;
+    }
+    int opened = lock_sockets[lock] >= 0;
+    pthread_mutex_unlock(&lock_mutexes[lock]);
+    if (!opened) {
+        i2c_client_lock_close(lock);
+        return -1;
+    }
+    return lock;
+}
+
+static int lock_request(int lock, uint32_t op, int32_t value)
+{
+    if (lock < 0 || lock >= I2C_CLIENT_MAX_LOCKS || lock_paths[lock][0] == '\0') {
+        errno = EBADF;
+        return -1;
+    }
+    struct i2cd_request request;
+    struct i2cd_response response;
+    struct msghdr msg;
+    struct iovec iov = {&response, sizeof(response)};
+    memset(&request, 0, sizeof(request));
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    request.op = op;
+    request.value = value;
+    copy_path(request.path, lock_paths[lock]);
+
+    pthread_mutex_lock(&lock_mutexes[lock]);
+    ssize_t received = -1;
+    if (lock_sockets[lock] < 0) {
+        errno = ENOTCONN;
+    } else {
+        received = exchange(lock_sockets[lock], &request, &response, &msg);
+    }
+    int err = errno;
+    pthread_mutex_unlock(&lock_mutexes[lock]);
+    errno = err;
+    return received < 0 ? -1 : response.result;
+}
+
+int i2c_client_lock(int lock, long timeout_ns)
+{
+    // The daemon queues the request and answers when the lock is granted, or
+    // with ETIMEDOUT; round the limit up so that a short wait still waits
+    long timeout_ms = timeout_ns > 0 ? (timeout_ns + 999999L) / 1000000L : 0;
+    return lock_request(lock, I2CD_OP_LOCK_BUS, (int32_t) (timeout_ms > INT32_MAX ? INT32_MAX : timeout_ms));
+}
+
+int i2c_client_unlock(int lock)
+{
+    return lock_request(lock, I2CD_OP_UNLOCK_BUS, 0);
+}
+
+int i2c_client_lock_close(int lock)
+{
+    if (lock < 0 || lock >= I2C_CLIENT_MAX_LOCKS) {
+        return -1;
+    }
+    pthread_mutex_lock(&client_lock);
+    lock_paths[lock][0] = '\0';
+    pthread_mutex_unlock(&client_lock);
+    pthread_mutex_lock(&lock_mutexes[lock]);
+    if (lock_sockets[lock] >= 0) {
+        // The daemon releases a lock held through the connection when it closes
+        close(lock_sockets[lock]);
+        lock_sockets[lock] = -1;
+    }
+    pthread_mutex_unlock(&lock_mutexes[lock]);
+    return 0;
+}
+
+int i2c_client_subscribe(uint32_t capacity)
+{
+    struct i2cd_request request;
+    struct i2cd_response response;
+    memset(&request, 0, sizeof(request));
+    request.op = I2CD_OP_SUBSCRIBE;
+    request.value = (int32_t) capacity;
+    int fd;
+    if (i2c_client_call(&request, &response, &fd) < 0 || fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t) sizeof(struct i2cd_ring_header)) {
+        map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    const struct i2cd_ring_header *header = map;
+    if (header->magic != I2CD_RING_MAGIC || header->version != I2CD_RING_VERSION ||
+        header->sample_size != sizeof(struct i2cd_sample) ||
+        i2cd_ring_size(header->capacity) > (uint64_t) st.st_size) {
+        munmap(map, (size_t) st.st_size);
+        errno = EPROTO;
+        return -1;
+    }
+
+    pthread_mutex_lock(&ring_lock);
+    if (ring != NULL) {
+        munmap((void *) ring, ring_size);
+    }
+    ring = header;
+    ring_size = (size_t) st.st_size;
+    ring_cursor = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+    ring_lost = 0;
+    pthread_mutex_unlock(&ring_lock);
+    return 0;
+}
+
+int i2c_client_add_poll(int handle, int addr, int reg, int length, uint32_t period_ms,
+                        int mux_addr, int mux_channel)
+{
+    struct i2cd_request request;
+    struct i2cd_response response;
+    memset(&request, 0, sizeof(request));
+    request.op = I2CD_OP_ADD_POLL;
+    request.handle = handle;
+    request.addr = addr;
+    request.reg = reg;
+    request.length = length;
+    request.period_ms = period_ms;
+    request.mux_addr = mux_addr;
+    request.mux_channel = mux_channel;
+    return i2c_client_call(&request, &response, NULL);
+}
+
+int i2c_client_remove_poll(int poll_id)
+{
+    return i2c_client_op(I2CD_OP_REMOVE_POLL, -1, 0, 0, poll_id);
+}
+
+int i2c_client_next_sample(struct i2cd_sample *out)
+{
+    pthread_mutex_lock(&ring_lock);
+    int result = ring != NULL ? i2cd_ring_read(ring, &ring_cursor, out, &ring_lost) : -1;
+    pthread_mutex_unlock(&ring_lock);
+    return result;
+}
+
+uint64_t i2c_client_lost_samples(void)
+{
+    pthread_mutex_lock(&ring_lock);
+    uint64_t lost = ring_lost;
+    pthread_mutex_unlock(&ring_lock);
+    return lost;
+}
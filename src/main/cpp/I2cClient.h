@@ -0,0 +1,65 @@
+#ifndef I2C_CLIENT_H
+#define I2C_CLIENT_H
+
+#include <stdint.h>
+
+#include "I2cDaemonProtocol.h"
+
+/*
+ * Client side of the i2cd protocol. One connection per process; calls are
+ * serialised internally and may be made from any thread. Functions return -1
+ * with errno set to the daemon's error on failure.
+ */
+
+/** Connects to the daemon at socket_path (I2CD_DEFAULT_SOCKET when NULL). Returns 0 or -1. */
+int i2c_client_connect(const char *socket_path);
+void i2c_client_disconnect(void);
+/** Returns 1 while connected to a daemon, 0 otherwise. */
+int i2c_client_connected(void);
+
+/** Sends one request and waits for its response. fd_out (may be NULL) receives a passed fd or -1. */
+int i2c_client_call(const struct i2cd_request *request, struct i2cd_response *response, int *fd_out);
+
+/** CLOCK_BOOTTIME at the end of the daemon transfer behind this thread's last call, 0 if none. */
+int64_t i2c_client_last_transfer_ns(void);
+
+/** Simple operation without data; returns the daemon's result. */
+int i2c_client_op(uint32_t op, int handle, int addr, int reg, int value);
+/** Read operation; copies up to length bytes into values and returns the number copied. */
+int i2c_client_read(uint32_t op, int handle, int reg, uint8_t *values, int length);
+/** Opens a bus in the daemon. Returns a handle that stands in for the bus fd. */
+int i2c_client_open(const char *path, int deviceAddress);
+
+/**
+ * Registers a bus path for locking, over a connection of its own so that a wait
+ * for the lock does not hold up this client's other calls. Returns a lock handle,
+ * or -1.
+ */
+int i2c_client_lock_open(const char *path);
+/**
+ * Locks the bus for this client, waiting up to timeout_ns (0 = forever). The
+ * daemon grants the lock in request order, and takes it back from a holder that
+ * leaves the bus idle for longer than its lease.
+ * Returns 0, 1 if another client or a daemon poll used the bus since this client
+ * last held it, or -1 with errno ETIMEDOUT on timeout, or another errno on error.
+ */
+int i2c_client_lock(int lock, long timeout_ns);
+int i2c_client_unlock(int lock);
+int i2c_client_lock_close(int lock);
+
+/** Maps a sample ring of `capacity` slots for this client's polls. Returns 0 or -1. */
+int i2c_client_subscribe(uint32_t capacity);
+/**
+ * Registers a periodic register block read. mux_addr is -1 for a device on the
+ * bare bus, else the 7-bit mux address with mux_channel 0-7. Returns the poll
+ * id, or -1 with errno EINVAL for other mux values.
+ */
+int i2c_client_add_poll(int handle, int addr, int reg, int length, uint32_t period_ms,
+                        int mux_addr, int mux_channel);
+int i2c_client_remove_poll(int poll_id);
+/** Copies the next unread sample. Returns 1, 0 if none is pending, or -1 when not subscribed. */
+int i2c_client_next_sample(struct i2cd_sample *out);
+/** Number of samples overwritten before this client read them. */
+uint64_t i2c_client_lost_samples(void);
+
+#endif //I2C_CLIENT_H
@@ -0,0 +1,1601 @@
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <linux/i2c-dev.h>
+#include <linux/i2c.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <syslog.h>
+
+#include "I2cCore.h"
+#include "I2cTrace.h"
+
+// Minimum interval between I2C operations in nanoseconds (250 microseconds).
+// Prevents interrupt clustering that causes rendering jank.
+#define MIN_I2C_INTERVAL_NS 250000L
+
+#define I2C_MAX_ADAPTERS 16
+
+// Buses /dev/i2c-0 .. /dev/i2c-31 get their own pacing; others share one slot
+#define I2C_MAX_BUSES 32
+
+// Character device major of /dev/i2c-N
+#define I2C_DEV_MAJOR 89
+
+// Transfer duration estimates are kept per transfer kind (enum i2c_trace_op) and
+// per size class: 0, 1, 2, 3-4, 5-8, 9-16, 17-32, 33-64 and more payload bytes
+#define I2C_COST_KINDS (I2C_TRACE_OP_WRITE + 1)
+#define I2C_COST_SIZES 9
+
+// Budget window when none is configured and no frame timing is known (60 Hz)
+#define DEFAULT_BUDGET_WINDOW_NS 16666667L
+
+// Frame timing older than this many periods is ignored: nothing is being rendered
+#define FRAME_TIMING_STALE_PERIODS 4
+
+/**
+ * Block read capabilities of one I2C adapter, identified by its sysfs name.
+ * Filled in by the block read self-test; until then the 31-byte SMBus default applies.
+ */
+struct i2c_adapter_caps {
+    char name[64];
+    int probed;
+    int method;
+    int max_block;
+    int no_combined_writes; // set once I2C_RDWR register writes failed with EOPNOTSUPP/EINVAL
+};
+
+/**
+ * Per file descriptor bookkeeping: the slave address last selected with I2C_SLAVE
+ * (needed to address I2C_RDWR messages), the adapter the fd belongs to
+ * (1-based index into adapter_caps, 0 when unknown) and its pacing slot.
+ */
+struct i2c_fd_state {
+    int addr;
+    int bus;                // bus number + 1, 0 if unknown
+    int adapter;
+    int pacing;
+};
+
+/**
+ * Bus-busy time allowed per window. Transfers that would exceed the budget, going
+ * by what transfers of their kind and size recently took, wait for the next
+ * window, so long sequences (scans, SMUX uploads, back-to-back block reads) are
+ * spread over several windows at transfer granularity. A single
+ * transfer longer than the whole budget still runs and counts as an overrun.
+ * Updated only by the thread holding the bus, counters are read lock-free.
+ */
+struct i2c_bus_budget {
+    long budget_ns;         // 0 when the bus has no budget
+    long window_ns;         // 0 to follow frame timing
+    long window_start_ns;   // CLOCK_MONOTONIC start of the current window
+    long window_busy_ns;
+    int window_overrun;
+    long long windows;      // windows with any bus activity
+    long long deferrals;    // transfers moved to a later window
+    long long overruns;     // windows whose busy time exceeded the budget
+    long long busy_ns;
+    long long worst_ns;     // highest busy time seen in one window
+};
+
+/**
+ * Pacing of one physical bus. Each bus is paced on its own, so that buses polled
+ * in parallel do not hold each other back. Unlike adapter_caps this is keyed by
+ * bus number: identical controllers share capabilities but not bus time.
+ */
+struct i2c_bus_pacing {
+    int has_interval;
+    long interval_ns;
+    long last_ns;       // CLOCK_MONOTONIC at the end of the last transfer, 0 if none
+    // Decaying peak of recent durations per transfer kind and size, 0 if none seen
+    long duration_ns[I2C_COST_KINDS][I2C_COST_SIZES];
+    int burst;          // depth of nested bursts; transfers run back-to-back while > 0
+    long idle_until_ns; // no transfer starts before this, set when a burst ends
+    struct i2c_bus_budget budget;
+    // Usage since the bus was first opened, read by the cost profiler
+    long long busy_ns;
+    long long transfers;
+    long long failures;
+};
+
+/**
+ * Frame timing fed by the renderer (Choreographer vsync, CLOCK_MONOTONIC).
+ * While it is fresh, transfers keep out of the quiet window before each frame
+ * deadline and run burst_interval_ns apart in the rest of the frame instead of
+ * the fixed bus interval. Fields are read without a lock; a transfer placed with
+ * a torn update is off by at most one frame.
+ */
+struct i2c_frame_timing {
+    long vsync_ns;          // latest vsync, 0 if none
+    long period_ns;
+    long quiet_ns;          // 0 disables frame pacing
+    long burst_interval_ns;
+};
+
+static struct i2c_adapter_caps adapter_caps[I2C_MAX_ADAPTERS];
+static int adapter_count = 0;
+static struct i2c_fd_state fd_state[I2C_MAX_FDS];
+static pthread_mutex_t caps_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Slot 0 paces fds of unknown buses, bus n uses slot n + 1
+static struct i2c_bus_pacing bus_pacing[I2C_MAX_BUSES + 1];
+
+static struct i2c_frame_timing frame_timing;
+
+// CLOCK_MONOTONIC when the calling thread's current transfer started
+static __thread long thread_transfer_start_ns = 0;
+// Start and end of the calling thread's last attempt, for the transfer trace
+static __thread long thread_attempt_start_ns = 0;
+static __thread long thread_attempt_end_ns = 0;
+// CLOCK_MONOTONIC when the calling thread's current attempt asked for the bus, 0 if none
+static __thread long thread_request_ns = 0;
+// Duration estimate of the calling thread's current transfer, updated when it ends
+static __thread long *thread_duration_slot = NULL;
+
+static int kernel_open(const char *path, int flags)
+{
+    return open(path, flags);
+}
+
+static int kernel_ioctl(int fd, unsigned long request, void *arg)
+{
+    return ioctl(fd, request, arg);
+}
+
+static const struct i2c_backend kernel_backend = {kernel_open, close, kernel_ioctl, read, write};
+static const struct i2c_backend *backend = &kernel_backend;
+
+// CLOCK_BOOTTIME at the end of the calling thread's last transfer attempt
+static __thread int64_t thread_last_transfer_ns = 0;
+
+/** Per fd retry counters, reported through getRetryStats. */
+struct i2c_retry_stats {
+    long long ops;
+    long long retries;
+    long long exhausted;
+    int last_attempts;      // attempts of the last transfer on the fd
+};
+
+// A single attempt: the historical behaviour, also used for probes and recovery
+// where a NAK is an answer rather than a transient error.
+static const struct i2c_retry_policy no_retry_policy = {1, 0, 0, 0, 0, 0, {0}};
+
+static struct i2c_retry_policy default_retry_policy = {1, 0, 0, 0, 0, 0, {0}};
+static struct i2c_retry_policy fd_retry_policy[I2C_MAX_FDS];
+static unsigned char fd_has_retry_policy[I2C_MAX_FDS];
+static struct i2c_retry_stats fd_retry_stats[I2C_MAX_FDS];
+
+// Thread-level override installed for the duration of a transaction or batch.
+static __thread struct i2c_retry_policy thread_retry_policy;
+static __thread int thread_has_retry_policy = 0;
+static __thread unsigned int thread_jitter_seed = 0;
+
+static inline long monotonic_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+static inline const struct i2c_retry_policy *retry_policy_for(int fd)
+{
+    if (thread_has_retry_policy) {
+        return &thread_retry_policy;
+    }
+    if (fd >= 0 && fd < I2C_MAX_FDS && fd_has_retry_policy[fd]) {
+        return &fd_retry_policy[fd];
+    }
+    return &default_retry_policy;
+}
+
+/** State of one retried transfer. */
+struct i2c_retry_state {
+    const struct i2c_retry_policy *policy;
+    int fd;
+    int attempts;
+    long start_ns;
+};
+
+static inline void retry_begin(struct i2c_retry_state *rs, int fd, const struct i2c_retry_policy *policy)
+{
+    rs->policy = policy;
+    rs->fd = fd;
+    rs->attempts = 1;
+    rs->start_ns = policy->max_attempts > 1 ? monotonic_ns() : 0;
+}
+
+/**
+ * Decides whether a failed attempt should be retried, and if so sleeps for the backoff.
+ * @return 1 to retry, 0 to give up
+ */
+static int retry_after_failure(struct i2c_retry_state *rs, int err)
+{
+    const struct i2c_retry_policy *p = rs->policy;
+    if (rs->attempts >= p->max_attempts) {
+        return 0;
+    }
+    int retryable = 0;
+    for (int i = 0; i < p->retryable_count; i++) {
+        if (p->retryable[i] == err) {
+            retryable = 1;
+            break;
+        }
+    }
+    if (!retryable) {
+        return 0;
+    }
+
+    long backoff = p->base_backoff_ns;
+    for (int i = 1; i < rs->attempts && backoff < p->max_backoff_ns; i++) {
+        backoff *= 2;
+    }
+    if (p->max_backoff_ns > 0 && backoff > p->max_backoff_ns) {
+        backoff = p->max_backoff_ns;
+    }
+    if (p->jitter_percent > 0 && backoff > 0) {
+        if (thread_jitter_seed == 0) {
+            thread_jitter_seed = (unsigned int)monotonic_ns() | 1u;
+        }
+        long span = backoff * p->jitter_percent / 100;
+        long r = (long)(rand_r(&thread_jitter_seed) % (2 * span + 1));
+        backoff += r - span;
+    }
+    if (p->deadline_ns > 0 && monotonic_ns() + backoff - rs->start_ns > p->deadline_ns) {
+        return 0;
+    }
+    if (backoff > 0) {
+        struct timespec sleep_time;
+        sleep_time.tv_sec = backoff / 1000000000L;
+        sleep_time.tv_nsec = backoff % 1000000000L;
+        nanosleep(&sleep_time, NULL);
+    }
+    rs->attempts++;
+    return 1;
+}
+
+static inline void retry_end(struct i2c_retry_state *rs, int failed)
+{
+    if (rs->fd >= 0 && rs->fd < I2C_MAX_FDS) {
+        struct i2c_retry_stats *stats = &fd_retry_stats[rs->fd];
+        __atomic_store_n(&stats->last_attempts, rs->attempts, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&stats->ops, 1, __ATOMIC_RELAXED);
+        if (rs->attempts > 1) {
+            __atomic_fetch_add(&stats->retries, rs->attempts - 1, __ATOMIC_RELAXED);
+        }
+        if (failed && rs->attempts > 1) {
+            __atomic_fetch_add(&stats->exhausted, 1, __ATOMIC_RELAXED);
+        }
+        if (failed) {
+            __atomic_fetch_add(&bus_pacing[fd_state[rs->fd].pacing].failures, 1, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static inline struct i2c_bus_pacing *pacing_for(int fd)
+{
+    if (fd >= 0 && fd < I2C_MAX_FDS) {
+        return &bus_pacing[fd_state[fd].pacing];
+    }
+    return &bus_pacing[0];
+}
+
+/**
+ * Returns the bus number behind an open fd from its device minor, or -1 if
+ * unknown. An fd that is not an I2C device, such as one of the replay
+ * backend, is numbered by the "/dev/i2c-N" path it was opened with.
+ */
+static int bus_number_for_fd(int fd, const char *path)
+{
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISCHR(st.st_mode) && major(st.st_rdev) == I2C_DEV_MAJOR) {
+        return (int)minor(st.st_rdev);
+    }
+    static const char prefix[] = "/dev/i2c-";
+    if (strncmp(path, prefix, sizeof(prefix) - 1) != 0) {
+        return -1;
+    }
+    char *end;
+    long bus = strtol(path + sizeof(prefix) - 1, &end, 10);
+    return end != path + sizeof(prefix) - 1 && *end == '\0' && bus >= 0 && bus <= 0xFFFFF ? (int)bus : -1;
+}
+
+/**
+ * Returns the pacing slot for a bus number from bus_number_for_fd.
+ */
+static int pacing_slot_for_bus(int bus)
+{
+    return bus >= 0 && bus < I2C_MAX_BUSES ? bus + 1 : 0;
+}
+
+static inline void sleep_ns(long ns)
+{
+    struct timespec sleep_time;
+    sleep_time.tv_sec = ns / 1000000000L;
+    sleep_time.tv_nsec = ns % 1000000000L;
+    nanosleep(&sleep_time, NULL);
+}
+
+static inline int frame_timing_fresh(long now, long vsync, long period)
+{
+    return period > 0 && vsync != 0 && now - vsync <= FRAME_TIMING_STALE_PERIODS * period;
+}
+
+/**
+ * Returns the earliest time from start at which a transfer of duration_ns fits
+ * the bus budget, and makes the window holding it current. Windows follow the
+ * frames while frame timing is fresh.
+ */
+static long budget_start(struct i2c_bus_budget *budget, long start, long duration_ns)
+{
+    long window = budget->window_ns;
+    long origin = 0;
+    if (window <= 0) {
+        long period = __atomic_load_n(&frame_timing.period_ns, __ATOMIC_RELAXED);
+        long vsync = __atomic_load_n(&frame_timing.vsync_ns, __ATOMIC_RELAXED);
+        if (frame_timing_fresh(start, vsync, period)) {
+            window = period;
+            origin = vsync;
+        } else {
+            window = DEFAULT_BUDGET_WINDOW_NS;
+        }
+    }
+    long offset = (start - origin) % window;
+    if (offset < 0) {
+        offset += window;
+    }
+    long window_start = start - offset;
+    if (window_start != budget->window_start_ns) {
+        budget->window_start_ns = window_start;
+        budget->window_busy_ns = 0;
+        budget->window_overrun = 0;
+    }
+    if (budget->window_busy_ns > 0 && budget->window_busy_ns + duration_ns > budget->budget_ns) {
+        __atomic_add_fetch(&budget->deferrals, 1, __ATOMIC_RELAXED);
+        budget->window_start_ns = window_start + window;
+        budget->window_busy_ns = 0;
+        budget->window_overrun = 0;
+        return window_start + window;
+    }
+    return start;
+}
+
+static void budget_charge(struct i2c_bus_budget *budget, long took)
+{
+    if (budget->window_busy_ns == 0) {
+        __atomic_add_fetch(&budget->windows, 1, __ATOMIC_RELAXED);
+    }
+    budget->window_busy_ns += took;
+    __atomic_add_fetch(&budget->busy_ns, took, __ATOMIC_RELAXED);
+    if (budget->window_busy_ns > __atomic_load_n(&budget->worst_ns, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&budget->worst_ns, budget->window_busy_ns, __ATOMIC_RELAXED);
+    }
+    if (budget->window_busy_ns > budget->budget_ns && !budget->window_overrun) {
+        budget->window_overrun = 1;
+        __atomic_add_fetch(&budget->overruns, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * Returns how long a transfer expected to take duration_ns must wait past start
+ * to stay out of the quiet window, or -1 if frame pacing is not in effect.
+ */
+static long frame_delay(long start, long duration_ns)
+{
+    long quiet = __atomic_load_n(&frame_timing.quiet_ns, __ATOMIC_RELAXED);
+    long period = __atomic_load_n(&frame_timing.period_ns, __ATOMIC_RELAXED);
+    long vsync = __atomic_load_n(&frame_timing.vsync_ns, __ATOMIC_RELAXED);
+    if (quiet <= 0 || quiet >= period || !frame_timing_fresh(start, vsync, period)) {
+        return -1;
+    }
+    long phase = (start - vsync) % period;
+    if (phase < 0) {
+        phase += period;
+    }
+    long safe = period - quiet - phase;
+    if (safe >= duration_ns) {
+        return 0;
+    }
+    // Too close to the deadline: start with the next frame. A transfer longer
+    // than the whole safe part cannot avoid the window and only waits once.
+    return period - phase;
+}
+
+static inline int cost_size_class(int bytes)
+{
+    if (bytes <= 0) {
+        return 0;
+    }
+    int size = 1;
+    while (size < I2C_COST_SIZES - 1 && (1 << (size - 1)) < bytes) {
+        size++;
+    }
+    return size;
+}
+
+/**
+ * Waits until a transfer of the given kind (enum i2c_trace_op) moving `bytes`
+ * payload bytes may start on the bus of fd. The frame and budget checks use what
+ * transfers of that kind and size recently took on this bus.
+ */
+static inline void i2c_rate_limit(int fd, int kind, int bytes)
+{
+    struct i2c_bus_pacing *pacing = pacing_for(fd);
+    long last = __atomic_load_n(&pacing->last_ns, __ATOMIC_RELAXED);
+    long now = monotonic_ns();
+    thread_request_ns = now;
+    thread_duration_slot = &pacing->duration_ns[kind][cost_size_class(bytes)];
+    long duration = __atomic_load_n(thread_duration_slot, __ATOMIC_RELAXED);
+    long start = now;
+    long delay = frame_delay(now, 0);
+    long interval = delay < 0
+            ? (pacing->has_interval ? pacing->interval_ns : MIN_I2C_INTERVAL_NS)
+            : __atomic_load_n(&frame_timing.burst_interval_ns, __ATOMIC_RELAXED);
+    if (__atomic_load_n(&pacing->burst, __ATOMIC_RELAXED)) {
+        interval = 0;
+    }
+    if (last != 0 && now - last < interval) {
+        start = last + interval;
+    }
+    long idle_until = __atomic_load_n(&pacing->idle_until_ns, __ATOMIC_RELAXED);
+    if (idle_until > start) {
+        start = idle_until;
+    }
+    if (delay >= 0) {
+        delay = frame_delay(start, duration);
+        if (delay > 0) {
+            start += delay;
+        }
+    }
+    if (pacing->budget.budget_ns > 0) {
+        long allowed = budget_start(&pacing->budget, start, duration);
+        if (allowed != start) {
+            // The next window may open inside the quiet window when windows are not frames
+            delay = frame_delay(allowed, duration);
+            start = delay > 0 ? budget_start(&pacing->budget, allowed + delay, duration) : allowed;
+        }
+    }
+    if (start > now) {
+        sleep_ns(start - now);
+        now = monotonic_ns();
+    }
+    thread_transfer_start_ns = now;
+}
+
+static inline void i2c_post_operation(int fd)
+{
+    // Timestamp before yielding so that scheduling noise stays out of it
+    struct timespec done;
+    clock_gettime(CLOCK_BOOTTIME, &done);
+    thread_last_transfer_ns = done.tv_sec * 1000000000LL + done.tv_nsec;
+    struct i2c_bus_pacing *pacing = pacing_for(fd);
+    long end = monotonic_ns();
+    if (thread_transfer_start_ns != 0) {
+        long took = end - thread_transfer_start_ns;
+        long estimate = __atomic_load_n(thread_duration_slot, __ATOMIC_RELAXED);
+        estimate -= estimate / 8;
+        __atomic_store_n(thread_duration_slot, took > estimate ? took : estimate, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&pacing->busy_ns, took, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&pacing->transfers, 1, __ATOMIC_RELAXED);
+        if (pacing->budget.budget_ns > 0) {
+            budget_charge(&pacing->budget, took);
+        }
+        thread_attempt_start_ns = thread_transfer_start_ns;
+        thread_transfer_start_ns = 0;
+    }
+    __atomic_store_n(&pacing->last_ns, end, __ATOMIC_RELAXED);
+    thread_attempt_end_ns = end;
+    thread_request_ns = 0;
+    sched_yield();
+}
+
+/**
+ * Adds the attempt i2c_post_operation just finished to the transfer trace.
+ * Payloads of reads are only recorded when the attempt succeeded.
+ */
+static void trace_attempt(int fd, int addr, const struct i2c_retry_state *rs, uint8_t op, uint8_t flags,
+                          uint8_t reg, uint8_t smbus_size, const void *payload, int length,
+                          int result, int err)
+{
+    struct i2c_trace_record record;
+    memset(&record, 0, sizeof(record));
+    long latency = thread_attempt_end_ns - thread_attempt_start_ns;
+    record.timestamp_ns = thread_attempt_start_ns;
+    record.latency_ns = latency < 0 ? 0 : (latency > (long) UINT32_MAX ? UINT32_MAX : (uint32_t) latency);
+    record.result = result < 0 ? -err : result;
+    record.fd = (int16_t) fd;
+    record.addr = (uint16_t) addr;
+    record.op = op;
+    record.flags = flags | (rs != NULL && rs->attempts > 1 ? I2C_TRACE_FLAG_RETRY : 0);
+    record.reg = reg;
+    record.smbus_size = smbus_size;
+    if (payload == NULL || length < 0 || (result < 0 && (flags & I2C_TRACE_FLAG_READ))) {
+        length = 0;
+    }
+    record.orig_length = (uint16_t) length;
+    record.length = (uint8_t) (length > I2C_TRACE_MAX_PAYLOAD ? I2C_TRACE_MAX_PAYLOAD : length);
+    i2c_trace_write(&record, (const uint8_t *) payload);
+}
+
+static inline int fd_addr(int fd)
+{
+    return fd >= 0 && fd < I2C_MAX_FDS ? fd_state[fd].addr : 0;
+}
+
+/**
+ * Bytes an SMBus transaction carries in data, as (offset, length) into data->block.
+ */
+static void smbus_payload(int size, const union i2c_smbus_data *data, int *offset, int *length)
+{
+    *offset = 0;
+    switch (size) {
+        case I2C_SMBUS_BYTE:
+        case I2C_SMBUS_BYTE_DATA:
+            *length = 1;
+            break;
+        case I2C_SMBUS_WORD_DATA:
+        case I2C_SMBUS_PROC_CALL:
+            *length = 2;
+            break;
+        case I2C_SMBUS_BLOCK_DATA:
+        case I2C_SMBUS_I2C_BLOCK_BROKEN:
+        case I2C_SMBUS_I2C_BLOCK_DATA:
+            *offset = 1;
+            *length = data->block[0];
+            break;
+        default:
+            *length = 0;
+            break;
+    }
+}
+
+static inline __s32 i2c_smbus_access_with_policy(int file, char read_write, __u8 command
+        , int size, union i2c_smbus_data *data, const struct i2c_retry_policy *policy)
+{
+    struct i2c_smbus_ioctl_data args;
+    struct i2c_retry_state rs;
+    __s32 result;
+    int err;
+
+    args.read_write = read_write;
+    args.command = command;
+    args.size = size;
+    args.data = data;
+
+    int data_offset = 0;
+    int bytes = 0;
+    if (data != NULL) {
+        smbus_payload(size, data, &data_offset, &bytes);
+    }
+    retry_begin(&rs, file, policy);
+    do {
+        i2c_rate_limit(file, I2C_TRACE_OP_SMBUS, bytes);
+        result = backend->ioctl(file, I2C_SMBUS, &args);
+        err = errno;
+        i2c_post_operation(file);
+        if (i2c_trace_active()) {
+            int offset = 0;
+            int length = 0;
+            // A byte write carries its byte in command; it has no data
+            if (data != NULL && !(size == I2C_SMBUS_BYTE && read_write == I2C_SMBUS_WRITE)) {
+                smbus_payload(size, data, &offset, &length);
+            }
+            trace_attempt(file, fd_addr(file), &rs, I2C_TRACE_OP_SMBUS,
+                          read_write == I2C_SMBUS_READ ? I2C_TRACE_FLAG_READ : 0, command, (uint8_t) size,
+                          data != NULL ? data->block + offset : NULL, length, result, err);
+        }
+    } while (result < 0 && retry_after_failure(&rs, err));
+    retry_end(&rs, result < 0);
+
+    return result;
+}
+
+static inline __s32 i2c_smbus_access(int file, char read_write, __u8 command
+        , int size, union i2c_smbus_data *data)
+{
+    return i2c_smbus_access_with_policy(file, read_write, command, size, data, retry_policy_for(file));
+}
+
+/**
+ * Single-attempt SMBus access for probing and recovery, where a NAK is an answer.
+ */
+static inline __s32 i2c_smbus_access_once(int file, char read_write, __u8 command
+        , int size, union i2c_smbus_data *data)
+{
+    return i2c_smbus_access_with_policy(file, read_write, command, size, data, &no_retry_policy);
+}
+
+/**
+ * Switches the I2C device on an already open file descriptor
+ * This allows multiple devices to share the same I2C bus
+ */
+static inline int switch_i2c_device(int fd, __u8 deviceAddress)
+{
+    if (fd < 0) {
+        return -1;
+    }
+    i2c_rate_limit(fd, I2C_TRACE_OP_SELECT, 0);
+    int result = backend->ioctl(fd, I2C_SLAVE, (void *) (long) deviceAddress);
+    int err = errno;
+    i2c_post_operation(fd);
+    if (i2c_trace_active()) {
+        trace_attempt(fd, deviceAddress, NULL, I2C_TRACE_OP_SELECT, 0, 0, 0, NULL, 0, result, err);
+    }
+    if (result >= 0 && fd < I2C_MAX_FDS) {
+        fd_state[fd].addr = deviceAddress;
+    }
+    return result;
+}
+
+static inline __s32 i2c_smbus_read_i2c_block_data(int file, __u8 command,
+                                                  __u8 length, __u8 *values)
+{
+    union i2c_smbus_data data;
+
+    // Cap at 31 bytes to always use I2C_SMBUS_I2C_BLOCK_DATA.
+    // I2C_SMBUS_I2C_BLOCK_BROKEN (used for length==32) is unreliable
+    // on some Qualcomm I2C controllers and can corrupt sensor state.
+    if (length > 31) {
+        length = 31;
+    }
+
+    data.block[0] = length;
+    if (i2c_smbus_access(file, I2C_SMBUS_READ, command
+            , I2C_SMBUS_I2C_BLOCK_DATA
+            , &data))
+    {
+        return -1;
+    } else {
+        for (int i = 1; i <= data.block[0]; i++) {
+            values[i - 1] = data.block[i];
+        }
+
+        return data.block[0];
+    }
+}
+
+/**
+ * Reads exactly 32 bytes with I2C_SMBUS_I2C_BLOCK_BROKEN.
+ * Only used on adapters where the block read self-test proved it safe.
+ */
+static inline __s32 i2c_smbus_read_i2c_block_data32(int file, __u8 command, __u8 *values)
+{
+    union i2c_smbus_data data;
+
+    data.block[0] = 32;
+    if (i2c_smbus_access(file, I2C_SMBUS_READ, command
+            , I2C_SMBUS_I2C_BLOCK_BROKEN
+            , &data))
+    {
+        return -1;
+    }
+    for (int i = 1; i <= data.block[0]; i++) {
+        values[i - 1] = data.block[i];
+    }
+    return data.block[0];
+}
+
+/**
+ * Reads `length` bytes starting at `command` as one combined I2C transfer
+ * (register write, repeated start, read) using I2C_RDWR.
+ */
+static inline __s32 i2c_rdwr_read_block(int file, __u8 command, int length, __u8 *values)
+{
+    if (file < 0 || file >= I2C_MAX_FDS || length <= 0 || length > I2C_MAX_BLOCK) {
+        return -1;
+    }
+
+    struct i2c_msg msgs[2];
+    struct i2c_rdwr_ioctl_data rdwr;
+    __u16 addr = (__u16)fd_state[file].addr;
+
+    msgs[0].addr = addr;
+    msgs[0].flags = 0;
+    msgs[0].len = 1;
+    msgs[0].buf = &command;
+    msgs[1].addr = addr;
+    msgs[1].flags = I2C_M_RD;
+    msgs[1].len = (__u16)length;
+    msgs[1].buf = values;
+    rdwr.msgs = msgs;
+    rdwr.nmsgs = 2;
+
+    struct i2c_retry_state rs;
+    int result;
+    int err;
+    retry_begin(&rs, file, retry_policy_for(file));
+    do {
+        i2c_rate_limit(file, I2C_TRACE_OP_RDWR_READ, length);
+        result = backend->ioctl(file, I2C_RDWR, &rdwr);
+        err = errno;
+        i2c_post_operation(file);
+        if (i2c_trace_active()) {
+            trace_attempt(file, addr, &rs, I2C_TRACE_OP_RDWR_READ, I2C_TRACE_FLAG_READ, command, 0,
+                          values, length, result, err);
+        }
+    } while (result < 0 && retry_after_failure(&rs, err));
+    retry_end(&rs, result != 2);
+
+    return result == 2 ? length : -1;
+}
+
+static inline __s32 i2c_smbus_read_byte_data(int file, __u8 command)
+{
+    union i2c_smbus_data data;
+    if (i2c_smbus_access(file, I2C_SMBUS_READ, command, I2C_SMBUS_BYTE_DATA, &data)) {
+        return -1;
+    }
+    return 0xFF & data.byte;
+}
+
+/**
+ * Looks up (or creates) the capability entry for the adapter behind an open fd.
+ * The adapter is identified by its sysfs name so that the self-test result survives
+ * reopening the bus, and buses on identical controllers share what was learned.
+ * Must be called with caps_lock held.
+ */
+static int adapter_for_fd_locked(int fd)
+{
+    if (fd < 0 || fd >= I2C_MAX_FDS) {
+        return -1;
+    }
+    if (fd_state[fd].adapter > 0) {
+        return fd_state[fd].adapter - 1;
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "unknown");
+    if (fd_state[fd].bus > 0) {
+        char path[96];
+        int bus = fd_state[fd].bus - 1;
+        snprintf(name, sizeof(name), "i2c-%d", bus);
+        snprintf(path, sizeof(path), "/sys/class/i2c-dev/i2c-%d/name", bus);
+        FILE *f = fopen(path, "r");
+        if (f != NULL) {
+            if (fgets(name, sizeof(name), f) != NULL) {
+                name[strcspn(name, "\r\n")] = '\0';
+            }
+            fclose(f);
+        }
+    }
+
+    int index = -1;
+    for (int i = 0; i < adapter_count; i++) {
+        if (strcmp(adapter_caps[i].name, name) == 0) {
+            index = i;
+            break;
+        }
+    }
+    if (index < 0) {
+        if (adapter_count >= I2C_MAX_ADAPTERS) {
+            return -1;
+        }
+        index = adapter_count++;
+        snprintf(adapter_caps[index].name, sizeof(adapter_caps[index].name), "%s", name);
+        adapter_caps[index].probed = 0;
+        adapter_caps[index].method = I2C_BLOCK_METHOD_SMBUS;
+        adapter_caps[index].max_block = I2C_DEFAULT_BLOCK;
+        adapter_caps[index].no_combined_writes = 0;
+    }
+    fd_state[fd].adapter = index + 1;
+    return index;
+}
+
+/**
+ * Returns the block method and chunk size to use on this fd.
+ */
+static void block_caps_for_fd(int fd, int *method, int *max_block)
+{
+    *method = I2C_BLOCK_METHOD_SMBUS;
+    *max_block = I2C_DEFAULT_BLOCK;
+    pthread_mutex_lock(&caps_lock);
+    int index = adapter_for_fd_locked(fd);
+    if (index >= 0) {
+        *method = adapter_caps[index].method;
+        *max_block = adapter_caps[index].max_block;
+    }
+    pthread_mutex_unlock(&caps_lock);
+}
+
+/**
+ * Reads one chunk of at most `length` bytes using the given block method.
+ * Returns the number of bytes read, or -1 on error.
+ */
+static __s32 i2c_read_block_chunk(int fd, int method, __u8 reg, int length, __u8 *values)
+{
+    switch (method) {
+        case I2C_BLOCK_METHOD_RDWR:
+            return i2c_rdwr_read_block(fd, reg, length, values);
+        case I2C_BLOCK_METHOD_SMBUS32:
+            if (length == 32) {
+                return i2c_smbus_read_i2c_block_data32(fd, reg, values);
+            }
+            return i2c_smbus_read_i2c_block_data(fd, reg, (__u8)length, values);
+        default:
+            return i2c_smbus_read_i2c_block_data(fd, reg, (__u8)length, values);
+    }
+}
+
+/**
+ * Reads `length` bytes with `method` in chunks of `chunk` bytes and compares them
+ * against the reference contents. Returns 1 if every byte matches.
+ */
+static int block_method_matches(int fd, int method, int chunk, __u8 reg, int length,
+                                const __u8 *reference)
+{
+    __u8 buffer[I2C_MAX_BLOCK];
+    int total = 0;
+    while (total < length) {
+        int size = length - total > chunk ? chunk : length - total;
+        __s32 n = i2c_read_block_chunk(fd, method, (__u8)(reg + total), size, buffer + total);
+        if (n != size) {
+            return 0;
+        }
+        total += n;
+    }
+    return memcmp(buffer, reference, length) == 0;
+}
+
+static inline __s32 i2c_smbus_write_byte_data(int file, __u8 command, __u8 value)
+{
+    union i2c_smbus_data data;
+    data.byte = value;
+    return i2c_smbus_access(file, I2C_SMBUS_WRITE, command, I2C_SMBUS_BYTE_DATA, &data);
+}
+
+static inline __s32 i2c_smbus_write_word_data(int file, __u8 command, __u16 value)
+{
+    union i2c_smbus_data data;
+    data.word = value;
+    return i2c_smbus_access(file, I2C_SMBUS_WRITE, command, I2C_SMBUS_WORD_DATA, &data);
+}
+
+int i2c_core_open(const char *path, int deviceAddress)
+{
+    __u8 devAddr = deviceAddress & 0xFF;
+
+    openlog("I2cNative", LOG_PID | LOG_CONS, LOG_USER);
+    syslog(LOG_INFO, "I2C Log: %s", path);
+
+    int fd = backend->open(path, O_RDWR);
+
+    syslog(LOG_INFO, "I2C FD: %d", fd);
+    closelog();
+    if (fd < 0 || backend->ioctl(fd, I2C_SLAVE, (void *) (long) deviceAddress) < 0 ) {
+        return -1;
+    } else {
+        if (fd < I2C_MAX_FDS) {
+            int bus = bus_number_for_fd(fd, path);
+            fd_state[fd].addr = devAddr;
+            fd_state[fd].bus = bus + 1;
+            fd_state[fd].adapter = 0;
+            fd_state[fd].pacing = pacing_slot_for_bus(bus);
+            fd_has_retry_policy[fd] = 0;
+            memset(&fd_retry_stats[fd], 0, sizeof(fd_retry_stats[fd]));
+        }
+        return fd;
+    }
+}
+
+/**
+ * Switches the I2C device address for an already open file descriptor.
+ * This allows multiple devices to share the same I2C bus.
+ */
+int i2c_core_switch_device(int fd, int deviceAddress)
+{
+    __u8 devAddr = deviceAddress & 0xFF;
+    
+    openlog("I2cNative", LOG_PID | LOG_CONS, LOG_USER);
+    syslog(LOG_DEBUG, "Switching I2C device address to 0x%02X on FD: %d", devAddr, fd);
+    closelog();
+    
+    int result = switch_i2c_device(fd, devAddr);
+    if (result < 0) {
+        return -1;
+    } else {
+        return 0;
+    }
+}
+
+int i2c_core_close(int fd)
+{
+    if (fd >= 0 && fd < I2C_MAX_FDS) {
+        fd_state[fd].addr = 0;
+        fd_state[fd].bus = 0;
+        fd_state[fd].adapter = 0;
+        fd_state[fd].pacing = 0;
+        fd_has_retry_policy[fd] = 0;
+    }
+    return backend->close(fd);
+}
+
+int i2c_core_write_byte(int fd, int address, int b)
+{
+    __u8 addr = address & 0xFF;
+    __u8 byte = b       & 0xFF;
+    return i2c_smbus_write_byte_data(fd, addr, byte);
+}
+
+int i2c_core_write_registers(int fd, const uint8_t *registers, const uint8_t *values, int count)
+{
+    if (fd < 0 || fd >= I2C_MAX_FDS || count <= 0 || count > I2C_MAX_REGISTER_WRITES) {
+        return -1;
+    }
+
+    struct i2c_msg msgs[I2C_MAX_REGISTER_WRITES];
+    __u8 bufs[I2C_MAX_REGISTER_WRITES][2];
+    struct i2c_rdwr_ioctl_data rdwr;
+    __u16 addr = (__u16)fd_state[fd].addr;
+    for (int i = 0; i < count; i++) {
+        bufs[i][0] = registers[i];
+        bufs[i][1] = values[i];
+        msgs[i].addr = addr;
+        msgs[i].flags = 0;
+        msgs[i].len = 2;
+        msgs[i].buf = bufs[i];
+    }
+    rdwr.msgs = msgs;
+    rdwr.nmsgs = (__u32)count;
+
+    pthread_mutex_lock(&caps_lock);
+    int index = adapter_for_fd_locked(fd);
+    int combined = index < 0 || !adapter_caps[index].no_combined_writes;
+    pthread_mutex_unlock(&caps_lock);
+
+    if (combined) {
+        struct i2c_retry_state rs;
+        int result;
+        int err;
+        retry_begin(&rs, fd, retry_policy_for(fd));
+        do {
+            i2c_rate_limit(fd, I2C_TRACE_OP_RDWR_WRITE, 2 * count);
+            result = backend->ioctl(fd, I2C_RDWR, &rdwr);
+            err = errno;
+            i2c_post_operation(fd);
+            if (i2c_trace_active()) {
+                trace_attempt(fd, addr, &rs, I2C_TRACE_OP_RDWR_WRITE, 0, registers[0], 0,
+                              bufs, 2 * count, result, err);
+            }
+        } while (result < 0 && err != EOPNOTSUPP && err != EINVAL && retry_after_failure(&rs, err));
+        retry_end(&rs, result != count && err != EOPNOTSUPP && err != EINVAL);
+
+        if (result == count) {
+            return count;
+        }
+        if (result >= 0 || (err != EOPNOTSUPP && err != EINVAL)) {
+            return -1;
+        }
+        // Remembered like the block read size, so later calls skip the failing ioctl
+        pthread_mutex_lock(&caps_lock);
+        if (index >= 0) {
+            adapter_caps[index].no_combined_writes = 1;
+        }
+        pthread_mutex_unlock(&caps_lock);
+    }
+
+    // Adapter without combined writes: one SMBus write per register
+    for (int i = 0; i < count; i++) {
+        if (i2c_smbus_write_byte_data(fd, registers[i], values[i]) < 0) {
+            return -1;
+        }
+    }
+    return count;
+}
+
+int i2c_core_write_word(int fd, int address, int word)
+{
+    __u8  addr = address & 0xFF;
+    __u16 value = word & 0xFFFF;
+    return i2c_smbus_write_word_data(fd, addr, value);
+}
+
+int i2c_core_read_word(int fd, int address)
+{
+    union i2c_smbus_data data;
+    __u8  addr = address & 0xFF;
+    if (i2c_smbus_access(fd, I2C_SMBUS_READ, addr, I2C_SMBUS_WORD_DATA, &data)) {
+        return -1;
+    } else {
+        return (int)(0x0FFFF & data.word);
+    }
+}
+
+/**
+ * Reads up to 31 bytes with a single SMBus I2C block read.
+ * @return number of bytes read, or -1 if error
+ */
+int i2c_core_read_i2c_block(int fd, int reg, int length, uint8_t *values)
+{
+    return i2c_smbus_read_i2c_block_data(fd, reg & 0xFF, (__u8)length, values);
+}
+
+int i2c_core_read_raw(int fd, uint8_t *values, int length)
+{
+    openlog("I2cNative", LOG_PID | LOG_CONS, LOG_USER);
+    syslog(LOG_DEBUG, "I2C readRawBytes");
+    closelog();
+
+    if (length <= 0 || length > 32) {
+        return -1; // Invalid length
+    }
+    
+    // Create a local buffer for reading
+    __u8 buffer[32] = {0};
+    
+    // Read data directly from the I2C device
+    // This is for reading after a command has been sent
+    struct i2c_retry_state rs;
+    int bytesRead;
+    int err;
+    retry_begin(&rs, fd, retry_policy_for(fd));
+    do {
+        i2c_rate_limit(fd, I2C_TRACE_OP_READ, length);
+        bytesRead = backend->read(fd, buffer, length);
+        err = errno;
+        i2c_post_operation(fd);
+        if (i2c_trace_active()) {
+            trace_attempt(fd, fd_addr(fd), &rs, I2C_TRACE_OP_READ, I2C_TRACE_FLAG_READ, 0, 0,
+                          buffer, bytesRead, bytesRead, err);
+        }
+    } while (bytesRead < 0 && retry_after_failure(&rs, err));
+    retry_end(&rs, bytesRead <= 0);
+
+    openlog("I2cNative", LOG_PID | LOG_CONS, LOG_USER);
+    syslog(LOG_DEBUG, "I2C %d bytes read on FD: %d", bytesRead, fd);
+    closelog();
+    
+    if (bytesRead <= 0) {
+        return -1; // Error reading
+    }
+    
+    memcpy(values, buffer, bytesRead);
+    
+    return bytesRead;
+}
+
+/**
+ * Reads a block of bytes starting from a register address.
+ * Uses the largest transfer size and method the adapter's block read self-test
+ * proved safe (31-byte SMBus block reads until a probe has run), splitting
+ * larger reads into multiple sequential transfers.
+ *
+ * @param fd       File descriptor for the I2C bus
+ * @param reg      Starting register address
+ * @param jbuffer  Java byte array to store the data
+ * @param length   Number of bytes to read
+ * @return Total number of bytes read, or -1 if error
+ */
+int i2c_core_read_block(int fd, int reg, uint8_t *values, int length)
+{
+    if (length <= 0 || length > I2C_MAX_BLOCK) {
+        return -1;
+    }
+
+    __u8 buffer[I2C_MAX_BLOCK] = {0};
+    int totalRead = 0;
+    int remaining = length;
+    __u8 currentReg = reg & 0xFF;
+    int method, maxBlock;
+    block_caps_for_fd(fd, &method, &maxBlock);
+
+    while (remaining > 0) {
+        int chunkSize = remaining > maxBlock ? maxBlock : remaining;
+        __s32 bytesRead = i2c_read_block_chunk(fd, method, currentReg, chunkSize, buffer + totalRead);
+        if (bytesRead <= 0) {
+            if (totalRead == 0) {
+                return -1; // First read failed
+            }
+            break; // Return what we have so far
+        }
+        totalRead += bytesRead;
+        remaining -= bytesRead;
+        currentReg += bytesRead;
+    }
+
+    memcpy(values, buffer, totalRead);
+    return totalRead;
+}
+
+/**
+ * Block read self-test for the adapter behind `fd`.
+ *
+ * Reads `length` bytes of a register range whose contents do not change (the caller
+ * picks it and selects the device first) one byte at a time as a reference, then
+ * re-reads the range with progressively larger transfers: SMBus block reads of
+ * 8, 16 and 31 bytes, a 32-byte I2C_SMBUS_I2C_BLOCK_BROKEN read, and I2C_RDWR reads
+ * of 32 bytes up to the whole range. The largest size whose data matches the
+ * reference is cached for the adapter and used by readBlockData from then on.
+ * A second reference pass guards against ranges that changed during the test.
+ *
+ * The result is cached per adapter name; later calls return the cached result
+ * unless `force` is set. A test without a result caches nothing, so that a
+ * transient failure can be retried.
+ *
+ * @return (method << 16) | maxBlock on success, -1 if a reference read failed,
+ *         the range changed or not even an 8-byte block read matched
+ */
+int i2c_core_probe_block_read(int fd, int reg, int length, int force)
+{
+    if (fd < 0 || length <= 0 || length > I2C_MAX_BLOCK) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&caps_lock);
+    int index = adapter_for_fd_locked(fd);
+    int cached = index >= 0 && adapter_caps[index].probed && !force;
+    int cachedResult = index >= 0
+            ? (adapter_caps[index].method << 16) | adapter_caps[index].max_block
+            : -1;
+    pthread_mutex_unlock(&caps_lock);
+    if (index < 0) {
+        return -1;
+    }
+    if (cached) {
+        return cachedResult;
+    }
+
+    __u8 start = reg & 0xFF;
+    __u8 reference[I2C_MAX_BLOCK];
+    __u8 check[I2C_MAX_BLOCK];
+    for (int i = 0; i < length; i++) {
+        __s32 value = i2c_smbus_read_byte_data(fd, (__u8)(start + i));
+        if (value < 0) {
+            return -1;
+        }
+        reference[i] = (__u8)value;
+    }
+
+    unsigned long funcs = 0;
+    if (backend->ioctl(fd, I2C_FUNCS, &funcs) < 0) {
+        funcs = I2C_FUNC_SMBUS_READ_I2C_BLOCK;
+    }
+
+    int bestMethod = I2C_BLOCK_METHOD_SMBUS;
+    int bestSize = 0;
+
+    if (funcs & I2C_FUNC_SMBUS_READ_I2C_BLOCK) {
+        static const int smbusSizes[] = {8, 16, 31};
+        for (unsigned i = 0; i < sizeof(smbusSizes) / sizeof(smbusSizes[0]); i++) {
+            int size = smbusSizes[i] < length ? smbusSizes[i] : length;
+            if (!block_method_matches(fd, I2C_BLOCK_METHOD_SMBUS, size, start, length, reference)) {
+                break;
+            }
+            bestSize = size;
+        }
+        if (bestSize == I2C_DEFAULT_BLOCK && length >= 32
+                && block_method_matches(fd, I2C_BLOCK_METHOD_SMBUS32, 32, start, length, reference)) {
+            bestMethod = I2C_BLOCK_METHOD_SMBUS32;
+            bestSize = 32;
+        }
+    }
+
+    if ((funcs & I2C_FUNC_I2C) && length > bestSize) {
+        for (int size = 32; ; size *= 2) {
+            if (size > length) {
+                size = length;
+            }
+            if (!block_method_matches(fd, I2C_BLOCK_METHOD_RDWR, size, start, length, reference)) {
+                break;
+            }
+            if (size > bestSize) {
+                bestMethod = I2C_BLOCK_METHOD_RDWR;
+                bestSize = size;
+            }
+            if (size == length) {
+                break;
+            }
+        }
+    }
+
+    // The range must not have changed underneath the test, otherwise a mismatch
+    // (or a lucky match) says nothing about the transfer method.
+    for (int i = 0; i < length; i++) {
+        __s32 value = i2c_smbus_read_byte_data(fd, (__u8)(start + i));
+        if (value < 0) {
+            return -1;
+        }
+        check[i] = (__u8)value;
+    }
+    if (memcmp(reference, check, length) != 0) {
+        openlog("I2cNative", LOG_PID | LOG_CONS, LOG_USER);
+        syslog(LOG_WARNING, "Block read probe range 0x%02X+%d changed during test on FD: %d", start, length, fd);
+        closelog();
+        return -1;
+    }
+
+    if (bestMethod == I2C_BLOCK_METHOD_SMBUS && bestSize == length && length < I2C_DEFAULT_BLOCK) {
+        // A range shorter than the default block says nothing about larger transfers.
+        bestSize = I2C_DEFAULT_BLOCK;
+    }
+    if (bestSize == 0) {
+        // Not even an 8-byte block read matched, which a NAK or a glitch can cause
+        // as well as the adapter. The adapter keeps its current settings.
+        openlog("I2cNative", LOG_PID | LOG_CONS, LOG_USER);
+        syslog(LOG_WARNING, "Block read probe found no working block read on FD: %d", fd);
+        closelog();
+        return -1;
+    }
+
+    pthread_mutex_lock(&caps_lock);
+    adapter_caps[index].probed = 1;
+    adapter_caps[index].method = bestMethod;
+    adapter_caps[index].max_block = bestSize;
+    pthread_mutex_unlock(&caps_lock);
+
+    openlog("I2cNative", LOG_PID | LOG_CONS, LOG_USER);
+    syslog(LOG_INFO, "Block read probe for adapter '%s': method=%d maxBlock=%d", adapter_caps[index].name, bestMethod, bestSize);
+    closelog();
+
+    return (bestMethod << 16) | bestSize;
+}
+
+/**
+ * Returns the cached block read capabilities of the adapter behind `fd`
+ * as (method << 16) | maxBlock, or -1 if the fd is unknown.
+ */
+int i2c_core_block_caps(int fd)
+{
+    int method, maxBlock;
+    if (fd < 0 || fd >= I2C_MAX_FDS) {
+        return -1;
+    }
+    block_caps_for_fd(fd, &method, &maxBlock);
+    return (method << 16) | maxBlock;
+}
+
+int i2c_core_write(int fd, int value)
+{
+    __u8 byte = value & 0xFF;
+    struct i2c_retry_state rs;
+    int result;
+    int err;
+    retry_begin(&rs, fd, retry_policy_for(fd));
+    do {
+        i2c_rate_limit(fd, I2C_TRACE_OP_WRITE, 1);
+        result = backend->write(fd, &byte, 1);
+        err = errno;
+        i2c_post_operation(fd);
+        if (i2c_trace_active()) {
+            trace_attempt(fd, fd_addr(fd), &rs, I2C_TRACE_OP_WRITE, 0, 0, 0, &byte, 1, result, err);
+        }
+    } while (result < 0 && retry_after_failure(&rs, err));
+    retry_end(&rs, result < 0);
+    return result;
+}
+
+/**
+ * SMBus Quick Write probe - used by i2cdetect for device detection
+ * This is the most compatible method for detecting I2C devices
+ */
+static inline __s32 i2c_smbus_quick_write(int file, __u8 deviceAddress)
+{
+    // Switch to the device address first
+    if (switch_i2c_device(file, deviceAddress) < 0) {
+        return -1;
+    }
+    
+    // Perform SMBus Quick Write - just sends address + write bit
+    return i2c_smbus_access_once(file, I2C_SMBUS_WRITE, 0, I2C_SMBUS_QUICK, NULL);
+}
+
+/**
+ * SMBus Read Byte probe - alternative method for device detection
+ * Some devices respond better to read operations
+ */
+static inline __s32 i2c_smbus_read_byte_probe(int file, __u8 deviceAddress)
+{
+    union i2c_smbus_data data;
+    
+    // Switch to the device address first
+    if (switch_i2c_device(file, deviceAddress) < 0) {
+        return -1;
+    }
+    
+    // Perform SMBus Read Byte
+    return i2c_smbus_access_once(file, I2C_SMBUS_READ, 0, I2C_SMBUS_BYTE, &data);
+}
+
+/**
+ * Scans for a device at a specific I2C address using i2cdetect-style probing.
+ * Uses SMBus Quick Write first (most compatible), falls back to Read Byte if needed.
+ * 
+ * @param fd File descriptor for the I2C bus
+ * @param deviceAddress 7-bit I2C address to probe (0x08-0x77)
+ * @return 1 if device responds, 0 if no device found, -1 if error
+ */
+int i2c_core_scan_address(int fd, int deviceAddress)
+{
+    __u8 devAddr = deviceAddress & 0x7F; // Ensure 7-bit address
+    
+    // Skip reserved addresses (like i2cdetect does)
+    if (devAddr < 0x08 || devAddr > 0x77) {
+        return 0; // Not a valid user device address
+    }
+    
+    // Skip addresses that are typically reserved or problematic
+    // 0x00-0x07: General call and reserved addresses
+    // 0x78-0x7F: Reserved addresses
+    if (devAddr <= 0x07 || devAddr >= 0x78) {
+        return 0;
+    }
+    
+    openlog("I2cNative", LOG_PID | LOG_CONS, LOG_USER);
+    syslog(LOG_INFO, "Scanning I2C address 0x%02X on FD: %d", devAddr, fd);
+    
+    // Method 1: Try SMBus Quick Write (most compatible, used by i2cdetect -q)
+    __s32 result = i2c_smbus_quick_write(fd, devAddr);
+    if (result == 0) {
+        syslog(LOG_INFO, "Device found at 0x%02X using Quick Write", devAddr);
+        closelog();
+        return 1; // Device responded to Quick Write
+    }
+    
+    // Method 2: Try SMBus Read Byte (alternative method, used by i2cdetect -r) 
+    result = i2c_smbus_read_byte_probe(fd, devAddr);
+    if (result >= 0) {
+        syslog(LOG_INFO, "Device found at 0x%02X using Read Byte", devAddr);
+        closelog();
+        return 1; // Device responded to Read Byte
+    }
+    
+    // No response from either method
+    syslog(LOG_DEBUG, "No device found at 0x%02X", devAddr);
+    closelog();
+    return 0;
+}
+
+/**
+ * Attempts to recover a frozen I2C bus using Linux kernel recovery mechanisms.
+ * This function tries multiple recovery approaches to restore bus functionality:
+ * 1. I2C_RECOVER ioctl (if supported by kernel/driver)
+ * 2. Bus reset through re-initialization
+ * 3. Force device switch to try clearing stuck transactions
+ * 
+ * @param fd File descriptor for the I2C bus
+ * @return 0 if recovery successful, -1 if recovery failed
+ */
+int i2c_core_recover_bus(int fd)
+{
+    if (fd < 0) {
+        return -1;
+    }
+    
+    openlog("I2cNative", LOG_PID | LOG_CONS, LOG_USER);
+    syslog(LOG_INFO, "Attempting I2C bus recovery on FD: %d", fd);
+    
+    // Method 1: Try I2C_RECOVER ioctl if supported by the kernel driver
+    // This leverages kernel-level recovery mechanisms that may include:
+    // - Clock pulse generation to unstick SDA line
+    // - Bus state machine reset
+    // - Hardware-specific recovery procedures
+#ifdef I2C_RECOVER
+    syslog(LOG_DEBUG, "Attempting I2C_RECOVER ioctl on FD: %d", fd);
+    if (backend->ioctl(fd, I2C_RECOVER, NULL) == 0) {
+        syslog(LOG_INFO, "I2C bus recovery successful using I2C_RECOVER ioctl on FD: %d", fd);
+        closelog();
+        return 0;
+    }
+    syslog(LOG_DEBUG, "I2C_RECOVER ioctl failed or not supported on FD: %d", fd);
+#endif
+    
+    // Method 2: Try to clear any stuck transaction by switching to general call address
+    // The general call address (0x00) can sometimes help clear stuck transactions
+    syslog(LOG_DEBUG, "Attempting general call address switch for recovery on FD: %d", fd);
+    if (backend->ioctl(fd, I2C_SLAVE, (void *) 0L) == 0) {
+        // Try a quick write to general call address - this may help unstick the bus
+        int result = i2c_smbus_access_once(fd, I2C_SMBUS_WRITE, 0, I2C_SMBUS_QUICK, NULL);
+        if (result == 0) {
+            syslog(LOG_INFO, "I2C bus recovery successful using general call on FD: %d", fd);
+            closelog();
+            return 0;
+        }
+    }
+    
+    // Method 3: Try force-clearing any pending transactions
+    // This attempts to send a STOP condition by doing a quick read/write cycle
+    syslog(LOG_DEBUG, "Attempting transaction force-clear for recovery on FD: %d", fd);
+    
+    // Try switching to a safe address and doing minimal operations
+    for (int addr = 0x08; addr <= 0x77; addr += 8) {
+        if (backend->ioctl(fd, I2C_SLAVE, (void *) (long) addr) == 0) {
+            // Try a quick operation that might help clear the bus
+            if (i2c_smbus_access_once(fd, I2C_SMBUS_READ, 0, I2C_SMBUS_QUICK, NULL) == 0) {
+                syslog(LOG_INFO, "I2C bus recovery successful using address probe method on FD: %d", fd);
+                closelog();
+                return 0;
+            }
+        }
+    }
+    
+    // Method 4: Try resetting I2C functionality flags
+    // Some drivers support resetting specific I2C functionality
+    syslog(LOG_DEBUG, "Attempting I2C functionality reset on FD: %d", fd);
+    
+    // Query current functionality to ensure the bus is still operational
+    unsigned long funcs;
+    if (backend->ioctl(fd, I2C_FUNCS, &funcs) == 0) {
+        // If we can query functionality, the low-level driver is responsive
+        // Try one more general call attempt
+        if (backend->ioctl(fd, I2C_SLAVE, (void *) 0L) == 0) {
+            syslog(LOG_INFO, "I2C bus recovery: driver responsive, attempting final general call on FD: %d", fd);
+            
+            // Give the bus some time to settle
+            usleep(1000); // 1ms delay
+            
+            // Try a final quick write
+            if (i2c_smbus_access_once(fd, I2C_SMBUS_WRITE, 0, I2C_SMBUS_QUICK, NULL) == 0) {
+                syslog(LOG_INFO, "I2C bus recovery successful using delayed general call on FD: %d", fd);
+                closelog();
+                return 0;
+            }
+        }
+    }
+    
+    // All recovery methods failed
+    syslog(LOG_ERR, "All I2C bus recovery methods failed on FD: %d", fd);
+    closelog();
+    return -1;
+}
+
+int i2c_core_set_retry_policy(int fd, const struct i2c_retry_policy *policy)
+{
+    if (fd == -1) {
+        default_retry_policy = *policy;
+        return 0;
+    }
+    if (fd < 0 || fd >= I2C_MAX_FDS) {
+        return -1;
+    }
+    fd_retry_policy[fd] = *policy;
+    fd_has_retry_policy[fd] = 1;
+    return 0;
+}
+
+int i2c_core_set_pacing(int fd, long interval_ns)
+{
+    if (fd < 0 || fd >= I2C_MAX_FDS) {
+        return -1;
+    }
+    struct i2c_bus_pacing *pacing = pacing_for(fd);
+    if (interval_ns < 0) {
+        pacing->has_interval = 0;
+    } else {
+        pacing->interval_ns = interval_ns;
+        pacing->has_interval = 1;
+    }
+    return 0;
+}
+
+void i2c_core_set_backend(const struct i2c_backend *replacement)
+{
+    backend = replacement != NULL ? replacement : &kernel_backend;
+}
+
+int64_t i2c_core_request_ns(void)
+{
+    return thread_request_ns;
+}
+
+int i2c_core_bus_usage(int fd, int64_t stats[3])
+{
+    if (fd < 0 || fd >= I2C_MAX_FDS) {
+        return -1;
+    }
+    struct i2c_bus_pacing *pacing = pacing_for(fd);
+    stats[0] = __atomic_load_n(&pacing->busy_ns, __ATOMIC_RELAXED);
+    stats[1] = __atomic_load_n(&pacing->transfers, __ATOMIC_RELAXED);
+    stats[2] = __atomic_load_n(&pacing->failures, __ATOMIC_RELAXED);
+    return 0;
+}
+
+int i2c_core_begin_burst(int fd)
+{
+    if (fd < 0 || fd >= I2C_MAX_FDS) {
+        return -1;
+    }
+    __atomic_add_fetch(&pacing_for(fd)->burst, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+int i2c_core_end_burst(int fd, long idle_ns)
+{
+    if (fd < 0 || fd >= I2C_MAX_FDS) {
+        return -1;
+    }
+    struct i2c_bus_pacing *pacing = pacing_for(fd);
+    int depth = __atomic_load_n(&pacing->burst, __ATOMIC_RELAXED);
+    if (depth <= 0) {
+        return -1;
+    }
+    // Only the outermost burst ends the run of back-to-back transfers
+    if (depth > 1) {
+        __atomic_store_n(&pacing->burst, depth - 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    __atomic_store_n(&pacing->idle_until_ns, idle_ns > 0 ? monotonic_ns() + idle_ns : 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&pacing->burst, 0, __ATOMIC_RELAXED);
+    return 0;
+}
+
+int i2c_core_set_budget(int fd, long budget_ns, long window_ns)
+{
+    if (fd < 0 || fd >= I2C_MAX_FDS) {
+        return -1;
+    }
+    struct i2c_bus_budget *budget = &pacing_for(fd)->budget;
+    budget->window_ns = window_ns < 0 ? 0 : window_ns;
+    budget->window_start_ns = 0;
+    budget->window_busy_ns = 0;
+    budget->budget_ns = budget_ns < 0 ? 0 : budget_ns;
+    return 0;
+}
+
+int i2c_core_budget_stats(int fd, int64_t stats[5])
+{
+    if (fd < 0 || fd >= I2C_MAX_FDS) {
+        return -1;
+    }
+    struct i2c_bus_budget *budget = &pacing_for(fd)->budget;
+    stats[0] = __atomic_load_n(&budget->windows, __ATOMIC_RELAXED);
+    stats[1] = __atomic_load_n(&budget->deferrals, __ATOMIC_RELAXED);
+    stats[2] = __atomic_load_n(&budget->overruns, __ATOMIC_RELAXED);
+    stats[3] = __atomic_load_n(&budget->busy_ns, __ATOMIC_RELAXED);
+    stats[4] = __atomic_load_n(&budget->worst_ns, __ATOMIC_RELAXED);
+    return 0;
+}
+
+void i2c_core_set_frame_timing(int64_t vsync_ns, int64_t period_ns)
+{
+    if (period_ns > 0) {
+        __atomic_store_n(&frame_timing.period_ns, (long) period_ns, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&frame_timing.vsync_ns, (long) vsync_ns, __ATOMIC_RELAXED);
+}
+
+void i2c_core_set_frame_pacing(long quiet_ns, long burst_interval_ns)
+{
+    __atomic_store_n(&frame_timing.burst_interval_ns, burst_interval_ns < 0 ? 0 : burst_interval_ns,
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&frame_timing.quiet_ns, quiet_ns < 0 ? 0 : quiet_ns, __ATOMIC_RELAXED);
+}
+
+void i2c_core_set_thread_retry_policy(const struct i2c_retry_policy *policy)
+{
+    if (policy != NULL) {
+        thread_retry_policy = *policy;
+        thread_has_retry_policy = 1;
+    } else {
+        thread_has_retry_policy = 0;
+    }
+}
+
+int i2c_core_last_attempts(int fd)
+{
+    if (fd < 0 || fd >= I2C_MAX_FDS) {
+        return -1;
+    }
+    return __atomic_load_n(&fd_retry_stats[fd].last_attempts, __ATOMIC_RELAXED);
+}
+
+int64_t i2c_core_last_transfer_ns(void)
+{
+    return thread_last_transfer_ns;
+}
+
+int i2c_core_retry_stats(int fd, int64_t stats[3])
+{
+    if (fd < 0 || fd >= I2C_MAX_FDS) {
+        return -1;
+    }
+    stats[0] = __atomic_load_n(&fd_retry_stats[fd].ops, __ATOMIC_RELAXED);
+    stats[1] = __atomic_load_n(&fd_retry_stats[fd].retries, __ATOMIC_RELAXED);
+    stats[2] = __atomic_load_n(&fd_retry_stats[fd].exhausted, __ATOMIC_RELAXED);
+    return 0;
+}
@@ -0,0 +1,150 @@
+#ifndef I2C_CORE_H
+#define I2C_CORE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Bus access shared by the JNI library and the i2cd daemon: rate limiting,
+ * the retry engine, adapter block read capabilities, scanning and recovery.
+ * All functions return -1 on error unless noted otherwise.
+ */
+
+// Largest block we ever transfer in one go.
+#define I2C_MAX_BLOCK 256
+
+// Block read methods, from most to least conservative.
+// SMBUS:   I2C_SMBUS_I2C_BLOCK_DATA, at most 31 bytes (safe everywhere)
+// SMBUS32: I2C_SMBUS_I2C_BLOCK_BROKEN, exactly 32 bytes (corrupts state on some Qualcomm controllers)
+// RDWR:    combined register write + read via I2C_RDWR, up to I2C_MAX_BLOCK bytes
+#define I2C_BLOCK_METHOD_SMBUS   0
+#define I2C_BLOCK_METHOD_SMBUS32 1
+#define I2C_BLOCK_METHOD_RDWR    2
+
+#define I2C_DEFAULT_BLOCK 31
+#define I2C_MAX_FDS 1024
+
+#define I2C_MAX_RETRYABLE 8
+
+// Messages in one I2C_RDWR submission (I2C_RDWR_IOCTL_MAX_MSGS)
+#define I2C_MAX_REGISTER_WRITES 42
+
+/**
+ * Retry policy applied to individual transfers inside the native layer.
+ * Backoff for attempt n (1-based) is base * 2^(n-1), capped at max_backoff_ns,
+ * then randomised by +/- jitter_percent. Retries stop when max_attempts is reached,
+ * when the next backoff would overrun deadline_ns (measured from the first attempt,
+ * 0 = no deadline), or when the failure's errno is not in the retryable set.
+ */
+struct i2c_retry_policy {
+    int max_attempts;
+    long base_backoff_ns;
+    long max_backoff_ns;
+    int jitter_percent;
+    long deadline_ns;
+    int retryable_count;
+    int retryable[I2C_MAX_RETRYABLE];
+};
+
+/**
+ * The system calls behind every bus access. The kernel is used unless another
+ * backend (e.g. trace replay) is installed. Swap backends only while no bus is open.
+ */
+struct i2c_backend {
+    int (*open)(const char *path, int flags);
+    int (*close)(int fd);
+    int (*ioctl)(int fd, unsigned long request, void *arg);
+    ssize_t (*read)(int fd, void *buf, size_t count);
+    ssize_t (*write)(int fd, const void *buf, size_t count);
+};
+
+/** Installs a backend; NULL restores the kernel. */
+void i2c_core_set_backend(const struct i2c_backend *backend);
+/**
+ * CLOCK_MONOTONIC at which the calling thread's attempt in progress asked for the
+ * bus, before pacing; 0 outside a paced attempt. Lets a backend measure latency.
+ */
+int64_t i2c_core_request_ns(void);
+
+/** Opens a bus device and selects deviceAddress. Returns the fd. */
+int i2c_core_open(const char *path, int deviceAddress);
+int i2c_core_close(int fd);
+int i2c_core_switch_device(int fd, int deviceAddress);
+
+int i2c_core_write_byte(int fd, int reg, int value);
+int i2c_core_write_word(int fd, int reg, int value);
+/**
+ * Writes count (register, value) pairs as one I2C_RDWR submission, falling back
+ * to one write per register if the adapter rejects it, which is remembered per
+ * adapter. Returns count, or -1.
+ */
+int i2c_core_write_registers(int fd, const uint8_t *registers, const uint8_t *values, int count);
+/** Writes a single byte without a register (e.g. a command or a mux mask). */
+int i2c_core_write(int fd, int value);
+/** Returns the 16-bit word at reg, or -1. */
+int i2c_core_read_word(int fd, int reg);
+int i2c_core_read_i2c_block(int fd, int reg, int length, uint8_t *values);
+/** Plain read() of up to 32 bytes. Returns the number of bytes read. */
+int i2c_core_read_raw(int fd, uint8_t *values, int length);
+/** Register block read using the adapter's probed method and size. Returns bytes read. */
+int i2c_core_read_block(int fd, int reg, uint8_t *values, int length);
+/** Block read self-test. Returns (method << 16) | maxBlock. */
+int i2c_core_probe_block_read(int fd, int reg, int length, int force);
+int i2c_core_block_caps(int fd);
+
+/** Returns 1 if a device acknowledges deviceAddress, 0 if not. */
+int i2c_core_scan_address(int fd, int deviceAddress);
+int i2c_core_recover_bus(int fd);
+
+/** Sets the retry policy of fd, or the default when fd is -1. */
+int i2c_core_set_retry_policy(int fd, const struct i2c_retry_policy *policy);
+/**
+ * Sets the minimum gap between transfers on the bus behind fd, for every fd on
+ * that bus. A negative interval restores the default of 250 us.
+ */
+int i2c_core_set_pacing(int fd, long interval_ns);
+/**
+ * Copies the running usage of fd's bus: [0] ns spent in transfers (attempts
+ * included), [1] transfer attempts, [2] transfers that failed for good.
+ */
+int i2c_core_bus_usage(int fd, int64_t stats[3]);
+/**
+ * Runs the transfers on fd's bus back-to-back, without the pacing interval,
+ * until i2c_core_end_burst. The bus then stays silent for idle_ns. Bursts nest:
+ * only the end of the outermost one ends the burst.
+ */
+int i2c_core_begin_burst(int fd);
+int i2c_core_end_burst(int fd, long idle_ns);
+/**
+ * Limits the bus behind fd to budget_ns of transfer time per window_ns (0: per
+ * frame while frame timing is known, else per 16.7 ms). Transfers over the
+ * budget wait for the next window. A budget of 0 removes the limit.
+ */
+int i2c_core_set_budget(int fd, long budget_ns, long window_ns);
+/** Copies windows, deferrals, overruns, busy ns and worst window busy ns of fd's bus. */
+int i2c_core_budget_stats(int fd, int64_t stats[5]);
+/**
+ * Reports the latest vsync (CLOCK_MONOTONIC) and the frame period. Call it every
+ * frame; timing not refreshed for a few periods is treated as "not rendering".
+ * A period of 0 keeps the previous one.
+ */
+void i2c_core_set_frame_timing(int64_t vsync_ns, int64_t period_ns);
+/**
+ * Enables frame pacing on all buses: no transfer starts within quiet_ns of the
+ * next vsync, and transfers run burst_interval_ns apart in the rest of the frame.
+ * A quiet window of 0 disables it; the per-bus interval applies again.
+ */
+void i2c_core_set_frame_pacing(long quiet_ns, long burst_interval_ns);
+/** Overrides the policy for the calling thread; NULL removes the override. */
+void i2c_core_set_thread_retry_policy(const struct i2c_retry_policy *policy);
+/**
+ * Attempts the last transfer on fd needed, or -1 for an invalid fd. Read it while
+ * still holding the bus to get the count of one's own transfer.
+ */
+int i2c_core_last_attempts(int fd);
+/** CLOCK_BOOTTIME in ns at the end of the calling thread's last transfer, 0 if none. */
+int64_t i2c_core_last_transfer_ns(void);
+/** Copies transfers, retries and exhausted transfers of fd. */
+int i2c_core_retry_stats(int fd, int64_t stats[3]);
+
+#endif //I2C_CORE_H
@@ -0,0 +1,1134 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // accept4 on glibc; bionic always has it
+#endif
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <syslog.h>
+
+#ifdef __ANDROID__
+#include <android/sharedmem.h>
+#endif
+
+#include "I2cCore.h"
+#include "I2cDaemonProtocol.h"
+#include "I2cTrace.h"
+#include "I2cReplay.h"
+
+/*
+ * i2cd: owns the I2C buses on behalf of any number of client processes.
+ *
+ * Clients send bus primitives over a Unix socket (see I2cDaemonProtocol.h) and
+ * may register periodic register block reads. The daemon runs those polls on
+ * its own timer and writes every result into the client's shared-memory ring,
+ * so readers get samples without a round trip or a syscall.
+ *
+ * Single threaded: requests, polls and lock hand-over are all driven by one
+ * poll() loop, which serialises every transfer on a bus without extra locking.
+ *
+ * Usage: i2cd [-s socket] [-m mode] [-u uid] [-g gid] [-l lease_ms] [-r retries [-n]]
+ *            [-f hz -q quiet_us] [-t capture] [-R capture [-F]]
+ *
+ * -r retries transient failures (EIO, EAGAIN, EBUSY, ETIMEDOUT). A NAK (ENXIO,
+ * EREMOTEIO) usually means the device is absent or busy converting, so it is
+ * only retried with -n.
+ *
+ * LOCK_BUS waiters are queued per bus and served in order. A lock holder that
+ * makes no request on its bus for -l milliseconds (default 1000) is presumed
+ * stuck and loses the lock to the next waiter.
+ *
+ * Only root, the daemon's own user, the user given with -u and processes whose
+ * group is the one given with -g (as reported by SO_PEERCRED) are served; other
+ * connections are closed at once. Clients may only open /dev/i2c-N buses.
+ *
+ * -t records every transfer and writes the capture (see I2cTrace.h) to the given
+ * path on SIGUSR1 and on exit.
+ *
+ * -R serves every transfer from a capture instead of the hardware (see
+ * I2cReplay.h), in the capture's timing or, with -F, as fast as possible. Clients
+ * see the same device and the same data, so a field capture can be replayed on
+ * any Linux machine.
+ *
+ * -f runs frame pacing against a synthetic vsync of the given rate, with a quiet
+ * window of -q microseconds before each frame. Meant for exercising the pacer on
+ * plain Linux; apps feed real vsync through I2cNative.setFrameTiming.
+ */
+
+#define MAX_CLIENTS 32
+#define MAX_BUSES   8
+#define MAX_HANDLES 256
+#define MAX_POLLS   128
+
+// A waiter whose LOCK_BUS timed out keeps its place this long, so that a client
+// waiting in bounded slices is not sent to the back of the queue each time
+#define WAITER_GRACE_NS 100000000L
+
+#define DEFAULT_RING_CAPACITY 256
+#define MAX_RING_CAPACITY     65536
+
+struct waiter {
+    int client;              // id of the waiting connection
+    long deadline_ns;        // when its LOCK_BUS times out, 0 once answered
+    long keep_until_ns;      // after answering with ETIMEDOUT: when it loses its place
+};
+
+struct bus {
+    char path[I2CD_PATH_LEN];
+    int fd;                  // -1 when unused
+    int current_addr;        // address last selected with I2C_SLAVE, -1 when unknown
+    int lock_owner;          // client id holding LOCK_BUS, 0 when unlocked
+    int lock_conn;           // id of the connection that took the lock
+    long lease_end_ns;       // lock released when the owner is idle until then
+    int last_user;           // client id of the last transfer, 0 for daemon polls, -1 never
+    struct waiter waiters[MAX_CLIENTS]; // LOCK_BUS queue, oldest first
+    int waiter_count;
+};
+
+struct handle {
+    int client;              // owning client id, 0 when free
+    int bus;
+    int addr;
+};
+
+struct client {
+    int sock;                // -1 when the slot is free
+    int id;
+    int owner;               // client id locks are taken for: its own, or the one it ATTACHed to
+    pid_t pid;
+    int waiting_lock;        // LOCK_BUS queued, not answered yet
+    int has_pending;         // request deferred while another client holds the bus lock
+    struct i2cd_request pending;
+    struct i2cd_ring_header *ring;
+    size_t ring_size;
+};
+
+struct poll_entry {
+    int id;                  // 0 when free
+    int client;
+    int bus;
+    int addr;
+    int reg;
+    int length;
+    int mux_addr;
+    int mux_channel;
+    long period_ns;
+    long next_ns;
+};
+
+static struct bus buses[MAX_BUSES];
+static struct handle handles[MAX_HANDLES];
+static struct client clients[MAX_CLIENTS];
+static struct poll_entry polls[MAX_POLLS];
+static int next_client_id = 1;
+static int next_poll_id = 1;
+
+// Peers allowed besides root and the daemon's own user (-u, -g), -1 when not set
+static long allowed_uid = -1;
+static long allowed_gid = -1;
+
+static long lease_ns = 1000000000L;
+
+static volatile sig_atomic_t running = 1;
+static volatile sig_atomic_t dump_requested = 0;
+
+// Synthetic vsync (-f): period and the time of frame 0, 0 when off
+static long synthetic_period_ns = 0;
+static long synthetic_epoch_ns = 0;
+
+static inline long monotonic_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+/** Reports the most recent synthetic vsync, as a renderer would every frame. */
+static void synthetic_vsync(void)
+{
+    if (synthetic_period_ns <= 0) {
+        return;
+    }
+    long now = monotonic_ns();
+    i2c_core_set_frame_timing(now - (now - synthetic_epoch_ns) % synthetic_period_ns, synthetic_period_ns);
+}
+
+static void on_signal(int sig)
+{
+    (void) sig;
+    running = 0;
+}
+
+static void on_dump_signal(int sig)
+{
+    (void) sig;
+    dump_requested = 1;
+}
+
+static void dump_trace(const char *path)
+{
+    int count = i2c_trace_dump(path);
+    if (count < 0) {
+        syslog(LOG_ERR, "Cannot write capture to %s: %s", path, strerror(errno));
+    } else {
+        syslog(LOG_INFO, "Wrote %d transfers to %s", count, path);
+    }
+}
+
+static struct client *client_by_id(int id)
+{
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (clients[i].sock >= 0 && clients[i].id == id) {
+            return &clients[i];
+        }
+    }
+    return NULL;
+}
+
+// Clients may only name I2C adapters, not arbitrary files opened with the daemon's rights
+static int is_bus_path(const char *path)
+{
+    static const char prefix[] = "/dev/i2c-";
+    if (strncmp(path, prefix, sizeof(prefix) - 1) != 0) {
+        return 0;
+    }
+    const char *digits = path + sizeof(prefix) - 1;
+    if (*digits == '\0') {
+        return 0;
+    }
+    for (; *digits != '\0'; digits++) {
+        if (*digits < '0' || *digits > '9') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Buses stay open for the daemon's lifetime: reopening costs more than an idle fd
+static int find_bus(const char *path, int open_missing)
+{
+    if (!is_bus_path(path)) {
+        errno = EACCES;
+        return -1;
+    }
+    int free_slot = -1;
+    for (int i = 0; i < MAX_BUSES; i++) {
+        if (buses[i].fd >= 0 && strncmp(buses[i].path, path, I2CD_PATH_LEN) == 0) {
+            return i;
+        }
+        if (free_slot < 0 && buses[i].fd < 0) {
+            free_slot = i;
+        }
+    }
+    if (!open_missing || free_slot < 0) {
+        errno = open_missing ? EMFILE : ENODEV;
+        return -1;
+    }
+    // Select the general call address until a client picks its device
+    int fd = i2c_core_open(path, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    struct bus *bus = &buses[free_slot];
+    strncpy(bus->path, path, I2CD_PATH_LEN - 1);
+    bus->path[I2CD_PATH_LEN - 1] = '\0';
+    bus->fd = fd;
+    bus->current_addr = 0;
+    bus->lock_owner = 0;
+    bus->waiter_count = 0;
+    bus->last_user = -1;
+    syslog(LOG_INFO, "Opened %s as bus %d", bus->path, free_slot);
+    return free_slot;
+}
+
+static int select_device(struct bus *bus, int addr)
+{
+    if (bus->current_addr == addr) {
+        return 0;
+    }
+    if (i2c_core_switch_device(bus->fd, addr) < 0) {
+        bus->current_addr = -1;
+        return -1;
+    }
+    bus->current_addr = addr;
+    return 0;
+}
+
+static struct handle *handle_for(const struct client *client, int index)
+{
+    if (index < 0 || index >= MAX_HANDLES || handles[index].client != client->id) {
+        errno = EBADF;
+        return NULL;
+    }
+    return &handles[index];
+}
+
+static inline int uses_handle(uint32_t op)
+{
+    return op >= I2CD_OP_SWITCH_DEVICE && op <= I2CD_OP_RECOVER_BUS;
+}
+
+static int bus_of_request(const struct client *client, const struct i2cd_request *request)
+{
+    if (!uses_handle(request->op)) {
+        return -1;
+    }
+    struct handle *h = handle_for(client, request->handle);
+    return h != NULL ? h->bus : -1;
+}
+
+static int create_ring(struct client *client, uint32_t capacity)
+{
+    if (capacity == 0) {
+        capacity = DEFAULT_RING_CAPACITY;
+    }
+    if (capacity > MAX_RING_CAPACITY) {
+        capacity = MAX_RING_CAPACITY;
+    }
+    size_t size = (size_t) i2cd_ring_size(capacity);
+#ifdef __ANDROID__
+    int fd = ASharedMemory_create("i2cd-ring", size);
+#else
+    int fd = (int) syscall(SYS_memfd_create, "i2cd-ring", 0);
+    if (fd >= 0 && ftruncate(fd, (off_t) size) < 0) {
+        close(fd);
+        fd = -1;
+    }
+#endif
+    if (fd < 0) {
+        return -1;
+    }
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    memset(map, 0, size);
+    struct i2cd_ring_header *ring = map;
+    ring->version = I2CD_RING_VERSION;
+    ring->capacity = capacity;
+    ring->sample_size = sizeof(struct i2cd_sample);
+    __atomic_store_n(&ring->magic, I2CD_RING_MAGIC, __ATOMIC_RELEASE);
+
+    if (client->ring != NULL) {
+        munmap(client->ring, client->ring_size);
+    }
+    client->ring = ring;
+    client->ring_size = size;
+    return fd;
+}
+
+static void ring_push(struct i2cd_ring_header *ring, const struct poll_entry *poll,
+                      int status, int64_t timestamp_ns, const uint8_t *data)
+{
+    uint64_t n = ring->head;
+    struct i2cd_sample *slot = &i2cd_ring_slots(ring)[n % ring->capacity];
+    __atomic_store_n(&slot->seq, 2 * n + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->poll_id = (uint32_t) poll->id;
+    slot->status = status;
+    slot->timestamp_ns = timestamp_ns;
+    slot->addr = (uint16_t) poll->addr;
+    slot->mux_channel = (int16_t) (poll->mux_addr >= 0 ? poll->mux_channel : -1);
+    slot->reg = (uint8_t) poll->reg;
+    slot->length = (uint8_t) (status > 0 ? status : 0);
+    if (status > 0) {
+        memcpy(slot->data, data, status);
+    }
+    __atomic_store_n(&slot->seq, 2 * (n + 1), __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->head, n + 1, __ATOMIC_RELEASE);
+}
+
+static void release_lock(struct bus *bus);
+
+static int handle_request(struct client *client, const struct i2cd_request *request,
+                          struct i2cd_response *response, int *pass_fd)
+{
+    struct handle *h = NULL;
+    struct bus *bus = NULL;
+    response->length = 0;
+
+    int bus_index = bus_of_request(client, request);
+    if (bus_index >= 0) {
+        h = &handles[request->handle];
+        bus = &buses[bus_index];
+        if (request->op != I2CD_OP_SWITCH_DEVICE && request->op != I2CD_OP_SCAN_ADDRESS &&
+            select_device(bus, h->addr) < 0) {
+            return -1;
+        }
+        bus->last_user = client->id;
+        if (bus->lock_owner == client->owner) {
+            bus->lease_end_ns = monotonic_ns() + lease_ns;
+        }
+    } else if (uses_handle(request->op)) {
+        return -1;
+    }
+
+    switch (request->op) {
+        case I2CD_OP_HELLO:
+            return I2CD_PROTOCOL_VERSION;
+
+        case I2CD_OP_OPEN_BUS: {
+            char path[I2CD_PATH_LEN];
+            memcpy(path, request->path, I2CD_PATH_LEN);
+            path[I2CD_PATH_LEN - 1] = '\0';
+            int index = find_bus(path, 1);
+            if (index < 0) {
+                return -1;
+            }
+            for (int i = 0; i < MAX_HANDLES; i++) {
+                if (handles[i].client == 0) {
+                    handles[i].client = client->id;
+                    handles[i].bus = index;
+                    handles[i].addr = request->addr & 0x7F;
+                    return i;
+                }
+            }
+            errno = EMFILE;
+            return -1;
+        }
+
+        case I2CD_OP_CLOSE_BUS:
+            // Polls registered through the handle keep running until removed
+            if ((h = handle_for(client, request->handle)) == NULL) {
+                return -1;
+            }
+            h->client = 0;
+            return 0;
+
+        case I2CD_OP_SWITCH_DEVICE:
+            h->addr = request->addr & 0x7F;
+            return select_device(bus, h->addr);
+
+        case I2CD_OP_WRITE_BYTE:
+            return i2c_core_write_byte(bus->fd, request->reg, request->value);
+
+        case I2CD_OP_WRITE_WORD:
+            return i2c_core_write_word(bus->fd, request->reg, request->value);
+
+        case I2CD_OP_WRITE:
+            return i2c_core_write(bus->fd, request->value);
+
+        case I2CD_OP_READ_WORD:
+            return i2c_core_read_word(bus->fd, request->reg);
+
+        case I2CD_OP_READ_RAW:
+        case I2CD_OP_READ_BLOCK:
+        case I2CD_OP_READ_I2C_BLOCK: {
+            int length = request->length;
+            if (length <= 0 || length > I2CD_MAX_DATA) {
+                errno = EINVAL;
+                return -1;
+            }
+            int result;
+            if (request->op == I2CD_OP_READ_RAW) {
+                result = i2c_core_read_raw(bus->fd, response->data, length);
+            } else if (request->op == I2CD_OP_READ_BLOCK) {
+                result = i2c_core_read_block(bus->fd, request->reg, response->data, length);
+            } else {
+                result = i2c_core_read_i2c_block(bus->fd, request->reg, length, response->data);
+                if (result >= 0) {
+                    result = length;
+                }
+            }
+            response->length = result > 0 ? result : 0;
+            return result;
+        }
+
+        case I2CD_OP_SCAN_ADDRESS: {
+            int result = i2c_core_scan_address(bus->fd, request->addr);
+            // Scanning leaves the probed address selected
+            bus->current_addr = -1;
+            return result;
+        }
+
+        case I2CD_OP_RECOVER_BUS:
+            bus->current_addr = -1;
+            return i2c_core_recover_bus(bus->fd);
+
+        case I2CD_OP_UNLOCK_BUS: {
+            char path[I2CD_PATH_LEN];
+            memcpy(path, request->path, I2CD_PATH_LEN);
+            path[I2CD_PATH_LEN - 1] = '\0';
+            int index = find_bus(path, 0);
+            if (index < 0) {
+                return -1;
+            }
+            bus = &buses[index];
+            if (bus->lock_owner != client->owner) {
+                errno = EPERM;
+                return -1;
+            }
+            release_lock(bus);
+            return 0;
+        }
+
+        case I2CD_OP_CLIENT_ID:
+            return client->id;
+
+        case I2CD_OP_ATTACH: {
+            // Only another connection of the same process may lock in a client's name
+            struct client *target = client_by_id(request->value);
+            if (target == NULL || target->pid != client->pid) {
+                errno = EPERM;
+                return -1;
+            }
+            client->owner = target->id;
+            return 0;
+        }
+
+        case I2CD_OP_SUBSCRIBE:
+            *pass_fd = create_ring(client, (uint32_t) request->value);
+            return *pass_fd >= 0 ? 0 : -1;
+
+        case I2CD_OP_ADD_POLL: {
+            if ((h = handle_for(client, request->handle)) == NULL) {
+                return -1;
+            }
+            if (request->length <= 0 || request->length > I2CD_SAMPLE_DATA || request->period_ms == 0) {
+                errno = EINVAL;
+                return -1;
+            }
+            // The channel becomes a shift count when the poll selects it
+            if (request->mux_addr != -1 && (request->mux_addr < 0 || request->mux_addr > 0x7F ||
+                                            request->mux_channel < 0 || request->mux_channel > 7)) {
+                errno = EINVAL;
+                return -1;
+            }
+            for (int i = 0; i < MAX_POLLS; i++) {
+                if (polls[i].id == 0) {
+                    struct poll_entry *poll = &polls[i];
+                    poll->id = next_poll_id++;
+                    poll->client = client->id;
+                    poll->bus = h->bus;
+                    poll->addr = request->addr & 0x7F;
+                    poll->reg = request->reg & 0xFF;
+                    poll->length = request->length;
+                    poll->mux_addr = request->mux_addr;
+                    poll->mux_channel = request->mux_channel;
+                    poll->period_ns = (long) request->period_ms * 1000000L;
+                    poll->next_ns = monotonic_ns();
+                    return poll->id;
+                }
+            }
+            errno = ENOSPC;
+            return -1;
+        }
+
+        case I2CD_OP_REMOVE_POLL:
+            for (int i = 0; i < MAX_POLLS; i++) {
+                if (polls[i].id == request->value && polls[i].client == client->id) {
+                    polls[i].id = 0;
+                    return 0;
+                }
+            }
+            errno = ENOENT;
+            return -1;
+
+        default:
+            errno = EINVAL;
+            return -1;
+    }
+}
+
+static void send_response(struct client *client, struct i2cd_response *response, int pass_fd)
+{
+    char control[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = {response, I2CD_RESPONSE_HEADER_SIZE + response->length};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (pass_fd >= 0) {
+        memset(control, 0, sizeof(control));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &pass_fd, sizeof(int));
+    }
+    if (sendmsg(client->sock, &msg, MSG_NOSIGNAL) < 0) {
+        syslog(LOG_WARNING, "Failed to reply to client %d: %s", client->id, strerror(errno));
+    }
+    if (pass_fd >= 0) {
+        close(pass_fd);
+    }
+}
+
+static void reply(struct client *client, int result, int error)
+{
+    struct i2cd_response response;
+    response.result = result;
+    response.error = error;
+    response.length = 0;
+    response.timestamp_ns = 0;
+    send_response(client, &response, -1);
+}
+
+/** Gives the lock to conn's owner; returns 1 if someone else used the bus since it last held it. */
+static int take_lock(struct bus *bus, const struct client *conn)
+{
+    bus->lock_owner = conn->owner;
+    bus->lock_conn = conn->id;
+    bus->lease_end_ns = monotonic_ns() + lease_ns;
+    int foreign = bus->last_user != conn->owner && bus->last_user != -1;
+    bus->last_user = conn->owner;
+    return foreign;
+}
+
+static void remove_waiter(struct bus *bus, int index)
+{
+    memmove(&bus->waiters[index], &bus->waiters[index + 1],
+            (size_t) (bus->waiter_count - index - 1) * sizeof(struct waiter));
+    bus->waiter_count--;
+}
+
+// Whether the peer closed its end; a waiting client has nothing left unread
+static int peer_gone(const struct client *conn)
+{
+    char byte;
+    return recv(conn->sock, &byte, sizeof(byte), MSG_PEEK | MSG_DONTWAIT) == 0;
+}
+
+/**
+ * Hands a free lock to the oldest waiter still waiting; lapsed waiters keep their place.
+ * Waiters that hung up since the last poll are skipped and dropped by the main loop.
+ */
+static void grant_next(struct bus *bus)
+{
+    for (int i = 0; i < bus->waiter_count && bus->lock_owner == 0; i++) {
+        if (bus->waiters[i].deadline_ns == 0) {
+            continue;
+        }
+        struct client *conn = client_by_id(bus->waiters[i].client);
+        remove_waiter(bus, i--);
+        if (conn != NULL && peer_gone(conn)) {
+            conn->waiting_lock = 0;
+        } else if (conn != NULL) {
+            conn->waiting_lock = 0;
+            reply(conn, take_lock(bus, conn), 0);
+        }
+    }
+}
+
+static void release_lock(struct bus *bus)
+{
+    bus->lock_owner = 0;
+    bus->lock_conn = 0;
+    grant_next(bus);
+}
+
+/** Takes the bus lock at once if it is free, or queues the client until it is granted or times out. */
+static void request_lock(struct client *client, const struct i2cd_request *request)
+{
+    char path[I2CD_PATH_LEN];
+    memcpy(path, request->path, I2CD_PATH_LEN);
+    path[I2CD_PATH_LEN - 1] = '\0';
+    errno = 0;
+    int index = find_bus(path, 1);
+    if (index < 0) {
+        reply(client, -1, errno);
+        return;
+    }
+    struct bus *bus = &buses[index];
+    int position = -1;
+    for (int i = 0; i < bus->waiter_count; i++) {
+        if (bus->waiters[i].client == client->id) {
+            position = i;
+            break;
+        }
+    }
+    // Parked waiters are granted on release, so a free lock has none ahead
+    if (bus->lock_owner == 0 || bus->lock_owner == client->owner) {
+        if (position >= 0) {
+            remove_waiter(bus, position);
+        }
+        reply(client, take_lock(bus, client), 0);
+        return;
+    }
+    if (position < 0) {
+        if (bus->waiter_count >= MAX_CLIENTS) {
+            reply(client, -1, EBUSY);
+            return;
+        }
+        position = bus->waiter_count++;
+        bus->waiters[position].client = client->id;
+    }
+    long now = monotonic_ns();
+    bus->waiters[position].deadline_ns = request->value > 0 ? now + (long) request->value * 1000000L : LONG_MAX;
+    bus->waiters[position].keep_until_ns = 0;
+    client->waiting_lock = 1;
+}
+
+/**
+ * Releases locks whose holder let the lease run out, times out waiters and drops
+ * lapsed ones. Returns the poll() timeout until the next such deadline, in
+ * milliseconds, or -1 if there is none.
+ */
+static int expire_locks(void)
+{
+    long now = monotonic_ns();
+    long next = -1;
+    for (int b = 0; b < MAX_BUSES; b++) {
+        struct bus *bus = &buses[b];
+        if (bus->fd < 0) {
+            continue;
+        }
+        if (bus->lock_owner != 0 && now >= bus->lease_end_ns) {
+            syslog(LOG_WARNING, "Client %d idle for %ld ms while holding %s, releasing its lock",
+                   bus->lock_owner, lease_ns / 1000000L, bus->path);
+            release_lock(bus);
+        }
+        for (int i = 0; i < bus->waiter_count; i++) {
+            struct waiter *waiter = &bus->waiters[i];
+            if (waiter->deadline_ns != 0 && now >= waiter->deadline_ns) {
+                struct client *conn = client_by_id(waiter->client);
+                waiter->deadline_ns = 0;
+                waiter->keep_until_ns = now + WAITER_GRACE_NS;
+                if (conn != NULL) {
+                    conn->waiting_lock = 0;
+                    reply(conn, -1, ETIMEDOUT);
+                }
+            } else if (waiter->deadline_ns == 0 && now >= waiter->keep_until_ns) {
+                remove_waiter(bus, i--);
+                continue;
+            }
+            long deadline = waiter->deadline_ns != 0 ? waiter->deadline_ns : waiter->keep_until_ns;
+            if (next < 0 || deadline < next) {
+                next = deadline;
+            }
+        }
+        if (bus->lock_owner != 0 && (next < 0 || bus->lease_end_ns < next)) {
+            next = bus->lease_end_ns;
+        }
+    }
+    if (next < 0) {
+        return -1;
+    }
+    long wait = next - now;
+    return wait <= 0 ? 0 : (int) ((wait + 999999L) / 1000000L);
+}
+
+/** Runs a request, or parks it if another client holds the lock of its bus. */
+static void dispatch(struct client *client, const struct i2cd_request *request)
+{
+    if (request->op == I2CD_OP_LOCK_BUS) {
+        request_lock(client, request);
+        return;
+    }
+    int bus_index = bus_of_request(client, request);
+    if (bus_index >= 0 && buses[bus_index].lock_owner != 0 &&
+        buses[bus_index].lock_owner != client->owner) {
+        client->pending = *request;
+        client->has_pending = 1;
+        return;
+    }
+    struct i2cd_response response;
+    int pass_fd = -1;
+    errno = 0;
+    int64_t before = i2c_core_last_transfer_ns();
+    response.result = handle_request(client, request, &response, &pass_fd);
+    response.error = response.result < 0 ? errno : 0;
+    int64_t after = i2c_core_last_transfer_ns();
+    response.timestamp_ns = after != before ? after : 0;
+    send_response(client, &response, pass_fd);
+}
+
+static void drop_client(struct client *client)
+{
+    syslog(LOG_INFO, "Client %d disconnected", client->id);
+    for (int i = 0; i < MAX_BUSES; i++) {
+        struct bus *bus = &buses[i];
+        if (bus->fd < 0) {
+            continue;
+        }
+        for (int w = 0; w < bus->waiter_count; w++) {
+            if (bus->waiters[w].client == client->id) {
+                remove_waiter(bus, w--);
+            }
+        }
+        if (bus->lock_owner == client->id || bus->lock_conn == client->id) {
+            release_lock(bus);
+        }
+    }
+    for (int i = 0; i < MAX_HANDLES; i++) {
+        if (handles[i].client == client->id) {
+            handles[i].client = 0;
+        }
+    }
+    for (int i = 0; i < MAX_POLLS; i++) {
+        if (polls[i].client == client->id) {
+            polls[i].id = 0;
+        }
+    }
+    if (client->ring != NULL) {
+        munmap(client->ring, client->ring_size);
+        client->ring = NULL;
+    }
+    close(client->sock);
+    client->sock = -1;
+    client->has_pending = 0;
+    client->waiting_lock = 0;
+}
+
+static int peer_allowed(const struct ucred *peer)
+{
+    return peer->uid == 0 || peer->uid == getuid() ||
+           (allowed_uid >= 0 && peer->uid == (uid_t) allowed_uid) ||
+           (allowed_gid >= 0 && peer->gid == (gid_t) allowed_gid);
+}
+
+static void accept_client(int listener)
+{
+    int sock = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+    if (sock < 0) {
+        return;
+    }
+    struct ucred peer;
+    socklen_t length = sizeof(peer);
+    if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &peer, &length) < 0 || length != sizeof(peer)) {
+        syslog(LOG_WARNING, "Cannot get peer credentials, refusing connection: %s", strerror(errno));
+        close(sock);
+        return;
+    }
+    if (!peer_allowed(&peer)) {
+        syslog(LOG_WARNING, "Refusing connection from pid %d (uid %d, gid %d)",
+               (int) peer.pid, (int) peer.uid, (int) peer.gid);
+        close(sock);
+        return;
+    }
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (clients[i].sock < 0) {
+            memset(&clients[i], 0, sizeof(clients[i]));
+            clients[i].sock = sock;
+            clients[i].id = next_client_id++;
+            clients[i].owner = clients[i].id;
+            clients[i].pid = peer.pid;
+            syslog(LOG_INFO, "Client %d connected (pid %d, uid %d)", clients[i].id, (int) peer.pid, (int) peer.uid);
+            return;
+        }
+    }
+    syslog(LOG_WARNING, "Too many clients, refusing connection");
+    close(sock);
+}
+
+static void run_poll(struct poll_entry *poll, long now)
+{
+    struct bus *bus = &buses[poll->bus];
+    struct client *client = client_by_id(poll->client);
+    uint8_t data[I2CD_SAMPLE_DATA];
+    int status;
+
+    if (poll->mux_addr >= 0) {
+        // Always rewrite the mask: a client may have switched channels since
+        if (select_device(bus, poll->mux_addr) < 0 ||
+            i2c_core_write(bus->fd, 1 << poll->mux_channel) < 0) {
+            status = -errno;
+            goto done;
+        }
+    }
+    if (select_device(bus, poll->addr) < 0) {
+        status = -errno;
+        goto done;
+    }
+    status = i2c_core_read_block(bus->fd, poll->reg, data, poll->length);
+    if (status < 0) {
+        status = -errno;
+    }
+
+done:
+    bus->last_user = 0;
+    if (client != NULL && client->ring != NULL) {
+        ring_push(client->ring, poll, status, i2c_core_last_transfer_ns(), data);
+    }
+    poll->next_ns += poll->period_ns;
+    if (poll->next_ns <= now) {
+        // Overran: skip the missed periods instead of bursting to catch up
+        poll->next_ns = now + poll->period_ns;
+    }
+}
+
+/** Runs due polls and returns the poll() timeout until the next one, in milliseconds. */
+static int run_polls(void)
+{
+    long now = monotonic_ns();
+    long next = -1;
+    for (int i = 0; i < MAX_POLLS; i++) {
+        struct poll_entry *poll = &polls[i];
+        if (poll->id == 0) {
+            continue;
+        }
+        if (buses[poll->bus].lock_owner != 0) {
+            // Retried once the bus is unlocked
+            continue;
+        }
+        if (poll->next_ns <= now) {
+            run_poll(poll, now);
+            now = monotonic_ns();
+        }
+        if (next < 0 || poll->next_ns < next) {
+            next = poll->next_ns;
+        }
+    }
+    if (next < 0) {
+        return -1;
+    }
+    long wait = next - now;
+    return wait <= 0 ? 0 : (int) ((wait + 999999L) / 1000000L);
+}
+
+static int listen_on(const char *path, mode_t mode)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    unlink(path);
+    if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+        chmod(path, mode) < 0 ||
+        listen(sock, 8) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+int main(int argc, char **argv)
+{
+    const char *socket_path = I2CD_DEFAULT_SOCKET;
+    mode_t mode = 0660;
+    int retries = 3;
+    int retry_naks = 0;
+    int frame_hz = 0;
+    long quiet_us = 2000;
+    const char *trace_path = NULL;
+    const char *replay_path = NULL;
+    int replay_mode = I2C_REPLAY_TIMED;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:m:u:g:l:r:nf:q:t:R:F")) != -1) {
+        switch (opt) {
+            case 's':
+                socket_path = optarg;
+                break;
+            case 'm':
+                mode = (mode_t) strtol(optarg, NULL, 8);
+                break;
+            case 'u':
+                allowed_uid = atol(optarg);
+                break;
+            case 'g':
+                allowed_gid = atol(optarg);
+                break;
+            case 'l':
+                lease_ns = atol(optarg) * 1000000L;
+                if (lease_ns <= 0) {
+                    fprintf(stderr, "Lease must be at least 1 ms\n");
+                    return 2;
+                }
+                break;
+            case 'r':
+                retries = atoi(optarg);
+                break;
+            case 'n':
+                retry_naks = 1;
+                break;
+            case 'f':
+                frame_hz = atoi(optarg);
+                break;
+            case 'q':
+                quiet_us = atol(optarg);
+                break;
+            case 't':
+                trace_path = optarg;
+                break;
+            case 'R':
+                replay_path = optarg;
+                break;
+            case 'F':
+                replay_mode = I2C_REPLAY_FAST;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-s socket] [-m mode] [-u uid] [-g gid] [-l lease_ms] [-r retries [-n]]"
+                                " [-f hz -q quiet_us] [-t capture] [-R capture [-F]]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    openlog("i2cd", LOG_PID | LOG_CONS | LOG_PERROR, LOG_DAEMON);
+
+    struct i2c_retry_policy policy = {retries < 1 ? 1 : retries, 200000L, 2000000L, 25, 10000000L,
+                                      4, {EIO, EAGAIN, EBUSY, ETIMEDOUT}};
+    if (retry_naks) {
+        policy.retryable[policy.retryable_count++] = ENXIO;
+        policy.retryable[policy.retryable_count++] = EREMOTEIO;
+    }
+    i2c_core_set_retry_policy(-1, &policy);
+
+    if (frame_hz > 0) {
+        synthetic_period_ns = 1000000000L / frame_hz;
+        synthetic_epoch_ns = monotonic_ns();
+        i2c_core_set_frame_pacing(quiet_us * 1000L, 0);
+        synthetic_vsync();
+        syslog(LOG_INFO, "Frame pacing against a synthetic %d Hz vsync, %ld us quiet window", frame_hz, quiet_us);
+    }
+
+    if (trace_path != NULL && i2c_trace_start(0) < 0) {
+        syslog(LOG_ERR, "Cannot start recording transfers");
+        trace_path = NULL;
+    }
+
+    if (replay_path != NULL) {
+        int count = i2c_replay_start(replay_path, replay_mode);
+        if (count < 0) {
+            syslog(LOG_ERR, "Cannot replay %s", replay_path);
+            return 1;
+        }
+        syslog(LOG_INFO, "Replaying %d transfers from %s%s", count, replay_path,
+               replay_mode == I2C_REPLAY_FAST ? " as fast as possible" : "");
+    }
+
+    for (int i = 0; i < MAX_BUSES; i++) {
+        buses[i].fd = -1;
+    }
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        clients[i].sock = -1;
+    }
+
+    int listener = listen_on(socket_path, mode);
+    if (listener < 0) {
+        syslog(LOG_ERR, "Cannot listen on %s: %s", socket_path, strerror(errno));
+        return 1;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    action.sa_handler = on_dump_signal;
+    sigaction(SIGUSR1, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    syslog(LOG_INFO, "Listening on %s", socket_path);
+
+    struct pollfd fds[MAX_CLIENTS + 1];
+    int owners[MAX_CLIENTS + 1];
+    while (running) {
+        synthetic_vsync();
+        if (dump_requested) {
+            dump_requested = 0;
+            if (trace_path != NULL) {
+                dump_trace(trace_path);
+            }
+        }
+        // Before the deferred requests, which may be waiting for a lock that expires now
+        int lock_timeout = expire_locks();
+        // Deferred requests whose bus has been unlocked go first, in client order
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            if (clients[i].sock >= 0 && clients[i].has_pending) {
+                clients[i].has_pending = 0;
+                dispatch(&clients[i], &clients[i].pending);
+            }
+        }
+
+        int timeout = run_polls();
+        if (lock_timeout >= 0 && (timeout < 0 || lock_timeout < timeout)) {
+            timeout = lock_timeout;
+        }
+
+        int count = 0;
+        fds[count].fd = listener;
+        fds[count].events = POLLIN;
+        owners[count++] = -1;
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            // A client with a parked request or a queued lock is not read until it has been
+            // answered, but a queued one is still watched for hangups (always reported)
+            if (clients[i].sock >= 0 && !clients[i].has_pending) {
+                fds[count].fd = clients[i].sock;
+                fds[count].events = clients[i].waiting_lock ? 0 : POLLIN;
+                owners[count++] = i;
+            }
+        }
+
+        if (poll(fds, count, timeout) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            syslog(LOG_ERR, "poll failed: %s", strerror(errno));
+            break;
+        }
+        synthetic_vsync();
+
+        if (fds[0].revents & POLLIN) {
+            accept_client(listener);
+        }
+        for (int i = 1; i < count; i++) {
+            if (fds[i].revents == 0) {
+                continue;
+            }
+            struct client *client = &clients[owners[i]];
+            if (client->waiting_lock) {
+                // Gone before its lock was granted
+                drop_client(client);
+                continue;
+            }
+            struct i2cd_request request;
+            ssize_t received = recv(client->sock, &request, sizeof(request), 0);
+            if (received == (ssize_t) sizeof(request)) {
+                dispatch(client, &request);
+            } else if (received == 0 || (received < 0 && errno != EINTR && errno != EAGAIN)) {
+                drop_client(client);
+            } else if (received > 0) {
+                syslog(LOG_WARNING, "Client %d sent a malformed request", client->id);
+                drop_client(client);
+            }
+        }
+    }
+
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (clients[i].sock >= 0) {
+            drop_client(&clients[i]);
+        }
+    }
+    for (int i = 0; i < MAX_BUSES; i++) {
+        if (buses[i].fd >= 0) {
+            i2c_core_close(buses[i].fd);
+        }
+    }
+    close(listener);
+    unlink(socket_path);
+    if (trace_path != NULL) {
+        dump_trace(trace_path);
+    }
+    if (replay_path != NULL) {
+        int64_t stats[4];
+        if (i2c_replay_stats(stats, 4) == 4) {
+            syslog(LOG_INFO, "Replayed %lld transfers in %lld ms, %lld unmatched", (long long) stats[0],
+                   (long long) (stats[3] / 1000000), (long long) stats[2]);
+        }
+        i2c_replay_stop();
+    }
+    syslog(LOG_INFO, "Stopped");
+    closelog();
+    return 0;
+}
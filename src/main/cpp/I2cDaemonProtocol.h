@@ -0,0 +1,169 @@
+#ifndef I2C_DAEMON_PROTOCOL_H
+#define I2C_DAEMON_PROTOCOL_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "I2cCore.h"
+
+/*
+ * Protocol between i2cd and its clients.
+ *
+ * Control plane: a SOCK_SEQPACKET Unix socket. Every request is one
+ * struct i2cd_request; every reply is one struct i2cd_response, truncated
+ * after `length` data bytes. SUBSCRIBE replies carry the ring's fd as
+ * SCM_RIGHTS ancillary data.
+ *
+ * Data plane: one shared-memory ring per subscriber. The daemon writes a
+ * sample for every poll the client registered with ADD_POLL. Readers copy
+ * samples out with i2cd_ring_read() and never block the daemon.
+ *
+ * Bus handles returned by OPEN_BUS stand in for file descriptors. Each handle
+ * remembers its own device address, and the daemon selects it before every
+ * operation. A multi-step transaction (mux select, then device access) must
+ * be wrapped in LOCK_BUS / UNLOCK_BUS. While a bus is locked, the daemon
+ * defers requests from other clients and its own polls on that bus.
+ *
+ * LOCK_BUS waits in the daemon: waiters are queued per bus and granted the lock
+ * in arrival order. Because a waiting connection gets no other answers, clients
+ * lock through a second connection per bus, attached with ATTACH to the one
+ * that makes the transfers; locks are owned by the attached-to client. A holder
+ * that makes no request on the bus for the lease time loses the lock.
+ */
+
+#define I2CD_DEFAULT_SOCKET "/data/local/tmp/i2cd.sock"
+#define I2CD_PROTOCOL_VERSION 3
+
+#define I2CD_PATH_LEN 64
+#define I2CD_MAX_DATA I2C_MAX_BLOCK
+
+enum i2cd_op {
+    I2CD_OP_HELLO = 1,       // value: protocol version; result: daemon version
+    I2CD_OP_OPEN_BUS,        // path, addr -> handle
+    I2CD_OP_CLOSE_BUS,       // handle
+    I2CD_OP_SWITCH_DEVICE,   // handle, addr
+    I2CD_OP_WRITE_BYTE,      // handle, reg, value
+    I2CD_OP_WRITE_WORD,      // handle, reg, value
+    I2CD_OP_WRITE,           // handle, value
+    I2CD_OP_READ_WORD,       // handle, reg -> result
+    I2CD_OP_READ_RAW,        // handle, length -> data
+    I2CD_OP_READ_BLOCK,      // handle, reg, length -> data
+    I2CD_OP_READ_I2C_BLOCK,  // handle, reg, length -> data
+    I2CD_OP_SCAN_ADDRESS,    // handle, addr -> 1 / 0
+    I2CD_OP_RECOVER_BUS,     // handle
+    I2CD_OP_LOCK_BUS,        // path, value: wait limit in ms (0 = none) -> 1 if anyone else used the
+                             // bus since this client last held it; ETIMEDOUT
+    I2CD_OP_UNLOCK_BUS,      // path
+    I2CD_OP_SUBSCRIBE,       // value: ring capacity in samples -> ring fd (SCM_RIGHTS)
+    I2CD_OP_ADD_POLL,        // handle, addr, reg, length, period_ms, mux_addr, mux_channel -> poll id
+    I2CD_OP_REMOVE_POLL,     // value: poll id
+    I2CD_OP_CLIENT_ID,       // -> id of this connection's client
+    I2CD_OP_ATTACH,          // value: client id of the same process to lock on behalf of
+};
+
+struct i2cd_request {
+    uint32_t op;
+    int32_t handle;
+    int32_t addr;
+    int32_t reg;
+    int32_t value;
+    int32_t length;
+    uint32_t period_ms;
+    int32_t mux_addr;        // -1 when the device is not behind a mux, else 0x00-0x7F
+    int32_t mux_channel;     // 0-7 behind a mux
+    char path[I2CD_PATH_LEN];
+};
+
+struct i2cd_response {
+    int32_t result;          // -1 on error
+    int32_t error;           // errno of the failure
+    int32_t length;          // number of valid bytes in data
+    int64_t timestamp_ns;    // CLOCK_BOOTTIME at the end of the transfer, 0 if none was made
+    uint8_t data[I2CD_MAX_DATA];
+};
+
+#define I2CD_RESPONSE_HEADER_SIZE (sizeof(struct i2cd_response) - I2CD_MAX_DATA)
+
+#define I2CD_RING_MAGIC   0x49324452u /* "I2DR" */
+#define I2CD_RING_VERSION 1
+#define I2CD_SAMPLE_DATA  64
+
+/**
+ * One polled sample. seq is 2 * (n + 1) once sample n is complete and odd while
+ * the daemon writes it.
+ */
+struct i2cd_sample {
+    uint64_t seq;
+    uint32_t poll_id;
+    int32_t status;          // bytes read, or -errno
+    int64_t timestamp_ns;    // CLOCK_BOOTTIME at the end of the transfer
+    uint16_t addr;
+    int16_t mux_channel;
+    uint8_t reg;
+    uint8_t length;
+    uint8_t reserved[2];
+    uint8_t data[I2CD_SAMPLE_DATA];
+};
+
+struct i2cd_ring_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;       // number of sample slots
+    uint32_t sample_size;
+    uint64_t head;           // number of samples written so far
+    uint64_t reserved;
+};
+
+static inline struct i2cd_sample *i2cd_ring_slots(const struct i2cd_ring_header *ring)
+{
+    return (struct i2cd_sample *) (ring + 1);
+}
+
+static inline uint64_t i2cd_ring_size(uint32_t capacity)
+{
+    return sizeof(struct i2cd_ring_header) + (uint64_t) capacity * sizeof(struct i2cd_sample);
+}
+
+/**
+ * Copies the next sample after *cursor into out.
+ * Returns 1 if a sample was copied, or 0 if the reader has caught up.
+ * Samples overwritten before they were read are skipped; *lost (if not NULL)
+ * is increased by their number.
+ */
+static inline int i2cd_ring_read(const struct i2cd_ring_header *ring, uint64_t *cursor,
+                                 struct i2cd_sample *out, uint64_t *lost)
+{
+    for (;;) {
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (*cursor >= head) {
+            return 0;
+        }
+        if (head - *cursor > ring->capacity) {
+            if (lost != NULL) {
+                *lost += head - ring->capacity - *cursor;
+            }
+            *cursor = head - ring->capacity;
+        }
+        const struct i2cd_sample *slot = &i2cd_ring_slots(ring)[*cursor % ring->capacity];
+        uint64_t expected = 2 * (*cursor + 1);
+        uint64_t before = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (before == expected) {
+            memcpy(out, slot, sizeof(*out));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == expected) {
+                (*cursor)++;
+                return 1;
+            }
+        }
+        if (before > expected) {
+            // Lapped by the writer while reading: skip ahead on the next pass
+            if (lost != NULL) {
+                (*lost)++;
+            }
+            (*cursor)++;
+        }
+        // Otherwise the slot is still being written; retry
+    }
+}
+
+#endif //I2C_DAEMON_PROTOCOL_H
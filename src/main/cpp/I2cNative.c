@@ -1,143 +1,40 @@
-#include <fcntl.h>
-#include <sys/ioctl.h>
-#include <linux/i2c-dev.h>
-#include <linux/i2c.h>
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // cpu_set_t and sched_setaffinity on glibc; bionic always has them
+#endif
+
 #include <unistd.h>
 #include <sched.h>
-#include <time.h>
 #include <errno.h>
+#include <string.h>
 
 #include <syslog.h>
 #include <jni.h>
 
 #include "I2cNative.h"
+#include "I2cCore.h"
+#include "I2cClient.h"
+#include "I2cArbiter.h"
+#include "I2cStateShm.h"
+#include "I2cTrace.h"
+#include "I2cReplay.h"
 
-// Minimum interval between I2C operations in nanoseconds (250 microseconds).
-// Prevents interrupt clustering that causes rendering jank.
-#define MIN_I2C_INTERVAL_NS 250000L
-
-static struct timespec last_i2c_time = {0, 0};
-
-static inline void i2c_rate_limit(void)
-{
-    struct timespec now;
-    clock_gettime(CLOCK_MONOTONIC, &now);
-
-    if (last_i2c_time.tv_sec != 0 || last_i2c_time.tv_nsec != 0) {
-        long elapsed_ns = (now.tv_sec - last_i2c_time.tv_sec) * 1000000000L
-                        + (now.tv_nsec - last_i2c_time.tv_nsec);
-        if (elapsed_ns < MIN_I2C_INTERVAL_NS) {
-            struct timespec sleep_time;
-            long remaining = MIN_I2C_INTERVAL_NS - elapsed_ns;
-            sleep_time.tv_sec = 0;
-            sleep_time.tv_nsec = remaining;
-            nanosleep(&sleep_time, NULL);
-        }
-    }
-}
-
-static inline void i2c_post_operation(void)
-{
-    clock_gettime(CLOCK_MONOTONIC, &last_i2c_time);
-    sched_yield();
-}
-
-static inline __s32 i2c_smbus_access(int file, char read_write, __u8 command
-        , int size, union i2c_smbus_data *data)
-{
-    struct i2c_smbus_ioctl_data args;
-
-    i2c_rate_limit();
-
-    args.read_write = read_write;
-    args.command = command;
-    args.size = size;
-    args.data = data;
-    __s32 result = ioctl(file, I2C_SMBUS, &args);
-
-    i2c_post_operation();
-
-    return result;
-}
-
-/**
- * Switches the I2C device on an already open file descriptor
- * This allows multiple devices to share the same I2C bus
- */
-static inline int switch_i2c_device(int fd, __u8 deviceAddress)
-{
-    if (fd < 0) {
-        return -1;
-    }
-    i2c_rate_limit();
-    int result = ioctl(fd, I2C_SLAVE, deviceAddress);
-    i2c_post_operation();
-    return result;
-}
-
-static inline __s32 i2c_smbus_read_i2c_block_data(int file, __u8 command,
-                                                  __u8 length, __u8 *values)
-{
-    union i2c_smbus_data data;
-
-    // Cap at 31 bytes to always use I2C_SMBUS_I2C_BLOCK_DATA.
-    // I2C_SMBUS_I2C_BLOCK_BROKEN (used for length==32) is unreliable
-    // on some Qualcomm I2C controllers and can corrupt sensor state.
-    if (length > 31) {
-        length = 31;
-    }
-
-    data.block[0] = length;
-    if (i2c_smbus_access(file, I2C_SMBUS_READ, command
-            , I2C_SMBUS_I2C_BLOCK_DATA
-            , &data))
-    {
-        return -1;
-    } else {
-        for (int i = 1; i <= data.block[0]; i++) {
-            values[i - 1] = data.block[i];
-        }
-
-        return data.block[0];
-    }
-}
-
-static inline __s32 i2c_smbus_write_byte_data(int file, __u8 command, __u8 value)
-{
-    union i2c_smbus_data data;
-    data.byte = value;
-    return i2c_smbus_access(file, I2C_SMBUS_WRITE, command, I2C_SMBUS_BYTE_DATA, &data);
-}
-
-static inline __s32 i2c_smbus_write_word_data(int file, __u8 command, __u16 value)
-{
-    union i2c_smbus_data data;
-    data.word = value;
-    return i2c_smbus_access(file, I2C_SMBUS_WRITE, command, I2C_SMBUS_WORD_DATA, &data);
-}
+// Client mode: while connected to i2cd every bus primitive is forwarded to the
+// daemon, and bus handles returned by openBus stand in for file descriptors.
+#define CLIENT_MODE() i2c_client_connected()
 
 //JNI part begins here
 
 JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_openBus
         (JNIEnv *env, jclass jcl, jstring busName, jint deviceAddress)
 {
-    char fileName[256];
-    __u8 devAddr = deviceAddress & 0xFF;
-    int len = (*env)->GetStringLength(env, busName);
-    (*env)->GetStringUTFRegion(env, busName, 0, len, fileName);
-
-    openlog("I2cNative", LOG_PID | LOG_CONS, LOG_USER);
-    syslog(LOG_INFO, "I2C Log: %s", fileName);
-
-    int fd = open(fileName, O_RDWR);
-
-    syslog(LOG_INFO, "I2C FD: %d", fd);
-    closelog();
-    if (fd < 0 || ioctl(fd, I2C_SLAVE, deviceAddress) < 0 ) {
+    const char *fileName = (*env)->GetStringUTFChars(env, busName, NULL);
+    if (fileName == NULL) {
         return -1;
-    } else {
-        return fd;
     }
+    int fd = CLIENT_MODE() ? i2c_client_open(fileName, deviceAddress)
+                           : i2c_core_open(fileName, deviceAddress);
+    (*env)->ReleaseStringUTFChars(env, busName, fileName);
+    return fd;
 }
 
 /**
@@ -147,52 +44,76 @@ JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_openBus
 JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_switchDeviceAddress
         (JNIEnv *env, jclass jcl, jint fd, jint deviceAddress)
 {
-    __u8 devAddr = deviceAddress & 0xFF;
-    
-    openlog("I2cNative", LOG_PID | LOG_CONS, LOG_USER);
-    syslog(LOG_DEBUG, "Switching I2C device address to 0x%02X on FD: %d", devAddr, fd);
-    closelog();
-    
-    int result = switch_i2c_device(fd, devAddr);
-    if (result < 0) {
-        return -1;
-    } else {
-        return 0;
+    if (CLIENT_MODE()) {
+        return i2c_client_op(I2CD_OP_SWITCH_DEVICE, fd, deviceAddress, 0, 0) < 0 ? -1 : 0;
     }
+    return i2c_core_switch_device(fd, deviceAddress);
 }
 
 JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_closeBus
         (JNIEnv *env, jclass jcl, jint fd)
 {
-    return close (fd);
+    if (CLIENT_MODE()) {
+        return i2c_client_op(I2CD_OP_CLOSE_BUS, fd, 0, 0, 0);
+    }
+    return i2c_core_close(fd);
 }
 
 JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_writeByte
         (JNIEnv *env, jclass jcl, jint fd, jint address, jint b)
 {
-    __u8 addr = address & 0xFF;
-    __u8 byte = b       & 0xFF;
-    return i2c_smbus_write_byte_data(fd, addr, byte);
+    if (CLIENT_MODE()) {
+        return i2c_client_op(I2CD_OP_WRITE_BYTE, fd, 0, address, b);
+    }
+    return i2c_core_write_byte(fd, address, b);
+}
+
+/**
+ * Writes registers[i] = values[i] for every i as one combined transfer where the
+ * adapter allows it. The daemon has no combined write, so client mode sends them
+ * one by one.
+ *
+ * @return the number of registers written, or -1 on error
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_writeRegisters
+        (JNIEnv *env, jclass jcl, jint fd, jbyteArray jregisters, jbyteArray jvalues)
+{
+    int count = (*env)->GetArrayLength(env, jregisters);
+    if (count <= 0 || count > I2C_MAX_REGISTER_WRITES || (*env)->GetArrayLength(env, jvalues) < count) {
+        return -1;
+    }
+
+    uint8_t registers[I2C_MAX_REGISTER_WRITES];
+    uint8_t values[I2C_MAX_REGISTER_WRITES];
+    (*env)->GetByteArrayRegion(env, jregisters, 0, count, (jbyte*)registers);
+    (*env)->GetByteArrayRegion(env, jvalues, 0, count, (jbyte*)values);
+    if (!CLIENT_MODE()) {
+        return i2c_core_write_registers(fd, registers, values, count);
+    }
+    for (int i = 0; i < count; i++) {
+        if (i2c_client_op(I2CD_OP_WRITE_BYTE, fd, 0, registers[i], values[i]) < 0) {
+            return -1;
+        }
+    }
+    return count;
 }
 
 JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_writeWord
         (JNIEnv *env, jclass jcl, jint fd, jint address, jint word)
 {
-    __u8  addr = address & 0xFF;
-    __u16 value = word & 0xFFFF;
-    return i2c_smbus_write_word_data(fd, addr, value);
+    if (CLIENT_MODE()) {
+        return i2c_client_op(I2CD_OP_WRITE_WORD, fd, 0, address, word);
+    }
+    return i2c_core_write_word(fd, address, word);
 }
 
 JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_readWord
         (JNIEnv *env, jclass jcl, jint fd, jint address)
 {
-    union i2c_smbus_data data;
-    __u8  addr = address & 0xFF;
-    if (i2c_smbus_access(fd, I2C_SMBUS_READ, addr, I2C_SMBUS_WORD_DATA, &data)) {
-        return -1;
-    } else {
-        return (jint)(0x0FFFF & data.word);
+    if (CLIENT_MODE()) {
+        return i2c_client_op(I2CD_OP_READ_WORD, fd, 0, address, 0);
     }
+    return i2c_core_read_word(fd, address);
 }
 
 JNIEXPORT jlong JNICALL Java_com_layer_i2c_I2cNative_readAllBytes
@@ -202,49 +123,39 @@ JNIEXPORT jlong JNICALL Java_com_layer_i2c_I2cNative_readAllBytes
     syslog(LOG_DEBUG, "I2C readAllBytes");
     closelog();
 
-    __u8 addr = address & 0xFF;
-    __u8 buffer[4] = {0};
-    i2c_smbus_read_i2c_block_data(fd, addr, 4, buffer);
+    uint8_t buffer[4] = {0};
+    if (CLIENT_MODE()) {
+        i2c_client_read(I2CD_OP_READ_I2C_BLOCK, fd, address, buffer, 4);
+    } else {
+        i2c_core_read_i2c_block(fd, address, 4, buffer);
+    }
     return (jlong)(buffer[3] << 24 | buffer[2] <<  16 | buffer[1] << 8 | buffer[0]);
 }
 
 JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_readRawBytes
         (JNIEnv *env, jclass jcl, jint fd, jbyteArray jbuffer, jint length)
 {
-    openlog("I2cNative", LOG_PID | LOG_CONS, LOG_USER);
-    syslog(LOG_DEBUG, "I2C readRawBytes");
-    closelog();
-
     if (length <= 0 || length > 32) {
         return -1; // Invalid length
     }
-    
-    // Create a local buffer for reading
-    __u8 buffer[32] = {0};
-    
-    // Read data directly from the I2C device
-    // This is for reading after a command has been sent
-    i2c_rate_limit();
-    int bytesRead = read(fd, buffer, length);
-    i2c_post_operation();
 
-    openlog("I2cNative", LOG_PID | LOG_CONS, LOG_USER);
-    syslog(LOG_DEBUG, "I2C %d bytes read on FD: %d", bytesRead, fd);
-    closelog();
-    
+    uint8_t buffer[32] = {0};
+    int bytesRead = CLIENT_MODE() ? i2c_client_read(I2CD_OP_READ_RAW, fd, 0, buffer, length)
+                                  : i2c_core_read_raw(fd, buffer, length);
     if (bytesRead <= 0) {
         return -1; // Error reading
     }
-    
+
     // Copy data to the Java byte array
     (*env)->SetByteArrayRegion(env, jbuffer, 0, bytesRead, (jbyte*)buffer);
-    
     return bytesRead;
 }
 
 /**
- * Reads a block of bytes starting from a register address using SMBus I2C block read.
- * Handles reads larger than 32 bytes by performing multiple sequential reads.
+ * Reads a block of bytes starting from a register address.
+ * Uses the largest transfer size and method the adapter's block read self-test
+ * proved safe (31-byte SMBus block reads until a probe has run), splitting
+ * larger reads into multiple sequential transfers.
  *
  * @param fd       File descriptor for the I2C bus
  * @param reg      Starting register address
@@ -255,73 +166,66 @@ JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_readRawBytes
 JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_readBlockData
         (JNIEnv *env, jclass jcl, jint fd, jint reg, jbyteArray jbuffer, jint length)
 {
-    if (length <= 0 || length > 256) {
+    if (length <= 0 || length > I2C_MAX_BLOCK) {
         return -1;
     }
 
-    __u8 buffer[256] = {0};
-    int totalRead = 0;
-    int remaining = length;
-    __u8 currentReg = reg & 0xFF;
-
-    while (remaining > 0) {
-        __u8 chunkSize = remaining > 32 ? 32 : (__u8)remaining;
-        __s32 bytesRead = i2c_smbus_read_i2c_block_data(fd, currentReg, chunkSize, buffer + totalRead);
-        if (bytesRead <= 0) {
-            if (totalRead == 0) {
-                return -1; // First read failed
-            }
-            break; // Return what we have so far
-        }
-        totalRead += bytesRead;
-        remaining -= bytesRead;
-        currentReg += bytesRead;
+    uint8_t buffer[I2C_MAX_BLOCK] = {0};
+    int totalRead = CLIENT_MODE() ? i2c_client_read(I2CD_OP_READ_BLOCK, fd, reg, buffer, length)
+                                  : i2c_core_read_block(fd, reg, buffer, length);
+    if (totalRead <= 0) {
+        return -1;
     }
-
     (*env)->SetByteArrayRegion(env, jbuffer, 0, totalRead, (jbyte*)buffer);
     return totalRead;
 }
 
-JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_write
-        (JNIEnv *env, jclass jcl, jint fd, jint value)
-{
-    __u8 byte = value & 0xFF;
-    i2c_rate_limit();
-    int result = write(fd, &byte, 1);
-    i2c_post_operation();
-    return result;
-}
-
 /**
- * SMBus Quick Write probe - used by i2cdetect for device detection
- * This is the most compatible method for detecting I2C devices
+ * Block read self-test for the adapter behind `fd`.
+ *
+ * Reads `length` bytes of a register range whose contents do not change (the caller
+ * picks it and selects the device first) one byte at a time as a reference, then
+ * re-reads the range with progressively larger transfers: SMBus block reads of
+ * 8, 16 and 31 bytes, a 32-byte I2C_SMBUS_I2C_BLOCK_BROKEN read, and I2C_RDWR reads
+ * of 32 bytes up to the whole range. The largest size whose data matches the
+ * reference is cached for the adapter and used by readBlockData from then on.
+ * A second reference pass guards against ranges that changed during the test.
+ *
+ * The result is cached per adapter name; later calls return the cached result
+ * unless `force` is set. In client mode the daemon owns the adapter, so this
+ * returns -1 and callers keep the default block size.
+ *
+ * @return (method << 16) | maxBlock on success, -1 if the reference read failed
  */
-static inline __s32 i2c_smbus_quick_write(int file, __u8 deviceAddress)
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_probeBlockRead
+        (JNIEnv *env, jclass jcl, jint fd, jint reg, jint length, jboolean force)
 {
-    // Switch to the device address first
-    if (switch_i2c_device(file, deviceAddress) < 0) {
+    if (CLIENT_MODE()) {
         return -1;
     }
-    
-    // Perform SMBus Quick Write - just sends address + write bit
-    return i2c_smbus_access(file, I2C_SMBUS_WRITE, 0, I2C_SMBUS_QUICK, NULL);
+    return i2c_core_probe_block_read(fd, reg, length, force);
 }
 
 /**
- * SMBus Read Byte probe - alternative method for device detection
- * Some devices respond better to read operations
+ * Returns the cached block read capabilities of the adapter behind `fd`
+ * as (method << 16) | maxBlock, or -1 if the fd is unknown.
  */
-static inline __s32 i2c_smbus_read_byte_probe(int file, __u8 deviceAddress)
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_getBlockReadCaps
+        (JNIEnv *env, jclass jcl, jint fd)
 {
-    union i2c_smbus_data data;
-    
-    // Switch to the device address first
-    if (switch_i2c_device(file, deviceAddress) < 0) {
+    if (CLIENT_MODE()) {
         return -1;
     }
-    
-    // Perform SMBus Read Byte
-    return i2c_smbus_access(file, I2C_SMBUS_READ, 0, I2C_SMBUS_BYTE, &data);
+    return i2c_core_block_caps(fd);
+}
+
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_write
+        (JNIEnv *env, jclass jcl, jint fd, jint value)
+{
+    if (CLIENT_MODE()) {
+        return i2c_client_op(I2CD_OP_WRITE, fd, 0, 0, value) < 0 ? -1 : 1;
+    }
+    return i2c_core_write(fd, value);
 }
 
 /**
@@ -335,43 +239,10 @@ static inline __s32 i2c_smbus_read_byte_probe(int file, __u8 deviceAddress)
 JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_scanAddress
         (JNIEnv *env, jclass jcl, jint fd, jint deviceAddress)
 {
-    __u8 devAddr = deviceAddress & 0x7F; // Ensure 7-bit address
-    
-    // Skip reserved addresses (like i2cdetect does)
-    if (devAddr < 0x08 || devAddr > 0x77) {
-        return 0; // Not a valid user device address
-    }
-    
-    // Skip addresses that are typically reserved or problematic
-    // 0x00-0x07: General call and reserved addresses
-    // 0x78-0x7F: Reserved addresses
-    if (devAddr <= 0x07 || devAddr >= 0x78) {
-        return 0;
-    }
-    
-    openlog("I2cNative", LOG_PID | LOG_CONS, LOG_USER);
-    syslog(LOG_INFO, "Scanning I2C address 0x%02X on FD: %d", devAddr, fd);
-    
-    // Method 1: Try SMBus Quick Write (most compatible, used by i2cdetect -q)
-    __s32 result = i2c_smbus_quick_write(fd, devAddr);
-    if (result == 0) {
-        syslog(LOG_INFO, "Device found at 0x%02X using Quick Write", devAddr);
-        closelog();
-        return 1; // Device responded to Quick Write
-    }
-    
-    // Method 2: Try SMBus Read Byte (alternative method, used by i2cdetect -r) 
-    result = i2c_smbus_read_byte_probe(fd, devAddr);
-    if (result >= 0) {
-        syslog(LOG_INFO, "Device found at 0x%02X using Read Byte", devAddr);
-        closelog();
-        return 1; // Device responded to Read Byte
+    if (CLIENT_MODE()) {
+        return i2c_client_op(I2CD_OP_SCAN_ADDRESS, fd, deviceAddress, 0, 0);
     }
-    
-    // No response from either method
-    syslog(LOG_DEBUG, "No device found at 0x%02X", devAddr);
-    closelog();
-    return 0;
+    return i2c_core_scan_address(fd, deviceAddress);
 }
 
 /**
@@ -387,88 +258,605 @@ JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_scanAddress
 JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_recoverBus
         (JNIEnv *env, jclass jcl, jint fd)
 {
-    if (fd < 0) {
+    if (CLIENT_MODE()) {
+        return i2c_client_op(I2CD_OP_RECOVER_BUS, fd, 0, 0, 0);
+    }
+    return i2c_core_recover_bus(fd);
+}
+
+static void fill_retry_policy(JNIEnv *env, struct i2c_retry_policy *policy, jint maxAttempts,
+                              jlong baseBackoffUs, jlong maxBackoffUs, jint jitterPercent,
+                              jlong deadlineUs, jintArray retryableErrnos)
+{
+    memset(policy, 0, sizeof(*policy));
+    policy->max_attempts = maxAttempts < 1 ? 1 : maxAttempts;
+    policy->base_backoff_ns = baseBackoffUs * 1000L;
+    policy->max_backoff_ns = maxBackoffUs * 1000L;
+    policy->jitter_percent = jitterPercent < 0 ? 0 : (jitterPercent > 100 ? 100 : jitterPercent);
+    policy->deadline_ns = deadlineUs * 1000L;
+    if (retryableErrnos != NULL) {
+        jsize count = (*env)->GetArrayLength(env, retryableErrnos);
+        if (count > I2C_MAX_RETRYABLE) {
+            count = I2C_MAX_RETRYABLE;
+        }
+        (*env)->GetIntArrayRegion(env, retryableErrnos, 0, count, policy->retryable);
+        policy->retryable_count = count;
+    }
+}
+
+/**
+ * Sets the retry policy for all transfers on a file descriptor.
+ * Passing fd = -1 sets the default for file descriptors without their own policy.
+ * Retries run inside the native call; probes and bus recovery always use a single attempt.
+ * In client mode the daemon applies its own policy and this call is ignored.
+ *
+ * @return 0 if successful, -1 if the fd is out of range
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_setRetryPolicy
+        (JNIEnv *env, jclass jcl, jint fd, jint maxAttempts, jlong baseBackoffUs,
+         jlong maxBackoffUs, jint jitterPercent, jlong deadlineUs, jintArray retryableErrnos)
+{
+    if (CLIENT_MODE()) {
+        return 0;
+    }
+    struct i2c_retry_policy policy;
+    fill_retry_policy(env, &policy, maxAttempts, baseBackoffUs,
+                      maxBackoffUs, jitterPercent, deadlineUs, retryableErrnos);
+    return i2c_core_set_retry_policy(fd, &policy);
+}
+
+/**
+ * Sets the minimum gap between transfers on the bus behind a file descriptor.
+ * Every physical bus is paced on its own; a negative interval restores the default.
+ * In client mode the daemon paces its buses and this call is ignored.
+ *
+ * @return 0 if successful, -1 if the fd is out of range
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_setBusPacing
+        (JNIEnv *env, jclass jcl, jint fd, jlong intervalUs)
+{
+    if (CLIENT_MODE()) {
+        return 0;
+    }
+    return i2c_core_set_pacing(fd, intervalUs < 0 ? -1 : (long) intervalUs * 1000L);
+}
+
+/**
+ * Starts recording every transfer into a ring of `capacity` records (0 for the
+ * default), discarding earlier records. In client mode the transfers happen in
+ * the daemon, which records them itself when started with -t.
+ *
+ * @return 0 if successful, -1 if error
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_startTrace
+        (JNIEnv *env, jclass jcl, jint capacity)
+{
+    if (CLIENT_MODE() || capacity < 0) {
         return -1;
     }
-    
-    openlog("I2cNative", LOG_PID | LOG_CONS, LOG_USER);
-    syslog(LOG_INFO, "Attempting I2C bus recovery on FD: %d", fd);
-    
-    // Method 1: Try I2C_RECOVER ioctl if supported by the kernel driver
-    // This leverages kernel-level recovery mechanisms that may include:
-    // - Clock pulse generation to unstick SDA line
-    // - Bus state machine reset
-    // - Hardware-specific recovery procedures
-#ifdef I2C_RECOVER
-    syslog(LOG_DEBUG, "Attempting I2C_RECOVER ioctl on FD: %d", fd);
-    if (ioctl(fd, I2C_RECOVER) == 0) {
-        syslog(LOG_INFO, "I2C bus recovery successful using I2C_RECOVER ioctl on FD: %d", fd);
-        closelog();
+    return i2c_trace_start((uint32_t) capacity);
+}
+
+JNIEXPORT void JNICALL Java_com_layer_i2c_I2cNative_stopTrace
+        (JNIEnv *env, jclass jcl)
+{
+    i2c_trace_stop();
+}
+
+/**
+ * Writes the recorded transfers to a capture file.
+ *
+ * @return the number of records written, or -1 on error
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_dumpTrace
+        (JNIEnv *env, jclass jcl, jstring path)
+{
+    const char *file = (*env)->GetStringUTFChars(env, path, NULL);
+    if (file == NULL) {
+        return -1;
+    }
+    int result = i2c_trace_dump(file);
+    (*env)->ReleaseStringUTFChars(env, path, file);
+    return result;
+}
+
+/**
+ * Serves every transfer from a capture file instead of the hardware. Must be
+ * called before any bus is opened. In client mode the transfers happen in the
+ * daemon, which replays a capture itself when started with -R.
+ *
+ * @return the number of records loaded, or -1 on error
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_startReplay
+        (JNIEnv *env, jclass jcl, jstring path, jboolean fast)
+{
+    if (CLIENT_MODE()) {
+        return -1;
+    }
+    const char *file = (*env)->GetStringUTFChars(env, path, NULL);
+    if (file == NULL) {
+        return -1;
+    }
+    int result = i2c_replay_start(file, fast ? I2C_REPLAY_FAST : I2C_REPLAY_TIMED);
+    (*env)->ReleaseStringUTFChars(env, path, file);
+    return result;
+}
+
+JNIEXPORT void JNICALL Java_com_layer_i2c_I2cNative_stopReplay
+        (JNIEnv *env, jclass jcl)
+{
+    i2c_replay_stop();
+}
+
+/**
+ * Copies the running replay's statistics into `stats` (layout in I2cReplay.h).
+ *
+ * @return the number of values copied, or -1 if no replay is running
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_getReplayStats
+        (JNIEnv *env, jclass jcl, jlongArray stats)
+{
+    int64_t values[I2C_REPLAY_STATS];
+    jsize length = (*env)->GetArrayLength(env, stats);
+    int count = i2c_replay_stats(values, length < I2C_REPLAY_STATS ? length : I2C_REPLAY_STATS);
+    if (count > 0) {
+        (*env)->SetLongArrayRegion(env, stats, 0, count, (const jlong *) values);
+    }
+    return count;
+}
+
+/**
+ * Copies the running usage of the bus behind fd into `stats`: [0] busy ns,
+ * [1] transfer attempts, [2] failed transfers. Not available in client mode,
+ * where the transfers happen in the daemon.
+ *
+ * @return 0 if successful, -1 if unavailable or the array is too small
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_getBusUsage
+        (JNIEnv *env, jclass jcl, jint fd, jlongArray stats)
+{
+    int64_t values[3];
+    if (CLIENT_MODE() || (*env)->GetArrayLength(env, stats) < 3 || i2c_core_bus_usage(fd, values) < 0) {
+        return -1;
+    }
+    (*env)->SetLongArrayRegion(env, stats, 0, 3, (const jlong *) values);
+    return 0;
+}
+
+/**
+ * Starts a burst: transfers on the bus behind fd run back-to-back until endBurst.
+ * Ignored in client mode.
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_beginBurst
+        (JNIEnv *env, jclass jcl, jint fd)
+{
+    if (CLIENT_MODE()) {
         return 0;
     }
-    syslog(LOG_DEBUG, "I2C_RECOVER ioctl failed or not supported on FD: %d", fd);
-#endif
-    
-    // Method 2: Try to clear any stuck transaction by switching to general call address
-    // The general call address (0x00) can sometimes help clear stuck transactions
-    syslog(LOG_DEBUG, "Attempting general call address switch for recovery on FD: %d", fd);
-    if (ioctl(fd, I2C_SLAVE, 0x00) == 0) {
-        // Try a quick write to general call address - this may help unstick the bus
-        union i2c_smbus_data data;
-        int result = i2c_smbus_access(fd, I2C_SMBUS_WRITE, 0, I2C_SMBUS_QUICK, NULL);
-        if (result == 0) {
-            syslog(LOG_INFO, "I2C bus recovery successful using general call on FD: %d", fd);
-            closelog();
-            return 0;
-        }
+    return i2c_core_begin_burst(fd);
+}
+
+/**
+ * Ends a burst and keeps the bus silent for idleUs. Ignored in client mode.
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_endBurst
+        (JNIEnv *env, jclass jcl, jint fd, jlong idleUs)
+{
+    if (CLIENT_MODE()) {
+        return 0;
     }
-    
-    // Method 3: Try force-clearing any pending transactions
-    // This attempts to send a STOP condition by doing a quick read/write cycle
-    syslog(LOG_DEBUG, "Attempting transaction force-clear for recovery on FD: %d", fd);
-    
-    // Try switching to a safe address and doing minimal operations
-    for (int addr = 0x08; addr <= 0x77; addr += 8) {
-        if (ioctl(fd, I2C_SLAVE, addr) == 0) {
-            // Try a quick operation that might help clear the bus
-            union i2c_smbus_data data;
-            if (i2c_smbus_access(fd, I2C_SMBUS_READ, 0, I2C_SMBUS_QUICK, NULL) == 0) {
-                syslog(LOG_INFO, "I2C bus recovery successful using address probe method on FD: %d", fd);
-                closelog();
-                return 0;
-            }
+    return i2c_core_end_burst(fd, (long) idleUs * 1000L);
+}
+
+/**
+ * Limits the transfer time on the bus behind a file descriptor per window.
+ * In client mode the daemon owns the buses and this call is ignored.
+ *
+ * @return 0 if successful, -1 if the fd is out of range
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_setBusBudget
+        (JNIEnv *env, jclass jcl, jint fd, jlong budgetUs, jlong windowUs)
+{
+    if (CLIENT_MODE()) {
+        return 0;
+    }
+    return i2c_core_set_budget(fd, (long) budgetUs * 1000L, (long) windowUs * 1000L);
+}
+
+/**
+ * Copies the budget counters of the bus behind a file descriptor into `stats`:
+ * [0] windows, [1] deferrals, [2] overruns, [3] busy ns, [4] worst window busy ns.
+ *
+ * @return 0 if successful, -1 if the fd is out of range or the array is too small
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_getBudgetStats
+        (JNIEnv *env, jclass jcl, jint fd, jlongArray stats)
+{
+    int64_t values[5];
+    if (CLIENT_MODE() || (*env)->GetArrayLength(env, stats) < 5 || i2c_core_budget_stats(fd, values) < 0) {
+        return -1;
+    }
+    (*env)->SetLongArrayRegion(env, stats, 0, 5, (const jlong *) values);
+    return 0;
+}
+
+/**
+ * Feeds the frame pacer with the latest vsync. Ignored in client mode, where
+ * transfers run in the daemon.
+ */
+JNIEXPORT void JNICALL Java_com_layer_i2c_I2cNative_setFrameTiming
+        (JNIEnv *env, jclass jcl, jlong vsyncNanos, jlong periodNanos)
+{
+    if (CLIENT_MODE()) {
+        return;
+    }
+    i2c_core_set_frame_timing(vsyncNanos, periodNanos);
+}
+
+/**
+ * Sets the quiet window before each frame deadline (0 disables frame pacing) and
+ * the gap between transfers in the rest of the frame.
+ */
+JNIEXPORT void JNICALL Java_com_layer_i2c_I2cNative_setFramePacing
+        (JNIEnv *env, jclass jcl, jlong quietUs, jlong burstIntervalUs)
+{
+    if (CLIENT_MODE()) {
+        return;
+    }
+    i2c_core_set_frame_pacing((long) quietUs * 1000L, (long) burstIntervalUs * 1000L);
+}
+
+/**
+ * Pins the calling thread to the CPUs in cpuMask (bit n = CPU n).
+ *
+ * @return 0 if successful, -1 if error
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_setThreadAffinity
+        (JNIEnv *env, jclass jcl, jlong cpuMask)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu = 0; cpu < 64 && cpu < CPU_SETSIZE; cpu++) {
+        if ((cpuMask >> cpu) & 1) {
+            CPU_SET(cpu, &set);
         }
     }
-    
-    // Method 4: Try resetting I2C functionality flags
-    // Some drivers support resetting specific I2C functionality
-    syslog(LOG_DEBUG, "Attempting I2C functionality reset on FD: %d", fd);
-    
-    // Query current functionality to ensure the bus is still operational
-    unsigned long funcs;
-    if (ioctl(fd, I2C_FUNCS, &funcs) == 0) {
-        // If we can query functionality, the low-level driver is responsive
-        // Try one more general call attempt
-        if (ioctl(fd, I2C_SLAVE, 0x00) == 0) {
-            syslog(LOG_INFO, "I2C bus recovery: driver responsive, attempting final general call on FD: %d", fd);
-            
-            // Give the bus some time to settle
-            usleep(1000); // 1ms delay
-            
-            // Try a final quick write
-            union i2c_smbus_data data;
-            if (i2c_smbus_access(fd, I2C_SMBUS_WRITE, 0, I2C_SMBUS_QUICK, NULL) == 0) {
-                syslog(LOG_INFO, "I2C bus recovery successful using delayed general call on FD: %d", fd);
-                closelog();
-                return 0;
+    int result = sched_setaffinity(0, sizeof(set), &set);
+    if (result < 0) {
+        openlog("I2cNative", LOG_PID | LOG_CONS, LOG_USER);
+        syslog(LOG_WARNING, "Failed to set CPU affinity 0x%llx: errno=%d", (unsigned long long) cpuMask, errno);
+        closelog();
+    }
+    return result;
+}
+
+/**
+ * Installs a retry policy for transfers made by the calling thread, overriding the
+ * per-fd policy until clearThreadRetryPolicy is called. Used to give a single
+ * transaction or batch its own policy.
+ */
+JNIEXPORT void JNICALL Java_com_layer_i2c_I2cNative_setThreadRetryPolicy
+        (JNIEnv *env, jclass jcl, jint maxAttempts, jlong baseBackoffUs,
+         jlong maxBackoffUs, jint jitterPercent, jlong deadlineUs, jintArray retryableErrnos)
+{
+    struct i2c_retry_policy policy;
+    fill_retry_policy(env, &policy, maxAttempts, baseBackoffUs,
+                      maxBackoffUs, jitterPercent, deadlineUs, retryableErrnos);
+    i2c_core_set_thread_retry_policy(&policy);
+}
+
+JNIEXPORT void JNICALL Java_com_layer_i2c_I2cNative_clearThreadRetryPolicy
+        (JNIEnv *env, jclass jcl)
+{
+    i2c_core_set_thread_retry_policy(NULL);
+}
+
+/**
+ * Returns the number of attempts the most recent transfer on fd needed.
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_getLastAttempts
+        (JNIEnv *env, jclass jcl, jint fd)
+{
+    if (CLIENT_MODE()) {
+        return -1;
+    }
+    return i2c_core_last_attempts(fd);
+}
+
+/**
+ * Returns the CLOCK_BOOTTIME timestamp, in nanoseconds, taken when the calling
+ * thread's most recent transfer completed (in client mode: the daemon's transfer
+ * behind the thread's last request), or 0 if the thread has made none.
+ * Read it right after the transfer whose sample it should date.
+ */
+JNIEXPORT jlong JNICALL Java_com_layer_i2c_I2cNative_getLastTransferTimeNanos
+        (JNIEnv *env, jclass jcl)
+{
+    return CLIENT_MODE() ? i2c_client_last_transfer_ns() : i2c_core_last_transfer_ns();
+}
+
+/**
+ * Copies the retry counters of a file descriptor into `stats`:
+ * [0] transfers, [1] retries, [2] transfers that failed after retrying.
+ *
+ * @return 0 if successful, -1 if the fd is out of range or the array is too small
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_getRetryStats
+        (JNIEnv *env, jclass jcl, jint fd, jlongArray stats)
+{
+    int64_t values[3];
+    if (CLIENT_MODE() || (*env)->GetArrayLength(env, stats) < 3 || i2c_core_retry_stats(fd, values) < 0) {
+        return -1;
+    }
+    (*env)->SetLongArrayRegion(env, stats, 0, 3, (const jlong *) values);
+    return 0;
+}
+
+/**
+ * Sets the directory holding the cross-process lock files. Every process sharing
+ * a bus must use the same directory.
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_setArbitrationDir
+        (JNIEnv *env, jclass jcl, jstring dir)
+{
+    const char *path = (*env)->GetStringUTFChars(env, dir, NULL);
+    if (path == NULL) {
+        return -1;
+    }
+    int result = i2c_arbiter_set_dir(path);
+    (*env)->ReleaseStringUTFChars(env, dir, path);
+    return result;
+}
+
+/**
+ * Opens the cross-process arbiter for a physical bus path.
+ * In client mode the bus lock is held by the daemon instead.
+ *
+ * @return handle, or -1 if the lock file could not be opened or its segment joined
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_arbitrationOpen
+        (JNIEnv *env, jclass jcl, jstring busName)
+{
+    const char *path = (*env)->GetStringUTFChars(env, busName, NULL);
+    if (path == NULL) {
+        return -1;
+    }
+    int handle = CLIENT_MODE() ? i2c_client_lock_open(path) : i2c_arbiter_open(path);
+    (*env)->ReleaseStringUTFChars(env, busName, path);
+    return handle;
+}
+
+/**
+ * Acquires the bus for this process. Uncontended acquisition is a single
+ * compare-and-swap on shared memory.
+ *
+ * @return 0 if acquired, 1 if acquired after another process used the bus, -2 on timeout,
+ *         -1 on error
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_arbitrationAcquire
+        (JNIEnv *env, jclass jcl, jint handle, jlong timeoutUs)
+{
+    int result = CLIENT_MODE() ? i2c_client_lock(handle, timeoutUs * 1000L)
+                               : i2c_arbiter_acquire(handle, timeoutUs * 1000L);
+    return result < 0 && errno == ETIMEDOUT ? -2 : result;
+}
+
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_arbitrationRelease
+        (JNIEnv *env, jclass jcl, jint handle)
+{
+    if (CLIENT_MODE()) {
+        return i2c_client_unlock(handle);
+    }
+    return i2c_arbiter_release(handle);
+}
+
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_arbitrationClose
+        (JNIEnv *env, jclass jcl, jint handle)
+{
+    if (CLIENT_MODE()) {
+        return i2c_client_lock_close(handle);
+    }
+    return i2c_arbiter_close(handle);
+}
+
+/**
+ * Copies arbitration counters into `stats` (see i2c_arbiter_stats for the order).
+ *
+ * @return 0 if successful, -1 if the handle is unknown or the array is too small
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_getArbitrationStats
+        (JNIEnv *env, jclass jcl, jint handle, jlongArray stats)
+{
+    int64_t values[I2C_ARBITER_STATS_COUNT];
+    if (CLIENT_MODE() || (*env)->GetArrayLength(env, stats) < I2C_ARBITER_STATS_COUNT ||
+        i2c_arbiter_stats(handle, values) < 0) {
+        return -1;
+    }
+    (*env)->SetLongArrayRegion(env, stats, 0, I2C_ARBITER_STATS_COUNT, (const jlong *) values);
+    return 0;
+}
+
+/**
+ * Creates the shared-memory region sensor samples are published into.
+ * Calling it again returns the existing region.
+ *
+ * @return file descriptor of the region, or -1 if error
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_stateRegionCreate
+        (JNIEnv *env, jclass jcl, jint maxRecords, jstring path)
+{
+    const char *file = path != NULL ? (*env)->GetStringUTFChars(env, path, NULL) : NULL;
+    int fd = i2c_state_create((uint32_t) maxRecords, file);
+    if (file != NULL) {
+        (*env)->ReleaseStringUTFChars(env, path, file);
+    }
+    return fd;
+}
+
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_getStateRegionFd
+        (JNIEnv *env, jclass jcl)
+{
+    return i2c_state_fd();
+}
+
+/**
+ * Publishes the latest sample of a sensor. keys and values must have the same length.
+ * captureTimeNs is the CLOCK_BOOTTIME of the transfer that produced the sample.
+ *
+ * @return index of the sensor's record, or -1 if the id is too long or the region is
+ *         missing or full
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_stateRegionPublish
+        (JNIEnv *env, jclass jcl, jstring sensorId, jlong updateTimeMs, jlong captureTimeNs,
+         jobjectArray keys, jdoubleArray values)
+{
+    jsize count = (*env)->GetArrayLength(env, values);
+    if ((*env)->GetArrayLength(env, keys) < count) {
+        return -1;
+    }
+    if (count > I2C_STATE_MAX_KEYS) {
+        count = I2C_STATE_MAX_KEYS;
+    }
+
+    char keyBuffers[I2C_STATE_MAX_KEYS][I2C_STATE_KEY_LEN];
+    const char *keyPtrs[I2C_STATE_MAX_KEYS];
+    double doubles[I2C_STATE_MAX_KEYS];
+    for (jsize i = 0; i < count; i++) {
+        jstring key = (jstring) (*env)->GetObjectArrayElement(env, keys, i);
+        const char *utf = (*env)->GetStringUTFChars(env, key, NULL);
+        if (utf == NULL) {
+            return -1;
+        }
+        size_t len = strlen(utf);
+        if (len >= I2C_STATE_KEY_LEN) {
+            // Truncate on a character boundary
+            len = I2C_STATE_KEY_LEN - 1;
+            while (len > 0 && (utf[len] & 0xC0) == 0x80) {
+                len--;
             }
         }
+        memcpy(keyBuffers[i], utf, len);
+        keyBuffers[i][len] = '\0';
+        keyPtrs[i] = keyBuffers[i];
+        (*env)->ReleaseStringUTFChars(env, key, utf);
+        (*env)->DeleteLocalRef(env, key);
     }
-    
-    // All recovery methods failed
-    syslog(LOG_ERR, "All I2C bus recovery methods failed on FD: %d", fd);
-    closelog();
-    return -1;
+    (*env)->GetDoubleArrayRegion(env, values, 0, count, doubles);
+
+    const char *id = (*env)->GetStringUTFChars(env, sensorId, NULL);
+    if (id == NULL) {
+        return -1;
+    }
+    int index = i2c_state_publish(id, updateTimeMs, captureTimeNs, keyPtrs, doubles, (uint32_t) count);
+    (*env)->ReleaseStringUTFChars(env, sensorId, id);
+    return index;
+}
+
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_stateRegionRemove
+        (JNIEnv *env, jclass jcl, jstring sensorId)
+{
+    const char *id = (*env)->GetStringUTFChars(env, sensorId, NULL);
+    if (id == NULL) {
+        return -1;
+    }
+    int result = i2c_state_remove(id);
+    (*env)->ReleaseStringUTFChars(env, sensorId, id);
+    return result;
+}
+
+/**
+ * Connects to the i2cd daemon. From then on every bus call of this process is
+ * forwarded to the daemon, which shares the buses with other processes. Must be
+ * called before any bus is opened.
+ *
+ * @param socketPath daemon socket, or null for the default path
+ * @return 0 if connected, -1 if error
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_connectDaemon
+        (JNIEnv *env, jclass jcl, jstring socketPath)
+{
+    const char *path = socketPath != NULL ? (*env)->GetStringUTFChars(env, socketPath, NULL) : NULL;
+    int result = i2c_client_connect(path);
+    if (path != NULL) {
+        (*env)->ReleaseStringUTFChars(env, socketPath, path);
+    }
+    return result;
+}
+
+JNIEXPORT void JNICALL Java_com_layer_i2c_I2cNative_disconnectDaemon
+        (JNIEnv *env, jclass jcl)
+{
+    i2c_client_disconnect();
+}
+
+JNIEXPORT jboolean JNICALL Java_com_layer_i2c_I2cNative_isDaemonConnected
+        (JNIEnv *env, jclass jcl)
+{
+    return CLIENT_MODE() ? JNI_TRUE : JNI_FALSE;
+}
+
+/**
+ * Maps a shared-memory ring the daemon writes this process's poll results into.
+ *
+ * @param capacity number of samples the ring holds
+ * @return 0 if successful, -1 if error
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_daemonSubscribe
+        (JNIEnv *env, jclass jcl, jint capacity)
+{
+    return i2c_client_subscribe((uint32_t) capacity);
+}
+
+/**
+ * Registers a register block read the daemon repeats every periodMs, selecting
+ * muxChannel on the mux at muxAddr first (muxAddr -1 for devices without a mux).
+ *
+ * @return poll id, or -1 if error
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_daemonAddPoll
+        (JNIEnv *env, jclass jcl, jint fd, jint deviceAddress, jint reg, jint length,
+         jint periodMs, jint muxAddr, jint muxChannel)
+{
+    return i2c_client_add_poll(fd, deviceAddress, reg, length, (uint32_t) periodMs, muxAddr, muxChannel);
+}
+
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_daemonRemovePoll
+        (JNIEnv *env, jclass jcl, jint pollId)
+{
+    return i2c_client_remove_poll(pollId);
+}
+
+/**
+ * Copies the next unread sample from the ring without a system call.
+ * meta receives [0] poll id, [1] status (bytes read or -errno), [2] CLOCK_BOOTTIME
+ * timestamp in ns, [3] device address, [4] mux channel (-1 if none), [5] register.
+ *
+ * @return number of data bytes copied into data, -1 if no sample is pending, -2 if not subscribed
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_daemonNextSample
+        (JNIEnv *env, jclass jcl, jlongArray meta, jbyteArray data)
+{
+    struct i2cd_sample sample;
+    int result = i2c_client_next_sample(&sample);
+    if (result <= 0) {
+        return result < 0 ? -2 : -1;
+    }
+    jlong values[6] = {sample.poll_id, sample.status, sample.timestamp_ns,
+                       sample.addr, sample.mux_channel, sample.reg};
+    jsize metaLength = (*env)->GetArrayLength(env, meta);
+    (*env)->SetLongArrayRegion(env, meta, 0, metaLength < 6 ? metaLength : 6, values);
+    jsize length = (*env)->GetArrayLength(env, data);
+    if (length > sample.length) {
+        length = sample.length;
+    }
+    (*env)->SetByteArrayRegion(env, data, 0, length, (const jbyte *) sample.data);
+    return length;
+}
+
+JNIEXPORT jlong JNICALL Java_com_layer_i2c_I2cNative_getDaemonLostSamples
+        (JNIEnv *env, jclass jcl)
+{
+    return (jlong) i2c_client_lost_samples();
 }
 
 /**
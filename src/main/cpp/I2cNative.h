@@ -31,6 +31,14 @@ JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_closeBus
 JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_writeByte
         (JNIEnv *, jclass, jint, jint, jint);
 
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    writeRegisters
+ * Signature: (I[B[B)I
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_writeRegisters
+        (JNIEnv *, jclass, jint, jbyteArray, jbyteArray);
+
 /*
  * Class:     com_layer_i2c_I2cNative
  * Method:    writeWord
@@ -66,6 +74,22 @@ JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_readRawBytes
 JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_readBlockData
         (JNIEnv *, jclass, jint, jint, jbyteArray, jint);
 
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    probeBlockRead
+ * Signature: (IIIZ)I
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_probeBlockRead
+        (JNIEnv *, jclass, jint, jint, jint, jboolean);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    getBlockReadCaps
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_getBlockReadCaps
+        (JNIEnv *, jclass, jint);
+
 JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_write
         (JNIEnv *env, jclass jcl, jint fd, jint value);
         
@@ -93,6 +117,318 @@ JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_scanAddress
 JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_recoverBus
         (JNIEnv *, jclass, jint);
 
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    setRetryPolicy
+ * Signature: (IIJJIJ[I)I
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_setRetryPolicy
+        (JNIEnv *, jclass, jint, jint, jlong, jlong, jint, jlong, jintArray);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    setBusPacing
+ * Signature: (IJ)I
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_setBusPacing
+        (JNIEnv *, jclass, jint, jlong);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    startTrace
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_startTrace
+        (JNIEnv *, jclass, jint);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    stopTrace
+ * Signature: ()V
+ */
+JNIEXPORT void JNICALL Java_com_layer_i2c_I2cNative_stopTrace
+        (JNIEnv *, jclass);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    dumpTrace
+ * Signature: (Ljava/lang/String;)I
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_dumpTrace
+        (JNIEnv *, jclass, jstring);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    startReplay
+ * Signature: (Ljava/lang/String;Z)I
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_startReplay
+        (JNIEnv *, jclass, jstring, jboolean);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    stopReplay
+ * Signature: ()V
+ */
+JNIEXPORT void JNICALL Java_com_layer_i2c_I2cNative_stopReplay
+        (JNIEnv *, jclass);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    getReplayStats
+ * Signature: ([J)I
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_getReplayStats
+        (JNIEnv *, jclass, jlongArray);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    getBusUsage
+ * Signature: (I[J)I
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_getBusUsage
+        (JNIEnv *, jclass, jint, jlongArray);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    beginBurst
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_beginBurst
+        (JNIEnv *, jclass, jint);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    endBurst
+ * Signature: (IJ)I
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_endBurst
+        (JNIEnv *, jclass, jint, jlong);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    setBusBudget
+ * Signature: (IJJ)I
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_setBusBudget
+        (JNIEnv *, jclass, jint, jlong, jlong);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    getBudgetStats
+ * Signature: (I[J)I
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_getBudgetStats
+        (JNIEnv *, jclass, jint, jlongArray);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    setFrameTiming
+ * Signature: (JJ)V
+ */
+JNIEXPORT void JNICALL Java_com_layer_i2c_I2cNative_setFrameTiming
+        (JNIEnv *, jclass, jlong, jlong);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    setFramePacing
+ * Signature: (JJ)V
+ */
+JNIEXPORT void JNICALL Java_com_layer_i2c_I2cNative_setFramePacing
+        (JNIEnv *, jclass, jlong, jlong);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    setThreadAffinity
+ * Signature: (J)I
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_setThreadAffinity
+        (JNIEnv *, jclass, jlong);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    setThreadRetryPolicy
+ * Signature: (IJJIJ[I)V
+ */
+JNIEXPORT void JNICALL Java_com_layer_i2c_I2cNative_setThreadRetryPolicy
+        (JNIEnv *, jclass, jint, jlong, jlong, jint, jlong, jintArray);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    clearThreadRetryPolicy
+ * Signature: ()V
+ */
+JNIEXPORT void JNICALL Java_com_layer_i2c_I2cNative_clearThreadRetryPolicy
+        (JNIEnv *, jclass);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    getLastAttempts
+ * Signature: ()I
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_getLastAttempts
+        (JNIEnv *, jclass, jint);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    getLastTransferTimeNanos
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_com_layer_i2c_I2cNative_getLastTransferTimeNanos
+        (JNIEnv *, jclass);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    getRetryStats
+ * Signature: (I[J)I
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_getRetryStats
+        (JNIEnv *, jclass, jint, jlongArray);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    setArbitrationDir
+ * Signature: (Ljava/lang/String;)I
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_setArbitrationDir
+        (JNIEnv *, jclass, jstring);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    arbitrationOpen
+ * Signature: (Ljava/lang/String;)I
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_arbitrationOpen
+        (JNIEnv *, jclass, jstring);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    arbitrationAcquire
+ * Signature: (IJ)I
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_arbitrationAcquire
+        (JNIEnv *, jclass, jint, jlong);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    arbitrationRelease
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_arbitrationRelease
+        (JNIEnv *, jclass, jint);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    arbitrationClose
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_arbitrationClose
+        (JNIEnv *, jclass, jint);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    getArbitrationStats
+ * Signature: (I[J)I
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_getArbitrationStats
+        (JNIEnv *, jclass, jint, jlongArray);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    stateRegionCreate
+ * Signature: (ILjava/lang/String;)I
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_stateRegionCreate
+        (JNIEnv *, jclass, jint, jstring);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    getStateRegionFd
+ * Signature: ()I
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_getStateRegionFd
+        (JNIEnv *, jclass);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    stateRegionPublish
+ * Signature: (Ljava/lang/String;JJ[Ljava/lang/String;[D)I
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_stateRegionPublish
+        (JNIEnv *, jclass, jstring, jlong, jlong, jobjectArray, jdoubleArray);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    stateRegionRemove
+ * Signature: (Ljava/lang/String;)I
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_stateRegionRemove
+        (JNIEnv *, jclass, jstring);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    connectDaemon
+ * Signature: (Ljava/lang/String;)I
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_connectDaemon
+        (JNIEnv *, jclass, jstring);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    disconnectDaemon
+ * Signature: ()V
+ */
+JNIEXPORT void JNICALL Java_com_layer_i2c_I2cNative_disconnectDaemon
+        (JNIEnv *, jclass);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    isDaemonConnected
+ * Signature: ()Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_layer_i2c_I2cNative_isDaemonConnected
+        (JNIEnv *, jclass);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    daemonSubscribe
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_daemonSubscribe
+        (JNIEnv *, jclass, jint);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    daemonAddPoll
+ * Signature: (IIIIIII)I
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_daemonAddPoll
+        (JNIEnv *, jclass, jint, jint, jint, jint, jint, jint, jint);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    daemonRemovePoll
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_daemonRemovePoll
+        (JNIEnv *, jclass, jint);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    daemonNextSample
+ * Signature: ([J[B)I
+ */
+JNIEXPORT jint JNICALL Java_com_layer_i2c_I2cNative_daemonNextSample
+        (JNIEnv *, jclass, jlongArray, jbyteArray);
+
+/*
+ * Class:     com_layer_i2c_I2cNative
+ * Method:    getDaemonLostSamples
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_com_layer_i2c_I2cNative_getDaemonLostSamples
+        (JNIEnv *, jclass);
+
 /*
  * Class:     com_layer_i2c_I2cNative
  * Method:    setSchedIdle
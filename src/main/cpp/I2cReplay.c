@@ -0,0 +1,468 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#include "I2cCore.h"
+#include "I2cTrace.h"
+#include "I2cReplay.h"
+
+// 7-bit addresses
+#define REPLAY_ADDRESSES 128
+
+struct replay_entry {
+    uint64_t key;
+    struct i2c_trace_record record;
+    uint8_t payload[I2C_TRACE_MAX_PAYLOAD];
+};
+
+/** The records of one key: entries[first .. first + count), in timestamp order. */
+struct replay_range {
+    uint64_t key;
+    uint32_t first;
+    uint32_t count;
+    uint32_t cursor;    // next record in I2C_REPLAY_FAST
+};
+
+static struct replay_entry *entries = NULL;
+static struct replay_range *ranges = NULL;
+static uint32_t range_count = 0;
+static unsigned char present[REPLAY_ADDRESSES];
+static int replay_mode = I2C_REPLAY_TIMED;
+static int64_t trace_first_ns = 0;
+static int64_t trace_span_ns = 1;
+static int64_t started_ns = 0;
+static int running = 0;
+static uint16_t replay_addr[I2C_MAX_FDS];
+static int64_t stats_total[I2C_REPLAY_STATS];
+static pthread_mutex_t control_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int64_t monotonic_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static inline uint64_t replay_key(int addr, int op, int smbus_size, int reg, int read)
+{
+    return ((uint64_t) (addr & 0xFFFF) << 32) | ((uint64_t) op << 24) | ((uint64_t) smbus_size << 16) |
+           ((uint64_t) reg << 8) | (read ? 1 : 0);
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+    const struct replay_entry *x = a;
+    const struct replay_entry *y = b;
+    if (x->key != y->key) {
+        return x->key < y->key ? -1 : 1;
+    }
+    if (x->record.timestamp_ns != y->record.timestamp_ns) {
+        return x->record.timestamp_ns < y->record.timestamp_ns ? -1 : 1;
+    }
+    return 0;
+}
+
+static const struct replay_range *find_range(uint64_t key)
+{
+    uint32_t low = 0;
+    uint32_t high = range_count;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (ranges[mid].key < key) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low < range_count && ranges[low].key == key ? &ranges[low] : NULL;
+}
+
+/**
+ * Picks the record that answers an attempt on range, per the replay mode.
+ */
+static const struct replay_entry *pick(struct replay_range *range)
+{
+    if (replay_mode == I2C_REPLAY_FAST) {
+        uint32_t n = __atomic_fetch_add(&range->cursor, 1, __ATOMIC_RELAXED);
+        return &entries[range->first + n % range->count];
+    }
+    int64_t clock = trace_first_ns + (monotonic_ns() - started_ns) % trace_span_ns;
+    // Last record at or before the trace clock; before the first, the previous loop's last
+    uint32_t low = 0;
+    uint32_t high = range->count;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (entries[range->first + mid].record.timestamp_ns <= clock) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return &entries[range->first + (low > 0 ? low - 1 : range->count - 1)];
+}
+
+/**
+ * Finds the record answering an attempt and, in timed mode, holds the caller for
+ * the recorded latency. Returns NULL if the capture has no such transfer.
+ */
+static const struct replay_entry *replay_match(int addr, int op, int smbus_size, int reg, int read)
+{
+    const struct replay_range *found = find_range(replay_key(addr, op, smbus_size, reg, read));
+    if (found == NULL) {
+        __atomic_fetch_add(&stats_total[2], 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    __atomic_fetch_add(&stats_total[1], 1, __ATOMIC_RELAXED);
+    const struct replay_entry *entry = pick((struct replay_range *) found);
+    if (replay_mode == I2C_REPLAY_TIMED && entry->record.latency_ns > 0) {
+        struct timespec ts = {entry->record.latency_ns / 1000000000, entry->record.latency_ns % 1000000000};
+        nanosleep(&ts, NULL);
+    }
+    return entry;
+}
+
+/**
+ * The answer to a transfer the capture does not have. Returns 0 or an errno.
+ */
+static int replay_unmatched(int addr, int read)
+{
+    if (addr < 0 || addr >= REPLAY_ADDRESSES || !present[addr]) {
+        return ENXIO;
+    }
+    return read ? EIO : 0;
+}
+
+/** Counts a finished attempt of op that entered the backend at call_ns. */
+static void replay_finish(int op, int64_t call_ns)
+{
+    int64_t requested = i2c_core_request_ns();
+    int64_t latency = monotonic_ns() - (requested > 0 ? requested : call_ns);
+    int64_t *kind = &stats_total[4 + 3 * (op - 1)];
+    __atomic_fetch_add(&stats_total[0], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&kind[0], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&kind[1], latency, __ATOMIC_RELAXED);
+    int64_t max = __atomic_load_n(&kind[2], __ATOMIC_RELAXED);
+    while (latency > max &&
+           !__atomic_compare_exchange_n(&kind[2], &max, latency, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+/** Copies a recorded read payload into buf, zero-filling what the capture lacks. */
+static void replay_fill(const struct replay_entry *entry, uint8_t *buf, int length)
+{
+    int copied = entry->record.length < length ? entry->record.length : length;
+    memcpy(buf, entry->payload, copied);
+    memset(buf + copied, 0, length - copied);
+}
+
+static int replay_smbus(int fd, struct i2c_smbus_ioctl_data *args)
+{
+    int read = args->read_write == I2C_SMBUS_READ;
+    int addr = replay_addr[fd];
+    union i2c_smbus_data *data = args->data;
+    const struct replay_entry *entry = replay_match(addr, I2C_TRACE_OP_SMBUS, args->size, args->command, read);
+    if (entry == NULL) {
+        // A quick write or a byte read is a probe; it only asks whether the address acknowledges
+        int probe = args->size == I2C_SMBUS_QUICK || args->size == I2C_SMBUS_BYTE;
+        int err = replay_unmatched(addr, read && !probe);
+        if (err != 0) {
+            errno = err;
+            return -1;
+        }
+        if (read && data != NULL) {
+            data->byte = 0;
+        }
+        return 0;
+    }
+    if (entry->record.result < 0) {
+        errno = -entry->record.result;
+        return -1;
+    }
+    if (read && data != NULL) {
+        switch (args->size) {
+            case I2C_SMBUS_BLOCK_DATA:
+                data->block[0] = entry->record.length;
+                replay_fill(entry, data->block + 1, entry->record.length);
+                break;
+            case I2C_SMBUS_I2C_BLOCK_BROKEN:
+            case I2C_SMBUS_I2C_BLOCK_DATA:
+                // The kernel returns exactly the requested length
+                if (data->block[0] > I2C_SMBUS_BLOCK_MAX) {
+                    data->block[0] = I2C_SMBUS_BLOCK_MAX;
+                }
+                replay_fill(entry, data->block + 1, data->block[0]);
+                break;
+            case I2C_SMBUS_WORD_DATA:
+            case I2C_SMBUS_PROC_CALL:
+                replay_fill(entry, data->block, 2);
+                break;
+            default:
+                replay_fill(entry, data->block, 1);
+                break;
+        }
+    }
+    return entry->record.result;
+}
+
+static int replay_rdwr(struct i2c_rdwr_ioctl_data *rdwr, int *op)
+{
+    struct i2c_msg *msgs = rdwr->msgs;
+    // Register write + repeated start + read, as i2c_rdwr_read_block sends; anything else is a write
+    int read = rdwr->nmsgs == 2 && (msgs[1].flags & I2C_M_RD) && !(msgs[0].flags & I2C_M_RD);
+    *op = read ? I2C_TRACE_OP_RDWR_READ : I2C_TRACE_OP_RDWR_WRITE;
+    if (rdwr->nmsgs == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    int reg = msgs[0].len > 0 ? msgs[0].buf[0] : 0;
+    const struct replay_entry *entry = replay_match(msgs[0].addr, *op, 0, reg, read);
+    if (entry == NULL) {
+        int err = replay_unmatched(msgs[0].addr, read);
+        if (err != 0) {
+            errno = err;
+            return -1;
+        }
+    } else if (entry->record.result < 0) {
+        errno = -entry->record.result;
+        return -1;
+    } else if (read) {
+        replay_fill(entry, msgs[1].buf, msgs[1].len);
+    }
+    return (int) rdwr->nmsgs;
+}
+
+static int replay_open(const char *path, int flags)
+{
+    (void) path;
+    // Any fd will do; nothing is ever read from or written to it. I2cCore takes
+    // the bus number from path, since /dev/null has no I2C minor.
+    int fd = open("/dev/null", flags);
+    if (fd >= I2C_MAX_FDS) {
+        close(fd);
+        errno = EMFILE;
+        return -1;
+    }
+    if (fd >= 0) {
+        replay_addr[fd] = 0;
+    }
+    return fd;
+}
+
+static int replay_ioctl(int fd, unsigned long request, void *arg)
+{
+    int64_t call_ns = monotonic_ns();
+    int result;
+    int op;
+    switch (request) {
+        case I2C_SLAVE:
+        case I2C_SLAVE_FORCE:
+            replay_addr[fd] = (uint16_t) (long) arg;
+            result = 0;
+            op = I2C_TRACE_OP_SELECT;
+            break;
+        case I2C_SMBUS:
+            result = replay_smbus(fd, arg);
+            op = I2C_TRACE_OP_SMBUS;
+            break;
+        case I2C_RDWR:
+            result = replay_rdwr(arg, &op);
+            break;
+        case I2C_FUNCS:
+            *(unsigned long *) arg = I2C_FUNC_I2C | I2C_FUNC_SMBUS_EMUL;
+            return 0;
+#ifdef I2C_RECOVER
+        case I2C_RECOVER:
+            return 0;
+#endif
+        default:
+            errno = ENOTTY;
+            return -1;
+    }
+    int err = errno;
+    replay_finish(op, call_ns);
+    errno = err;
+    return result;
+}
+
+static ssize_t replay_read(int fd, void *buf, size_t count)
+{
+    int64_t call_ns = monotonic_ns();
+    int addr = replay_addr[fd];
+    ssize_t result = (ssize_t) count;
+    const struct replay_entry *entry = replay_match(addr, I2C_TRACE_OP_READ, 0, 0, 1);
+    if (entry == NULL) {
+        int err = replay_unmatched(addr, 1);
+        if (err != 0) {
+            errno = err;
+            result = -1;
+        }
+    } else if (entry->record.result < 0) {
+        errno = -entry->record.result;
+        result = -1;
+    } else {
+        if ((size_t) entry->record.result < count) {
+            result = entry->record.result;
+        }
+        replay_fill(entry, buf, (int) result);
+    }
+    int err = errno;
+    replay_finish(I2C_TRACE_OP_READ, call_ns);
+    errno = err;
+    return result;
+}
+
+static ssize_t replay_write(int fd, const void *buf, size_t count)
+{
+    (void) buf;
+    int64_t call_ns = monotonic_ns();
+    int addr = replay_addr[fd];
+    ssize_t result = (ssize_t) count;
+    const struct replay_entry *entry = replay_match(addr, I2C_TRACE_OP_WRITE, 0, 0, 0);
+    int err = entry == NULL ? replay_unmatched(addr, 0)
+            : (entry->record.result < 0 ? -entry->record.result : 0);
+    if (err != 0) {
+        result = -1;
+    }
+    replay_finish(I2C_TRACE_OP_WRITE, call_ns);
+    errno = err;
+    return result;
+}
+
+static const struct i2c_backend replay_backend = {replay_open, close, replay_ioctl, replay_read, replay_write};
+
+/**
+ * Reads a capture into a new array of entries. Returns the count, or -1.
+ */
+static int load_capture(const char *path, struct replay_entry **loaded)
+{
+    FILE *in = fopen(path, "rb");
+    if (in == NULL) {
+        return -1;
+    }
+    struct i2c_trace_file_header header;
+    if (fread(&header, sizeof(header), 1, in) != 1 || header.magic != I2C_TRACE_MAGIC ||
+        (header.version >> 8) > (I2C_TRACE_VERSION >> 8) || header.count == 0 ||
+        fseek(in, header.header_size, SEEK_SET) != 0) {
+        fclose(in);
+        return -1;
+    }
+    struct replay_entry *list = calloc(header.count, sizeof(*list));
+    if (list == NULL) {
+        fclose(in);
+        return -1;
+    }
+    for (uint32_t i = 0; i < header.count; i++) {
+        struct replay_entry *entry = &list[i];
+        if (fread(&entry->record, sizeof(entry->record), 1, in) != 1 ||
+            entry->record.length > I2C_TRACE_MAX_PAYLOAD ||
+            fread(entry->payload, 1, entry->record.length, in) != entry->record.length) {
+            free(list);
+            fclose(in);
+            return -1;
+        }
+        entry->key = replay_key(entry->record.addr, entry->record.op, entry->record.smbus_size,
+                                entry->record.reg, entry->record.flags & I2C_TRACE_FLAG_READ);
+    }
+    fclose(in);
+    *loaded = list;
+    return (int) header.count;
+}
+
+int i2c_replay_start(const char *path, int mode)
+{
+    struct replay_entry *list = NULL;
+    int count = load_capture(path, &list);
+    if (count < 0) {
+        return -1;
+    }
+    qsort(list, count, sizeof(*list), compare_entries);
+
+    uint32_t keys = 0;
+    for (int i = 0; i < count; i++) {
+        if (i == 0 || list[i].key != list[i - 1].key) {
+            keys++;
+        }
+    }
+    struct replay_range *index = calloc(keys, sizeof(*index));
+    if (index == NULL) {
+        free(list);
+        return -1;
+    }
+
+    pthread_mutex_lock(&control_lock);
+    free(entries);
+    free(ranges);
+    entries = list;
+    ranges = index;
+    range_count = 0;
+    memset(present, 0, sizeof(present));
+    int64_t first = list[0].record.timestamp_ns;
+    int64_t last = first;
+    for (int i = 0; i < count; i++) {
+        const struct i2c_trace_record *record = &list[i].record;
+        if (i == 0 || list[i].key != list[i - 1].key) {
+            ranges[range_count].key = list[i].key;
+            ranges[range_count].first = (uint32_t) i;
+            range_count++;
+        }
+        ranges[range_count - 1].count++;
+        // Selecting an address needs no device, so it says nothing about presence
+        if (record->op != I2C_TRACE_OP_SELECT && record->result >= 0 && record->addr < REPLAY_ADDRESSES) {
+            present[record->addr] = 1;
+        }
+        if (record->timestamp_ns < first) {
+            first = record->timestamp_ns;
+        }
+        if (record->timestamp_ns + record->latency_ns > last) {
+            last = record->timestamp_ns + record->latency_ns;
+        }
+    }
+    trace_first_ns = first;
+    trace_span_ns = last > first ? last - first : 1;
+    replay_mode = mode == I2C_REPLAY_FAST ? I2C_REPLAY_FAST : I2C_REPLAY_TIMED;
+    memset(stats_total, 0, sizeof(stats_total));
+    started_ns = monotonic_ns();
+    running = 1;
+    i2c_core_set_backend(&replay_backend);
+    pthread_mutex_unlock(&control_lock);
+    return count;
+}
+
+void i2c_replay_stop(void)
+{
+    pthread_mutex_lock(&control_lock);
+    if (running) {
+        i2c_core_set_backend(NULL);
+        running = 0;
+        free(entries);
+        free(ranges);
+        entries = NULL;
+        ranges = NULL;
+        range_count = 0;
+    }
+    pthread_mutex_unlock(&control_lock);
+}
+
+int i2c_replay_stats(int64_t *stats, int count)
+{
+    pthread_mutex_lock(&control_lock);
+    if (!running) {
+        pthread_mutex_unlock(&control_lock);
+        return -1;
+    }
+    if (count > I2C_REPLAY_STATS) {
+        count = I2C_REPLAY_STATS;
+    }
+    for (int i = 0; i < count; i++) {
+        stats[i] = i == 3 ? monotonic_ns() - started_ns : __atomic_load_n(&stats_total[i], __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&control_lock);
+    return count;
+}
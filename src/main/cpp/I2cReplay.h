@@ -0,0 +1,55 @@
+#ifndef I2C_REPLAY_H
+#define I2C_REPLAY_H
+
+#include <stdint.h>
+
+/*
+ * Trace replay: a simulated bus backend (see struct i2c_backend) that answers
+ * transfers from a capture written by i2c_trace_dump(). The sensor drivers and
+ * the poll loop run unchanged on any Linux machine, without an I2C adapter.
+ *
+ * A transfer is matched against the capture by (address, op, SMBus size,
+ * register, direction). The answer is the recorded result and payload, so a
+ * recorded NAK or timeout is replayed as the same errno. Records from every bus
+ * in the capture are pooled by address, so captures of one bus, or of buses with
+ * distinct addresses, replay best.
+ *
+ * I2C_REPLAY_TIMED follows the capture's clock: trace time advances with wall
+ * time from i2c_replay_start() (looping at the end), a transfer gets the latest
+ * matching record at or before the current trace time, and each matched attempt
+ * occupies the caller for its recorded latency.
+ *
+ * I2C_REPLAY_FAST answers each key's records in capture order (wrapping) with no
+ * delay, which measures the library's own cost per transfer.
+ *
+ * Transfers without a matching record: a probe or write to an address that shows
+ * up in the capture succeeds, a read fails with EIO, and any transfer to an
+ * absent address fails with ENXIO.
+ */
+
+#define I2C_REPLAY_TIMED 0
+#define I2C_REPLAY_FAST  1
+
+// Values copied by i2c_replay_stats(): 4 totals, then 3 per op kind
+#define I2C_REPLAY_OP_KINDS 6
+#define I2C_REPLAY_STATS (4 + 3 * I2C_REPLAY_OP_KINDS)
+
+/**
+ * Loads the capture at path and installs the replay backend. Call before any bus
+ * is opened. Returns the number of records loaded, or -1.
+ */
+int i2c_replay_start(const char *path, int mode);
+
+/** Restores the kernel backend and frees the capture. Call after every bus is closed. */
+void i2c_replay_stop(void);
+
+/**
+ * Copies up to count statistics of the running replay: [0] transfers, [1] matched,
+ * [2] unmatched, [3] ns since start, then for each enum i2c_trace_op (1-based, in
+ * order) the attempts, their total latency in ns and the largest latency in ns.
+ * Latency runs from the moment the library asked for the bus, so it includes
+ * pacing. Returns the number of values copied, or -1 if no replay is running.
+ */
+int i2c_replay_stats(int64_t *stats, int count);
+
+#endif //I2C_REPLAY_H
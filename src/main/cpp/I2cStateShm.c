@@ -0,0 +1,302 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <errno.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <syslog.h>
+
+#ifdef __ANDROID__
+#include <android/sharedmem.h>
+#endif
+
+#include "I2cStateShm.h"
+
+// Reader retries before yielding the CPU to a writer that is mid-update
+#define I2C_STATE_SPIN 64
+// Time a reader keeps retrying a record, e.g. one left odd by a writer that died.
+// Generous, as the writer may run at idle priority and be preempted mid-update.
+#define I2C_STATE_READ_TIMEOUT_NS 100000000LL
+
+static struct i2c_state_header *writer_header = NULL;
+static struct i2c_state_record *writer_records = NULL;
+static size_t writer_size = 0;
+static int writer_fd = -1;
+static pthread_mutex_t writer_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline size_t region_size(uint32_t record_count)
+{
+    return sizeof(struct i2c_state_header) + (size_t) record_count * sizeof(struct i2c_state_record);
+}
+
+static int create_anonymous(size_t size)
+{
+#ifdef __ANDROID__
+    return ASharedMemory_create("i2c-sensor-state", size);
+#else
+    int fd = (int) syscall(SYS_memfd_create, "i2c-sensor-state", 0);
+    if (fd >= 0 && ftruncate(fd, (off_t) size) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+#endif
+}
+
+int i2c_state_create(uint32_t record_count, const char *path)
+{
+    pthread_mutex_lock(&writer_lock);
+    if (writer_fd >= 0) {
+        pthread_mutex_unlock(&writer_lock);
+        return writer_fd;
+    }
+
+    size_t size = region_size(record_count);
+    int fd;
+    if (path != NULL) {
+        fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd >= 0 && ftruncate(fd, (off_t) size) < 0) {
+            close(fd);
+            fd = -1;
+        }
+    } else {
+        fd = create_anonymous(size);
+    }
+    if (fd < 0) {
+        openlog("I2cStateShm", LOG_PID | LOG_CONS, LOG_USER);
+        syslog(LOG_ERR, "Failed to create sensor state region: %s", strerror(errno));
+        closelog();
+        pthread_mutex_unlock(&writer_lock);
+        return -1;
+    }
+
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        pthread_mutex_unlock(&writer_lock);
+        return -1;
+    }
+    memset(map, 0, size);
+
+    writer_header = map;
+    writer_records = (struct i2c_state_record *) (writer_header + 1);
+    writer_size = size;
+    writer_header->version = I2C_STATE_VERSION;
+    writer_header->record_count = record_count;
+    writer_header->record_size = sizeof(struct i2c_state_record);
+    // Readers check the magic last
+    __atomic_store_n(&writer_header->magic, I2C_STATE_MAGIC, __ATOMIC_RELEASE);
+    writer_fd = fd;
+
+    pthread_mutex_unlock(&writer_lock);
+    return fd;
+}
+
+int i2c_state_fd(void)
+{
+    return writer_fd;
+}
+
+// Must be called with writer_lock held
+static int find_locked(const char *sensor_id, int allocate)
+{
+    int free_slot = -1;
+    for (uint32_t i = 0; i < writer_header->record_count; i++) {
+        if (writer_records[i].sensor_id[0] == '\0') {
+            if (free_slot < 0) {
+                free_slot = (int) i;
+            }
+        } else if (strcmp(writer_records[i].sensor_id, sensor_id) == 0) {
+            return (int) i;
+        }
+    }
+    return allocate ? free_slot : -1;
+}
+
+static inline void write_begin(struct i2c_state_record *record)
+{
+    uint32_t seq = record->seq;
+    __atomic_store_n(&record->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void write_end(struct i2c_state_record *record)
+{
+    __atomic_store_n(&record->seq, record->seq + 1, __ATOMIC_RELEASE);
+}
+
+int i2c_state_publish(const char *sensor_id, int64_t update_time_ms, int64_t capture_time_ns,
+                      const char *const *keys, const double *values, uint32_t count)
+{
+    // Truncated ids would collide with every other id sharing their prefix
+    if (strlen(sensor_id) >= I2C_STATE_ID_LEN) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    pthread_mutex_lock(&writer_lock);
+    if (writer_header == NULL) {
+        pthread_mutex_unlock(&writer_lock);
+        return -1;
+    }
+    int index = find_locked(sensor_id, 1);
+    if (index < 0) {
+        pthread_mutex_unlock(&writer_lock);
+        return -1;
+    }
+
+    struct i2c_state_record *record = &writer_records[index];
+    int is_new = record->sensor_id[0] == '\0';
+    if (count > I2C_STATE_MAX_KEYS) {
+        count = I2C_STATE_MAX_KEYS;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_BOOTTIME, &now);
+
+    write_begin(record);
+    if (is_new) {
+        strcpy(record->sensor_id, sensor_id);
+    }
+    record->update_time_ms = update_time_ms;
+    record->capture_time_ns = capture_time_ns;
+    record->publish_time_ns = now.tv_sec * 1000000000LL + now.tv_nsec;
+    for (uint32_t i = 0; i < count; i++) {
+        strncpy(record->entries[i].key, keys[i], I2C_STATE_KEY_LEN - 1);
+        record->entries[i].key[I2C_STATE_KEY_LEN - 1] = '\0';
+        record->entries[i].value = values[i];
+    }
+    record->key_count = count;
+    write_end(record);
+
+    if (is_new) {
+        __atomic_add_fetch(&writer_header->generation, 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&writer_lock);
+    return index;
+}
+
+int i2c_state_remove(const char *sensor_id)
+{
+    if (strlen(sensor_id) >= I2C_STATE_ID_LEN) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    pthread_mutex_lock(&writer_lock);
+    int index = writer_header != NULL ? find_locked(sensor_id, 0) : -1;
+    if (index >= 0) {
+        struct i2c_state_record *record = &writer_records[index];
+        write_begin(record);
+        record->key_count = 0;
+        memset(record->sensor_id, 0, sizeof(record->sensor_id));
+        write_end(record);
+        __atomic_add_fetch(&writer_header->generation, 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&writer_lock);
+    return index >= 0 ? 0 : -1;
+}
+
+int i2c_state_map(int fd, struct i2c_state_region *region)
+{
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(struct i2c_state_header)) {
+        return -1;
+    }
+    void *map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    const struct i2c_state_header *header = map;
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != I2C_STATE_MAGIC ||
+        header->version != I2C_STATE_VERSION ||
+        header->record_size != sizeof(struct i2c_state_record) ||
+        region_size(header->record_count) > (size_t) st.st_size) {
+        munmap(map, (size_t) st.st_size);
+        return -1;
+    }
+    region->header = header;
+    region->records = (const struct i2c_state_record *) (header + 1);
+    region->size = (uint64_t) st.st_size;
+    return 0;
+}
+
+void i2c_state_unmap(struct i2c_state_region *region)
+{
+    if (region->header != NULL) {
+        munmap((void *) region->header, (size_t) region->size);
+        region->header = NULL;
+        region->records = NULL;
+    }
+}
+
+uint32_t i2c_state_record_count(const struct i2c_state_region *region)
+{
+    return region->header->record_count;
+}
+
+int i2c_state_read(const struct i2c_state_region *region, uint32_t index, struct i2c_state_record *out)
+{
+    if (index >= region->header->record_count) {
+        return -1;
+    }
+    const struct i2c_state_record *record = &region->records[index];
+    int spins = 0;
+    int64_t deadline = 0;
+    for (;;) {
+        uint32_t before = __atomic_load_n(&record->seq, __ATOMIC_ACQUIRE);
+        if (!(before & 1)) {
+            memcpy(out, record, sizeof(*out));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&record->seq, __ATOMIC_RELAXED) == before) {
+                break;
+            }
+        }
+        if (++spins >= I2C_STATE_SPIN) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            int64_t now_ns = now.tv_sec * 1000000000LL + now.tv_nsec;
+            if (deadline == 0) {
+                deadline = now_ns + I2C_STATE_READ_TIMEOUT_NS;
+            } else if (now_ns >= deadline) {
+                errno = EAGAIN;
+                return -1;
+            }
+            spins = 0;
+            sched_yield();
+        }
+    }
+    if (out->key_count > I2C_STATE_MAX_KEYS) {
+        out->key_count = I2C_STATE_MAX_KEYS;
+    }
+    out->sensor_id[I2C_STATE_ID_LEN - 1] = '\0';
+    return out->key_count > 0 ? 1 : 0;
+}
+
+int i2c_state_find(const struct i2c_state_region *region, const char *sensor_id)
+{
+    struct i2c_state_record snapshot;
+    if (strlen(sensor_id) >= I2C_STATE_ID_LEN) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < region->header->record_count; i++) {
+        if (i2c_state_read(region, i, &snapshot) == 1 &&
+            strcmp(snapshot.sensor_id, sensor_id) == 0) {
+            return (int) i;
+        }
+    }
+    return -1;
+}
+
+int i2c_state_value(const struct i2c_state_record *record, const char *key, double *value)
+{
+    for (uint32_t i = 0; i < record->key_count && i < I2C_STATE_MAX_KEYS; i++) {
+        if (strncmp(record->entries[i].key, key, I2C_STATE_KEY_LEN - 1) == 0) {
+            *value = record->entries[i].value;
+            return 0;
+        }
+    }
+    return -1;
+}
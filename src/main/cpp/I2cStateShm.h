@@ -0,0 +1,108 @@
+#ifndef I2C_STATE_SHM_H
+#define I2C_STATE_SHM_H
+
+#include <stdint.h>
+
+/*
+ * Shared-memory publication of the latest sample of every sensor.
+ *
+ * The region is created by the process that polls the sensors (ashmem on
+ * Android, memfd elsewhere, or a plain file when a path is given). Its file
+ * descriptor can be passed to other processes over binder or a Unix socket.
+ * Any number of readers may map it read-only.
+ *
+ * Each record is protected by its own sequence counter. The writer makes it
+ * odd before changing the record and even afterwards. A reader copies the
+ * record and retries if the counter was odd or changed during the copy, so
+ * readers never block the writer.
+ */
+
+#define I2C_STATE_MAGIC   0x49325353u /* "I2SS" */
+#define I2C_STATE_VERSION 2
+
+#define I2C_STATE_ID_LEN  48
+#define I2C_STATE_KEY_LEN 24
+#define I2C_STATE_MAX_KEYS 24
+
+struct i2c_state_entry {
+    char key[I2C_STATE_KEY_LEN];   // NUL-terminated, truncated if longer
+    double value;
+};
+
+struct i2c_state_record {
+    uint32_t seq;                  // odd while the writer is updating the record
+    uint32_t key_count;            // 0 for a free or removed record
+    char sensor_id[I2C_STATE_ID_LEN];
+    int64_t update_time_ms;        // wall clock time of the sample
+    int64_t capture_time_ns;       // CLOCK_BOOTTIME when the sample's transfer completed, 0 if unknown
+    int64_t publish_time_ns;       // CLOCK_BOOTTIME when it was published
+    struct i2c_state_entry entries[I2C_STATE_MAX_KEYS];
+};
+
+struct i2c_state_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_count;
+    uint32_t record_size;          // sizeof(struct i2c_state_record), for layout checks
+    uint32_t generation;           // bumped when a record is assigned to a new sensor
+    uint32_t reserved[3];
+};
+
+/** Mapped state region as seen by a reader. */
+struct i2c_state_region {
+    const struct i2c_state_header *header;
+    const struct i2c_state_record *records;
+    uint64_t size;
+};
+
+/*
+ * Reader API. Safe to use from any process that received the region's fd.
+ */
+
+/** Maps a region read-only. Returns 0, or -1 if the fd does not hold a compatible region. */
+int i2c_state_map(int fd, struct i2c_state_region *region);
+
+/** Unmaps a region mapped with i2c_state_map. */
+void i2c_state_unmap(struct i2c_state_region *region);
+
+/** Returns the number of record slots in the region. */
+uint32_t i2c_state_record_count(const struct i2c_state_region *region);
+
+/**
+ * Copies a consistent snapshot of record `index` into `out`.
+ * Returns 1 if the record holds a sample, 0 if it is free, -1 if index is out of
+ * range, or -1 with errno EAGAIN if no consistent copy could be taken, as when
+ * the writer died in the middle of an update.
+ */
+int i2c_state_read(const struct i2c_state_region *region, uint32_t index, struct i2c_state_record *out);
+
+/**
+ * Finds the record of a sensor. Returns its index, or -1 if the sensor is not
+ * published or its record cannot be read.
+ */
+int i2c_state_find(const struct i2c_state_region *region, const char *sensor_id);
+
+/** Looks up one value in a snapshot. Returns 0 and sets *value, or -1 if the key is absent. */
+int i2c_state_value(const struct i2c_state_record *record, const char *key, double *value);
+
+/*
+ * Writer API, used by the library itself.
+ */
+
+/** Creates the process-wide region. path may be NULL for an anonymous region. Returns its fd, or -1. */
+int i2c_state_create(uint32_t record_count, const char *path);
+
+/** Returns the fd of the region created by i2c_state_create, or -1. */
+int i2c_state_fd(void);
+
+/**
+ * Publishes a sample. sensor_id must be shorter than I2C_STATE_ID_LEN. Returns
+ * the record index, or -1 if the id is too long or the region is full or missing.
+ */
+int i2c_state_publish(const char *sensor_id, int64_t update_time_ms, int64_t capture_time_ns,
+                      const char *const *keys, const double *values, uint32_t count);
+
+/** Removes a sensor's record. Returns 0, or -1 if it was not published. */
+int i2c_state_remove(const char *sensor_id);
+
+#endif //I2C_STATE_SHM_H
@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "I2cTrace.h"
+
+/*
+ * Ring of fixed-size slots, written lock-free by any number of transfer threads.
+ * A writer claims slot n by incrementing head. Its seq is odd while the slot is
+ * written and 2 * (n + 1) once it is complete, as in the i2cd sample ring.
+ */
+struct i2c_trace_slot {
+    uint64_t seq;
+    struct i2c_trace_record record;
+    uint8_t payload[I2C_TRACE_MAX_PAYLOAD];
+};
+
+int i2c_trace_on = 0;
+
+static struct i2c_trace_slot *slots = NULL;
+static uint32_t slot_count = 0;
+static uint64_t head = 0;
+static int64_t start_ns = 0;
+static pthread_mutex_t control_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int64_t clock_ns(clockid_t clock)
+{
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+int i2c_trace_start(uint32_t capacity)
+{
+    pthread_mutex_lock(&control_lock);
+    if (slots == NULL) {
+        uint32_t count = capacity > 0 ? capacity : I2C_TRACE_DEFAULT_CAPACITY;
+        struct i2c_trace_slot *ring = calloc(count, sizeof(*ring));
+        if (ring == NULL) {
+            pthread_mutex_unlock(&control_lock);
+            return -1;
+        }
+        slot_count = count;
+        __atomic_store_n(&slots, ring, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&i2c_trace_on, 0, __ATOMIC_RELAXED);
+    // Writers still finishing an old record may land after the reset; the seq
+    // check in the dump discards them
+    for (uint32_t i = 0; i < slot_count; i++) {
+        __atomic_store_n(&slots[i].seq, 0, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&head, 0, __ATOMIC_RELEASE);
+    start_ns = clock_ns(CLOCK_MONOTONIC);
+    __atomic_store_n(&i2c_trace_on, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&control_lock);
+    return 0;
+}
+
+void i2c_trace_stop(void)
+{
+    __atomic_store_n(&i2c_trace_on, 0, __ATOMIC_RELAXED);
+}
+
+void i2c_trace_write(const struct i2c_trace_record *record, const uint8_t *payload)
+{
+    struct i2c_trace_slot *ring = __atomic_load_n(&slots, __ATOMIC_ACQUIRE);
+    if (ring == NULL) {
+        return;
+    }
+    uint64_t n = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED);
+    struct i2c_trace_slot *slot = &ring[n % slot_count];
+    __atomic_store_n(&slot->seq, 2 * n + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->record = *record;
+    if (record->length > 0 && payload != NULL) {
+        memcpy(slot->payload, payload, record->length);
+    }
+    __atomic_store_n(&slot->seq, 2 * (n + 1), __ATOMIC_RELEASE);
+}
+
+int i2c_trace_dump(const char *path)
+{
+    pthread_mutex_lock(&control_lock);
+    if (slots == NULL) {
+        pthread_mutex_unlock(&control_lock);
+        return -1;
+    }
+    FILE *out = fopen(path, "wb");
+    if (out == NULL) {
+        pthread_mutex_unlock(&control_lock);
+        return -1;
+    }
+
+    uint64_t end = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+    uint64_t first = end > slot_count ? end - slot_count : 0;
+
+    struct i2c_trace_file_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = I2C_TRACE_MAGIC;
+    header.version = I2C_TRACE_VERSION;
+    header.header_size = sizeof(header);
+    header.start_ns = start_ns;
+    header.boottime_offset_ns = clock_ns(CLOCK_BOOTTIME) - clock_ns(CLOCK_MONOTONIC);
+    header.dropped = first;
+    // Placeholder; rewritten once the records that could be copied are known
+    fwrite(&header, sizeof(header), 1, out);
+
+    uint32_t count = 0;
+    for (uint64_t n = first; n < end; n++) {
+        const struct i2c_trace_slot *slot = &slots[n % slot_count];
+        struct i2c_trace_slot copy;
+        uint64_t expected = 2 * (n + 1);
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != expected) {
+            header.dropped++;
+            continue;
+        }
+        memcpy(&copy, slot, sizeof(copy));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != expected) {
+            // Overwritten while copying
+            header.dropped++;
+            continue;
+        }
+        if (copy.record.length > I2C_TRACE_MAX_PAYLOAD) {
+            copy.record.length = I2C_TRACE_MAX_PAYLOAD;
+        }
+        fwrite(&copy.record, sizeof(copy.record), 1, out);
+        fwrite(copy.payload, 1, copy.record.length, out);
+        count++;
+    }
+
+    header.count = count;
+    fseek(out, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, out);
+    int failed = ferror(out);
+    if (fclose(out) != 0) {
+        failed = 1;
+    }
+    pthread_mutex_unlock(&control_lock);
+    return failed ? -1 : (int) count;
+}
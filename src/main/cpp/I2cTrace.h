@@ -0,0 +1,98 @@
+#ifndef I2C_TRACE_H
+#define I2C_TRACE_H
+
+#include <stdint.h>
+
+/*
+ * Transfer capture: every bus transfer attempt made by I2cCore can be logged
+ * into an in-memory ring and dumped to a file for offline inspection or replay.
+ *
+ * Recording is off until i2c_trace_start(). While off, a transfer costs one
+ * relaxed load and a branch. While on, it costs one slot copy of about 80 bytes
+ * and no locks or syscalls, so recording can stay on in production. When the
+ * ring is full, the oldest records are overwritten.
+ *
+ * File format (all fields little-endian, as on every supported target):
+ *
+ *   struct i2c_trace_file_header
+ *   count x { struct i2c_trace_record, then record.length payload bytes }
+ *
+ * As in pcap, each record says how many payload bytes follow (length) and how
+ * many the transfer actually moved (orig_length). Payloads longer than
+ * I2C_TRACE_MAX_PAYLOAD are truncated. The payload holds the bytes written for
+ * writes, and the bytes read for successful reads. Records are in start time
+ * order within a thread; a reader should sort by timestamp_ns if it needs a
+ * global order. Readers must skip header_size bytes to reach the first record,
+ * and must reject files with a higher major version (version >> 8).
+ */
+
+#define I2C_TRACE_MAGIC   0x49325452u /* "I2TR" */
+#define I2C_TRACE_VERSION 0x0100      /* major 1, minor 0 */
+
+#define I2C_TRACE_MAX_PAYLOAD 32
+#define I2C_TRACE_DEFAULT_CAPACITY 16384
+
+/** What kind of transfer a record describes. */
+enum i2c_trace_op {
+    I2C_TRACE_OP_SELECT = 1,   // I2C_SLAVE ioctl; addr is the new address, nothing on the wire
+    I2C_TRACE_OP_SMBUS,        // I2C_SMBUS ioctl; smbus_size holds the SMBus transaction size
+    I2C_TRACE_OP_RDWR_READ,    // I2C_RDWR register write + repeated start + read
+    I2C_TRACE_OP_RDWR_WRITE,   // I2C_RDWR of (register, value) messages; payload alternates reg, value
+    I2C_TRACE_OP_READ,         // plain read()
+    I2C_TRACE_OP_WRITE,        // plain write()
+};
+
+#define I2C_TRACE_FLAG_READ  0x01  // data moved from the device
+#define I2C_TRACE_FLAG_RETRY 0x02  // not the first attempt of this transfer
+
+struct i2c_trace_file_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;          // offset of the first record
+    int64_t start_ns;              // CLOCK_MONOTONIC when recording started
+    int64_t boottime_offset_ns;    // CLOCK_BOOTTIME - CLOCK_MONOTONIC at dump time
+    uint64_t dropped;              // records overwritten before the dump
+    uint32_t count;                // records in the file
+    uint32_t reserved;
+};
+
+struct i2c_trace_record {
+    int64_t timestamp_ns;          // CLOCK_MONOTONIC when the attempt started
+    uint32_t latency_ns;           // duration of the attempt, saturated at UINT32_MAX
+    int32_t result;                // return value of the attempt, or -errno on failure
+    int16_t fd;
+    uint16_t addr;                 // 7-bit slave address
+    uint8_t op;                    // enum i2c_trace_op
+    uint8_t flags;                 // I2C_TRACE_FLAG_*
+    uint8_t reg;                   // register or command byte, 0 if none
+    uint8_t smbus_size;            // I2C_SMBUS_* size for I2C_TRACE_OP_SMBUS, else 0
+    uint16_t orig_length;          // payload bytes the transfer moved
+    uint8_t length;                // payload bytes recorded after this header
+    uint8_t reserved[5];
+};
+
+extern int i2c_trace_on;
+
+static inline int i2c_trace_active(void)
+{
+    return __atomic_load_n(&i2c_trace_on, __ATOMIC_RELAXED);
+}
+
+/**
+ * Starts recording into a ring of capacity records (0 for the default) and
+ * clears what was recorded before. The ring is allocated by the first call and
+ * keeps that size until the process exits.
+ */
+int i2c_trace_start(uint32_t capacity);
+void i2c_trace_stop(void);
+
+/** Appends one attempt; called by I2cCore, only while i2c_trace_active(). */
+void i2c_trace_write(const struct i2c_trace_record *record, const uint8_t *payload);
+
+/**
+ * Writes the records currently in the ring to path in the format above.
+ * Recording continues. Returns the number of records written, or -1.
+ */
+int i2c_trace_dump(const char *path);
+
+#endif //I2C_TRACE_H
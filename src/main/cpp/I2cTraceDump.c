@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <linux/i2c.h>
+
+#include "I2cTrace.h"
+
+/*
+ * i2ctrace: prints a transfer capture (see I2cTrace.h) as text, one line per attempt:
+ *
+ *   <seconds since start> <latency>us fd=<fd> 0x<addr> <op> <R|W> reg=0x<reg> [<payload>] -> <result>
+ *
+ * Usage: i2ctrace capture.i2ctrace
+ */
+
+static const char *op_name(const struct i2c_trace_record *record)
+{
+    switch (record->op) {
+        case I2C_TRACE_OP_SELECT:
+            return "SELECT";
+        case I2C_TRACE_OP_SMBUS:
+            switch (record->smbus_size) {
+                case I2C_SMBUS_QUICK:
+                    return "SMBUS_QUICK";
+                case I2C_SMBUS_BYTE:
+                    return "SMBUS_BYTE";
+                case I2C_SMBUS_BYTE_DATA:
+                    return "SMBUS_BYTE_DATA";
+                case I2C_SMBUS_WORD_DATA:
+                    return "SMBUS_WORD_DATA";
+                case I2C_SMBUS_BLOCK_DATA:
+                    return "SMBUS_BLOCK_DATA";
+                case I2C_SMBUS_I2C_BLOCK_BROKEN:
+                    return "SMBUS_I2C_BLOCK_32";
+                case I2C_SMBUS_I2C_BLOCK_DATA:
+                    return "SMBUS_I2C_BLOCK";
+                default:
+                    return "SMBUS";
+            }
+        case I2C_TRACE_OP_RDWR_READ:
+            return "RDWR_READ";
+        case I2C_TRACE_OP_RDWR_WRITE:
+            return "RDWR_WRITE";
+        case I2C_TRACE_OP_READ:
+            return "READ";
+        case I2C_TRACE_OP_WRITE:
+            return "WRITE";
+        default:
+            return "?";
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s capture\n", argv[0]);
+        return 2;
+    }
+    FILE *in = fopen(argv[1], "rb");
+    if (in == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    struct i2c_trace_file_header header;
+    if (fread(&header, sizeof(header), 1, in) != 1 || header.magic != I2C_TRACE_MAGIC) {
+        fprintf(stderr, "%s: not a transfer capture\n", argv[1]);
+        return 1;
+    }
+    if ((header.version >> 8) > (I2C_TRACE_VERSION >> 8)) {
+        fprintf(stderr, "%s: unsupported version %d.%d\n", argv[1], header.version >> 8, header.version & 0xFF);
+        return 1;
+    }
+    fseek(in, header.header_size, SEEK_SET);
+    printf("# %" PRIu32 " records, %" PRIu64 " dropped\n", header.count, header.dropped);
+
+    for (uint32_t i = 0; i < header.count; i++) {
+        struct i2c_trace_record record;
+        uint8_t payload[256];
+        if (fread(&record, sizeof(record), 1, in) != 1 ||
+            fread(payload, 1, record.length, in) != record.length) {
+            fprintf(stderr, "%s: truncated after %" PRIu32 " records\n", argv[1], i);
+            return 1;
+        }
+        printf("%12.6f %6" PRIu32 "us fd=%d 0x%02x %-18s %c%c reg=0x%02x [",
+               (double) (record.timestamp_ns - header.start_ns) / 1e9, record.latency_ns / 1000,
+               record.fd, record.addr, op_name(&record),
+               record.flags & I2C_TRACE_FLAG_READ ? 'R' : 'W',
+               record.flags & I2C_TRACE_FLAG_RETRY ? '+' : ' ', record.reg);
+        for (int j = 0; j < record.length; j++) {
+            printf(j == 0 ? "%02x" : " %02x", payload[j]);
+        }
+        if (record.orig_length > record.length) {
+            printf(" ...%d", record.orig_length);
+        }
+        printf("] -> %" PRId32 "\n", record.result);
+    }
+    fclose(in);
+    return 0;
+}
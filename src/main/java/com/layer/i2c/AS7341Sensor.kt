@@ -225,6 +225,7 @@ open class AS7341Sensor : I2CSensor {
         override val errorMessage = lastError()
         override val connected = this@AS7341Sensor.isConnected()
         override val updateTS = this@AS7341Sensor.updateTS
+        override val captureTimeNanos = this@AS7341Sensor.sampleTimeNanos
         override val sensorId = this@AS7341Sensor.toString()
         override val channelData: Map<String, Int> = getLatestChannelData().toMap()
     }
@@ -249,18 +250,23 @@ open class AS7341Sensor : I2CSensor {
         return this.primaryChannelData
     }
 
+    // A full measurement and channel extraction, shared by concurrent callers of measure()
+    override suspend fun measureOnce(): Map<String, Int> {
+        val rawData = readAllChannels()
+        return if (rawData.isEmpty()) emptyMap() else extractPrimaryChannels(rawData)
+    }
+
     // --- Spectral data reading ---
 
     suspend fun readSpectralDataOnce(): Map<String, Int> {
         if (!connect()) {
             return emptyMap()
         }
-        val rawData = readAllChannels()
-        if (rawData.isEmpty()) {
+        val primaryData = measure()
+        if (primaryData.isEmpty()) {
             Log.w(TAG, "Read failed or returned empty data for $busPath.")
-            return emptyMap()
         }
-        return extractPrimaryChannels(rawData)
+        return primaryData
     }
 
     suspend fun readSpectralData(): Map<String, Int> {
@@ -278,11 +284,11 @@ open class AS7341Sensor : I2CSensor {
         while (attempt <= maxRetries) {
             try {
                 Log.d(TAG, "Attempting spectral data read (attempt ${attempt + 1}/${maxRetries + 1}) on fd=$fileDescriptor")
-                val rawData = readAllChannels()
+                val primaryData = measure()
 
-                if (rawData.isNotEmpty()) {
+                if (primaryData.isNotEmpty()) {
                     Log.d(TAG, "Spectral data read successful on attempt ${attempt + 1} for fd=$fileDescriptor")
-                    return extractPrimaryChannels(rawData)
+                    return primaryData
                 } else {
                     Log.w(TAG, "Read returned empty data on attempt ${attempt + 1} for fd=$fileDescriptor")
                 }
@@ -504,9 +510,7 @@ open class AS7341Sensor : I2CSensor {
     private fun writeSmuxConfigTransaction(config: IntArray) {
         // Set SMUX command to "write" (CMD=2) BEFORE writing config, matching Adafruit sequence
         writeByteRegTransaction(REG_CFG6, 0x10)  // SMUX_CMD bits [4:3] = 0b10 = 2
-        for (i in config.indices) {
-            writeByteRegTransaction(i, config[i])
-        }
+        writeByteRegsTransaction(IntArray(config.size) { it }, config)
     }
 
 
@@ -527,7 +531,7 @@ open class AS7341Sensor : I2CSensor {
             if (!smuxActive) {
                 return
             }
-            delay(1)
+            conversionDelay(1)
         }
         Log.w(TAG, "SMUX load timed out on fd=$fileDescriptor")
     }
@@ -552,7 +556,7 @@ open class AS7341Sensor : I2CSensor {
             if (avalid) {
                 return true
             }
-            delay(10)
+            conversionDelay(10)
         }
         return false
     }
@@ -564,6 +568,7 @@ open class AS7341Sensor : I2CSensor {
     private fun readDataRegistersTransaction(): List<Int> {
         val dataBytes = ByteArray(BYTES_PER_SMUX)
         val bytesRead = I2cNative.readBlockData(fileDescriptor, REG_DATA0_L, dataBytes, dataBytes.size)
+        markSampleCaptured()
 
         if (bytesRead == dataBytes.size) {
             val values = mutableListOf<Int>()
@@ -584,6 +589,7 @@ open class AS7341Sensor : I2CSensor {
                 val dataH = readByteRegTransaction(dataHReg)
                 values.add(((dataH and 0xFF) shl 8) or (dataL and 0xFF))
             }
+            markSampleCaptured()
             return values
         }
     }
@@ -11,7 +11,7 @@ import kotlin.math.min
  * High-level interface for the AS7343 spectral sensor.
  * Provides convenient methods for sensor operations.
  */
-open class AS7343Sensor : I2CSensor {
+open class AS7343Sensor : I2CSensor, BroadcastTriggerable, BroadcastConfigurable {
 
     /**
      * Constructor for direct I2C connection (no multiplexer).
@@ -54,6 +54,14 @@ open class AS7343Sensor : I2CSensor {
     
     private var updateTS : Long = 0
     
+    // The configuration registers from CFG1 up to FD_STATUS hold what the driver
+    // wrote, and reading them has no side effects. The data registers change with
+    // every measurement and FD_STATUS with flicker detection, so they cannot serve
+    // as the reference. The 29 bytes fit in an SMBus block, so the probe checks
+    // block reads rather than finding a longer limit.
+    override val blockProbeRange: IntRange? =
+        REG_CFG1 until AS7343_FD_STATUS_REG
+    
     companion object : SensorFactory<I2CSensor> {
         
         override fun create(busPath:String): AS7343Sensor = AS7343Sensor(busPath)
@@ -70,6 +78,7 @@ open class AS7343Sensor : I2CSensor {
         // Status Registers (Bank 0)
         private const val AS7343_STATUS2_REG = 0x90     // Secondary Status (AVALID, Saturation flags)
         private const val AS7343_ASTATUS_REG = 0x94     // Latched Gain/Saturation for DATA read
+        private const val AS7343_FD_STATUS_REG = 0xE3   // Flicker detection status, changes as FD runs
 
         // Data Registers (Bank 0)
         private const val AS7343_DATA0_L_REG = 0x95      // Base address for DATA_0_L
@@ -276,6 +285,7 @@ open class AS7343Sensor : I2CSensor {
         override val errorMessage = lastError()
         override val connected = this@AS7343Sensor.isConnected()
         override val updateTS = this@AS7343Sensor.updateTS
+        override val captureTimeNanos = this@AS7343Sensor.sampleTimeNanos
         override val sensorId = this@AS7343Sensor.toString()
         override val channelData :  Map<String, Int> = getLatestChannelData().toMap()
     }
@@ -289,6 +299,11 @@ open class AS7343Sensor : I2CSensor {
     }
     
     override suspend fun readDataImpl(): Map<String, Int> {
+        if (triggeredResult) {
+            // Collected after a broadcast trigger; primaryChannelData already holds it
+            triggeredResult = false
+            return this.primaryChannelData
+        }
         val read = readSpectralDataOnce()
         return if (read.isEmpty()) {
             read
@@ -300,6 +315,59 @@ open class AS7343Sensor : I2CSensor {
     fun getLatestChannelData(): Map<String, Int> {
         return this.primaryChannelData
     }
+
+    // A full measurement and channel extraction, shared by concurrent callers of measure()
+    override suspend fun measureOnce(): Map<String, Int> {
+        val rawData = readAllChannels()
+        return if (rawData.isEmpty()) emptyMap() else extractPrimaryChannels(rawData)
+    }
+
+    // Set when collectTriggered stored a result the next read hands out
+    @Volatile
+    private var triggeredResult = false
+
+    // Bank 0 (CONFIG0 holds nothing else this driver sets), then power and SP_EN together
+    override fun broadcastTriggerWrites(): Pair<IntArray, IntArray> =
+        Pair(intArrayOf(REG_CONFIG0, REG_ENABLE), intArrayOf(0, (1 shl BIT_POWER) or (1 shl BIT_MEASUREMENT)))
+
+    // performProperPowerOnReset() as absolute writes: the register bits it would
+    // preserve by read-modify-write are at their reset values after power-on
+    override fun broadcastInitSteps(): List<BroadcastStep> = listOf(
+        // Bank 0, powered off
+        BroadcastStep(intArrayOf(REG_CONFIG0, REG_ENABLE), intArrayOf(0, 0), settleMs = 5),
+        // Power on (>200us initialization)
+        BroadcastStep(intArrayOf(REG_ENABLE), intArrayOf(1 shl BIT_POWER), settleMs = 1),
+        // Clear SAI, 18-channel auto_smux, ATIME=0 / ASTEP=65534, gain 512x
+        BroadcastStep(
+            intArrayOf(AS7343_CONTROL_REG, AS7343_CFG20_REG, REG_ATIME, REG_ASTEP_L, REG_ASTEP_L + 1, REG_CFG1),
+            intArrayOf(1 shl AS7343_CLEAR_SAI_ACT_BIT, AS7343_AUTO_SMUX_MODE_18CH shl AS7343_CFG20_AUTO_SMUX_SHIFT,
+                0, 65534 and 0xFF, 65534 shr 8, 10)
+        )
+    )
+
+    // One ID read per device, as in step 9 of performProperPowerOnReset()
+    override fun verifyBroadcastInit(): Boolean = isSensorResponsive()
+
+    override suspend fun collectTriggered(timeoutMs: Long): Boolean {
+        if (fileDescriptor < 0) return false
+        val rawData = executeTransaction {
+            if (!waitForDataReadyTransaction(timeoutMs)) {
+                Log.e(TAG, "Timeout waiting for broadcast-triggered data on fd=$fileDescriptor")
+                enableSpectralMeasurementTransaction(false)
+                return@executeTransaction emptyMap<String, Int>()
+            }
+            val channelData = readChannelsTransaction()
+            enableSpectralMeasurementTransaction(false)
+            channelData
+        }
+        if (rawData.isEmpty()) {
+            return false
+        }
+        extractPrimaryChannels(rawData)
+        triggeredResult = true
+        return true
+    }
+
     /**
      * Reads all spectral channels from the sensor.
      * Handles connect/disconnect internally for a single read operation.
@@ -312,14 +380,13 @@ open class AS7343Sensor : I2CSensor {
         if (!connect()) {
             return emptyMap()
         }
-        val rawData = readAllChannels()
+        val primaryData = measure()
         // Do not disconnect here if caller wants to manage connection externally
         // disconnect()
-        if (rawData.isEmpty()) {
+        if (primaryData.isEmpty()) {
             Log.w(TAG, "Read failed or returned empty data for $busPath.")
-            return emptyMap()
         }
-        return extractPrimaryChannels(rawData) // Return the filtered primary channels
+        return primaryData
     }
 
     /**
@@ -350,12 +417,12 @@ open class AS7343Sensor : I2CSensor {
             try {
                 Log.d(TAG, "Attempting spectral data read (attempt ${attempt + 1}/${maxRetries + 1}) on fd=$fileDescriptor")
 
-                val rawData = readAllChannels()
+                val primaryData = measure()
 
-                if (rawData.isNotEmpty()) {
+                if (primaryData.isNotEmpty()) {
                     Log.d(TAG, "Spectral data read successful on attempt ${attempt + 1} for fd=$fileDescriptor")
 
-                    return extractPrimaryChannels(rawData)
+                    return primaryData
                 } else {
                     Log.w(TAG, "Read returned empty data on attempt ${attempt + 1} for fd=$fileDescriptor")
                 }
@@ -547,8 +614,6 @@ open class AS7343Sensor : I2CSensor {
 
         return try {
             executeTransaction {
-                val channelData = mutableMapOf<String, Int>()
-                
                 setBankTransaction(false) // Ensure Bank 0
                 Log.d(TAG, "Starting spectral measurement on fd=$fileDescriptor")
 
@@ -563,31 +628,8 @@ open class AS7343Sensor : I2CSensor {
                 }
                 Log.d(TAG, "Data ready on fd=$fileDescriptor")
 
-                // 3. Read ASTATUS (contains saturation info, read to clear it)
-                readByteRegTransaction(AS7343_ASTATUS_REG)
-                // We don't use the value, but reading it clears latched status bits
-
-                // 4. Read all data registers in a single block read (36 bytes for 18 channels)
-                val dataBytes = ByteArray(AS7343_NUM_DATA_REGISTERS * 2)
-                val bytesRead = I2cNative.readBlockData(fileDescriptor, AS7343_DATA0_L_REG, dataBytes, dataBytes.size)
-                if (bytesRead == dataBytes.size) {
-                    // Parse 18 little-endian 16-bit values
-                    for (i in 0 until AS7343_NUM_DATA_REGISTERS) {
-                        val lo = dataBytes[i * 2].toInt() and 0xFF
-                        val hi = dataBytes[i * 2 + 1].toInt() and 0xFF
-                        val value = (hi shl 8) or lo
-                        val name = dataRegisterNames.getOrElse(i) { "Unknown_Data_$i" }
-                        channelData[name] = value
-                    }
-                } else {
-                    // Fallback to individual register reads if block read fails
-                    Log.w(TAG, "Block read returned $bytesRead bytes (expected ${dataBytes.size}), falling back to individual reads on fd=$fileDescriptor")
-                    for (i in 0 until AS7343_NUM_DATA_REGISTERS) {
-                        val value = readDataChannelTransaction(i)
-                        val name = dataRegisterNames.getOrElse(i) { "Unknown_Data_$i" }
-                        channelData[name] = value
-                    }
-                }
+                // 3-4. Read latched status and all data registers
+                val channelData = readChannelsTransaction()
 
                 // 5. Disable Spectral Measurement
                 enableSpectralMeasurementTransaction(false)
@@ -615,11 +657,45 @@ open class AS7343Sensor : I2CSensor {
     }
 
 
+    /**
+     * Reads ASTATUS and the 18 data registers of a finished measurement.
+     * Must run inside a transaction, with Bank 0 selected.
+     */
+    private fun readChannelsTransaction(): Map<String, Int> {
+        val channelData = mutableMapOf<String, Int>()
+        // Read ASTATUS (contains saturation info, read to clear it)
+        readByteRegTransaction(AS7343_ASTATUS_REG)
+        // We don't use the value, but reading it clears latched status bits
+
+        // Read all data registers in a single block read (36 bytes for 18 channels)
+        val dataBytes = ByteArray(AS7343_NUM_DATA_REGISTERS * 2)
+        val bytesRead = I2cNative.readBlockData(fileDescriptor, AS7343_DATA0_L_REG, dataBytes, dataBytes.size)
+        markSampleCaptured()
+        if (bytesRead == dataBytes.size) {
+            // Parse 18 little-endian 16-bit values
+            for (i in 0 until AS7343_NUM_DATA_REGISTERS) {
+                val lo = dataBytes[i * 2].toInt() and 0xFF
+                val hi = dataBytes[i * 2 + 1].toInt() and 0xFF
+                val value = (hi shl 8) or lo
+                val name = dataRegisterNames.getOrElse(i) { "Unknown_Data_$i" }
+                channelData[name] = value
+            }
+        } else {
+            // Fallback to individual register reads if block read fails
+            Log.w(TAG, "Block read returned $bytesRead bytes (expected ${dataBytes.size}), falling back to individual reads on fd=$fileDescriptor")
+            for (i in 0 until AS7343_NUM_DATA_REGISTERS) {
+                val value = readDataChannelTransaction(i)
+                val name = dataRegisterNames.getOrElse(i) { "Unknown_Data_$i" }
+                channelData[name] = value
+            }
+            markSampleCaptured()
+        }
+        return channelData
+    }
+
     private fun getIsDataReady(): Boolean {
         // Use the shared file descriptor lock
-        val lock = fdLock ?: this
-
-        synchronized(lock) {
+        withBusLock {
             // Ensure we're talking to the right device
             if (!switchToDeviceBlocking()) {
                 Log.e(TAG, "Failed to switch device before getIsDataReady")
@@ -638,16 +714,14 @@ open class AS7343Sensor : I2CSensor {
             if (System.currentTimeMillis() - startTime > timeoutMillis) {
                 return false // Timeout
             }
-            delay(10) // Polling interval
+            conversionDelay(10) // Polling interval
         }
         return true // Data is ready
     }
 
     private fun readDataChannel(channelIndex: Int): Int {
         // Use the shared file descriptor lock
-        val lock = fdLock ?: this
-
-        synchronized(lock) {
+        withBusLock {
             // Ensure we're talking to the right device
             if (!switchToDeviceBlocking()) {
                 Log.e(TAG, "Failed to switch device before readDataChannel")
@@ -927,7 +1001,7 @@ open class AS7343Sensor : I2CSensor {
                 return true
             }
 
-            delay(10) // Wait 10ms before next check
+            conversionDelay(10) // Wait 10ms before next check
         }
 
         return false // Timeout
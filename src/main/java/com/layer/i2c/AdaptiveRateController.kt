@@ -0,0 +1,118 @@
+package com.layer.i2c
+
+import kotlin.math.abs
+
+/**
+ * Picks a sensor's read interval from how fast its readings change.
+ *
+ * For every numeric field the controller tracks a smoothed rate of change and
+ * estimates how long the field takes to drift by its tolerance. While readings
+ * are stable the interval grows by [growthFactor] per sample up to [maxIntervalMs];
+ * when a field moves by more than its tolerance between two samples the interval
+ * drops at once to the estimated time-to-tolerance, down to [minIntervalMs].
+ *
+ * A field's tolerance is the larger of its absolute tolerance (see [setTolerance])
+ * and [relativeTolerance] times its magnitude. Fields whose tolerance comes out
+ * as zero, and non-numeric fields, don't steer the rate.
+ *
+ * Attach to a sensor with I2CSensor.rateController; the bus loop then reads the
+ * sensor every [intervalMs] instead of every minReadIntervalMs.
+ */
+class AdaptiveRateController(
+    val minIntervalMs: Long,
+    val maxIntervalMs: Long,
+    initialIntervalMs: Long = minIntervalMs,
+    val relativeTolerance: Double = DEFAULT_RELATIVE_TOLERANCE,
+    val growthFactor: Double = DEFAULT_GROWTH_FACTOR
+) {
+    companion object {
+        const val DEFAULT_RELATIVE_TOLERANCE = 0.02
+        const val DEFAULT_GROWTH_FACTOR = 1.5
+        // Weight of the newest rate estimate in the smoothed rate
+        private const val RATE_SMOOTHING = 0.5
+        // Fraction of the time-to-tolerance to aim for, leaving margin for acceleration
+        private const val TARGET_MARGIN = 0.5
+    }
+
+    init {
+        require(minIntervalMs > 0 && maxIntervalMs >= minIntervalMs) {
+            "Invalid interval bounds $minIntervalMs..$maxIntervalMs"
+        }
+        require(growthFactor >= 1.0) { "Growth factor must be at least 1" }
+    }
+
+    private class FieldState(var value: Double, var ratePerMs: Double = 0.0)
+
+    private val fields = HashMap<String, FieldState>()
+    private val tolerances = HashMap<String, Double>()
+    private var lastCaptureNs = 0L
+
+    /** Interval the sensor should currently be read at */
+    @Volatile
+    var intervalMs: Long = initialIntervalMs.coerceIn(minIntervalMs, maxIntervalMs)
+        private set
+
+    /**
+     * Set the absolute change of a field the consumer can tolerate going unseen,
+     * in the field's own units. Pass null to fall back to [relativeTolerance].
+     */
+    @Synchronized
+    fun setTolerance(field: String, tolerance: Double?) {
+        if (tolerance == null) tolerances.remove(field) else tolerances[field] = tolerance
+    }
+
+    /**
+     * Feed a sample captured at [captureNs] (CLOCK_BOOTTIME) and update [intervalMs].
+     */
+    @Synchronized
+    fun update(data: Map<String, Any>, captureNs: Long) {
+        val elapsedMs = if (lastCaptureNs > 0 && captureNs > lastCaptureNs) {
+            (captureNs - lastCaptureNs) / 1_000_000.0
+        } else {
+            0.0
+        }
+        lastCaptureNs = captureNs
+
+        var changed = false
+        // Shortest estimated time for any field to drift by its tolerance
+        var timeToToleranceMs = Double.MAX_VALUE
+        for ((key, raw) in data) {
+            val value = (raw as? Number)?.toDouble() ?: continue
+            val state = fields[key]
+            if (state == null) {
+                fields[key] = FieldState(value)
+                continue
+            }
+            val tolerance = maxOf(tolerances[key] ?: 0.0, relativeTolerance * abs(value))
+            val delta = abs(value - state.value)
+            state.value = value
+            if (elapsedMs <= 0.0) continue
+
+            state.ratePerMs += RATE_SMOOTHING * (delta / elapsedMs - state.ratePerMs)
+            if (tolerance <= 0.0) continue
+            if (delta > tolerance) {
+                changed = true
+            }
+            if (state.ratePerMs > 0.0) {
+                timeToToleranceMs = minOf(timeToToleranceMs, tolerance / state.ratePerMs)
+            }
+        }
+        if (elapsedMs <= 0.0) return
+
+        val targetMs = timeToToleranceMs * TARGET_MARGIN
+        val next = if (changed) {
+            minOf(intervalMs.toDouble(), targetMs)
+        } else {
+            minOf(intervalMs * growthFactor, targetMs)
+        }
+        intervalMs = next.coerceIn(minIntervalMs.toDouble(), maxIntervalMs.toDouble()).toLong()
+    }
+
+    /** Forget the signal history, e.g. after the sensor reconnects */
+    @Synchronized
+    fun reset() {
+        fields.clear()
+        lastCaptureNs = 0
+        intervalMs = minIntervalMs
+    }
+}
@@ -0,0 +1,79 @@
+package com.layer.i2c
+
+import android.util.Log
+import kotlinx.coroutines.delay
+
+/**
+ * One step of a broadcast configuration: (register, value) writes sent to every
+ * device of a group at once, then [settleMs] of waiting before the next step.
+ */
+class BroadcastStep(val registers: IntArray, val values: IntArray, val settleMs: Long = 0)
+
+/**
+ * A sensor whose configuration can be pushed to several devices with one
+ * broadcast, then checked on each device on its own.
+ */
+interface BroadcastConfigurable {
+    /**
+     * The writes that take the device from power-on to configured. They must be the
+     * same for every instance and must not depend on reading the device first.
+     */
+    fun broadcastInitSteps(): List<BroadcastStep>
+
+    /**
+     * Checks the device after the broadcast steps, with as few transfers as the
+     * driver can afford.
+     * @return true if the device is configured
+     */
+    fun verifyBroadcastInit(): Boolean
+}
+
+/**
+ * Bulk initialization of same-address sensors on one multiplexer.
+ *
+ * Identical sensors behind different channels of a TCA9548 are normally
+ * initialized one after another, each with its own channel selection and the
+ * full write sequence. Here the devices are opened first, the configuration
+ * writes go out once with all their channels open, and only the verification is
+ * done per channel. A sensor that fails verification stays disconnected and is
+ * connected on its own later.
+ */
+object BroadcastInit {
+    private const val TAG = "BroadcastInit"
+
+    /**
+     * Connects the sensors of [group], as grouped by MultiplexerTree.broadcastGroups,
+     * configuring them with one broadcast per step.
+     *
+     * @return the sensors that are connected
+     */
+    suspend fun initialize(group: List<I2CSensor>): List<I2CSensor> {
+        val opened = group.filter { !it.isReady() && it.openForConnect() }
+        if (opened.isEmpty()) {
+            return emptyList()
+        }
+        val leader = opened.first()
+        if (opened.size < 2) {
+            return opened.filter { it.finishConnect() }
+        }
+
+        try {
+            for (step in (leader as BroadcastConfigurable).broadcastInitSteps()) {
+                leader.broadcastWrites(opened.drop(1), step.registers, step.values)
+                if (step.settleMs > 0) {
+                    delay(step.settleMs)
+                }
+            }
+        } catch (e: Exception) {
+            Log.e(TAG, "Broadcast configuration of ${opened.size} sensors at ${leader.getAddressHex()} failed, " +
+                    "initializing one by one: ${e.message}")
+            return opened.filter { it.finishConnect() }
+        }
+
+        val connected = opened.filter { sensor ->
+            sensor.finishConnect { (sensor as BroadcastConfigurable).verifyBroadcastInit() }
+        }
+        Log.i(TAG, "Broadcast initialization of ${connected.size}/${opened.size} sensors at ${leader.getAddressHex()}")
+        return connected
+    }
+}
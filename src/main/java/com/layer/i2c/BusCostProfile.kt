@@ -0,0 +1,94 @@
+package com.layer.i2c
+
+/**
+ * What one sensor's reads cost on its bus, over its last [window] reads.
+ *
+ * Per read it keeps the bus-occupied time (time inside I2C transfers, as measured
+ * by the native layer), the wall time of readData, the number of transfer
+ * attempts and the transfers that failed, plus whether the read as a whole failed.
+ * Bus time comes from the bus's running usage counters, so it is only meaningful
+ * while nothing else uses the bus during the read, which holds for the poll loop.
+ * In client mode the daemon does the transfers and only wall time is known.
+ *
+ * Thread safe; the poll loop records while the scheduler and others take snapshots.
+ */
+class BusCostProfile(val window: Int = DEFAULT_WINDOW) {
+    companion object {
+        const val DEFAULT_WINDOW = 32
+    }
+
+    data class Snapshot(
+        val reads: Int,
+        val meanBusNs: Long,
+        val maxBusNs: Long,
+        val meanWallNs: Long,
+        val maxWallNs: Long,
+        val meanTransfers: Double,
+        /** Failed transfers per transfer attempt */
+        val transferFailureRate: Double,
+        /** Failed reads per read */
+        val readFailureRate: Double
+    ) {
+        /** Share of the bus this sensor takes when read every [periodNs] */
+        fun busUtilization(periodNs: Long): Double =
+            if (periodNs > 0) meanBusNs.toDouble() / periodNs else 0.0
+    }
+
+    private val lock = Any()
+    private val busNs = LongArray(window)
+    private val wallNs = LongArray(window)
+    private val transfers = IntArray(window)
+    private val failures = IntArray(window)
+    private val failed = BooleanArray(window)
+    private var next = 0
+    private var count = 0
+
+    init {
+        require(window > 0) { "Window must hold at least one read" }
+    }
+
+    fun record(busNs: Long, wallNs: Long, transfers: Int, failures: Int, failed: Boolean) = synchronized(lock) {
+        this.busNs[next] = busNs
+        this.wallNs[next] = wallNs
+        this.transfers[next] = transfers
+        this.failures[next] = failures
+        this.failed[next] = failed
+        next = (next + 1) % window
+        if (count < window) count++
+    }
+
+    fun snapshot(): Snapshot = synchronized(lock) {
+        if (count == 0) return@synchronized Snapshot(0, 0, 0, 0, 0, 0.0, 0.0, 0.0)
+        var busSum = 0L
+        var busMax = 0L
+        var wallSum = 0L
+        var wallMax = 0L
+        var transferSum = 0L
+        var failureSum = 0L
+        var failedReads = 0
+        for (i in 0 until count) {
+            busSum += busNs[i]
+            busMax = maxOf(busMax, busNs[i])
+            wallSum += wallNs[i]
+            wallMax = maxOf(wallMax, wallNs[i])
+            transferSum += transfers[i]
+            failureSum += failures[i]
+            if (failed[i]) failedReads++
+        }
+        Snapshot(
+            reads = count,
+            meanBusNs = busSum / count,
+            maxBusNs = busMax,
+            meanWallNs = wallSum / count,
+            maxWallNs = wallMax,
+            meanTransfers = transferSum.toDouble() / count,
+            transferFailureRate = if (transferSum > 0) failureSum.toDouble() / transferSum else 0.0,
+            readFailureRate = failedReads.toDouble() / count
+        )
+    }
+
+    fun reset() = synchronized(lock) {
+        next = 0
+        count = 0
+    }
+}
@@ -6,17 +6,14 @@ import kotlinx.coroutines.CoroutineDispatcher
 import kotlinx.coroutines.CoroutineScope
 import kotlinx.coroutines.Dispatchers
 import kotlinx.coroutines.Job
-import kotlinx.coroutines.delay
-import kotlinx.coroutines.isActive
 import kotlinx.coroutines.launch
-import java.io.File
-import kotlin.math.max
 
 /**
  * Reads all CPU and GPU thermal zones and stores the MAX temperature.
  * Used to detect chip-level thermal throttling for fan control.
  *
- * Zones: cpuss (31-34), cpu cores (35-45, 47-49), gpuss (63-70)
+ * Zones are found by type (see [ThermalZones.CHIP]); [ZONE_IDS] is used when no
+ * zone type matches.
  */
 class ChipMaxThermalSensor(context: CoroutineDispatcher = Dispatchers.IO) : DeviceNodeSensor<Float>(0.0f, context) {
 
@@ -25,53 +22,50 @@ class ChipMaxThermalSensor(context: CoroutineDispatcher = Dispatchers.IO) : Devi
     companion object {
         const val TAG = "ChipMaxThermalSensor"
 
-        // CPU subsystem + CPU cores + GPU subsystem zone IDs
+        // CPU subsystem + CPU cores + GPU subsystem zone IDs of the original board: cpuss (31-34),
+        // cpu cores (35-45, 47-49), gpuss (63-70)
         val ZONE_IDS: List<Int> = (31..45).toList() + (47..49).toList() + (63..70).toList()
     }
 
-    private val zones = ZONE_IDS.map { "/sys/class/thermal/thermal_zone$it/temp" }
+    /**
+     * Adapts the poll interval to the headroom to the nearest trip point; null polls
+     * every updateFrequencyMS. May be set while running.
+     */
+    @Volatile
+    var throttleRate: ThrottleAwareRate? = null
+
+    /** Smallest distance of any zone to a trip point in °C, when [throttleRate] is set */
+    val headroomC: Float? get() = throttleRate?.headroomC
+
+    /** Predicted time until throttling starts, when [throttleRate] is set and it is approaching */
+    val timeToTripMs: Long? get() = throttleRate?.timeToTripMs
 
     @SuppressLint("DefaultLocale")
     override fun start(): Job {
         val job = CoroutineScope(context).launch {
-            while (isActive) {
-                var maxTemp = Float.NEGATIVE_INFINITY
-                var readCount = 0
-
-                for (zone in zones) {
-                    try {
-                        val file = File(zone)
-                        if (file.canRead()) {
-                            val temp = file.readText().trim().toInt()
-                            val tempCelsius = temp / 1000.0f
-                            if (tempCelsius > 0 && tempCelsius <= 150) {
-                                maxTemp = max(maxTemp, tempCelsius)
-                                readCount++
-                            }
-                        }
-                    } catch (e: SecurityException) {
-                        Log.e(TAG, "Cannot access thermal zone: $zone")
-                    } catch (e: Exception) {
-                        Log.e(TAG, "Error reading thermal zone $zone: ${e.message}")
-                    }
-                }
-
-                if (readCount > 0) {
-                    state.value = maxTemp
-                    if (maxTemp > 99) {
-                        lastErrorMessage = "Chip max temperature out of range: ${maxTemp}°C"
-                        Log.w(TAG, "Chip max temperature: ${maxTemp}°C (from $readCount zones)")
-                    }
-                } else {
-                    state.value = 0.0f
-                    lastErrorMessage = "No thermal zones readable"
-                    Log.e(TAG, "No thermal zones readable")
-                }
-
-                delay(updateFrequencyMS)
+            // Zones are read by ThermalSampler, shared with the other thermal sensors
+            ThermalSampler.subscribe(ThermalZones.CHIP, { throttleRate?.intervalMs ?: updateFrequencyMS }) { snapshot ->
+                update(snapshot)
             }
         }
         this.job = job
         return job
     }
+
+    private fun update(snapshot: ThermalSampler.Snapshot) {
+        throttleRate?.update(snapshot, ThermalZones.zones(ThermalZones.CHIP))
+        val stats = snapshot.stats(ThermalZones.CHIP) { it > 0 && it <= 150 }
+        if (stats != null) {
+            val maxTemp = stats.max
+            state.value = maxTemp
+            if (maxTemp > 99) {
+                lastErrorMessage = "Chip max temperature out of range: ${maxTemp}°C"
+                Log.w(TAG, "Chip max temperature: ${maxTemp}°C (from ${stats.count} zones)")
+            }
+        } else {
+            state.value = 0.0f
+            lastErrorMessage = "No thermal zones readable"
+            Log.e(TAG, "No thermal zones readable")
+        }
+    }
 }
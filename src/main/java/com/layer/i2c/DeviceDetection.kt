@@ -8,11 +8,13 @@ import android.util.Log
  * @param address The 7-bit I2C address of the device (0x08-0x77)
  * @param channel The multiplexer channel where the device was found (0-7 for TCA9548)
  * @param deviceType Optional device type identification (if detectable)
+ * @param route Full route through cascaded multiplexers, or null if not behind one
  */
 data class DeviceInfo(
     val address: Int,
     val channel: Int,
-    val deviceType: String? = null
+    val deviceType: String? = null,
+    val route: MuxRoute? = null
 ) {
     companion object {
         private const val TAG = "DeviceInfo"
@@ -25,7 +27,8 @@ data class DeviceInfo(
     
     override fun toString(): String {
         val deviceTypeStr = deviceType?.let { " ($it)" } ?: ""
-        return "Device at ${getAddressHex()} on channel $channel$deviceTypeStr"
+        val channelStr = route?.label ?: channel.toString()
+        return "Device at ${getAddressHex()} on channel $channelStr$deviceTypeStr"
     }
     
     fun isSameDevice(other : Any?) : Boolean {
@@ -0,0 +1,141 @@
+package com.layer.i2c
+
+import android.os.Handler
+import android.os.Looper
+import android.util.Log
+import android.view.Choreographer
+
+/**
+ * Render-aware bus pacing.
+ *
+ * The fixed gap between transfers (MIN_I2C_INTERVAL_NS) keeps I2C interrupts from
+ * clustering while a frame is being rendered. With frame pacing the native layer
+ * knows when each frame is due instead: it runs transfers back-to-back in the safe
+ * part of the frame and starts none in the quiet window before the deadline.
+ *
+ * Frame timing comes from a [FrameTimingSource]. [ChoreographerFrameSource] follows
+ * the display; [SyntheticVsyncSource] generates vsync on a plain thread, so the mode
+ * can be exercised without a display. When the source stops reporting, pacing falls
+ * back to the per-bus interval after a few frames.
+ */
+object FramePacing {
+    private const val TAG = "FramePacing"
+
+    /** Receives one call per frame */
+    fun interface Sink {
+        fun onVsync(vsyncNanos: Long, periodNanos: Long)
+    }
+
+    private val nativeSink = Sink { vsyncNanos, periodNanos ->
+        I2cNative.setFrameTiming(vsyncNanos, periodNanos)
+    }
+
+    private var source: FrameTimingSource? = null
+
+    /**
+     * Starts feeding [frameSource] into the native pacer.
+     *
+     * @param quietWindowUs no transfer starts this long before a frame deadline
+     * @param burstIntervalUs gap between transfers in the rest of the frame
+     */
+    @Synchronized
+    fun enable(frameSource: FrameTimingSource, quietWindowUs: Long = 2000, burstIntervalUs: Long = 0) {
+        source?.stop()
+        source = frameSource
+        I2cNative.setFramePacing(quietWindowUs, burstIntervalUs)
+        frameSource.start(nativeSink)
+        Log.d(TAG, "Frame pacing enabled: quiet=${quietWindowUs}us burst=${burstIntervalUs}us")
+    }
+
+    /** Stops the frame source and restores the per-bus interval */
+    @Synchronized
+    fun disable() {
+        source?.stop()
+        source = null
+        I2cNative.setFramePacing(0, 0)
+    }
+}
+
+interface FrameTimingSource {
+    /** Start calling [sink] once per frame */
+    fun start(sink: FramePacing.Sink)
+
+    fun stop()
+}
+
+/**
+ * Frame timing from the display's Choreographer. Callbacks run on the main looper.
+ * Without a known period, it is estimated from the gaps between frames.
+ */
+class ChoreographerFrameSource(private val periodNanos: Long = 0) : FrameTimingSource, Choreographer.FrameCallback {
+    private val handler = Handler(Looper.getMainLooper())
+    @Volatile private var sink: FramePacing.Sink? = null
+    private var lastFrameNanos = 0L
+    private var estimatedPeriod = 0L
+
+    override fun start(sink: FramePacing.Sink) {
+        this.sink = sink
+        handler.post {
+            lastFrameNanos = 0L
+            Choreographer.getInstance().postFrameCallback(this)
+        }
+    }
+
+    override fun stop() {
+        sink = null
+        handler.post { Choreographer.getInstance().removeFrameCallback(this) }
+    }
+
+    override fun doFrame(frameTimeNanos: Long) {
+        val target = sink ?: return
+        if (lastFrameNanos != 0L) {
+            val gap = frameTimeNanos - lastFrameNanos
+            // Skipped frames show up as multiples of the period; only near-single gaps count
+            if (estimatedPeriod == 0L || gap < estimatedPeriod * 3 / 2) {
+                estimatedPeriod = if (estimatedPeriod == 0L) gap else (estimatedPeriod * 7 + gap) / 8
+            }
+        }
+        lastFrameNanos = frameTimeNanos
+        target.onVsync(frameTimeNanos, if (periodNanos > 0) periodNanos else estimatedPeriod)
+        Choreographer.getInstance().postFrameCallback(this)
+    }
+}
+
+/**
+ * Vsync at a fixed rate on its own thread, on the System.nanoTime() clock.
+ * For running frame pacing without a display, e.g. on plain Linux.
+ */
+class SyntheticVsyncSource(private val periodNanos: Long = 16_666_667L) : FrameTimingSource {
+    @Volatile private var thread: Thread? = null
+
+    override fun start(sink: FramePacing.Sink) {
+        stop()
+        thread = Thread({
+            val epoch = System.nanoTime()
+            var frame = 0L
+            try {
+                while (!Thread.currentThread().isInterrupted) {
+                    sink.onVsync(epoch + frame * periodNanos, periodNanos)
+                    frame++
+                    val wait = epoch + frame * periodNanos - System.nanoTime()
+                    if (wait > 0) {
+                        Thread.sleep(wait / 1_000_000, (wait % 1_000_000).toInt())
+                    } else {
+                        // Fell behind: report the current frame rather than every missed one
+                        frame = (System.nanoTime() - epoch) / periodNanos
+                    }
+                }
+            } catch (e: InterruptedException) {
+                // Stopped
+            }
+        }, "SyntheticVsync").apply {
+            isDaemon = true
+            start()
+        }
+    }
+
+    override fun stop() {
+        thread?.interrupt()
+        thread = null
+    }
+}
@@ -0,0 +1,329 @@
+package com.layer.i2c
+
+import android.util.Log
+import kotlinx.coroutines.CancellableContinuation
+import kotlinx.coroutines.CancellationException
+import kotlinx.coroutines.ExperimentalCoroutinesApi
+import kotlinx.coroutines.TimeoutCancellationException
+import kotlinx.coroutines.asContextElement
+import kotlinx.coroutines.delay
+import kotlinx.coroutines.suspendCancellableCoroutine
+import kotlinx.coroutines.withContext
+import kotlinx.coroutines.withTimeout
+import java.util.concurrent.CopyOnWriteArraySet
+import java.util.concurrent.locks.LockSupport
+
+/**
+ * Fair FIFO ownership of a physical I2C bus.
+ *
+ * Suspending callers (transactions) wait as queued continuations and give their thread
+ * back while they wait; blocking callers (the register helpers) park. Ownership is handed
+ * directly to the head of the queue on release, so waiters are served strictly in arrival
+ * order whichever way they wait.
+ *
+ * The lock is reentrant per owner token rather than per thread: a transaction installs its
+ * token as a coroutine context element of this lock, so blocking helpers called from inside
+ * it recognise the owner even after the coroutine has resumed on another thread. Outside a
+ * transaction the current thread is the token.
+ *
+ * Blocking acquisition must not be used on a single-threaded dispatcher that a suspended
+ * owner needs to resume on; the poll loops only ever have one sensor active per bus, so
+ * this only concerns external callers.
+ *
+ * When cross-process arbitration is enabled ([arbiterHandle] >= 0), the outermost owner
+ * also holds the native per-bus lock shared with other processes. Suspending owners wait
+ * for it in short native slices with a delay in between, so a timeout or cancellation of
+ * the caller ends the wait; blocking owners wait for it without limit.
+ */
+class I2CBusLock(val name: String) {
+    companion object {
+        private const val TAG = "I2CBusLock"
+
+        // Longest a suspending owner blocks its thread on the native lock at a time
+        private const val EXTERNAL_SLICE_US = 5_000L
+        // Pause between native slices, where the caller's timeout or cancellation can act
+        private const val EXTERNAL_RETRY_MS = 1L
+    }
+
+    // Owner token of the transaction on this lock running on this thread, if any. Per
+    // lock, so a transaction on another bus nested inside one on this bus keeps ours.
+    private val ownerToken = ThreadLocal<Any?>()
+
+    /**
+     * Token identifying the caller: the enclosing transaction on this lock, or the
+     * current thread.
+     */
+    fun currentToken(): Any = ownerToken.get() ?: Thread.currentThread()
+
+    /**
+     * Snapshot of lock metrics. Times are in nanoseconds.
+     */
+    data class Stats(
+        val acquisitions: Long,
+        val contended: Long,
+        val totalWaitNs: Long,
+        val maxWaitNs: Long,
+        val totalHoldNs: Long,
+        val maxHoldNs: Long,
+        val queueLength: Int
+    ) {
+        val meanWaitNs: Long get() = if (acquisitions > 0) totalWaitNs / acquisitions else 0
+    }
+
+    private abstract class Waiter(val token: Any) {
+        val enqueuedNs = System.nanoTime()
+    }
+
+    private class CoroutineWaiter(token: Any, val continuation: CancellableContinuation<Unit>) : Waiter(token)
+
+    private class ThreadWaiter(token: Any, val thread: Thread) : Waiter(token) {
+        @Volatile
+        var granted = false
+    }
+
+    // Guards all fields below; only held for queue bookkeeping, never during I/O
+    private val state = Any()
+    private var owner: Any? = null
+    private var holdCount = 0
+    private var acquiredNs = 0L
+    private val waiters = ArrayDeque<Waiter>()
+
+    /**
+     * Native cross-process arbiter handle from I2cNative.arbitrationOpen, or -1 when off.
+     */
+    @Volatile
+    var arbiterHandle: Int = -1
+
+    /**
+     * Called by the new owner when another process used the bus since this process last
+     * held it, so cached bus state (such as mux channel masks) can be invalidated.
+     * Listeners run while the bus is held and must not perform I/O.
+     */
+    val foreignAccessListeners = CopyOnWriteArraySet<() -> Unit>()
+
+    // Handle the external lock was taken with; only touched by the current owner
+    private var externalHandle = -1
+
+    private var acquisitions = 0L
+    private var contended = 0L
+    private var totalWaitNs = 0L
+    private var maxWaitNs = 0L
+    private var totalHoldNs = 0L
+    private var maxHoldNs = 0L
+
+    /**
+     * Check whether the lock is currently held by the given token.
+     */
+    fun isHeldBy(token: Any): Boolean = synchronized(state) { owner === token }
+
+    /**
+     * Check whether the lock is held by the caller.
+     */
+    fun isHeldByCurrent(): Boolean = isHeldBy(currentToken())
+
+    fun getStats(): Stats = synchronized(state) {
+        Stats(acquisitions, contended, totalWaitNs, maxWaitNs, totalHoldNs, maxHoldNs, waiters.size)
+    }
+
+    fun resetStats() = synchronized(state) {
+        acquisitions = 0
+        contended = 0
+        totalWaitNs = 0
+        maxWaitNs = 0
+        totalHoldNs = 0
+        maxHoldNs = 0
+    }
+
+    // Must be called while holding state
+    private fun grantLocked(token: Any, waitNs: Long) {
+        owner = token
+        holdCount = 1
+        acquiredNs = System.nanoTime()
+        acquisitions++
+        if (waitNs > 0) {
+            contended++
+            totalWaitNs += waitNs
+            if (waitNs > maxWaitNs) maxWaitNs = waitNs
+        }
+    }
+
+    // Must be called while holding state. Returns true if the token now owns the lock.
+    private fun tryAcquireLocked(token: Any): Boolean {
+        if (owner === token) {
+            holdCount++
+            return true
+        }
+        if (owner == null && waiters.isEmpty()) {
+            grantLocked(token, 0)
+            return true
+        }
+        return false
+    }
+
+    /**
+     * Acquire the lock for [token], suspending while other owners are ahead in the queue.
+     */
+    suspend fun lock(token: Any) {
+        lockInternal(token)
+        try {
+            acquireExternal()
+        } catch (e: CancellationException) {
+            unlock(token)
+            throw e
+        }
+    }
+
+    @OptIn(ExperimentalCoroutinesApi::class)
+    private suspend fun lockInternal(token: Any) {
+        synchronized(state) {
+            if (tryAcquireLocked(token)) return
+        }
+        suspendCancellableCoroutine<Unit> { continuation ->
+            val waiter = CoroutineWaiter(token, continuation)
+            val acquired = synchronized(state) {
+                if (tryAcquireLocked(token)) {
+                    true
+                } else {
+                    waiters.addLast(waiter)
+                    false
+                }
+            }
+            if (acquired) {
+                continuation.resume(Unit) { unlock(token) }
+            } else {
+                continuation.invokeOnCancellation {
+                    // If the waiter is no longer queued, ownership was already handed over
+                    // and the onCancellation handler of resume() releases it
+                    synchronized(state) { waiters.remove(waiter) }
+                }
+            }
+        }
+    }
+
+    /**
+     * Acquire the lock for [token], parking the calling thread while other owners are ahead.
+     */
+    fun lockBlocking(token: Any) {
+        val waiter = synchronized(state) {
+            if (tryAcquireLocked(token)) null
+            else ThreadWaiter(token, Thread.currentThread()).also { waiters.addLast(it) }
+        }
+        if (waiter != null) {
+            var interrupted = false
+            while (!waiter.granted) {
+                LockSupport.park(this)
+                if (Thread.interrupted()) interrupted = true
+            }
+            if (interrupted) Thread.currentThread().interrupt()
+        }
+        val handle = arbiterHandle
+        if (handle < 0 || externalHandle >= 0) return
+        acquiredExternal(handle, I2cNative.arbitrationAcquire(handle, 0))
+    }
+
+    // Called by the owner after every acquisition; only the outermost one takes the native lock
+    private suspend fun acquireExternal() {
+        val handle = arbiterHandle
+        if (handle < 0 || externalHandle >= 0) return
+        var result = I2cNative.arbitrationAcquire(handle, EXTERNAL_SLICE_US)
+        while (result == I2cNative.ARBITRATION_TIMEOUT) {
+            delay(EXTERNAL_RETRY_MS)
+            result = I2cNative.arbitrationAcquire(handle, EXTERNAL_SLICE_US)
+        }
+        acquiredExternal(handle, result)
+    }
+
+    private fun acquiredExternal(handle: Int, result: Int) {
+        if (result < 0) {
+            // Arbitration is best effort; never fail local I/O because of it
+            Log.w(TAG, "Cross-process arbitration failed for $name, continuing without it")
+            return
+        }
+        externalHandle = handle
+        if (result == 1) {
+            for (listener in foreignAccessListeners) listener()
+        }
+    }
+
+    /**
+     * Release one hold of [token]. When the last hold is released, ownership passes to the
+     * longest waiting caller.
+     */
+    @OptIn(ExperimentalCoroutinesApi::class)
+    fun unlock(token: Any) {
+        synchronized(state) {
+            check(owner === token) { "I2C bus lock $name released by a non-owner" }
+            if (holdCount > 1) {
+                holdCount--
+                return
+            }
+        }
+        // Still the owner here: let other processes in before the next local owner
+        if (externalHandle >= 0) {
+            I2cNative.arbitrationRelease(externalHandle)
+            externalHandle = -1
+        }
+        val next: Waiter
+        synchronized(state) {
+            holdCount = 0
+            val heldNs = System.nanoTime() - acquiredNs
+            totalHoldNs += heldNs
+            if (heldNs > maxHoldNs) maxHoldNs = heldNs
+            owner = null
+            next = waiters.removeFirstOrNull() ?: return
+            grantLocked(next.token, System.nanoTime() - next.enqueuedNs)
+        }
+        when (next) {
+            is CoroutineWaiter -> next.continuation.resume(Unit) { unlock(next.token) }
+            is ThreadWaiter -> {
+                next.granted = true
+                LockSupport.unpark(next.thread)
+            }
+        }
+    }
+
+    /**
+     * Run [block] while owning the bus. Nested calls from the same transaction, or from a
+     * thread that already holds the lock with a blocking acquire, reenter without queueing.
+     * The owner token travels with the coroutine, so blocking helpers called inside [block]
+     * reenter as well.
+     *
+     * @param timeoutMs Maximum time to wait for the bus, or 0 to wait indefinitely
+     * @throws I2CException if the bus could not be acquired within [timeoutMs]
+     */
+    suspend fun <T> withLock(timeoutMs: Long = 0, block: suspend () -> T): T {
+        val inherited = ownerToken.get()
+        val token = when {
+            inherited != null && isHeldBy(inherited) -> inherited
+            isHeldBy(Thread.currentThread()) -> Thread.currentThread()
+            else -> Any()
+        }
+        if (timeoutMs > 0) {
+            try {
+                withTimeout(timeoutMs) { lock(token) }
+            } catch (e: TimeoutCancellationException) {
+                throw I2CException("Timed out after ${timeoutMs}ms waiting for I2C bus $name")
+            }
+        } else {
+            lock(token)
+        }
+        try {
+            return withContext(ownerToken.asContextElement(token)) { block() }
+        } finally {
+            unlock(token)
+        }
+    }
+
+    /**
+     * Run [block] while owning the bus, parking the calling thread until it is available.
+     */
+    inline fun <T> withLockBlocking(block: () -> T): T {
+        val token = currentToken()
+        lockBlocking(token)
+        try {
+            return block()
+        } finally {
+            unlock(token)
+        }
+    }
+}
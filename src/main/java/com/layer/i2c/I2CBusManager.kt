@@ -1,5 +1,6 @@
 package com.layer.i2c
 
+import android.os.SystemClock
 import android.util.Log
 import java.io.IOException
 import java.util.concurrent.ConcurrentHashMap
@@ -13,6 +14,9 @@ class I2CBusManager private constructor() {
     companion object {
         private const val TAG = "I2CBusManager"
         
+        // Wait before repeating a block read self-test that could not reach a result
+        private const val BLOCK_PROBE_RETRY_MS = 60_000L
+        
         // Singleton instance
         private val instance = I2CBusManager()
         
@@ -29,17 +33,39 @@ class I2CBusManager private constructor() {
     // Map to track reference count for each bus
     private val referenceCountMap = ConcurrentHashMap<String, Int>()
     
-    // Map of file descriptors to locks for fd-level synchronization
-    private val fdLockMap = ConcurrentHashMap<Int, Any>()
+    // Map of file descriptors to bus ownership locks for fd-level synchronization
+    private val fdLockMap = ConcurrentHashMap<Int, I2CBusLock>()
+    
+    // Multiplexers operating on each physical bus, and the route currently selected through them
+    private val multiplexerTreeMap = ConcurrentHashMap<String, MultiplexerTree>()
+    
+    // Block read capabilities per physical bus, as reported by I2cNative.probeBlockRead
+    private val blockReadCapsMap = ConcurrentHashMap<String, Int>()
+    
+    // Earliest time (elapsedRealtime) to repeat a failed block read self-test, per physical bus
+    private val blockProbeRetryMap = ConcurrentHashMap<String, Long>()
+    
+    // Retry policy per physical bus; buses without an entry use RetryPolicy.DEFAULT
+    private val retryPolicyMap = ConcurrentHashMap<String, RetryPolicy>()
+    
+    // Minimum gap between transfers per physical bus in microseconds; native default if absent
+    private val pacingMap = ConcurrentHashMap<String, Long>()
+    
+    // Silence after each burst per physical bus in microseconds, for buses in burst mode
+    private val burstIdleMap = ConcurrentHashMap<String, Long>()
     
-    // A singleton instance if there is a multiplexer operating on this bus.
-    private val multiplexerMap = ConcurrentHashMap<String, I2CMultiplexer>()
+    // Bus time budget per physical bus: (budget, window) in microseconds
+    private val budgetMap = ConcurrentHashMap<String, Pair<Long, Long>>()
+    
+    // Whether buses opened from now on take part in cross-process arbitration
+    @Volatile
+    private var arbitrationEnabled = false
     
     /**
      * Extracts the physical bus path from an effective bus path.
      * For multiplexed sensors, this removes the channel suffix.
      * 
-     * @param effectiveBusPath The effective bus path (e.g., "/dev/i2c-0:ch7" or "/dev/i2c-0")
+     * @param effectiveBusPath The effective bus path (e.g., "/dev/i2c-0:ch7", "/dev/i2c-0:ch2:ch5@71" or "/dev/i2c-0")
      * @return The physical bus path (e.g., "/dev/i2c-0")
      */
     private fun getPhysicalBusPath(effectiveBusPath: String): String {
@@ -79,8 +105,22 @@ class I2CBusManager private constructor() {
             // Initialize address set for this effective bus path
             addressMap[busPath] = mutableSetOf(address)
             
-            // Create a lock object for this file descriptor
-            fdLockMap[fd] = Any()
+            // Create the ownership lock for this file descriptor
+            val lock = I2CBusLock(physicalBusPath)
+            // Another process may have switched multiplexers behind our back
+            lock.foreignAccessListeners.add { multiplexerTreeMap[physicalBusPath]?.invalidate() }
+            if (arbitrationEnabled) {
+                lock.arbiterHandle = I2cNative.arbitrationOpen(physicalBusPath)
+                if (lock.arbiterHandle < 0) {
+                    Log.w(TAG, "Cross-process arbitration unavailable for $physicalBusPath")
+                }
+            }
+            fdLockMap[fd] = lock
+            
+            // Native retry state is per fd, so (re)apply the bus policy on every open
+            (retryPolicyMap[physicalBusPath] ?: RetryPolicy.DEFAULT).applyTo(fd)
+            pacingMap[physicalBusPath]?.let { I2cNative.setBusPacing(fd, it) }
+            budgetMap[physicalBusPath]?.let { (budgetUs, windowUs) -> I2cNative.setBusBudget(fd, budgetUs, windowUs) }
             
             // Register this device as the current device on this fd
             I2CSensor.setCurrentDevice(fd, address)
@@ -139,7 +179,7 @@ class I2CBusManager private constructor() {
                 I2CSensor.clearDeviceMapping(fd)
                 
                 // Remove the lock object for this file descriptor
-                fdLockMap.remove(fd)
+                releaseFdLock(fd)
                 
                 Log.d(TAG, "Closed I2C bus $busPath (fd=$fd), no more references to physical bus")
             } else {
@@ -185,10 +225,11 @@ class I2CBusManager private constructor() {
         if (fd != null && fd >= 0) {
             I2cNative.closeBus(fd)
             I2CSensor.clearDeviceMapping(fd)
-            fdLockMap.remove(fd)
+            releaseFdLock(fd)
             busMap.remove(physicalBusPath)
             Log.d(TAG, "Cleared all state for physical bus $physicalBusPath (fd=$fd)")
         }
+        multiplexerTreeMap.remove(physicalBusPath)
     }
     
     /**
@@ -203,14 +244,269 @@ class I2CBusManager private constructor() {
     }
     
     /**
-     * Get the lock object for a file descriptor.
+     * Get the multiplexer tree of a physical bus, creating an empty one if needed.
+     *
+     * @param busPath The effective or physical bus path
+     */
+    fun getMultiplexerTree(busPath: String): MultiplexerTree {
+        val physicalBusPath = getPhysicalBusPath(busPath)
+        return multiplexerTreeMap.computeIfAbsent(physicalBusPath) { MultiplexerTree(it) }
+    }
+    
+    /**
+     * Check whether the block read self-test has already run for a physical bus.
+     *
+     * @param busPath The effective or physical bus path
+     */
+    fun isBlockReadProbed(busPath: String): Boolean {
+        return blockReadCapsMap.containsKey(getPhysicalBusPath(busPath))
+    }
+    
+    /**
+     * Check whether the block read self-test should run now for a physical bus: it
+     * has not reached a result yet, and did not just fail.
+     *
+     * @param busPath The effective or physical bus path
+     */
+    fun isBlockReadProbeDue(busPath: String): Boolean {
+        val physicalBusPath = getPhysicalBusPath(busPath)
+        if (blockReadCapsMap.containsKey(physicalBusPath)) return false
+        val retryAt = blockProbeRetryMap[physicalBusPath] ?: return true
+        return SystemClock.elapsedRealtime() >= retryAt
+    }
+    
+    /**
+     * Record that the block read self-test on a physical bus could not reach a
+     * result, e.g. because a transfer failed or the probed range changed. The bus
+     * keeps its current block read settings, and the test is repeated later.
+     *
+     * @param busPath The effective or physical bus path
+     */
+    fun blockReadProbeFailed(busPath: String) {
+        blockProbeRetryMap[getPhysicalBusPath(busPath)] = SystemClock.elapsedRealtime() + BLOCK_PROBE_RETRY_MS
+    }
+    
+    /**
+     * Record the result of the block read self-test for a physical bus.
+     * The native layer keeps the authoritative copy per adapter; this only
+     * avoids re-running the test every time a sensor reconnects.
+     *
+     * @param busPath The effective or physical bus path
+     * @param caps (method shl 16) or maxBlock, as returned by I2cNative.probeBlockRead
+     */
+    fun setBlockReadCaps(busPath: String, caps: Int) {
+        val physicalBusPath = getPhysicalBusPath(busPath)
+        blockReadCapsMap[physicalBusPath] = caps
+        Log.i(TAG, "Block reads on $physicalBusPath: method=${caps shr 16}, maxBlock=${caps and 0xFFFF}")
+    }
+    
+    /**
+     * Set the retry policy for a physical bus. Applied immediately if the bus is
+     * open and again whenever it is reopened.
+     *
+     * @param busPath The effective or physical bus path
+     * @param policy The policy to use for all transfers on this bus
+     */
+    fun setRetryPolicy(busPath: String, policy: RetryPolicy) {
+        val physicalBusPath = getPhysicalBusPath(busPath)
+        retryPolicyMap[physicalBusPath] = policy
+        busMap[physicalBusPath]?.let { fd ->
+            if (fd >= 0) policy.applyTo(fd)
+        }
+    }
+    
+    /**
+     * Set the minimum gap between transfers on a physical bus. Every bus is paced on
+     * its own, so this does not affect other buses. Applied immediately if the bus is
+     * open and again whenever it is reopened.
+     *
+     * @param busPath The effective or physical bus path
+     * @param intervalUs Minimum gap in microseconds, or -1 for the native default
+     */
+    fun setBusPacing(busPath: String, intervalUs: Long) {
+        val physicalBusPath = getPhysicalBusPath(busPath)
+        if (intervalUs < 0) {
+            pacingMap.remove(physicalBusPath)
+        } else {
+            pacingMap[physicalBusPath] = intervalUs
+        }
+        busMap[physicalBusPath]?.let { fd ->
+            if (fd >= 0) I2cNative.setBusPacing(fd, intervalUs)
+        }
+    }
+    
+    /**
+     * Switch a physical bus to burst-then-idle coalescing. Each sensor transaction
+     * then runs its transfers back-to-back instead of one pacing interval apart,
+     * with register writes combined into single submissions, and the bus stays
+     * silent for [idleUs] afterwards. Interrupts arrive in short clusters with
+     * long gaps between them, rather than trickling through the whole transaction.
+     *
+     * @param busPath The effective or physical bus path
+     * @param idleUs Silence after each burst in microseconds, or -1 to return to interval pacing
+     */
+    fun setBurstMode(busPath: String, idleUs: Long) {
+        val physicalBusPath = getPhysicalBusPath(busPath)
+        if (idleUs < 0) {
+            burstIdleMap.remove(physicalBusPath)
+        } else {
+            burstIdleMap[physicalBusPath] = idleUs
+        }
+    }
+    
+    /** Silence after each burst on a bus in microseconds, or null if it is not in burst mode */
+    fun getBurstIdleUs(busPath: String): Long? = burstIdleMap[getPhysicalBusPath(busPath)]
+    
+    /**
+     * Limit the transfer time on a physical bus to [budgetUs] per window, e.g. 2000us
+     * per 16.7ms frame. Transfers over the budget wait for the next window, which
+     * splits scans, SMUX uploads and runs of block reads across windows and bounds
+     * how much of any frame the bus can take. Applied now and on every reopen.
+     *
+     * @param busPath The effective or physical bus path
+     * @param budgetUs Bus-busy time allowed per window, or 0 to remove the limit
+     * @param windowUs Window length, or 0 to follow frame timing (see [FramePacing])
+     */
+    fun setBusBudget(busPath: String, budgetUs: Long, windowUs: Long = 0) {
+        val physicalBusPath = getPhysicalBusPath(busPath)
+        if (budgetUs <= 0) {
+            budgetMap.remove(physicalBusPath)
+        } else {
+            budgetMap[physicalBusPath] = budgetUs to windowUs
+        }
+        busMap[physicalBusPath]?.let { fd ->
+            if (fd >= 0) I2cNative.setBusBudget(fd, maxOf(budgetUs, 0), windowUs)
+        }
+    }
+    
+    data class BudgetStats(
+        val windows: Long,
+        val deferrals: Long,
+        val overruns: Long,
+        val busyNanos: Long,
+        val worstWindowNanos: Long
+    )
+    
+    /**
+     * Get the budget counters of a bus, or null if it has no budget or is not open.
+     * Overruns count windows whose transfers took longer than the budget, which
+     * happens when a single transfer cannot be split further.
+     */
+    fun getBudgetStats(busPath: String): BudgetStats? {
+        if (!budgetMap.containsKey(getPhysicalBusPath(busPath))) return null
+        val fd = getBusFd(busPath)
+        if (fd < 0) return null
+        val stats = LongArray(5)
+        if (I2cNative.getBudgetStats(fd, stats) != 0) return null
+        return BudgetStats(stats[0], stats[1], stats[2], stats[3], stats[4])
+    }
+    
+    /**
+     * Get the retry counters for a bus: transfers, retries and transfers that
+     * still failed after their last attempt.
+     *
+     * @param busPath The effective or physical bus path
+     * @return Triple(transfers, retries, exhausted), or null if the bus is not open
+     */
+    fun getRetryStats(busPath: String): Triple<Long, Long, Long>? {
+        val fd = getBusFd(busPath)
+        if (fd < 0) return null
+        val stats = LongArray(3)
+        if (I2cNative.getRetryStats(fd, stats) != 0) return null
+        return Triple(stats[0], stats[1], stats[2])
+    }
+    
+    private fun releaseFdLock(fd: Int) {
+        val lock = fdLockMap.remove(fd) ?: return
+        if (lock.arbiterHandle >= 0) {
+            I2cNative.arbitrationClose(lock.arbiterHandle)
+            lock.arbiterHandle = -1
+        }
+    }
+    
+    /**
+     * Take part in cross-process arbitration for every bus this process opens, so that
+     * other processes using the same mechanism (or mapping the same lock files) do not
+     * interleave their transfers with ours. Applies to buses opened after this call.
+     *
+     * @param lockDir Directory holding the per-bus lock files, such as the app's
+     *                files directory (context.filesDir.path); must be shared by, and
+     *                writable for, all participating processes
+     * @return true if arbitration was enabled
+     */
+    @Synchronized
+    fun enableCrossProcessArbitration(lockDir: String): Boolean {
+        if (I2cNative.setArbitrationDir(lockDir) != 0) {
+            Log.e(TAG, "Invalid arbitration directory $lockDir")
+            return false
+        }
+        arbitrationEnabled = true
+        return true
+    }
+    
+    /**
+     * Route all bus access of this process through the i2cd daemon, which owns the
+     * buses and shares them between processes. Bus handles stand in for file
+     * descriptors, and bus locks map to the daemon's per-bus lock so a sensor's
+     * multi-step transactions (mux select, then device access) stay atomic.
+     * Must be called before any bus is opened.
+     *
+     * @param socketPath Daemon socket, or null for the default path
+     * @return true if connected
+     */
+    @Synchronized
+    fun enableClientMode(socketPath: String? = null): Boolean {
+        if (busMap.isNotEmpty()) {
+            Log.e(TAG, "Client mode must be enabled before any bus is opened")
+            return false
+        }
+        if (I2cNative.connectDaemon(socketPath) != 0) {
+            Log.e(TAG, "Cannot connect to i2cd at ${socketPath ?: "default socket"}")
+            return false
+        }
+        arbitrationEnabled = true
+        Log.i(TAG, "Bus access is routed through i2cd")
+        return true
+    }
+    
+    fun isClientMode(): Boolean = I2cNative.isDaemonConnected()
+    
+    /**
+     * Get cross-process arbitration counters for a bus. The counters cover all
+     * participating processes.
+     *
+     * @param busPath The effective or physical bus path
+     * @return acquisitions, contended, steals, totalWaitNs, totalHoldNs and maxHoldNs,
+     *         or null if arbitration is off
+     */
+    fun getArbitrationStats(busPath: String): LongArray? {
+        val fd = getBusFd(busPath)
+        val handle = (if (fd >= 0) fdLockMap[fd] else null)?.arbiterHandle ?: return null
+        if (handle < 0) return null
+        val stats = LongArray(6)
+        return if (I2cNative.getArbitrationStats(handle, stats) == 0) stats else null
+    }
+    
+    /**
+     * Get the ownership lock for a file descriptor.
      * This allows multiple sensors sharing the same file descriptor
      * to synchronize I/O operations across different instances.
      * 
      * @param fd The file descriptor to get the lock for
-     * @return The lock object, or null if the file descriptor is not managed
+     * @return The lock, or null if the file descriptor is not managed
      */
-    fun getFdLock(fd: Int): Any? {
+    fun getFdLock(fd: Int): I2CBusLock? {
         return fdLockMap[fd]
     }
+    
+    /**
+     * Get wait and hold time metrics of the ownership lock for a bus.
+     *
+     * @param busPath The effective or physical bus path
+     * @return The lock metrics, or null if the bus is not open
+     */
+    fun getBusLockStats(busPath: String): I2CBusLock.Stats? {
+        val fd = getBusFd(busPath)
+        return if (fd >= 0) fdLockMap[fd]?.getStats() else null
+    }
 }
\ No newline at end of file
@@ -0,0 +1,114 @@
+package com.layer.i2c
+
+import android.util.Log
+
+/**
+ * Daemon-side polling for processes in client mode (see I2CBusManager.enableClientMode).
+ *
+ * Registered register blocks are read by i2cd on its own timer and land in a
+ * shared-memory ring mapped into this process, so reading a sample costs no
+ * system call and no bus round trip. Samples overwritten before they were
+ * drained are counted in [lostSamples].
+ */
+object I2CDaemonClient {
+    private const val TAG = "I2CDaemonClient"
+
+    const val DEFAULT_RING_CAPACITY = 256
+
+    /**
+     * One polled sample.
+     *
+     * @property status Number of bytes read, or -errno if the read failed
+     * @property timestampNanos CLOCK_BOOTTIME at the end of the transfer
+     * @property muxChannel Mux channel selected before the read, or -1
+     */
+    data class Sample(
+        val pollId: Int,
+        val status: Int,
+        val timestampNanos: Long,
+        val address: Int,
+        val muxChannel: Int,
+        val register: Int,
+        val data: ByteArray
+    ) {
+        val isSuccess: Boolean get() = status > 0
+
+        override fun equals(other: Any?): Boolean {
+            if (this === other) return true
+            if (other !is Sample) return false
+            return pollId == other.pollId && timestampNanos == other.timestampNanos &&
+                    status == other.status && data.contentEquals(other.data)
+        }
+
+        override fun hashCode(): Int = 31 * (31 * pollId + timestampNanos.hashCode()) + data.contentHashCode()
+    }
+
+    private val meta = LongArray(6)
+    private val buffer = ByteArray(64)
+
+    /**
+     * Map the sample ring. Must be called before the first [drain].
+     */
+    @Synchronized
+    fun subscribe(capacity: Int = DEFAULT_RING_CAPACITY): Boolean {
+        if (!I2cNative.isDaemonConnected()) {
+            Log.e(TAG, "Not connected to i2cd")
+            return false
+        }
+        return I2cNative.daemonSubscribe(capacity) == 0
+    }
+
+    /**
+     * Have the daemon read `length` bytes from `register` every `periodMs`.
+     *
+     * @param busPath Effective bus path of an open bus
+     * @param muxAddress Address of the mux in front of the device, or -1
+     * @return Poll id, or -1 if error
+     */
+    fun addPoll(
+        busPath: String,
+        address: Int,
+        register: Int,
+        length: Int,
+        periodMs: Int,
+        muxAddress: Int = -1,
+        muxChannel: Int = 0
+    ): Int {
+        val fd = I2CBusManager.getInstance().getBusFd(busPath)
+        if (fd < 0) {
+            Log.e(TAG, "Bus $busPath is not open")
+            return -1
+        }
+        val id = I2cNative.daemonAddPoll(fd, address, register, length, periodMs, muxAddress, muxChannel)
+        if (id < 0) {
+            Log.e(TAG, "Failed to add poll for 0x${address.toString(16)} on $busPath")
+        }
+        return id
+    }
+
+    fun removePoll(pollId: Int): Boolean = I2cNative.daemonRemovePoll(pollId) == 0
+
+    /**
+     * Copy out all samples written since the last call, oldest first.
+     */
+    @Synchronized
+    fun drain(maxSamples: Int = Int.MAX_VALUE): List<Sample> {
+        val samples = ArrayList<Sample>()
+        while (samples.size < maxSamples) {
+            val length = I2cNative.daemonNextSample(meta, buffer)
+            if (length < 0) break
+            samples.add(Sample(
+                pollId = meta[0].toInt(),
+                status = meta[1].toInt(),
+                timestampNanos = meta[2],
+                address = meta[3].toInt(),
+                muxChannel = meta[4].toInt(),
+                register = meta[5].toInt(),
+                data = buffer.copyOf(length)
+            ))
+        }
+        return samples
+    }
+
+    val lostSamples: Long get() = I2cNative.getDaemonLostSamples()
+}
@@ -1,10 +1,9 @@
 package com.layer.i2c
 
+import android.os.SystemClock
 import android.util.Log
 import kotlinx.coroutines.delay
 import kotlinx.coroutines.runBlocking
-import kotlinx.coroutines.sync.Mutex
-import kotlinx.coroutines.sync.withLock
 import java.io.IOException
 
 class I2CException(override val message:String, val reg: Int = -1, val value : Int? = null, val fileDescriptor: Int? = null,  val errorCode: Int = -1) : IOException(message) {
@@ -15,6 +14,15 @@ class I2CException(override val message:String, val reg: Int = -1, val value : I
 
 interface OnDataReceivedListener {
     fun onDataReceived(sensor: I2CSensor, channelData:  Map<String, Any>)
+    
+    /**
+     * Called with the capture time of the sample: CLOCK_BOOTTIME nanoseconds (the clock of
+     * SystemClock.elapsedRealtimeNanos) taken natively when the transfer completed.
+     * Override this instead of the two-argument variant to get jitter-free timestamps.
+     */
+    fun onDataReceived(sensor: I2CSensor, channelData: Map<String, Any>, captureTimeNanos: Long) {
+        onDataReceived(sensor, channelData)
+    }
 }
 
 fun addressToHex(address: Int): String = "0x${address.toString(16).padStart(2, '0')}"
@@ -63,11 +71,14 @@ abstract class I2CSensor(
     protected var isInitialized: Boolean = false
     protected var isBusOpen: Boolean = false
     
-    // Lock object for file descriptor-level synchronization
-    protected var fdLock: Any? = null
+    // Bus ownership lock shared by all sensors on the same file descriptor
+    protected var fdLock: I2CBusLock? = null
 
-    // Coroutine mutex for transaction-level locking (survives suspension points)
-    private val transactionMutex = Mutex()
+    // Stands in for the shared lock while the bus is not open
+    private val localLock = I2CBusLock("local")
+
+    protected val busLock: I2CBusLock
+        get() = fdLock ?: localLock
     
     // Flag to prevent recursive recovery attempts
     @Volatile
@@ -90,9 +101,9 @@ abstract class I2CSensor(
         listeners.clear()
     }
     
-    protected fun notifyListeners(data: Map<String, Any>) : Map<String, Any> {
+    protected fun notifyListeners(data: Map<String, Any>, captureTimeNanos: Long = sampleTimeNanos) : Map<String, Any> {
         for (l in listeners) {
-            l.onDataReceived(this, data)
+            l.onDataReceived(this, data, captureTimeNanos)
         }
         return data
     }
@@ -102,9 +113,9 @@ abstract class I2CSensor(
      */
     open fun deviceUniqueId(): String {
         val address = addressToHex(sensorAddress)
-        val deviceId = if (isMultiplexed()) {
-            val channel = getSensorMultiplexerChannel()
-            "$busPath:$channel:$address"
+        val route = muxRoute
+        val deviceId = if (route != null) {
+            "$busPath:${route.label}:$address"
         } else {
             "$busPath::$address"
         }
@@ -112,16 +123,31 @@ abstract class I2CSensor(
     }
     
     fun setMultiplexer(multiplexer: TCA9548Multiplexer, channel: Int) {
-        this.multiplexer = multiplexer
-        this.multiplexerChannel = channel
+        setRoute(MuxRoute.to(multiplexer, channel))
     }
     
+    /**
+     * Place this device behind a chain of cascaded multiplexers.
+     * @param route The route from the bare bus, or null if directly connected
+     */
+    fun setRoute(route: MuxRoute?) {
+        this.muxRoute = route
+        this.multiplexer = route?.last?.mux
+        this.multiplexerChannel = route?.last?.channel
+    }
+    
+    /**
+     * Get the route through cascaded multiplexers to this device.
+     * @return The route, or null if directly connected
+     */
+    fun getMuxRoute(): MuxRoute? = muxRoute
+    
     override fun toString(): String {
         val type = this.javaClass.simpleName
         val connected = if (this.connected) "Connected" else "Disconnected"
-        val sensorInfo = if (isMultiplexed()) {
-            val channel = getSensorMultiplexerChannel()
-            "$type ($busPath Multiplexed Ch$channel) $connected"
+        val route = muxRoute
+        val sensorInfo = if (route != null) {
+            "$type ($busPath Multiplexed Ch${route.label}) $connected"
         } else {
             "$type ($busPath) - $connected"
         }
@@ -149,6 +175,9 @@ abstract class I2CSensor(
      */
     fun isMultiplexed(): Boolean = multiplexer != null && multiplexerChannel != null
     
+    // Full path through cascaded multiplexers; its last hop is multiplexer/multiplexerChannel
+    private var muxRoute: MuxRoute? = null
+    
     // Validate multiplexer configuration
     init {
         if (multiplexer != null && multiplexerChannel == null) {
@@ -161,6 +190,7 @@ abstract class I2CSensor(
             if (multiplexerChannel!! < 0 || multiplexerChannel!! >= multiplexer!!.maxChannels) {
                 throw IllegalArgumentException("Multiplexer channel $multiplexerChannel is out of range (0-${multiplexer!!.maxChannels - 1})")
             }
+            muxRoute = MuxRoute.to(multiplexer!!, multiplexerChannel!!)
         }
     }
     
@@ -172,6 +202,22 @@ abstract class I2CSensor(
 
     public abstract suspend fun readDataImpl(): Map<String, Any>
 
+    /**
+     * Coalesces measurements requested concurrently by the bus loop and direct callers
+     * of drivers that read through [measure]. Set its freshnessMs to also hand out
+     * recent results without measuring again.
+     */
+    val measurement = SingleFlight<Map<String, Int>>()
+
+    /**
+     * One full measurement, or an empty map on failure. Drivers whose reads are expensive
+     * enough to share override this and read through [measure].
+     */
+    protected open suspend fun measureOnce(): Map<String, Int> = emptyMap()
+
+    // Runs measureOnce(), or shares the result of the call already in flight
+    protected suspend fun measure(): Map<String, Int> = measurement.run({ it.isNotEmpty() }) { measureOnce() }
+
     /**
      * Minimum interval between reads for this sensor (in milliseconds).
      * Subclasses can override to throttle low-priority sensors.
@@ -179,14 +225,119 @@ abstract class I2CSensor(
      */
     open val minReadIntervalMs: Long = 0L
 
+    /**
+     * Optional controller that adapts the read interval to how fast the readings change.
+     * When set, it replaces [minReadIntervalMs] as the interval the bus loop reads at.
+     */
+    @Volatile
+    var rateController: AdaptiveRateController? = null
+
+    /** Interval the bus loop currently reads this sensor at (in milliseconds) */
+    fun readIntervalMs(): Long = rateController?.intervalMs ?: minReadIntervalMs
+
     /** Timestamp of the last successful read */
     var lastReadTime: Long = 0L
 
+    /**
+     * CLOCK_BOOTTIME nanoseconds at which the transfer behind the latest sample completed.
+     * Drivers set it with [markSampleCaptured] right after reading their data registers;
+     * for drivers that don't, readData falls back to the time readDataImpl returned.
+     */
+    @Volatile
+    var sampleTimeNanos: Long = 0L
+        protected set
+
+    /**
+     * Date the current sample by the completion of the transfer just made on this thread.
+     * Must be called right after the data read, before anything else touches the bus.
+     */
+    protected fun markSampleCaptured() {
+        marksCaptures = true
+        val captured = I2cNative.getLastTransferTimeNanos()
+        sampleTimeNanos = if (captured > 0) captured else SystemClock.elapsedRealtimeNanos()
+    }
+
+    // Set once the driver dates its own samples; a read that leaves sampleTimeNanos
+    // alone then returned a shared or cached sample rather than a new one
+    private var marksCaptures = false
+
+    /** Schedule adherence and time breakdown of this sensor's reads, recorded by the poll loop */
+    val pollStats = PollStats()
+
+    /** Bus time, wall time, transfers and failures of this sensor's recent reads */
+    val busCost = BusCostProfile()
+
     public suspend fun readData(): Map<String, Any> {
-        val result = notifyListeners(readDataImpl())
+        val previousSampleTime = sampleTimeNanos
+        val fd = fileDescriptor
+        // Bus usage counters around this read; per call, as reads may overlap
+        val usageBefore = LongArray(3)
+        val usageAfter = LongArray(3)
+        val haveUsage = fd >= 0 && I2cNative.getBusUsage(fd, usageBefore) == 0
+        val readStart = System.nanoTime()
+        var data: Map<String, Any>? = null
+        try {
+            data = readDataImpl()
+        } finally {
+            val wallNs = System.nanoTime() - readStart
+            pollStats.endRead(wallNs)
+            val failed = data == null || data.isEmpty() || data.containsKey("ERROR")
+            if (haveUsage && I2cNative.getBusUsage(fd, usageAfter) == 0) {
+                busCost.record(usageAfter[0] - usageBefore[0], wallNs,
+                    (usageAfter[1] - usageBefore[1]).toInt(), (usageAfter[2] - usageBefore[2]).toInt(), failed)
+            } else {
+                busCost.record(0, wallNs, 0, 0, failed)
+            }
+        }
+        if (sampleTimeNanos == previousSampleTime && !marksCaptures) {
+            sampleTimeNanos = SystemClock.elapsedRealtimeNanos()
+        }
+        val result = notifyListeners(data!!)
         lastReadTime = System.currentTimeMillis()
+        if (result.isNotEmpty() && !result.containsKey("ERROR")) {
+            rateController?.update(result, sampleTimeNanos)
+            probeBlockReadIfNeeded()
+        }
         return result
     }
+
+    /**
+     * Register range used for the per-adapter block read self-test, or null if this
+     * device has no suitable range. The contents must not change between reads, as
+     * ID and configuration registers do and measurement data does not. Reading them
+     * must have no side effects, and the range should be longer than 31 bytes to
+     * learn anything beyond the SMBus default.
+     */
+    protected open val blockProbeRange: IntRange? = null
+
+    /**
+     * Runs the block read self-test once per physical bus, using this sensor's
+     * probe range. Called after a successful read, when the device is known to
+     * answer. A test that fails is repeated after a while.
+     */
+    private fun probeBlockReadIfNeeded() {
+        val range = blockProbeRange ?: return
+        if (fileDescriptor < 0 || !busManager.isBlockReadProbeDue(busPath) || busManager.isClientMode()) {
+            // In client mode the daemon owns the adapter and its block read settings
+            return
+        }
+        withBusLock {
+            if (!switchToDeviceBlocking()) {
+                return
+            }
+            // A retried transfer would hide exactly the failures the probe is looking for
+            val caps = RetryPolicy.NONE.runWith {
+                I2cNative.probeBlockRead(fileDescriptor, range.first, range.last - range.first + 1, false)
+            }
+            if (caps >= 0) {
+                busManager.setBlockReadCaps(busPath, caps)
+            } else {
+                // Keep the defaults for now; a transient failure must not decide them for good
+                Log.w(TAG, "Block read self-test failed on $busPath using ${this.javaClass.simpleName}, will retry")
+                busManager.blockReadProbeFailed(busPath)
+            }
+        }
+    }
     
     protected var lastErrorMessage: String? = null
     /**
@@ -210,6 +361,7 @@ abstract class I2CSensor(
         override val errorMessage : String? = lastError()
         override val connected = isConnected()
         override val updateTS = System.currentTimeMillis()
+        override val captureTimeNanos = sampleTimeNanos
         override val sensorId = this@I2CSensor.toString()
     }
     
@@ -245,8 +397,9 @@ abstract class I2CSensor(
      * @return Bus path with channel info for multiplexed sensors, plain path for direct connections
      */
     public fun getEffectiveBusPath(): String {
-        return if (multiplexer != null && multiplexerChannel != null) {
-            "${busPath}:ch${multiplexerChannel}"
+        val route = muxRoute
+        return if (route != null) {
+            busPath + route.pathSuffix
         } else {
             busPath
         }
@@ -327,7 +480,20 @@ abstract class I2CSensor(
             connected = true
             return true
         }
-        
+        if (!openForConnect()) {
+            return false
+        }
+        return finishConnect()
+    }
+    
+    /**
+     * First half of [connect]: connects the multiplexers on the route and opens the
+     * device, without initializing it. Lets several devices be configured together
+     * before each one is finished with [finishConnect].
+     * @return true if the device is open
+     */
+    @Synchronized
+    internal fun openForConnect(): Boolean {
         // Already open but not initialized? Close first.
         if (isBusOpen) {
             Log.w(TAG, "Sensor fd already open but not initialized. Re-opening.")
@@ -335,20 +501,26 @@ abstract class I2CSensor(
             fileDescriptor = -1
         }
         
+        // Readings from before a reconnect say nothing about the signal now
+        rateController?.reset()
+        
         val effectiveBusPath = getEffectiveBusPath()
         Log.d(
             TAG,
             "Connecting to sensor on $effectiveBusPath for address 0x${sensorAddress.toString(16)}..."
         )
         
-        // If using a multiplexer, connect to it first
-        if (multiplexer != null) {
-            if (multiplexer?.isReady() == false) {
-                Log.d(TAG, "Multiplexer not ready, attempting to connect...")
-                if (multiplexer?.connect() == false) {
-                    Log.e(TAG,"Failed to connect to multiplexer for sensor 0x${sensorAddress.toString(16)}")
-                    connected = false
-                    return false
+        // If using multiplexers, connect to them first, outermost first
+        val route = muxRoute
+        if (route != null) {
+            for (hop in route.hops) {
+                if (!hop.mux.isReady()) {
+                    Log.d(TAG, "Multiplexer ${hop.mux.getAddressHex()} not ready, attempting to connect...")
+                    if (!hop.mux.connect()) {
+                        Log.e(TAG,"Failed to connect to multiplexer for sensor 0x${sensorAddress.toString(16)}")
+                        connected = false
+                        return false
+                    }
                 }
             }
             Log.d(TAG, "Multiplexer ready for sensor 0x${sensorAddress.toString(16)}")
@@ -378,7 +550,18 @@ abstract class I2CSensor(
             TAG,
             "Sensor opened (fd=$fileDescriptor) for address 0x${sensorAddress.toString(16)}. Initializing..."
         )
-        isInitialized = initializeSensor()
+        return true
+    }
+    
+    /**
+     * Second half of [connect]: runs [initialize] on the open device and closes it
+     * again if that fails.
+     * @return true if the sensor is connected and initialized
+     */
+    @Synchronized
+    internal fun finishConnect(initialize: () -> Boolean = ::initializeSensor): Boolean {
+        val effectiveBusPath = getEffectiveBusPath()
+        isInitialized = isBusOpen && initialize()
         
         if (!isInitialized) {
             Log.e(
@@ -443,9 +626,10 @@ abstract class I2CSensor(
             return Pair(false, false)
         }
 
-        // If using a multiplexer, ensure the correct channel is selected first
-        if (multiplexer != null && multiplexerChannel != null) {
-            if (!multiplexer!!.isReady()) {
+        // If behind multiplexers, select the route first; only hops that differ are written
+        val route = muxRoute
+        if (route != null) {
+            if (route.hops.any { !it.mux.isReady() }) {
                 Log.e(
                     TAG,
                     "Multiplexer not ready for sensor at address 0x${sensorAddress.toString(16)}"
@@ -453,23 +637,14 @@ abstract class I2CSensor(
                 return Pair(false, false)
             }
 
-            // Switch to the multiplexer and select our channel
-            if (!multiplexer!!.isChannelEnabled(multiplexerChannel!!)) {
-                try {
-                    multiplexer!!.selectChannel(multiplexerChannel!!)
-                    Log.d(
-                        TAG,
-                        "Selected multiplexer channel $multiplexerChannel for sensor 0x${
-                            sensorAddress.toString(16)
-                        }"
-                    )
-                } catch (e: Exception) {
-                    Log.e(
-                        TAG,
-                        "Failed to select multiplexer channel $multiplexerChannel: ${e.message}"
-                    )
-                    return Pair(false, false)
-                }
+            if (!busManager.getMultiplexerTree(busPath).select(route)) {
+                Log.e(
+                    TAG,
+                    "Failed to select multiplexer route ${route.pathSuffix} for sensor 0x${
+                        sensorAddress.toString(16)
+                    }"
+                )
+                return Pair(false, false)
             }
         }
 
@@ -505,11 +680,11 @@ abstract class I2CSensor(
             return false
         }
 
-        val (success, needsDelay) = synchronized(fdLock ?: this) {
+        val (success, needsDelay) = busLock.withLock {
             switchToDeviceCore()
         }
 
-        // Delay outside synchronized block to avoid holding lock while sleeping
+        // Delay outside the lock to avoid holding the bus while sleeping
         if (needsDelay) {
             delay(DEVICE_SWITCH_DELAY_MS)
         }
@@ -519,7 +694,7 @@ abstract class I2CSensor(
 
     /**
      * Blocking version — uses Thread.sleep for the (now tiny 1ms) delay.
-     * Use this inside synchronized blocks where suspend is not allowed.
+     * Use this inside withBusLock blocks where suspend is not allowed.
      */
     protected fun switchToDeviceBlocking(): Boolean {
         if (fileDescriptor < 0) {
@@ -527,7 +702,7 @@ abstract class I2CSensor(
             return false
         }
 
-        val (success, needsDelay) = synchronized(fdLock ?: this) {
+        val (success, needsDelay) = withBusLock {
             switchToDeviceCore()
         }
 
@@ -540,6 +715,28 @@ abstract class I2CSensor(
     
     // --- I2C Primitive Helpers ---
     
+    /**
+     * Runs [block] while owning the bus, blocking the calling thread until it is available.
+     * Reentrant, also from inside [executeTransaction].
+     */
+    protected inline fun <T> withBusLock(block: () -> T): T {
+        val requested = System.nanoTime()
+        return busLock.withLockBlocking {
+            pollStats.addBusWait(System.nanoTime() - requested)
+            block()
+        }
+    }
+    
+    /**
+     * Sleeps while the device converts. Use instead of delay() for measurement waits so that
+     * the poll statistics can tell conversion time from scheduling delays.
+     */
+    protected suspend fun conversionDelay(ms: Long) {
+        val start = System.nanoTime()
+        delay(ms)
+        pollStats.addConversion(ms * 1_000_000, System.nanoTime() - start)
+    }
+    
     /**
      * Direct I2C read that bypasses recovery mechanisms.
      * Use this method within recovery functions to avoid infinite loops.
@@ -550,8 +747,7 @@ abstract class I2CSensor(
         }
 
         // Use the shared lock for file descriptor level synchronization
-        val lock = fdLock ?: this
-        synchronized(lock) {
+        withBusLock {
             // Switch to this device before performing I/O
             if (!switchToDeviceBlocking()) {
                 throw IOException("Failed to switch to device 0x${sensorAddress.toString(16)}")
@@ -574,8 +770,7 @@ abstract class I2CSensor(
         }
 
         // Use the shared lock for file descriptor level synchronization
-        val lock = fdLock ?: this
-        synchronized(lock) {
+        withBusLock {
             // Switch to this device before performing I/O
             if (!switchToDeviceBlocking()) {
                 throw IOException("Failed to switch to device 0x${sensorAddress.toString(16)}")
@@ -655,8 +850,7 @@ abstract class I2CSensor(
         }
 
         // Use the shared lock for file descriptor level synchronization
-        val lock = fdLock ?: this
-        synchronized(lock) {
+        withBusLock {
             // Switch to this device before performing I/O
             if (!switchToDeviceBlocking()) {
                 throw IOException("Failed to switch to device 0x${sensorAddress.toString(16)}")
@@ -681,8 +875,7 @@ abstract class I2CSensor(
         }
 
         // Use the shared lock for file descriptor level synchronization
-        val lock = fdLock ?: this
-        synchronized(lock) {
+        withBusLock {
             // Switch to this device before performing I/O
             if (!switchToDeviceBlocking()) {
                 throw IOException("Failed to switch to device 0x${sensorAddress.toString(16)}")
@@ -722,8 +915,7 @@ abstract class I2CSensor(
         }
 
         // Use the shared lock for file descriptor level synchronization
-        val lock = fdLock ?: this
-        synchronized(lock) {
+        withBusLock {
             // Switch to this device before performing I/O
             if (!switchToDeviceBlocking()) {
                 throw IOException("Failed to switch to device 0x${sensorAddress.toString(16)}")
@@ -756,8 +948,7 @@ abstract class I2CSensor(
         }
 
         // Use the shared lock for file descriptor level synchronization
-        val lock = fdLock ?: this
-        synchronized(lock) {
+        withBusLock {
             // Switch to this device before performing I/O
             if (!switchToDeviceBlocking()) {
                 throw IOException("Failed to switch to device 0x${sensorAddress.toString(16)}")
@@ -801,8 +992,7 @@ abstract class I2CSensor(
         }
 
         // Use the shared lock for file descriptor level synchronization
-        val lock = fdLock ?: this
-        synchronized(lock) {
+        withBusLock {
             // Switch to this device before performing I/O
             if (!switchToDeviceBlocking()) {
                 throw IOException("Failed to switch to device 0x${sensorAddress.toString(16)}")
@@ -834,8 +1024,7 @@ abstract class I2CSensor(
         }
 
         // Use the shared lock for file descriptor level synchronization
-        val lock = fdLock ?: this
-        synchronized(lock) {
+        withBusLock {
             // Switch to this device before performing I/O
             if (!switchToDeviceBlocking()) {
                 throw IOException("Failed to switch to device 0x${sensorAddress.toString(16)}")
@@ -873,21 +1062,67 @@ abstract class I2CSensor(
     
     /**
      * Executes a block of I2C operations as an atomic transaction.
-     * Holds the file descriptor lock for the entire operation to prevent
-     * race conditions when multiple sensors share the same I2C bus.
+     * Owns the bus for the entire operation, including suspension points, to prevent
+     * race conditions when multiple sensors share the same I2C bus. Waiting for the
+     * bus suspends instead of blocking the calling thread.
+     *
+     * On a bus in burst mode (see [I2CBusManager.setBurstMode]) the transaction is
+     * one burst: its transfers run back-to-back and the bus idles afterwards.
      *
      * @param operation The block of I2C operations to execute atomically
      * @return The result of the operation block
      */
     protected suspend fun <T> executeTransaction(operation: suspend () -> T): T {
-        return transactionMutex.withLock {
-            val lock = fdLock ?: this
-            synchronized(lock) {
-                if (!switchToDeviceBlocking()) {
+        val requested = System.nanoTime()
+        return busLock.withLock {
+            pollStats.addBusWait(System.nanoTime() - requested)
+            val burstIdleUs = busManager.getBurstIdleUs(busPath)
+            if (burstIdleUs != null) {
+                I2cNative.beginBurst(fileDescriptor)
+            }
+            try {
+                if (!switchToDevice()) {
                     throw IOException("Failed to switch to device 0x${sensorAddress.toString(16)}")
                 }
+                operation()
+            } finally {
+                if (burstIdleUs != null) {
+                    I2cNative.endBurst(fileDescriptor, burstIdleUs)
+                }
             }
-            operation()
+        }
+    }
+
+    /**
+     * Writes byte registers of this sensor and of every one of [peers] at once, with
+     * all their multiplexer channels open together. Peers are sensors at the same
+     * address behind other channels of the same multiplexer. Writes only: the
+     * replies to a read would collide on the bus.
+     *
+     * @param registers The register addresses, in write order
+     * @param values The byte to write to each register
+     */
+    internal suspend fun broadcastWrites(peers: Collection<I2CSensor>, registers: IntArray, values: IntArray) {
+        val routes = (peers + this).map {
+            it.muxRoute ?: throw IllegalArgumentException("Broadcast to $it, which is not behind a multiplexer")
+        }.distinct()
+        val requested = System.nanoTime()
+        busLock.withLock {
+            pollStats.addBusWait(System.nanoTime() - requested)
+            if (fileDescriptor < 0) {
+                throw IOException("Invalid file descriptor")
+            }
+            if (routes.any { route -> route.hops.any { !it.mux.isReady() } } ||
+                !busManager.getMultiplexerTree(busPath).selectBroadcast(routes)) {
+                throw IOException("Failed to open ${routes.size} channels for broadcast to 0x${sensorAddress.toString(16)}")
+            }
+            if (getCurrentDevice(fileDescriptor) != sensorAddress) {
+                if (I2cNative.switchDeviceAddress(fileDescriptor, sensorAddress) < 0) {
+                    throw IOException("Failed to switch to device 0x${sensorAddress.toString(16)}")
+                }
+                setCurrentDevice(fileDescriptor, sensorAddress)
+            }
+            writeByteRegsTransaction(registers, values)
         }
     }
     
@@ -938,6 +1173,39 @@ abstract class I2CSensor(
         }
     }
     
+    /**
+     * Writes several byte registers within a transaction. In burst mode they go out
+     * as one combined submission, otherwise one write per register as usual.
+     *
+     * @param registers The register addresses, in write order
+     * @param values The byte to write to each register
+     */
+    protected fun writeByteRegsTransaction(registers: IntArray, values: IntArray) {
+        if (fileDescriptor < 0) {
+            throw IOException("Invalid file descriptor")
+        }
+        if (busManager.getBurstIdleUs(busPath) == null) {
+            for (i in registers.indices) {
+                writeByteRegTransaction(registers[i], values[i])
+            }
+            return
+        }
+        
+        val result = I2cNative.writeRegisters(
+            fileDescriptor,
+            ByteArray(registers.size) { registers[it].toByte() },
+            ByteArray(registers.size) { values[it].toByte() }
+        )
+        if (result != registers.size) {
+            val errorMessage =
+                "I2C Write Error on fd=$fileDescriptor, ${registers.size} registers from 0x${
+                    registers.first().toString(16)
+                }, code=$result"
+            Log.e(TAG, errorMessage)
+            throw IOException(errorMessage)
+        }
+    }
+    
     /**
      * Internal method for I2C word register writes within a transaction.
      * Skips device switching since it's already done at transaction start.
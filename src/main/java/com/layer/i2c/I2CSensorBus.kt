@@ -1,17 +1,22 @@
 package com.layer.i2c
 
+import android.os.SystemClock
 import android.util.Log
 import com.layer.hardware.DeviceUtils
 import kotlinx.coroutines.CoroutineScope
 import kotlinx.coroutines.DelicateCoroutinesApi
+import kotlinx.coroutines.ExecutorCoroutineDispatcher
 import kotlinx.coroutines.ExperimentalCoroutinesApi
 import kotlinx.coroutines.Job
+import kotlinx.coroutines.cancelAndJoin
 import kotlinx.coroutines.delay
 import kotlinx.coroutines.isActive
 import kotlinx.coroutines.launch
 import kotlinx.coroutines.newSingleThreadContext
 import kotlinx.coroutines.withContext
 import java.io.IOException
+import java.util.concurrent.ConcurrentHashMap
+import kotlin.coroutines.CoroutineContext
 import kotlin.coroutines.cancellation.CancellationException
 import kotlin.math.min
 
@@ -27,35 +32,127 @@ open class Expectation(
 @OptIn(DelicateCoroutinesApi::class, ExperimentalCoroutinesApi::class)
 class I2CSensorBus(val busPath: String) {
     var i2cBusDescriptor : Int = -1
-    var multiplexer : TCA9548Multiplexer? = null
+    // Multiplexers on this bus, possibly cascaded, as found by the last scan
+    val multiplexerTree : MultiplexerTree
+        get() = I2CBusManager.getInstance().getMultiplexerTree(busPath)
+    // First multiplexer on the bare bus, if any
+    val multiplexer : TCA9548Multiplexer?
+        get() = multiplexerTree.roots().firstOrNull()
     var lastRescanTime = 0L
     var errorCounter = 0
     var rescanInterval = 15000L
     var maxRescanInterval = 150000L
     var updateInterval = 5000L
     var staleStateTimeoutMS = updateInterval * 3
+    // Breathing room between consecutive sensor reads (in milliseconds)
+    var readDelayMs = SENSOR_READ_DELAY_MS
+    
+    /**
+     * CPUs the bus thread is pinned to (bit n = CPU n), or 0 to leave it unpinned.
+     * Applied when the loop starts; mostly useful with [parallelAcquisition].
+     */
+    var cpuAffinity = 0L
+    
+    /**
+     * Share of bus time sensor reads may take, judged by their measured costs (see
+     * I2CSensor.busCost). When the sensors' combined demand exceeds it, every read
+     * period is stretched by the same factor. A new sensor is turned away if the
+     * periods would have to stretch by more than [maxPeriodStretch].
+     */
+    var busUtilizationTarget = 0.5
+    var maxPeriodStretch = 4.0
+    
+    /**
+     * Trigger same-address sensors behind one multiplexer together with a single
+     * broadcast write, then read them out channel by channel (see
+     * [SynchronizedAcquisition]). A group is acquired when any of its sensors is due,
+     * and all of its sensors are then read in the same cycle.
+     */
+    var synchronizedAcquisition = false
+    
+    /**
+     * Configure new same-address sensors behind one multiplexer together, with one
+     * broadcast per configuration step and a per-device check (see [BroadcastInit]).
+     * Sensors that fail the check are connected one by one as usual.
+     */
+    var broadcastInit = false
     
     private var reconnectList = mutableListOf<I2CSensor>()
+    // Bus budget overruns already reported
+    private var reportedOverruns = 0L
     private var ioJob : Job? = null
     
+    // Thread this bus runs on: the shared one, or its own in parallel acquisition mode
+    private var context : CoroutineContext = sharedContext
+    // Own thread of the running loop in parallel acquisition mode, closed when it stops
+    private var ownContext : ExecutorCoroutineDispatcher? = null
+    
     companion object {
-        var allSensors : MutableSet<I2CSensor> = mutableSetOf()
+        var allSensors : MutableSet<I2CSensor> = ConcurrentHashMap.newKeySet()
+        
+        /**
+         * Cost of a sensor type as measured on the most read instance polled anywhere,
+         * or null if none has been read yet. Stands in for sensors not read yet.
+         */
+        fun typicalCost(sensorClass: Class<out I2CSensor>): BusCostProfile.Snapshot? =
+            allSensors.filter { it.javaClass == sensorClass }
+                .map { it.busCost.snapshot() }
+                .filter { it.reads > 0 }
+                .maxByOrNull { it.reads }
         private const val TAG = "I2CBusManager"
-        private val context = newSingleThreadContext("I2CBusThread")
-        // Breathing room between consecutive sensor reads (in milliseconds)
+        private val sharedContext = newSingleThreadContext("I2CBusThread")
+        
+        /**
+         * Poll each physical bus on its own thread instead of taking turns on a shared one.
+         * Each bus is paced independently by the native layer, so every added bus adds
+         * close to its full capacity. Takes effect for buses started afterwards.
+         */
+        @Volatile
+        var parallelAcquisition = false
+        
+        /** Samples of all polled buses, merged in capture time order */
+        val samples = MergedSampleStream()
         private const val SENSOR_READ_DELAY_MS = 100L
         // Singleton instance
         private val port0 = I2CSensorBus("/dev/i2c-0")
         private val port1 = I2CSensorBus("/dev/i2c-1")
         
+        // Expectations are matched by every bus, so matching is done under this lock
+        private val expectationLock = Any()
         private var expectedSensors :  List<Expectation> = listOf()
-        private var mappedSensors : MutableMap<I2CSensor,  Expectation> = mutableMapOf()
-        private var latestSensorState = HashMap<String, SensorState>()
+        private var mappedSensors : MutableMap<I2CSensor,  Expectation> = ConcurrentHashMap()
+        private val latestSensorState = SensorStateRegistry()
         
         fun expect(sensors : List<Any>) {
-            expectedSensors = sensors.map { sensor ->
-                val name = sensor.javaClass.name.split("$")[0]
-                Expectation(name) }
+            synchronized(expectationLock) {
+                expectedSensors = sensors.map { sensor ->
+                    val name = sensor.javaClass.name.split("$")[0]
+                    Expectation(name) }
+            }
+        }
+        
+        // Assign [sensor] to the first unfilled expectation of its class, if any
+        private fun matchExpectation(sensor : I2CSensor) {
+            synchronized(expectationLock) {
+                for (expected in expectedSensors) {
+                    if (expected.expected == sensor.javaClass.name && expected.instance == null) {
+                        expected.instance = sensor
+                        mappedSensors[sensor] = expected
+                        break
+                    }
+                }
+            }
+        }
+        
+        // Free the expectations filled by sensors on [busPath]
+        private fun releaseExpectations(busPath : String) {
+            synchronized(expectationLock) {
+                mappedSensors.entries.removeAll { (sensor, expected) ->
+                    if (sensor.busPath != busPath) return@removeAll false
+                    if (expected.instance == sensor) expected.instance = null
+                    true
+                }
+            }
         }
         
         // Get the singleton instance
@@ -68,13 +165,33 @@ class I2CSensorBus(val busPath: String) {
         }
         
         fun getAllSensorState() : Map<String, SensorState> {
-            return latestSensorState.toMap()
+            return latestSensorState.snapshot()
         }
         
         fun getSensorState(sensorId : String) : SensorState? {
             return latestSensorState[sensorId]
         }
         
+        /**
+         * Snapshot of the schedule adherence of every polled sensor, keyed by sensor id.
+         */
+        fun getPollStats() : Map<String, PollStats.Snapshot> {
+            return allSensors.toList().associate { it.deviceUniqueId() to it.pollStats.snapshot() }
+        }
+        
+        fun resetPollStats() {
+            for (sensor in allSensors.toList()) {
+                sensor.pollStats.reset()
+            }
+        }
+        
+        // Sleeps and returns by how much the wake-up overran the request, in ns
+        private suspend fun timedDelay(ms: Long): Long {
+            val start = System.nanoTime()
+            delay(ms)
+            return maxOf(0L, System.nanoTime() - start - ms * 1_000_000)
+        }
+        
         fun initPorts():MutableList<I2CSensorBus> {
             val ports = mutableListOf(
                 getInstance(0)
@@ -123,25 +240,35 @@ class I2CSensorBus(val busPath: String) {
                 if (devClass != null && devClass !== TCA9548Multiplexer) {
                     val sensor = devClass.create(busPath)
                     if (sensor !is TCA9548Multiplexer) {
-                        if (multiplexer != null && device.channel >= 0) {
-                            sensor.setMultiplexer(multiplexer!!, device.channel)
+                        if (device.route != null) {
+                            sensor.setRoute(device.route)
                         }
                         sensors.add(sensor)
                     }
                 }
             }
+            if (broadcastInit) {
+                val configurable = sensors.filter { it is BroadcastConfigurable && !allSensors.contains(it) }
+                for (group in MultiplexerTree.broadcastGroups(configurable)) {
+                    try {
+                        BroadcastInit.initialize(group)
+                    } catch (e : Exception) {
+                        Log.e(TAG, "Broadcast initialization on ${busPath} failed: ${e.message}")
+                    }
+                }
+            }
+            // Sensors configured by broadcast are already initialized and connect() at once
             sensors.forEach { sensor ->
                 if (!allSensors.contains(sensor)) {
                     try {
                         if (sensor.connect()) {
-                            allSensors.add(sensor)
-                            for (expected in expectedSensors) {
-                                if (expected.expected == sensor.javaClass.name && expected.instance == null) {
-                                    expected.instance = sensor
-                                    mappedSensors[sensor] = expected
-                                    break
-                                }
+                            if (!admit(sensor)) {
+                                Log.w(TAG, "Not polling $sensor: $busPath cannot fit its bus time")
+                                tryDisconnectSafely(sensor)
+                                return@forEach
                             }
+                            allSensors.add(sensor)
+                            matchExpectation(sensor)
                         }
                     } catch (e : Exception) {
                         
@@ -169,56 +296,23 @@ class I2CSensorBus(val busPath: String) {
                 // Perform i2cdetect-style scan
                 val scanResult = I2CDetect.performI2CDetect(busPath)
                 
-                if (scanResult.detectedDevices.isNotEmpty()) {
-                    for (dev in scanResult.detectedDevices) {
-                        // Record and deduplicate the detected devices
-                        // use * for devices no on any multiplexer channel
-                        val devId = "$busPath:*:${dev.address}"
-                        if (!uniqueDeviceIds.contains(devId)) {
-                            allDevices.add(dev)
-                            uniqueDeviceIds.add(devId)
-                        }
-                    }
-                    
-                    // Check for multiplexers and scan their channels
-                    val multiplexers = scanResult.getDevicesOfType("TCA9548")
-                    
-                    multiplexers.forEach { muxDevice ->
-                        if (multiplexer != null && multiplexer!!.getAddress() != muxDevice.address) {
-                            val oldAddress = multiplexer?.getAddress()
-                            val newAddress = muxDevice.address
-                            Log.w(TAG, "Multiple multiplexers on $busPath, replacing old address: $oldAddress with new address: $newAddress")
-                            multiplexer?.disableAllChannels()
-                            tryDisconnectSafely(multiplexer)
-                            multiplexer = null
-                        }
-                        if (multiplexer == null) {
-                            multiplexer = TCA9548Multiplexer(busPath, muxDevice.address)
-                        }
-                    }
-                    val mux = multiplexer
-                    if (mux != null && (mux.isReady() || mux.connect())) {
-                        val allChannels = mux.scanAllChannels()
-                        val muxDevices = allChannels.channelDevices
-                        for (channel in muxDevices.keys) {
-                            muxDevices[channel]?.let {
-                                for (dev in it) {
-                                    // The multiplexer allows us to turn off certain devices while scanning, howver,
-                                    // devices that are not on a multiplexer channel will still show up in the
-                                    // multiplexer scan, so we need to deduplicate.  We only allow one device per
-                                    // address and per channel. Devices with * as their channel will block
-                                    // the same device address with any channel. In order to have more than one
-                                    // device of the same address, all of them must be on a multiplexer channel.
-                                    if (!uniqueDeviceIds.contains("$busPath:*:${dev.address}")){
-                                        val channelDevId = "$busPath:${dev.channel}:${dev.address}"
-                                        if (!uniqueDeviceIds.contains(channelDevId)) {
-                                            allDevices.add(dev)
-                                            uniqueDeviceIds.add(channelDevId)
-                                        }
-                                    }
-                                }
-                            }
-                        }
+                // Check for multiplexers and discover what is cascaded behind them
+                val multiplexers = scanResult.getDevicesOfType("TCA9548")
+                val detected = if (multiplexers.isNotEmpty()) {
+                    multiplexerTree.discover(multiplexers.map { it.address })
+                } else {
+                    scanResult.detectedDevices
+                }
+                for (dev in detected) {
+                    // Record and deduplicate the detected devices, using * for devices
+                    // not on any multiplexer channel. Discovery already hides devices that
+                    // are visible further up the tree, so a device on the bare bus blocks
+                    // its address on every channel. In order to have more than one device
+                    // of the same address, all of them must be behind a multiplexer.
+                    val devId = "$busPath:${dev.route?.label ?: "*"}:${dev.address}"
+                    if (!uniqueDeviceIds.contains(devId)) {
+                        allDevices.add(dev)
+                        uniqueDeviceIds.add(devId)
                     }
                 }
             } catch (e : Exception) {
@@ -231,6 +325,7 @@ class I2CSensorBus(val busPath: String) {
     private suspend fun scanForSensors() {
         withContext(context) {
             val devices = scanI2CPort()
+            reportBudgetOverruns("scan")
             if (devices.isEmpty()) {
                 rescanInterval =  min(maxRescanInterval, (rescanInterval * 1.1).toLong())
             }
@@ -240,6 +335,103 @@ class I2CSensorBus(val busPath: String) {
         }
     }
     
+    /**
+     * Order one poll cycle's sensors to keep multiplexer writes down: sensors on the
+     * bare bus first, then sensors grouped by the batches planned by the multiplexer
+     * tree. Each sensor is paired with the routes of its batch.
+     */
+    private fun planReads(sensors: List<I2CSensor>): List<Pair<I2CSensor, List<MuxRoute>>> {
+        val byRoute = sensors.groupBy { it.getMuxRoute() }
+        val plan = mutableListOf<Pair<I2CSensor, List<MuxRoute>>>()
+        byRoute[null]?.forEach { plan.add(it to emptyList()) }
+        for (batch in multiplexerTree.planBatches(byRoute.keys.filterNotNull())) {
+            for (route in batch) {
+                byRoute[route]?.forEach { plan.add(it to batch) }
+            }
+        }
+        return plan
+    }
+    
+    // Period the loop reads a sensor at before stretching: its own read interval, or
+    // about once per update interval for sensors read every cycle
+    private fun nominalPeriodMs(sensor: I2CSensor): Long =
+        sensor.readIntervalMs().takeIf { it > 0 } ?: updateInterval
+    
+    // Interval the loop reads a sensor at, stretched when the bus is over its utilization target
+    private fun readIntervalMs(sensor: I2CSensor, stretch: Double): Long =
+        if (stretch > 1.0) (nominalPeriodMs(sensor) * stretch).toLong() else sensor.readIntervalMs()
+    
+    // Whether the read interval of [sensor] has elapsed
+    private fun isDue(sensor: I2CSensor, stretch: Double, nowNanos: Long): Boolean {
+        val readIntervalMs = readIntervalMs(sensor, stretch)
+        return readIntervalMs <= 0 || sensor.sampleTimeNanos <= 0 ||
+            (nowNanos - sensor.sampleTimeNanos) / 1_000_000 >= readIntervalMs
+    }
+    
+    /** Share of bus time [sensors] take at their nominal periods, by their measured costs */
+    fun busDemand(sensors: Collection<I2CSensor> = allSensors.filter { it.busPath == busPath }): Double =
+        sensors.sumOf { it.busCost.snapshot().busUtilization(nominalPeriodMs(it) * 1_000_000) }
+    
+    /** Factor read periods are stretched by to keep the bus within [busUtilizationTarget] */
+    fun periodStretch(sensors: Collection<I2CSensor> = allSensors.filter { it.busPath == busPath }): Double =
+        maxOf(1.0, busDemand(sensors) / busUtilizationTarget)
+    
+    /**
+     * Whether [sensor] fits next to the sensors already polled on this bus. Its own
+     * measured cost is used if it has been read, else that of its type; a sensor of
+     * unknown cost is admitted.
+     */
+    fun admit(sensor: I2CSensor): Boolean {
+        val cost = sensor.busCost.snapshot().takeIf { it.reads > 0 }
+            ?: typicalCost(sensor.javaClass)
+            ?: return true
+        val others = allSensors.filter { it.busPath == busPath && it != sensor }
+        val demand = busDemand(others) + cost.busUtilization(nominalPeriodMs(sensor) * 1_000_000)
+        return demand / busUtilizationTarget <= maxPeriodStretch
+    }
+    
+    // Reads [sensor] and publishes its sample; a failed read queues it for reconnection
+    private suspend fun readAndPublish(sensor: I2CSensor, readIntervalMs: Long) {
+        val data = sensor.readData()
+        reportBudgetOverruns(sensor.toString())
+        if (data.isEmpty()) {
+            Log.e(TAG, "Sensor $sensor returned empty data. Marking sensor as disconnected")
+            errorCounter++
+            reconnectList.add(sensor)
+        } else if (data.containsKey("ERROR")) {
+            Log.e(
+                TAG,
+                "Sensor $sensor returned error: ${data["ERROR"]}. Marking sensor as disconnected"
+            )
+            errorCounter++
+            reconnectList.add(sensor)
+        } else {
+            Log.d(TAG, "Sensor $sensor returned data: $data")
+            val sensorId = sensor.deviceUniqueId()
+            latestSensorState.put(sensorId, sensor.getSensorState(), staleStateTimeoutMS)
+            val intendedMs = readIntervalMs.takeIf { it > 0 } ?: updateInterval
+            sensor.pollStats.recordSample(sensor.sampleTimeNanos, intendedMs * 1_000_000)
+            SensorStatePublisher.publish(sensorId, data, captureTimeNanos = sensor.sampleTimeNanos)
+            samples.offer(busPath, MergedSampleStream.Sample(busPath, sensorId, data, sensor.sampleTimeNanos))
+        }
+    }
+    
+    // Sleeps like timedDelay. Nothing is read meanwhile, which lets the merged stream move on.
+    private suspend fun idle(ms: Long): Long {
+        samples.advance(busPath, SystemClock.elapsedRealtimeNanos() + ms * 1_000_000)
+        return timedDelay(ms)
+    }
+    
+    // Logs windows that went over the bus budget since the last check, blaming [work]
+    private fun reportBudgetOverruns(work: String) {
+        val stats = I2CBusManager.getInstance().getBudgetStats(busPath) ?: return
+        if (stats.overruns > reportedOverruns) {
+            Log.w(TAG, "$work overran the bus budget of $busPath in ${stats.overruns - reportedOverruns} window(s), " +
+                "worst window so far ${stats.worstWindowNanos / 1000}us")
+        }
+        reportedOverruns = stats.overruns
+    }
+    
     private fun tryDisconnectSafely(sensor : I2CSensor?) {
         try {
             sensor?.disconnect()
@@ -259,6 +451,12 @@ class I2CSensorBus(val busPath: String) {
             }
         }
 
+        val dispatcher = if (parallelAcquisition)
+            newSingleThreadContext("I2CBusThread-${busPath.substringAfterLast('/')}")
+        else
+            null
+        ownContext = dispatcher
+        context = dispatcher ?: sharedContext
         ioJob = CoroutineScope(context).launch {
             // Set absolute lowest scheduling priority — SCHED_IDLE threads only run
             // when no other thread on the system wants CPU time
@@ -270,27 +468,55 @@ class I2CSensorBus(val busPath: String) {
             } else {
                 Log.i(TAG, "I2C thread set to SCHED_IDLE scheduling policy")
             }
+            if (cpuAffinity != 0L && I2cNative.setThreadAffinity(cpuAffinity) < 0) {
+                Log.w(TAG, "Cannot pin $busPath thread to CPUs 0x${cpuAffinity.toString(16)}")
+            }
+            samples.register(busPath)
             scanForSensors()
+            samples.advance(busPath, SystemClock.elapsedRealtimeNanos())
             // update interval is divided between the delay at the end of the for loop and
             // another delay at the end of the while loop
             
-            var currentTime: Long
+            // Oversleep of the loop's own delays, charged to the next sensor read
+            var loopCpuWaitNs = 0L
             try {
                 while (isActive) {
-                    val waitTime =  if (allSensors.isEmpty())
+                    val busSensors = allSensors.filter { it.busPath == busPath }
+                    val waitTime =  if (busSensors.isEmpty())
                         updateInterval * 2
                     else
-                        updateInterval / (allSensors.size+2)
+                        updateInterval / (busSensors.size+2)
+                    
+                    val nowNanos = SystemClock.elapsedRealtimeNanos()
+                    latestSensorState.evictExpired(nowNanos)
                     
-                    currentTime = System.currentTimeMillis()
-                    val it = latestSensorState.iterator()
-                    for (state in it) {
-                        if (currentTime - state.value.updateTS > staleStateTimeoutMS) {
-                            it.remove()
+                    val stretch = periodStretch(busSensors)
+                    // Sensors whose result a synchronized acquisition collected this cycle
+                    val acquired = HashSet<I2CSensor>()
+                    if (synchronizedAcquisition) {
+                        for (group in SynchronizedAcquisition.groups(busSensors)) {
+                            if (group.any { isDue(it, stretch, nowNanos) }) {
+                                acquired.addAll(SynchronizedAcquisition.acquire(group))
+                            }
+                        }
+                        // Hand out the collected results in capture order before anything idles:
+                        // idling moves this bus's watermark past captures still waiting their turn
+                        for (sensor in acquired.sortedBy { it.sampleTimeNanos }) {
+                            try {
+                                readAndPublish(sensor, readIntervalMs(sensor, stretch))
+                            } catch(e: CancellationException) {
+                                throw e
+                            } catch (e : Exception) {
+                                logException("Error collecting from sensor $sensor: ${e.message}", e)
+                                errorCounter++
+                                reconnectList.add(sensor)
+                            }
                         }
                     }
-                    
-                    for (sensor in allSensors.toList()) {
+                    for ((sensor, batch) in planReads(busSensors)) {
+                        if (sensor in acquired) {
+                            continue
+                        }
                         try {
                             if (!sensor.isReady()) {
                                 try {
@@ -306,38 +532,27 @@ class I2CSensorBus(val busPath: String) {
                                 }
                             }
                             if (sensor.isReady()) {
-                                // Skip this sensor if its minimum read interval hasn't elapsed
-                                if (sensor.minReadIntervalMs > 0) {
-                                    val elapsed = currentTime - sensor.lastReadTime
-                                    if (sensor.lastReadTime > 0 && elapsed < sensor.minReadIntervalMs) {
-                                        continue
-                                    }
+                                val readIntervalMs = readIntervalMs(sensor, stretch)
+                                // Skip this sensor if its read interval hasn't elapsed
+                                if (!isDue(sensor, stretch, nowNanos)) {
+                                    continue
                                 }
-                                val data = sensor.readData()
-                                if (data.isEmpty()) {
-                                    Log.e(TAG, "Sensor $sensor returned empty data. Marking sensor as disconnected")
-                                    errorCounter++
-                                    reconnectList.add(sensor)
-                                } else if (data.containsKey("ERROR")) {
-                                    Log.e(
-                                        TAG,
-                                        "Sensor $sensor returned error: ${data["ERROR"]}. Marking sensor as disconnected"
-                                    )
-                                    errorCounter++
-                                    reconnectList.add(sensor)
-                                } else {
-                                    Log.d(TAG, "Sensor $sensor returned data: $data")
-                                    val sensorId = sensor.deviceUniqueId()
-                                    latestSensorState[sensorId] = sensor.getSensorState()
+                                sensor.pollStats.addCpuWait(loopCpuWaitNs)
+                                loopCpuWaitNs = 0L
+                                if (batch.size > 1) {
+                                    // Open every channel of the batch at once; the reads in it then
+                                    // find their routes selected already
+                                    batch[0].last.mux.withBus { multiplexerTree.selectBatch(batch) }
                                 }
-                                delay(SENSOR_READ_DELAY_MS)  // Delay after successful sensor read, before any other I2C operations
+                                readAndPublish(sensor, readIntervalMs)
+                                loopCpuWaitNs += idle(readDelayMs)  // Delay after successful sensor read, before any other I2C operations
                             }
                         } catch (e : IOException) {
                             Log.e(TAG, "Error reading from sensor $sensor: ${e.message}")
                             // Disconnect to ensure clean reconnection later
                             errorCounter++
                             reconnectList.add(sensor)
-                            delay(SENSOR_READ_DELAY_MS)  // Delay after I/O error
+                            loopCpuWaitNs += idle(readDelayMs)  // Delay after I/O error
                         } catch(e: CancellationException) {
                             Log.i(TAG, "Coroutine canceled.", e)
                             throw e
@@ -345,9 +560,9 @@ class I2CSensorBus(val busPath: String) {
                             logException("Unexpected error reading from sensor0: ${e.message}", e)
                             errorCounter++
                             reconnectList.add(sensor)
-                            delay(SENSOR_READ_DELAY_MS)  // Delay after unexpected error
+                            loopCpuWaitNs += idle(readDelayMs)  // Delay after unexpected error
                         }
-                        delay(waitTime)
+                        loopCpuWaitNs += idle(waitTime)
                     }
                     
                     // reconnect any disconnected sensors
@@ -370,6 +585,7 @@ class I2CSensorBus(val busPath: String) {
                             // Remove the sensor from active polling but keep it in the reconnect
                             allSensors.remove(sensor)
                             latestSensorState.remove(sensor.deviceUniqueId())
+                            SensorStatePublisher.remove(sensor.deviceUniqueId())
                         }
                     }
                     
@@ -389,12 +605,23 @@ class I2CSensorBus(val busPath: String) {
                         cleanupSensors()
                         scanForSensors()
                     }
-                    delay(SENSOR_READ_DELAY_MS)
+                    loopCpuWaitNs += idle(readDelayMs)
                 }
             } finally {
+                samples.unregister(busPath)
                 cleanupSensors()
             }
         }
+        if (dispatcher != null) {
+            // Stop the bus's own thread with its loop; later work runs on the shared one
+            ioJob?.invokeOnCompletion {
+                if (ownContext === dispatcher) {
+                    context = sharedContext
+                    ownContext = null
+                }
+                dispatcher.close()
+            }
+        }
     }
     
     /** cancel the running coroutine */
@@ -402,31 +629,33 @@ class I2CSensorBus(val busPath: String) {
         this.ioJob?.cancel()
     }
     
+    /** cancel the running coroutine and wait until its sensors are cleaned up */
+    suspend fun cancelAndJoin() {
+        this.ioJob?.cancelAndJoin()
+    }
+    
     /** Disconnect all devices on this bus and free up resources */
     fun cleanupSensors() {
         try {
             errorCounter = 0
             // Clean up attached sensors before multiplexers.
-            for (sensor in allSensors.toList()) {
+            for (sensor in allSensors.filter { it.busPath == busPath }) {
                 if (sensor !is TCA9548Multiplexer) {
                     tryDisconnectSafely(sensor)
                 }
             }
-            val multiplexer = this.multiplexer
-            if (multiplexer != null) {
-                try {
-                    // now clean up multiplexers (if any)
-                    multiplexer.connect()
-                    multiplexer.disableAllChannels()
-                } catch(e:Exception) {
-                    logException(e)
-                }
-                tryDisconnectSafely(multiplexer)
+            // now clean up multiplexers (if any), innermost last to disconnect
+            val multiplexers = multiplexerTree.multiplexers()
+            try {
+                multiplexers.forEach { it.connect() }
+                multiplexerTree.disableAll()
+            } catch(e:Exception) {
+                logException(e)
             }
+            multiplexers.asReversed().forEach { tryDisconnectSafely(it) }
         } finally {
-            this.multiplexer = null
-            mappedSensors.clear()
-            allSensors.clear()
+            releaseExpectations(busPath)
+            allSensors.removeAll { it.busPath == busPath }
             reconnectList.clear()
             // Clear ALL tracked state (addresses, refcounts, fd) for this physical bus.
             // Using closeBus() for individual addresses can leak entries when sensors
@@ -22,6 +22,13 @@ interface SensorState {
     val updateTS: Long
     val sensorId: String
     
+    /**
+     * CLOCK_BOOTTIME nanoseconds (SystemClock.elapsedRealtimeNanos) at which the transfer
+     * that produced this sample completed, or 0 if unknown. Unlike updateTS it is free of
+     * wall clock steps and of the time spent building the state.
+     */
+    val captureTimeNanos: Long get() = 0L
+    
     val errorMessage: String?
     
     
@@ -40,6 +40,17 @@ public class I2cNative {
      */
     public static native int writeByte(int fd, int address, int value);
 
+    /**
+     * Writes one byte to each of several registers as a single I2C_RDWR submission,
+     * or one write per register if the adapter does not support it.
+     *
+     * @param fd        file descriptor of i2c bus
+     * @param registers register addresses, at most 42
+     * @param values    the byte for each register
+     * @return the number of registers written, or -1 on error
+     */
+    public static native int writeRegisters(int fd, byte[] registers, byte[] values);
+
     /**
      * Writes number of bytes to a specified address inside the i2c bus.
      *
@@ -80,9 +91,17 @@ public class I2cNative {
      */
     public static native int readRawBytes(int fd, byte[] buffer, int length);
 
+    /** Block read method: SMBus I2C block read, at most 31 bytes per transfer. */
+    public static final int BLOCK_METHOD_SMBUS = 0;
+    /** Block read method: 32-byte SMBus read (I2C_SMBUS_I2C_BLOCK_BROKEN). */
+    public static final int BLOCK_METHOD_SMBUS32 = 1;
+    /** Block read method: combined write/read transfer via I2C_RDWR. */
+    public static final int BLOCK_METHOD_RDWR = 2;
+
     /**
-     * Reads a block of bytes from a register address using SMBus I2C block read.
-     * Supports reading more than 32 bytes by performing multiple reads.
+     * Reads a block of bytes from a register address.
+     * Uses the largest transfer size the adapter's block read self-test proved safe
+     * (see {@link #probeBlockRead}), and performs multiple reads for larger blocks.
      *
      * @param fd         file descriptor of i2c bus
      * @param register   starting register address
@@ -92,6 +111,31 @@ public class I2cNative {
      */
     public static native int readBlockData(int fd, int register, byte[] buffer, int length);
 
+    /**
+     * Block read self-test for the adapter behind the file descriptor.
+     * Reads a register range of the currently selected device byte by byte as a
+     * reference, then with progressively larger block transfers and methods, and
+     * caches the largest size that returned identical data. The register range must
+     * not change while it is read and reading it must have no side effects.
+     * The result is cached per adapter (by sysfs name) and used by {@link #readBlockData}.
+     *
+     * @param fd         file descriptor of i2c bus, already switched to the test device
+     * @param register   first register of the test range
+     * @param length     length of the test range in bytes (1-256)
+     * @param force      re-run the test even if the adapter was already probed
+     * @return (method &lt;&lt; 16) | maxBlock, or negative value if the test could not run
+     *         or reached no result; nothing is cached then, so it can be repeated
+     */
+    public static native int probeBlockRead(int fd, int register, int length, boolean force);
+
+    /**
+     * Returns the block read capabilities currently used for the adapter behind the file descriptor.
+     *
+     * @param fd file descriptor of i2c bus
+     * @return (method &lt;&lt; 16) | maxBlock, or negative value if the fd is unknown
+     */
+    public static native int getBlockReadCaps(int fd);
+
     /**
      * Writes one byte inside the i2c bus.
      *
@@ -131,6 +175,373 @@ public class I2cNative {
      */
     public static native int recoverBus(int fd);
 
+    /**
+     * Sets the retry policy for transfers on a file descriptor. Failed transfers whose
+     * errno is in {@code retryableErrnos} are retried inside the native call with
+     * exponential backoff (base doubled per attempt, capped at maxBackoffUs, randomized
+     * by +/- jitterPercent) until maxAttempts or the deadline is reached.
+     * Probes and bus recovery never retry.
+     *
+     * @param fd              file descriptor of i2c bus, or -1 to set the default policy
+     * @param maxAttempts     total attempts including the first (1 disables retries)
+     * @param baseBackoffUs   backoff before the first retry in microseconds
+     * @param maxBackoffUs    upper bound for a single backoff in microseconds
+     * @param jitterPercent   random spread applied to each backoff (0-100)
+     * @param deadlineUs      total time budget for one transfer in microseconds (0 for none)
+     * @param retryableErrnos errno values that are retried (null retries nothing)
+     * @return 0 if successful, -1 if error
+     */
+    public static native int setRetryPolicy(int fd, int maxAttempts, long baseBackoffUs, long maxBackoffUs,
+                                            int jitterPercent, long deadlineUs, int[] retryableErrnos);
+
+    /**
+     * Sets the minimum gap between transfers on the bus behind a file descriptor.
+     * Each physical bus is paced independently, so buses polled from separate
+     * threads do not slow each other down.
+     *
+     * @param fd         file descriptor of i2c bus
+     * @param intervalUs minimum gap in microseconds, or -1 for the default of 250us
+     * @return 0 if successful, -1 if error
+     */
+    public static native int setBusPacing(int fd, long intervalUs);
+
+    /**
+     * Starts recording every bus transfer of this process into an in-memory ring,
+     * discarding earlier records. Cheap enough to leave on. Not available in client
+     * mode; start i2cd with -t instead.
+     *
+     * @param capacity ring size in records, or 0 for the default (16384); only the
+     *                 first call's size takes effect
+     * @return 0 if successful, -1 if error
+     */
+    public static native int startTrace(int capacity);
+
+    /**
+     * Stops recording. The records stay available to {@link #dumpTrace}.
+     */
+    public static native void stopTrace();
+
+    /**
+     * Writes the recorded transfers to a capture file (format in I2cTrace.h; print it
+     * with the i2ctrace tool). Recording continues.
+     *
+     * @param path file to write
+     * @return the number of records written, or -1 on error
+     */
+    public static native int dumpTrace(String path);
+
+    /**
+     * Serves every bus transfer of this process from a capture file written by
+     * {@link #dumpTrace}, instead of the hardware, so sensor drivers run on any Linux
+     * machine. Call before opening any bus. Not available in client mode; start i2cd
+     * with -R instead.
+     *
+     * @param path capture file
+     * @param fast answer as fast as possible instead of in the capture's timing
+     * @return the number of records loaded, or -1 on error
+     */
+    public static native int startReplay(String path, boolean fast);
+
+    /**
+     * Returns to the hardware. Call after closing every bus opened during the replay.
+     */
+    public static native void stopReplay();
+
+    /**
+     * Copies the running replay's statistics: [0] transfers, [1] matched in the
+     * capture, [2] unmatched, [3] nanoseconds since start, then for each transfer kind
+     * (select, SMBus, combined read, combined write, read, write) the attempts, their
+     * total latency and their largest latency in nanoseconds.
+     *
+     * @param stats array of up to 22 values
+     * @return the number of values copied, or -1 if no replay is running
+     */
+    public static native int getReplayStats(long[] stats);
+
+    /**
+     * Copies the running usage of the bus behind a file descriptor: [0] nanoseconds
+     * spent in transfers, [1] transfer attempts, [2] transfers that failed after
+     * their last attempt. Unavailable in client mode.
+     *
+     * @param fd    file descriptor of i2c bus
+     * @param stats array of at least 3 elements
+     * @return 0 if successful, -1 if error
+     */
+    public static native int getBusUsage(int fd, long[] stats);
+
+    /**
+     * Starts a burst on the bus behind a file descriptor: transfers run back-to-back
+     * without the pacing interval until {@link #endBurst}. Bursts nest; only the
+     * outermost one ends the burst.
+     *
+     * @param fd file descriptor of i2c bus
+     * @return 0 if successful, -1 if error
+     */
+    public static native int beginBurst(int fd);
+
+    /**
+     * Ends a burst. When it is the outermost one, no transfer starts on the bus for
+     * the following idle period.
+     *
+     * @param fd     file descriptor of i2c bus
+     * @param idleUs silence after the burst in microseconds
+     * @return 0 if successful, -1 if error or no burst is running
+     */
+    public static native int endBurst(int fd, long idleUs);
+
+    /**
+     * Limits the transfer time on the bus behind a file descriptor to a budget per
+     * window. Transfers over the budget wait for the next window, so long sequences
+     * are spread out instead of occupying the bus for many consecutive frames.
+     *
+     * @param fd       file descriptor of i2c bus
+     * @param budgetUs bus-busy time allowed per window, or 0 to remove the limit
+     * @param windowUs window length, or 0 to use frames (16.7ms without frame timing)
+     * @return 0 if successful, -1 if error
+     */
+    public static native int setBusBudget(int fd, long budgetUs, long windowUs);
+
+    /**
+     * Copies the budget counters of the bus behind a file descriptor: [0] windows with
+     * bus activity, [1] transfers deferred to a later window, [2] windows over budget,
+     * [3] total busy time in ns, [4] highest busy time in one window in ns.
+     *
+     * @param fd    file descriptor of i2c bus
+     * @param stats array of at least 5 elements
+     * @return 0 if successful, -1 if error
+     */
+    public static native int getBudgetStats(int fd, long[] stats);
+
+    /**
+     * Reports the latest vsync to the frame pacer. Call it once per frame.
+     *
+     * @param vsyncNanos  vsync time on the System.nanoTime() clock
+     * @param periodNanos frame period, or 0 to keep the previous one
+     */
+    public static native void setFrameTiming(long vsyncNanos, long periodNanos);
+
+    /**
+     * Enables frame pacing on all buses: no transfer starts within the quiet window
+     * before a frame deadline, and transfers run burstIntervalUs apart in the rest
+     * of the frame instead of the bus interval.
+     *
+     * @param quietUs         quiet window before each vsync, or 0 to disable frame pacing
+     * @param burstIntervalUs gap between transfers outside the quiet window
+     */
+    public static native void setFramePacing(long quietUs, long burstIntervalUs);
+
+    /**
+     * Pins the calling thread to a set of CPUs.
+     *
+     * @param cpuMask bit n set allows CPU n
+     * @return 0 if successful, -1 if error
+     */
+    public static native int setThreadAffinity(long cpuMask);
+
+    /**
+     * Overrides the retry policy for all transfers made by the calling thread until
+     * {@link #clearThreadRetryPolicy} is called. Parameters as in {@link #setRetryPolicy}.
+     */
+    public static native void setThreadRetryPolicy(int maxAttempts, long baseBackoffUs, long maxBackoffUs,
+                                                   int jitterPercent, long deadlineUs, int[] retryableErrnos);
+
+    /**
+     * Removes the calling thread's retry policy override.
+     */
+    public static native void clearThreadRetryPolicy();
+
+    /**
+     * Returns the number of attempts the last transfer on a bus needed. The count is
+     * kept with the bus rather than the thread, so a coroutine that resumed on another
+     * thread still reads its own transfer's count, as long as it still holds the bus.
+     *
+     * @param fd file descriptor of i2c bus
+     * @return attempts, or -1 if the fd is invalid or in client mode
+     */
+    public static native int getLastAttempts(int fd);
+
+    /**
+     * Returns the CLOCK_BOOTTIME timestamp (the clock of SystemClock.elapsedRealtimeNanos),
+     * taken natively when the calling thread's most recent transfer completed, or 0 if the
+     * thread has made none. Call it right after the read whose sample it should date.
+     */
+    public static native long getLastTransferTimeNanos();
+
+    /**
+     * Copies retry counters of a file descriptor: [0] transfers, [1] retries,
+     * [2] transfers that still failed after the last attempt.
+     *
+     * @param fd    file descriptor of i2c bus
+     * @param stats array of at least 3 elements
+     * @return 0 if successful, -1 if error
+     */
+    public static native int getRetryStats(int fd, long[] stats);
+
+    /**
+     * Sets the directory holding the cross-process lock files. There is no default:
+     * {@link #arbitrationOpen} fails until it is set. All processes sharing a bus must
+     * use the same directory, and be able to write to it.
+     *
+     * @param dir directory path
+     * @return 0 if successful, -1 if the path is too long
+     */
+    public static native int setArbitrationDir(String dir);
+
+    /**
+     * Opens the cross-process arbiter for a physical bus. The lock lives in a small
+     * shared-memory file per bus; if it cannot be mapped, arbitration is unavailable.
+     *
+     * @param busName physical bus path, e.g. /dev/i2c-1
+     * @return arbiter handle, or -1 if error or arbitration is unavailable
+     */
+    public static native int arbitrationOpen(String busName);
+
+    /** Result of {@link #arbitrationAcquire} when the bus was not free within the timeout. */
+    public static final int ARBITRATION_TIMEOUT = -2;
+
+    /**
+     * Acquires the bus for this process. The uncontended case needs no system call;
+     * waiters sleep on a futex and take over locks whose owner process has died.
+     *
+     * @param handle    arbiter handle
+     * @param timeoutUs maximum wait in microseconds, or 0 to wait indefinitely
+     * @return 0 if acquired, 1 if acquired and another process used the bus since this
+     *         process last held it, {@link #ARBITRATION_TIMEOUT} on timeout, -1 on error
+     */
+    public static native int arbitrationAcquire(int handle, long timeoutUs);
+
+    /**
+     * Releases the bus acquired with {@link #arbitrationAcquire}.
+     *
+     * @return 0 if successful, -1 if error
+     */
+    public static native int arbitrationRelease(int handle);
+
+    /**
+     * Closes an arbiter handle opened with {@link #arbitrationOpen}.
+     *
+     * @return 0 if successful, -1 if error
+     */
+    public static native int arbitrationClose(int handle);
+
+    /**
+     * Copies arbitration counters: [0] acquisitions, [1] contended acquisitions,
+     * [2] locks taken over from dead owners, [3] total wait ns, [4] total hold ns,
+     * [5] max hold ns. The counters are shared between processes.
+     *
+     * @param handle arbiter handle
+     * @param stats  array of at least 6 elements
+     * @return 0 if successful, -1 if error
+     */
+    public static native int getArbitrationStats(int handle, long[] stats);
+
+    /**
+     * Creates the shared-memory region that sensor samples are published into
+     * (ashmem, or a plain file when a path is given). Other processes map the
+     * returned fd read-only and use the reader API in I2cStateShm.h.
+     * Calling it again returns the existing region.
+     *
+     * @param maxRecords number of sensor records in the region
+     * @param path       file to back the region with, or null for anonymous shared memory
+     * @return file descriptor of the region, or -1 if error
+     */
+    public static native int stateRegionCreate(int maxRecords, String path);
+
+    /**
+     * Returns the file descriptor of the region created by {@link #stateRegionCreate}, or -1.
+     */
+    public static native int getStateRegionFd();
+
+    /**
+     * Publishes the latest sample of a sensor. Readers never block this call; each
+     * record is guarded by a sequence counter they retry on.
+     *
+     * @param sensorId     unique sensor id of at most 47 bytes
+     * @param updateTimeMs wall clock time of the sample
+     * @param captureTimeNs CLOCK_BOOTTIME when the sample's transfer completed, 0 if unknown
+     * @param keys         field names (truncated to 23 bytes, at most 24 fields)
+     * @param values       field values, same length as keys
+     * @return index of the sensor's record, or -1 if the id is too long or the region
+     *         is missing or full
+     */
+    public static native int stateRegionPublish(String sensorId, long updateTimeMs, long captureTimeNs,
+                                                String[] keys, double[] values);
+
+    /**
+     * Removes a sensor's record from the region.
+     *
+     * @return 0 if successful, -1 if the sensor was not published
+     */
+    public static native int stateRegionRemove(String sensorId);
+
+    /**
+     * Connects to the i2cd daemon. From then on every bus call of this process is
+     * forwarded to the daemon, which owns the buses and shares them with other
+     * processes; bus handles returned by {@link #openBus} stand in for file
+     * descriptors. Must be called before any bus is opened. The daemon only serves
+     * root, its own user and the user or group it was started with (-u, -g).
+     *
+     * @param socketPath daemon socket, or null for /data/local/tmp/i2cd.sock
+     * @return 0 if connected, -1 if error
+     */
+    public static native int connectDaemon(String socketPath);
+
+    /**
+     * Closes the daemon connection. Bus handles opened through it become invalid.
+     */
+    public static native void disconnectDaemon();
+
+    /**
+     * Returns true while bus calls are forwarded to the daemon.
+     */
+    public static native boolean isDaemonConnected();
+
+    /**
+     * Maps a shared-memory ring the daemon writes this process's poll results into.
+     *
+     * @param capacity number of samples the ring holds
+     * @return 0 if successful, -1 if error
+     */
+    public static native int daemonSubscribe(int capacity);
+
+    /**
+     * Registers a register block read that the daemon repeats on its own timer.
+     *
+     * @param fd            bus handle from {@link #openBus}
+     * @param deviceAddress device to read
+     * @param reg           first register
+     * @param length        bytes to read (at most 64)
+     * @param periodMs      poll period
+     * @param muxAddr       address of the mux in front of the device, or -1
+     * @param muxChannel    mux channel to select before reading
+     * @return poll id, or -1 if error
+     */
+    public static native int daemonAddPoll(int fd, int deviceAddress, int reg, int length,
+                                           int periodMs, int muxAddr, int muxChannel);
+
+    /**
+     * Stops a poll registered with {@link #daemonAddPoll}.
+     *
+     * @return 0 if successful, -1 if the poll is unknown
+     */
+    public static native int daemonRemovePoll(int pollId);
+
+    /**
+     * Copies the next unread poll sample from the shared ring without a system call.
+     *
+     * @param meta array of at least 6 elements: [0] poll id, [1] status (bytes read or
+     *             -errno), [2] CLOCK_BOOTTIME timestamp in ns, [3] device address,
+     *             [4] mux channel or -1, [5] register
+     * @param data receives the sample bytes
+     * @return number of bytes copied, -1 if no sample is pending, -2 if not subscribed
+     */
+    public static native int daemonNextSample(long[] meta, byte[] data);
+
+    /**
+     * Returns how many samples were overwritten before this process read them.
+     */
+    public static native long getDaemonLostSamples();
+
     /**
      * Sets the calling thread to SCHED_IDLE scheduling policy.
      * SCHED_IDLE is the absolute lowest scheduling priority in Linux —
@@ -0,0 +1,93 @@
+package com.layer.i2c
+
+import java.util.PriorityQueue
+import java.util.concurrent.CopyOnWriteArraySet
+
+/**
+ * Merges the samples of buses polled in parallel into one stream ordered by capture time.
+ *
+ * Every source (one bus loop) offers its samples and advances a watermark: a promise
+ * that it will offer nothing captured earlier. Samples are delivered once every
+ * registered source has advanced past them, so a listener sees capture times in
+ * order even though the buses run on separate threads. Delivery happens on the
+ * thread of the source that released the samples.
+ */
+class MergedSampleStream {
+    data class Sample(
+        val busPath: String,
+        val sensorId: String,
+        val data: Map<String, Any>,
+        val captureTimeNanos: Long
+    )
+
+    fun interface Listener {
+        fun onSample(sample: Sample)
+    }
+
+    private val lock = Any()
+    // Held while popping and delivering, so that deliveries never overtake each other
+    private val deliveryLock = Any()
+    private val pending = PriorityQueue<Sample>(compareBy { it.captureTimeNanos })
+    private val watermarks = HashMap<String, Long>()
+    private val listeners = CopyOnWriteArraySet<Listener>()
+
+    fun addListener(listener: Listener): Boolean = listeners.add(listener)
+
+    fun removeListener(listener: Listener): Boolean = listeners.remove(listener)
+
+    /** Start holding back samples for [source] until it advances */
+    fun register(source: String) {
+        synchronized(lock) {
+            watermarks.putIfAbsent(source, 0L)
+        }
+    }
+
+    /** Stop waiting for [source]; samples it was holding back are released */
+    fun unregister(source: String) {
+        synchronized(lock) {
+            watermarks.remove(source)
+        }
+        drain()
+    }
+
+    fun offer(source: String, sample: Sample) {
+        synchronized(lock) {
+            pending.add(sample)
+            val mark = watermarks[source]
+            if (mark != null && sample.captureTimeNanos > mark) {
+                watermarks[source] = sample.captureTimeNanos
+            }
+        }
+        drain()
+    }
+
+    /**
+     * Promise that [source] offers nothing captured before [nowNanos] from now on.
+     * Call it with SystemClock.elapsedRealtimeNanos() whenever no read is in progress.
+     */
+    fun advance(source: String, nowNanos: Long) {
+        synchronized(lock) {
+            val mark = watermarks[source] ?: return
+            if (nowNanos <= mark) return
+            watermarks[source] = nowNanos
+        }
+        drain()
+    }
+
+    private fun drain() {
+        synchronized(deliveryLock) {
+            val ready = mutableListOf<Sample>()
+            synchronized(lock) {
+                val limit = watermarks.values.minOrNull() ?: Long.MAX_VALUE
+                while (pending.isNotEmpty() && pending.peek()!!.captureTimeNanos <= limit) {
+                    ready.add(pending.poll()!!)
+                }
+            }
+            for (sample in ready) {
+                for (listener in listeners) {
+                    listener.onSample(sample)
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,411 @@
+package com.layer.i2c
+
+import android.util.Log
+
+/**
+ * One step of a route through cascaded multiplexers: [channel] of [mux] must be selected.
+ */
+data class MuxHop(val mux: TCA9548Multiplexer, val channel: Int) {
+    // "ch2" for a multiplexer at the default address, "ch2@71" otherwise
+    override fun toString(): String {
+        val address = mux.getMultiplexerAddress()
+        return if (address == TCA9548Multiplexer.DEFAULT_ADDRESS) "ch$channel" else "ch$channel@${address.toString(16)}"
+    }
+}
+
+/**
+ * Path from the bare bus to a device behind one or more cascaded multiplexers,
+ * outermost hop first. A single-hop route is the classic one-mux setup.
+ */
+data class MuxRoute(val hops: List<MuxHop>) {
+    init {
+        require(hops.isNotEmpty()) { "A route needs at least one hop" }
+    }
+
+    val last: MuxHop get() = hops.last()
+    val depth: Int get() = hops.size
+
+    /** Suffix of the effective bus path, e.g. ":ch2" or ":ch2:ch5@71" */
+    val pathSuffix: String = hops.joinToString("") { ":$it" }
+
+    /** Channel part of device ids: "2" for a single hop at 0x70 as before, "2:5@71" when nested */
+    val label: String = hops.joinToString(":") { it.toString().removePrefix("ch") }
+
+    fun then(mux: TCA9548Multiplexer, channel: Int) = MuxRoute(hops + MuxHop(mux, channel))
+
+    override fun toString(): String = label
+
+    companion object {
+        /** Route to [channel] of [mux], extending the route [mux] itself sits on */
+        fun to(mux: TCA9548Multiplexer, channel: Int): MuxRoute {
+            return mux.getMuxRoute()?.then(mux, channel) ?: MuxRoute(listOf(MuxHop(mux, channel)))
+        }
+    }
+}
+
+/**
+ * The multiplexers of one physical bus, arranged by the segment each sits on.
+ *
+ * Selecting a route only writes the multiplexers whose cached channel mask differs
+ * from what the route needs. Hops shared with the previously selected route are
+ * known to be exclusive already; for the others, sibling multiplexers on the same
+ * segment are switched off so that same-address devices behind them stay hidden.
+ *
+ * Routes whose channels may be open together can be selected as one batch
+ * (see [planBatches]).
+ *
+ * Multiplexers are registered by [discover], or lazily the first time a route
+ * through them is selected.
+ */
+class MultiplexerTree(val busPath: String) {
+    companion object {
+        private const val TAG = "MultiplexerTree"
+
+        // Levels of cascading explored by discover(); 8 x 8 channels need two
+        const val MAX_DEPTH = 3
+
+        /**
+         * Groups [sensors] that one broadcast can reach together: sensors of one type
+         * and address whose routes differ only in the last channel. Groups holding
+         * another type at the same address, which would take the broadcast as well,
+         * are left out, as are groups of fewer than two.
+         */
+        fun broadcastGroups(sensors: Collection<I2CSensor>): List<List<I2CSensor>> {
+            return sensors.filter { it.getMuxRoute() != null }
+                .groupBy { sensor ->
+                    val route = sensor.getMuxRoute()!!
+                    Triple(sensor.getAddress(), route.hops.dropLast(1), route.last.mux)
+                }
+                .values
+                .filter { group -> group.all { it.javaClass == group[0].javaClass } }
+                .map { group -> group.distinctBy { it.getMuxRoute() } }
+                .filter { it.size > 1 }
+        }
+    }
+
+    data class Stats(
+        val selects: Long,
+        val cacheHits: Long,
+        val muxWrites: Long
+    )
+
+    // Multiplexers by the segment they sit on; the bare bus is keyed by null
+    private val segments = HashMap<MuxRoute?, MutableList<TCA9548Multiplexer>>()
+
+    // Selection established last, or null when unknown: the routes it serves, all
+    // ending on the same multiplexer, and that multiplexer's mask. Only touched by
+    // the bus owner.
+    private var activeRoute: MuxRoute? = null
+    private var activeRoutes: Set<MuxRoute> = emptySet()
+    private var activeMask = 0
+
+    // Addresses found behind each channel by discover(), including cascaded multiplexers
+    private val channelAddresses = HashMap<MuxRoute, Set<Int>>()
+
+    @Volatile private var selects = 0L
+    @Volatile private var cacheHits = 0L
+    @Volatile private var muxWrites = 0L
+
+    fun register(mux: TCA9548Multiplexer) {
+        val segment = mux.getMuxRoute()
+        synchronized(segments) {
+            val muxes = segments.getOrPut(segment) { mutableListOf() }
+            if (muxes.none { it === mux }) {
+                muxes.add(mux)
+            }
+        }
+    }
+
+    /** All registered multiplexers, outermost first */
+    fun multiplexers(): List<TCA9548Multiplexer> = synchronized(segments) {
+        segments.values.flatten().sortedBy { it.getMuxRoute()?.depth ?: 0 }
+    }
+
+    /** Multiplexers on the bare bus */
+    fun roots(): List<TCA9548Multiplexer> = synchronized(segments) {
+        segments[null]?.toList() ?: emptyList()
+    }
+
+    private fun muxesOn(segment: MuxRoute?): List<TCA9548Multiplexer> = synchronized(segments) {
+        segments[segment]?.toList() ?: emptyList()
+    }
+
+    /**
+     * Forget which route is selected, e.g. after another process used the bus.
+     */
+    fun invalidate() {
+        activeRoute = null
+        activeRoutes = emptySet()
+    }
+
+    fun getStats() = Stats(selects, cacheHits, muxWrites)
+
+    /**
+     * Make the device end of [route] reachable, and nothing else that could share
+     * its address. The caller must own the bus.
+     *
+     * @return true if the route is selected
+     */
+    fun select(route: MuxRoute): Boolean {
+        selects++
+        if (isActive(route)) {
+            cacheHits++
+            return true
+        }
+        return establish(route, 1 shl route.last.channel, setOf(route))
+    }
+
+    /**
+     * Select several channels of the same multiplexer at once, as planned by
+     * [planBatches]. Each route of the batch is then served without further writes.
+     * The caller must own the bus.
+     *
+     * @return true if the batch is selected
+     */
+    fun selectBatch(batch: List<MuxRoute>): Boolean {
+        if (batch.size == 1) {
+            return select(batch[0])
+        }
+        selects++
+        var mask = 0
+        batch.forEach { mask = mask or (1 shl it.last.channel) }
+        if (activeMask == mask && batch.all { isActive(it) }) {
+            cacheHits++
+            return true
+        }
+        return establish(batch[0], mask, batch.toSet())
+    }
+
+    /**
+     * Open the channels [routes] end on all at once, so that one write reaches the
+     * devices behind every one of them, same-address devices included. The routes
+     * must differ only in their last channel. Unlike a batch, the selection serves
+     * none of the routes on its own: the next [select] writes the mask again.
+     * The caller must own the bus.
+     *
+     * @return true if the channels are open
+     */
+    fun selectBroadcast(routes: List<MuxRoute>): Boolean {
+        require(routes.isNotEmpty()) { "A broadcast needs at least one route" }
+        val first = routes[0]
+        require(routes.all { it.depth == first.depth && it.hops.dropLast(1) == first.hops.dropLast(1) &&
+                it.last.mux === first.last.mux }) { "Broadcast routes must differ only in their last channel" }
+        selects++
+        var mask = 0
+        routes.forEach { mask = mask or (1 shl it.last.channel) }
+        return establish(first, mask, emptySet())
+    }
+
+    private fun isActive(route: MuxRoute): Boolean {
+        if (route !in activeRoutes || !route.last.mux.isChannelMask(activeMask)) {
+            return false
+        }
+        for (index in 0 until route.depth - 1) {
+            val hop = route.hops[index]
+            if (!hop.mux.isOnlyChannelSelected(hop.channel)) return false
+        }
+        return true
+    }
+
+    // Select [route] with [lastMask] on its last multiplexer, serving [members]
+    private fun establish(route: MuxRoute, lastMask: Int, members: Set<MuxRoute>): Boolean {
+        // Siblings along the shared prefix were switched off when the active route was selected
+        val active = activeRoute
+        var shared = 0
+        if (active != null) {
+            while (shared < minOf(active.depth, route.depth) && active.hops[shared] == route.hops[shared]) {
+                shared++
+            }
+        }
+        activeRoute = null
+        activeRoutes = emptySet()
+
+        try {
+            for ((index, hop) in route.hops.withIndex()) {
+                register(hop.mux)
+                if (index >= shared) {
+                    for (sibling in muxesOn(hop.mux.getMuxRoute())) {
+                        if (sibling !== hop.mux && !sibling.isAllDisabled()) {
+                            sibling.disableAllChannels()
+                            muxWrites++
+                        }
+                    }
+                }
+                val mask = if (index == route.depth - 1) lastMask else 1 shl hop.channel
+                if (!hop.mux.isChannelMask(mask)) {
+                    hop.mux.setChannelMask(mask)
+                    muxWrites++
+                }
+            }
+        } catch (e: Exception) {
+            Log.e(TAG, "Failed to select route ${route.pathSuffix} on $busPath: ${e.message}")
+            return false
+        }
+
+        activeRoute = route
+        activeRoutes = members
+        activeMask = lastMask
+        return true
+    }
+
+    /**
+     * Group [routes] into batches that one selection each can serve, ordered so that
+     * a cycle through them takes as few multiplexer writes as the topology allows.
+     *
+     * Routes are visited depth-first, so that routes sharing a prefix are adjacent,
+     * starting from the active selection. Routes ending on the same multiplexer are
+     * merged into one multi-channel batch when discovery saw no address in common
+     * behind their channels and no further multiplexer hangs off them.
+     */
+    fun planBatches(routes: Collection<MuxRoute>): List<List<MuxRoute>> {
+        val ordered = routes.distinct().sortedWith(routeOrder)
+        val batches = mutableListOf<MutableList<MuxRoute>>()
+        // Addresses behind the last batch, or null if it cannot take more routes
+        var batchAddresses: MutableSet<Int>? = null
+        for (route in ordered) {
+            val addresses = mergeableAddresses(route)
+            val batch = batches.lastOrNull()
+            val current = batchAddresses
+            if (batch != null && current != null && addresses != null &&
+                batch[0].last.mux === route.last.mux && current.none { it in addresses }) {
+                batch.add(route)
+                current.addAll(addresses)
+            } else {
+                batches.add(mutableListOf(route))
+                batchAddresses = addresses?.toMutableSet()
+            }
+        }
+
+        // The cycle can start anywhere; start where the bus already is
+        val start = batches.indexOfFirst { batch -> batch.any { it in activeRoutes } }
+        return if (start > 0) batches.drop(start) + batches.take(start) else batches
+    }
+
+    // Addresses behind the channel [route] ends on, or null if it cannot share a mask
+    private fun mergeableAddresses(route: MuxRoute): Set<Int>? {
+        if (muxesOn(route).isNotEmpty()) return null
+        return synchronized(segments) { channelAddresses[route] }
+    }
+
+    private val routeOrder = Comparator<MuxRoute> { a, b ->
+        for (index in 0 until minOf(a.depth, b.depth)) {
+            val hopA = a.hops[index]
+            val hopB = b.hops[index]
+            val byAddress = hopA.mux.getMultiplexerAddress().compareTo(hopB.mux.getMultiplexerAddress())
+            if (byAddress != 0) return@Comparator byAddress
+            val byChannel = hopA.channel.compareTo(hopB.channel)
+            if (byChannel != 0) return@Comparator byChannel
+        }
+        a.depth.compareTo(b.depth)
+    }
+
+    /**
+     * Discover the multiplexers cascaded below [rootAddresses] and the devices on each
+     * of their channels. Replaces whatever was registered before.
+     *
+     * @param rootAddresses Addresses of the multiplexers seen on the bare bus
+     * @return Devices on the bare bus (channel -1, including the root multiplexers)
+     *         followed by the devices behind multiplexers, each with its route
+     */
+    fun discover(rootAddresses: List<Int>): List<DeviceInfo> {
+        for (mux in multiplexers().asReversed()) {
+            try {
+                mux.disconnect()
+            } catch (e: Exception) {
+                Log.w(TAG, "Failed to disconnect multiplexer ${mux.getAddressHex()}: ${e.message}")
+            }
+        }
+        synchronized(segments) {
+            segments.clear()
+            channelAddresses.clear()
+        }
+        invalidate()
+
+        val roots = rootAddresses.mapNotNull { address ->
+            val mux = TCA9548Multiplexer(busPath, address)
+            if (mux.connect()) mux else {
+                Log.w(TAG, "Cannot connect to multiplexer ${addressToHex(address)} on $busPath")
+                null
+            }
+        }
+        roots.forEach(::register)
+
+        // Connecting resets every root to all channels disabled, so only the bare bus is visible
+        val direct = I2CDetect.scanI2CBus(busPath)
+        val found = direct.mapTo(mutableListOf()) {
+            DeviceInfo(it, -1, CommonI2CDevices.getDeviceType(it))
+        }
+        for (root in roots) {
+            explore(root, direct.toSet(), found)
+        }
+
+        Log.i(TAG, "Discovered ${multiplexers().size} multiplexers and ${found.count { it.route != null }} devices behind them on $busPath")
+        return found
+    }
+
+    private fun explore(mux: TCA9548Multiplexer, above: Set<Int>, found: MutableList<DeviceInfo>) {
+        val depth = (mux.getMuxRoute()?.depth ?: 0) + 1
+        for (channel in 0 until mux.maxChannels) {
+            val route = MuxRoute.to(mux, channel)
+            var fresh = scanSegment(route, above) ?: continue
+
+            val children = if (depth < MAX_DEPTH) {
+                fresh.filter { it in TCA9548Multiplexer.MIN_ADDRESS..TCA9548Multiplexer.MAX_ADDRESS }
+                    .mapNotNull { address -> connectChild(route, address) }
+            } else {
+                emptyList()
+            }
+            if (children.isNotEmpty()) {
+                // Children come up with all channels disabled; look again without their devices
+                fresh = scanSegment(route, above) ?: continue
+            }
+
+            synchronized(segments) {
+                channelAddresses[route] = fresh.toSet()
+            }
+            for (address in fresh) {
+                if (children.none { it.getMultiplexerAddress() == address }) {
+                    found.add(DeviceInfo(address, channel, CommonI2CDevices.getDeviceType(address), route))
+                }
+            }
+            val seen = above + fresh
+            for (child in children) {
+                explore(child, seen, found)
+            }
+        }
+    }
+
+    private fun connectChild(route: MuxRoute, address: Int): TCA9548Multiplexer? {
+        val child = TCA9548Multiplexer(busPath, address)
+        child.setRoute(route)
+        if (!child.connect()) {
+            Log.w(TAG, "Cannot connect to cascaded multiplexer ${addressToHex(address)} behind ${route.pathSuffix}")
+            return null
+        }
+        register(child)
+        Log.i(TAG, "Found cascaded multiplexer ${addressToHex(address)} behind $busPath${route.pathSuffix}")
+        return child
+    }
+
+    // Addresses visible with [route] selected that are not visible further up
+    private fun scanSegment(route: MuxRoute, above: Set<Int>): List<Int>? {
+        return route.last.mux.withBus {
+            if (select(route)) I2CDetect.scanI2CBus(busPath).filter { it !in above } else null
+        }
+    }
+
+    /**
+     * Switch every multiplexer off, innermost first so that each one is still
+     * reachable when its turn comes.
+     */
+    fun disableAll() {
+        for (mux in multiplexers().asReversed()) {
+            try {
+                mux.disableAllChannels()
+            } catch (e: Exception) {
+                Log.w(TAG, "Failed to disable multiplexer ${mux.getAddressHex()}: ${e.message}")
+            }
+        }
+        invalidate()
+    }
+}
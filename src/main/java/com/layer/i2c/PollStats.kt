@@ -0,0 +1,190 @@
+package com.layer.i2c
+
+import kotlin.math.sqrt
+
+/**
+ * Schedule adherence of one sensor in a poll loop: how far the actual interval between
+ * samples strays from the intended one, and where the time of each read goes.
+ *
+ * Intervals are measured between capture timestamps (see I2CSensor.sampleTimeNanos), so
+ * they reflect when the bus transfers actually happened. Lateness is the amount by which
+ * an interval exceeded the intended one; an interval of n intended periods or more counts
+ * as n - 1 skipped cycles.
+ *
+ * Read time is split into:
+ * - cpu: waiting to be scheduled, i.e. sleeps that overran what was asked for
+ * - bus: waiting for the bus lock while other sensors or processes used the bus
+ * - conversion: sleeps the driver requested while the device converted
+ * - transfer: the remainder, mostly I2C transfers and their rate limiting
+ *
+ * Thread safe; the poll loop records while other threads take snapshots.
+ */
+class PollStats {
+    companion object {
+        /** Upper bounds of the lateness histogram buckets, in ms; the last bucket is open ended */
+        val LATENESS_BUCKETS_MS = longArrayOf(1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000)
+    }
+
+    data class Snapshot(
+        val intendedIntervalNs: Long,
+        val samples: Long,
+        val meanIntervalNs: Long,
+        val minIntervalNs: Long,
+        val maxIntervalNs: Long,
+        /** Standard deviation of the interval */
+        val intervalJitterNs: Long,
+        val meanLatenessNs: Long,
+        val maxLatenessNs: Long,
+        /** Sample counts per [LATENESS_BUCKETS_MS] bucket, plus one overflow bucket */
+        val latenessHistogram: LongArray,
+        val skippedCycles: Long,
+        val reads: Long,
+        val cpuWaitNs: Long,
+        val busWaitNs: Long,
+        val conversionNs: Long,
+        val transferNs: Long
+    ) {
+        /** Lateness below which the given fraction (0..1) of samples fell, at bucket resolution */
+        fun latenessPercentileMs(fraction: Double): Long {
+            val total = latenessHistogram.sum()
+            if (total == 0L) return 0
+            var seen = 0L
+            for (i in latenessHistogram.indices) {
+                seen += latenessHistogram[i]
+                if (seen >= total * fraction) {
+                    return if (i < LATENESS_BUCKETS_MS.size) LATENESS_BUCKETS_MS[i] else maxLatenessNs / 1_000_000
+                }
+            }
+            return maxLatenessNs / 1_000_000
+        }
+
+        override fun equals(other: Any?): Boolean = this === other ||
+                (other is Snapshot && samples == other.samples && reads == other.reads &&
+                        intendedIntervalNs == other.intendedIntervalNs && meanIntervalNs == other.meanIntervalNs &&
+                        latenessHistogram.contentEquals(other.latenessHistogram))
+
+        override fun hashCode(): Int = 31 * samples.hashCode() + latenessHistogram.contentHashCode()
+    }
+
+    private val lock = Any()
+
+    private var intendedIntervalNs = 0L
+    private var lastCaptureNs = 0L
+    private var samples = 0L
+    // Running mean and sum of squared deviations of the interval (Welford)
+    private var intervalMeanNs = 0.0
+    private var intervalM2 = 0.0
+    private var minIntervalNs = Long.MAX_VALUE
+    private var maxIntervalNs = 0L
+    private var latenessSumNs = 0L
+    private var maxLatenessNs = 0L
+    private val histogram = LongArray(LATENESS_BUCKETS_MS.size + 1)
+    private var skippedCycles = 0L
+
+    private var reads = 0L
+    private var cpuWaitNs = 0L
+    private var busWaitNs = 0L
+    private var conversionNs = 0L
+    private var transferNs = 0L
+
+    // Breakdown of the read in progress
+    private var readCpuNs = 0L
+    private var readBusNs = 0L
+    private var readConversionNs = 0L
+
+    /** Scheduling delay outside a read, e.g. a poll loop sleep that overran */
+    fun addCpuWait(ns: Long) = synchronized(lock) { cpuWaitNs += ns }
+
+    fun addBusWait(ns: Long) = synchronized(lock) { readBusNs += ns }
+
+    /**
+     * Account a driver sleep: the requested part is conversion time, any overrun is cpu wait.
+     */
+    fun addConversion(requestedNs: Long, actualNs: Long) = synchronized(lock) {
+        readConversionNs += minOf(requestedNs, actualNs)
+        readCpuNs += maxOf(0L, actualNs - requestedNs)
+    }
+
+    /**
+     * Close the breakdown of a read that took [totalNs] from start to finish.
+     */
+    fun endRead(totalNs: Long) = synchronized(lock) {
+        reads++
+        cpuWaitNs += readCpuNs
+        busWaitNs += readBusNs
+        conversionNs += readConversionNs
+        transferNs += maxOf(0L, totalNs - readCpuNs - readBusNs - readConversionNs)
+        readCpuNs = 0
+        readBusNs = 0
+        readConversionNs = 0
+    }
+
+    /**
+     * Record a successful sample captured at [captureNs] (CLOCK_BOOTTIME) by a loop that
+     * meant to sample every [intendedNs].
+     */
+    fun recordSample(captureNs: Long, intendedNs: Long) = synchronized(lock) {
+        intendedIntervalNs = intendedNs
+        val previous = lastCaptureNs
+        lastCaptureNs = captureNs
+        if (previous <= 0 || captureNs <= previous) return@synchronized
+
+        val interval = captureNs - previous
+        samples++
+        val delta = interval - intervalMeanNs
+        intervalMeanNs += delta / samples
+        intervalM2 += delta * (interval - intervalMeanNs)
+        if (interval < minIntervalNs) minIntervalNs = interval
+        if (interval > maxIntervalNs) maxIntervalNs = interval
+
+        val lateness = if (intendedNs > 0) maxOf(0L, interval - intendedNs) else 0L
+        latenessSumNs += lateness
+        if (lateness > maxLatenessNs) maxLatenessNs = lateness
+        val latenessMs = lateness / 1_000_000
+        var bucket = LATENESS_BUCKETS_MS.indexOfFirst { latenessMs < it }
+        if (bucket < 0) bucket = LATENESS_BUCKETS_MS.size
+        histogram[bucket]++
+        if (intendedNs > 0 && interval >= 2 * intendedNs) {
+            skippedCycles += interval / intendedNs - 1
+        }
+    }
+
+    fun snapshot(): Snapshot = synchronized(lock) {
+        val variance = if (samples > 1) intervalM2 / (samples - 1) else 0.0
+        Snapshot(
+            intendedIntervalNs = intendedIntervalNs,
+            samples = samples,
+            meanIntervalNs = intervalMeanNs.toLong(),
+            minIntervalNs = if (samples > 0) minIntervalNs else 0,
+            maxIntervalNs = maxIntervalNs,
+            intervalJitterNs = sqrt(variance).toLong(),
+            meanLatenessNs = if (samples > 0) latenessSumNs / samples else 0,
+            maxLatenessNs = maxLatenessNs,
+            latenessHistogram = histogram.copyOf(),
+            skippedCycles = skippedCycles,
+            reads = reads,
+            cpuWaitNs = cpuWaitNs,
+            busWaitNs = busWaitNs,
+            conversionNs = conversionNs,
+            transferNs = transferNs
+        )
+    }
+
+    fun reset() = synchronized(lock) {
+        lastCaptureNs = 0
+        samples = 0
+        intervalMeanNs = 0.0
+        intervalM2 = 0.0
+        minIntervalNs = Long.MAX_VALUE
+        maxIntervalNs = 0
+        latenessSumNs = 0
+        maxLatenessNs = 0
+        histogram.fill(0)
+        skippedCycles = 0
+        reads = 0
+        cpuWaitNs = 0
+        busWaitNs = 0
+        conversionNs = 0
+        transferNs = 0
+    }
+}
@@ -0,0 +1,135 @@
+package com.layer.i2c
+
+import kotlinx.coroutines.ThreadContextElement
+import kotlin.coroutines.AbstractCoroutineContextElement
+import kotlin.coroutines.CoroutineContext
+
+/**
+ * Retry policy for I2C transfers. Retries run inside the native transfer call,
+ * so a transient failure costs one backoff of a few hundred microseconds instead of a
+ * JNI round trip plus a coroutine delay.
+ *
+ * @param maxAttempts Total attempts including the first; 1 disables retries
+ * @param baseBackoffUs Backoff before the first retry, doubled for each further retry
+ * @param maxBackoffUs Upper bound for a single backoff
+ * @param jitterPercent Random spread applied to each backoff (0-100)
+ * @param deadlineUs Total time budget for one transfer including retries (0 for none)
+ * @param retryableErrnos errno values that are worth retrying. A NAK is not among them
+ *        by default: use [withNakRetries] where a device may NAK while it is busy.
+ */
+data class RetryPolicy(
+    val maxAttempts: Int = 3,
+    val baseBackoffUs: Long = 200,
+    val maxBackoffUs: Long = 2_000,
+    val jitterPercent: Int = 25,
+    val deadlineUs: Long = 10_000,
+    val retryableErrnos: IntArray = TRANSIENT_ERRNOS
+) {
+    companion object {
+        // EIO, EAGAIN, EBUSY, ETIMEDOUT
+        val TRANSIENT_ERRNOS = intArrayOf(5, 11, 16, 110)
+
+        // ENXIO, EREMOTEIO: the device did not acknowledge. Usually absent, so not
+        // worth retrying unless it is known to NAK while busy.
+        val NAK_ERRNOS = intArrayOf(6, 121)
+
+        /** Default policy applied to every bus opened through I2CBusManager */
+        val DEFAULT = RetryPolicy()
+
+        /** Single attempt, used for probing where a failure is the answer */
+        val NONE = RetryPolicy(maxAttempts = 1, retryableErrnos = IntArray(0))
+
+        private val threadPolicy = ThreadLocal<RetryPolicy?>()
+
+        /**
+         * Get the policy currently installed on this thread by [asContextElement], if any.
+         */
+        fun current(): RetryPolicy? = threadPolicy.get()
+
+        private fun install(policy: RetryPolicy?) {
+            threadPolicy.set(policy)
+            if (policy != null) {
+                I2cNative.setThreadRetryPolicy(
+                    policy.maxAttempts, policy.baseBackoffUs, policy.maxBackoffUs,
+                    policy.jitterPercent, policy.deadlineUs, policy.retryableErrnos
+                )
+            } else {
+                I2cNative.clearThreadRetryPolicy()
+            }
+        }
+    }
+
+    /**
+     * This policy, also retrying transfers the device did not acknowledge.
+     */
+    fun withNakRetries(): RetryPolicy =
+        copy(retryableErrnos = (retryableErrnos + NAK_ERRNOS).distinct().toIntArray())
+
+    /**
+     * Apply this policy to all transfers on a file descriptor.
+     *
+     * @param fd File descriptor, or -1 to set the native default
+     * @return true if the policy was applied
+     */
+    fun applyTo(fd: Int): Boolean {
+        return I2cNative.setRetryPolicy(
+            fd, maxAttempts, baseBackoffUs, maxBackoffUs, jitterPercent, deadlineUs, retryableErrnos
+        ) == 0
+    }
+
+    /**
+     * Run [block] with this policy overriding the per-bus policy on the current thread.
+     */
+    inline fun <T> runWith(block: () -> T): T {
+        val element = asContextElement()
+        val previous = element.updateThreadContext(kotlin.coroutines.EmptyCoroutineContext)
+        try {
+            return block()
+        } finally {
+            element.restoreThreadContext(kotlin.coroutines.EmptyCoroutineContext, previous)
+        }
+    }
+
+    /**
+     * Coroutine context element that installs this policy on whichever thread the
+     * coroutine resumes on, so a transaction or batch can carry its own policy
+     * across suspension points: `withContext(policy.asContextElement()) { ... }`.
+     */
+    fun asContextElement(): ThreadContextElement<RetryPolicy?> = PolicyElement(this)
+
+    private class PolicyElement(private val policy: RetryPolicy) :
+        AbstractCoroutineContextElement(PolicyElement), ThreadContextElement<RetryPolicy?> {
+        companion object Key : CoroutineContext.Key<PolicyElement>
+
+        override fun updateThreadContext(context: CoroutineContext): RetryPolicy? {
+            val previous = threadPolicy.get()
+            install(policy)
+            return previous
+        }
+
+        override fun restoreThreadContext(context: CoroutineContext, oldState: RetryPolicy?) {
+            install(oldState)
+        }
+    }
+
+    override fun equals(other: Any?): Boolean {
+        if (this === other) return true
+        if (other !is RetryPolicy) return false
+        return maxAttempts == other.maxAttempts &&
+                baseBackoffUs == other.baseBackoffUs &&
+                maxBackoffUs == other.maxBackoffUs &&
+                jitterPercent == other.jitterPercent &&
+                deadlineUs == other.deadlineUs &&
+                retryableErrnos.contentEquals(other.retryableErrnos)
+    }
+
+    override fun hashCode(): Int {
+        var result = maxAttempts
+        result = 31 * result + baseBackoffUs.hashCode()
+        result = 31 * result + maxBackoffUs.hashCode()
+        result = 31 * result + jitterPercent
+        result = 31 * result + deadlineUs.hashCode()
+        result = 31 * result + retryableErrnos.contentHashCode()
+        return result
+    }
+}
@@ -86,17 +86,15 @@ open class SHT40Sensor : I2CSensor {
     }
     
     private suspend fun softReset(): Boolean {
-        val writeResult: Int
-        val lock = fdLock ?: this
-
-        synchronized(lock) {
+        val writeResult = withBusLock {
             if (!switchToDeviceBlocking()) {
                 logError(TAG, "Failed switching to device ahead of sending command")
                 return false
             }
 
-            writeResult = I2cNative.write(fileDescriptor, 0x94)
-            Log.d(TAG, "Soft reset command result on SHT40: $writeResult")
+            val result = I2cNative.write(fileDescriptor, 0x94)
+            Log.d(TAG, "Soft reset command result on SHT40: $result")
+            result
         }
 
         // SHT40 needs about 100ms to soft reset - delay outside lock
@@ -128,6 +126,7 @@ open class SHT40Sensor : I2CSensor {
         override val errorMessage = lastError()
         override val connected = this@SHT40Sensor.isConnected()
         override val updateTS = System.currentTimeMillis()
+        override val captureTimeNanos = this@SHT40Sensor.sampleTimeNanos
         override val sensorId = this@SHT40Sensor.toString()
         override val temperature = this@SHT40Sensor.temperature
         override val humidity = this@SHT40Sensor.humidity
@@ -155,11 +154,12 @@ open class SHT40Sensor : I2CSensor {
                     mapOf("ERROR" to 65535)
                 } else {
                     // SHT40 high-precision measurement completes in 8.2ms max per datasheet
-                    delay(15)
+                    conversionDelay(15)
                 }
                 // Read 6 bytes: 2 for temperature, 1 CRC, 2 for humidity, 1 CRC
                 val buffer = ByteArray(6)
                 val bytesRead = I2cNative.readRawBytes(fileDescriptor, buffer, 6)
+                markSampleCaptured()
                 
                 if (bytesRead == 6) {
                     // Extract temperature (first 2 bytes)
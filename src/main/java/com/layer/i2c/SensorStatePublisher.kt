@@ -0,0 +1,92 @@
+package com.layer.i2c
+
+import android.os.ParcelFileDescriptor
+import android.util.Log
+
+/**
+ * Publishes the latest sample of every sensor into a shared-memory region that
+ * other local processes can map and read without touching the bus or going
+ * through binder. See I2cStateShm.h for the layout and the native reader API.
+ *
+ * Publishing is off until [start] is called.
+ */
+object SensorStatePublisher {
+    private const val TAG = "SensorStatePublisher"
+    
+    const val DEFAULT_MAX_RECORDS = 32
+    
+    @Volatile
+    private var started = false
+    
+    /**
+     * Create the shared region and start publishing.
+     *
+     * @param maxRecords Number of sensors the region can hold
+     * @param path File to back the region with (for readers that open it by path),
+     *             or null for anonymous shared memory handed out via [getSharedMemoryFd]
+     * @return true if the region is available
+     */
+    @Synchronized
+    fun start(maxRecords: Int = DEFAULT_MAX_RECORDS, path: String? = null): Boolean {
+        if (started) return true
+        val fd = I2cNative.stateRegionCreate(maxRecords, path)
+        if (fd < 0) {
+            Log.e(TAG, "Failed to create shared sensor state region")
+            return false
+        }
+        started = true
+        Log.i(TAG, "Publishing sensor state to shared memory (fd=$fd, records=$maxRecords)")
+        return true
+    }
+    
+    fun isStarted(): Boolean = started
+    
+    /**
+     * Get a duplicate of the region's file descriptor to pass to another process,
+     * e.g. through binder. The caller owns the returned descriptor.
+     */
+    fun getSharedMemoryFd(): ParcelFileDescriptor? {
+        val fd = I2cNative.getStateRegionFd()
+        return if (fd >= 0) ParcelFileDescriptor.fromFd(fd) else null
+    }
+    
+    /**
+     * Publish a sample. Numeric and boolean fields are published; other fields are skipped.
+     *
+     * @param sensorId Unique sensor id
+     * @param data Sample fields as returned by I2CSensor.readData
+     * @param updateTimeMs Wall clock time of the sample
+     * @param captureTimeNanos CLOCK_BOOTTIME when the sample's transfer completed, 0 if unknown
+     */
+    fun publish(
+        sensorId: String,
+        data: Map<String, Any>,
+        updateTimeMs: Long = System.currentTimeMillis(),
+        captureTimeNanos: Long = 0L
+    ) {
+        if (!started) return
+        val keys = ArrayList<String>(data.size)
+        val values = ArrayList<Double>(data.size)
+        for ((key, value) in data) {
+            val number = when (value) {
+                is Number -> value.toDouble()
+                is Boolean -> if (value) 1.0 else 0.0
+                else -> continue
+            }
+            keys.add(key)
+            values.add(number)
+        }
+        if (I2cNative.stateRegionPublish(sensorId, updateTimeMs, captureTimeNanos, keys.toTypedArray(), values.toDoubleArray()) < 0) {
+            Log.w(TAG, "$sensorId not published: its id is too long or the shared sensor state region is full")
+        }
+    }
+    
+    /**
+     * Remove a sensor's record, e.g. when it is dropped from polling.
+     */
+    fun remove(sensorId: String) {
+        if (started) {
+            I2cNative.stateRegionRemove(sensorId)
+        }
+    }
+}
@@ -0,0 +1,83 @@
+package com.layer.i2c
+
+import android.os.SystemClock
+import java.util.PriorityQueue
+
+/**
+ * Latest state of every sensor, with expiry.
+ *
+ * Each entry carries a deadline (CLOCK_BOOTTIME ns) held in a deadline-ordered
+ * queue, so [evictExpired] only looks at entries that actually expired. Replaced
+ * and removed entries leave their old deadline in the queue; it is recognised by
+ * its generation and dropped when it reaches the head.
+ *
+ * Readers get an immutable snapshot. It is rebuilt at most once per change, on
+ * the first read after it, and shared by all readers until the next change.
+ */
+class SensorStateRegistry {
+    private class Entry(val state: SensorState, val generation: Long)
+    private class Deadline(val atNanos: Long, val sensorId: String, val generation: Long)
+
+    private val lock = Any()
+    private val entries = HashMap<String, Entry>()
+    private val deadlines = PriorityQueue<Deadline>(compareBy { it.atNanos })
+    private var generation = 0L
+
+    private var snapshot: Map<String, SensorState> = emptyMap()
+    private var snapshotVersion = 0L
+
+    /** Incremented on every change */
+    @Volatile
+    var version = 0L
+        private set
+
+    /**
+     * Store a sensor's state, replacing the previous one. The state expires
+     * [timeoutMs] after its capture time, or after now if the capture time is unknown.
+     */
+    fun put(sensorId: String, state: SensorState, timeoutMs: Long) = synchronized(lock) {
+        val base = if (state.captureTimeNanos > 0) state.captureTimeNanos else SystemClock.elapsedRealtimeNanos()
+        generation++
+        entries[sensorId] = Entry(state, generation)
+        deadlines.add(Deadline(base + timeoutMs * 1_000_000, sensorId, generation))
+        version++
+    }
+
+    fun remove(sensorId: String) = synchronized(lock) {
+        if (entries.remove(sensorId) != null) {
+            version++
+        }
+    }
+
+    operator fun get(sensorId: String): SensorState? = synchronized(lock) { entries[sensorId]?.state }
+
+    /**
+     * Drop every state whose deadline is at or before [nowNanos].
+     * @return Number of states dropped
+     */
+    fun evictExpired(nowNanos: Long = SystemClock.elapsedRealtimeNanos()): Int = synchronized(lock) {
+        var evicted = 0
+        while (true) {
+            val head = deadlines.peek() ?: break
+            if (head.atNanos > nowNanos) break
+            deadlines.poll()
+            if (entries[head.sensorId]?.generation == head.generation) {
+                entries.remove(head.sensorId)
+                evicted++
+            }
+        }
+        if (evicted > 0) {
+            version++
+        }
+        evicted
+    }
+
+    /** Immutable view of all current states, keyed by sensor id */
+    fun snapshot(): Map<String, SensorState> = synchronized(lock) {
+        if (snapshotVersion != version) {
+            snapshot = entries.mapValues { it.value.state }
+            snapshotVersion = version
+        }
+        snapshot
+    }
+}
@@ -0,0 +1,82 @@
+package com.layer.i2c
+
+import android.os.SystemClock
+import kotlinx.coroutines.CancellationException
+import kotlinx.coroutines.CompletableDeferred
+import kotlinx.coroutines.currentCoroutineContext
+import kotlinx.coroutines.ensureActive
+
+/**
+ * Coalesces concurrent requests for the same expensive operation, e.g. a full
+ * spectral measurement.
+ *
+ * While a call is in flight, later callers wait for it and share its result
+ * instead of starting their own. A result is also handed out to callers that
+ * arrive within [freshnessMs] of its completion. Results rejected by the
+ * `cacheable` predicate (typically failures) are shared with the callers already
+ * waiting but are not kept for later ones.
+ */
+class SingleFlight<T>(
+    @Volatile var freshnessMs: Long = 0L
+) {
+    private val lock = Any()
+    private var inFlight: CompletableDeferred<T>? = null
+    private var cached: T? = null
+    private var cachedAtNs = 0L
+
+    /** Number of calls that were served without running the operation */
+    @Volatile
+    var sharedCount = 0L
+        private set
+
+    suspend fun run(cacheable: (T) -> Boolean = { true }, block: suspend () -> T): T {
+        while (true) {
+            val owner: Boolean
+            val flight: CompletableDeferred<T>
+            synchronized(lock) {
+                val result = cached
+                if (result != null && SystemClock.elapsedRealtimeNanos() - cachedAtNs <= freshnessMs * 1_000_000) {
+                    sharedCount++
+                    return result
+                }
+                val current = inFlight
+                owner = current == null
+                flight = current ?: CompletableDeferred<T>().also { inFlight = it }
+                if (!owner) sharedCount++
+            }
+
+            if (!owner) {
+                try {
+                    return flight.await()
+                } catch (e: CancellationException) {
+                    // The owner was cancelled; take over unless this caller was cancelled too
+                    currentCoroutineContext().ensureActive()
+                    continue
+                }
+            }
+
+            try {
+                val result = block()
+                synchronized(lock) {
+                    if (cacheable(result)) {
+                        cached = result
+                        cachedAtNs = SystemClock.elapsedRealtimeNanos()
+                    }
+                    inFlight = null
+                }
+                flight.complete(result)
+                return result
+            } catch (e: Throwable) {
+                synchronized(lock) { inFlight = null }
+                flight.completeExceptionally(e)
+                throw e
+            }
+        }
+    }
+
+    /** Drop the cached result so the next call runs the operation */
+    fun invalidate() = synchronized(lock) {
+        cached = null
+        cachedAtNs = 0L
+    }
+}
@@ -0,0 +1,76 @@
+package com.layer.i2c
+
+import android.util.Log
+
+/**
+ * A sensor whose measurement can be started by a broadcast write and read out
+ * later, one device at a time.
+ */
+interface BroadcastTriggerable {
+    /**
+     * (register, value) writes that start a measurement from the sensor's idle state.
+     * They must be the same for every instance and must not depend on reading the
+     * device first.
+     */
+    fun broadcastTriggerWrites(): Pair<IntArray, IntArray>
+
+    /**
+     * Waits for the measurement a broadcast started, reads it out and stops it.
+     * The result is handed out by the next readData() instead of measuring again.
+     *
+     * @return true if a result was collected
+     */
+    suspend fun collectTriggered(timeoutMs: Long): Boolean
+}
+
+/**
+ * Synchronized acquisition across same-address sensors on one multiplexer.
+ *
+ * Identical sensors behind different channels of a TCA9548 share an address, so
+ * they are normally selected, triggered, waited on and read one after another,
+ * and N sensors take N integration times. Here all their channels are opened
+ * together and the trigger is written once, reaching every sensor at the same
+ * moment; the channels are then walked one at a time to read the results. A group
+ * completes in about one integration time and its samples are time aligned.
+ */
+object SynchronizedAcquisition {
+    private const val TAG = "SynchronizedAcquisition"
+
+    // Longest wait for the first result of a group
+    private const val COLLECT_TIMEOUT_MS = 2000L
+
+    /**
+     * Groups the ready [BroadcastTriggerable] sensors among [sensors] that can be
+     * triggered together (see MultiplexerTree.broadcastGroups).
+     */
+    fun groups(sensors: Collection<I2CSensor>): List<List<I2CSensor>> =
+        MultiplexerTree.broadcastGroups(sensors.filter { it is BroadcastTriggerable && it.isReady() })
+
+    /**
+     * Triggers every sensor of [group] with one broadcast, then collects each result.
+     *
+     * @return the sensors whose results were collected
+     */
+    suspend fun acquire(group: List<I2CSensor>): List<I2CSensor> {
+        val leader = group.first()
+        val (registers, values) = (leader as BroadcastTriggerable).broadcastTriggerWrites()
+        try {
+            leader.broadcastWrites(group.drop(1), registers, values)
+        } catch (e: Exception) {
+            Log.e(TAG, "Broadcast trigger to ${group.size} sensors at ${leader.getAddressHex()} failed: ${e.message}")
+            return emptyList()
+        }
+        val collected = mutableListOf<I2CSensor>()
+        for (sensor in group) {
+            try {
+                if ((sensor as BroadcastTriggerable).collectTriggered(COLLECT_TIMEOUT_MS)) {
+                    collected.add(sensor)
+                }
+            } catch (e: Exception) {
+                Log.e(TAG, "Collecting $sensor after broadcast trigger failed: ${e.message}")
+            }
+        }
+        Log.d(TAG, "Synchronized acquisition of ${collected.size}/${group.size} sensors at ${leader.getAddressHex()}")
+        return collected
+    }
+}
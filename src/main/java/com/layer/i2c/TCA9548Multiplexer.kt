@@ -54,6 +54,10 @@ open class TCA9548Multiplexer(
     // Current channel mask (cached for performance)
     private var currentChannelMask: Int = 0
     
+    // False after another process used the bus; the next select rewrites the mask
+    @Volatile
+    private var channelMaskKnown = true
+    
     // Maximum number of channels for this multiplexer variant
     open val maxChannels: Int = MAX_CHANNELS
     
@@ -71,7 +75,7 @@ open class TCA9548Multiplexer(
             currentChannelMask = 0
             val validMask = 0 and ((1 shl maxChannels) - 1)
             
-            synchronized(fdLock ?: this) {
+            withBusLock {
                 if (!switchToDeviceBlocking()) {
                     connected = false
                     throw IOException("Failed to switch to multiplexer 0x${multiplexerAddress.toString(16)}")
@@ -89,6 +93,10 @@ open class TCA9548Multiplexer(
             // Read back the channel mask to confirm reset
             val mask = readChannelMaskDirect()
             currentChannelMask = mask
+            channelMaskKnown = true
+            
+            // Other processes sharing the bus may switch channels behind our back
+            fdLock?.foreignAccessListeners?.add(::invalidateChannelMask)
             
             Log.d(TAG, "TCA9548 multiplexer initialized at address 0x${multiplexerAddress.toString(16)}, reset to mask: 0x${mask.toString(16)}")
             true
@@ -102,6 +110,7 @@ open class TCA9548Multiplexer(
         override val errorMessage = lastError()
         override val connected = this@TCA9548Multiplexer.isConnected()
         override val updateTS = System.currentTimeMillis()
+        override val captureTimeNanos = this@TCA9548Multiplexer.sampleTimeNanos
         override val sensorId = this@TCA9548Multiplexer.toString()
         override val channelMask = this@TCA9548Multiplexer.getChannelMask()
         override val deviceSummary = "Multiplexer ${busPath} address 0x${multiplexerAddress.toString(16)}: Devices: ${deviceMap.toString()}"
@@ -139,7 +148,7 @@ open class TCA9548Multiplexer(
         
         // For TCA9548, reading from the device returns the current channel mask
         // Use raw I2C read since TCA9548 doesn't use registers
-        synchronized(fdLock ?: this) {
+        withBusLock {
             if (!switchToDeviceBlocking()) {
                 throw IOException("Failed to switch to multiplexer 0x${multiplexerAddress.toString(16)}")
             }
@@ -164,7 +173,7 @@ open class TCA9548Multiplexer(
 
         // For TCA9548, reading from the device returns the current channel mask
         // Use raw I2C read since TCA9548 doesn't use registers
-        synchronized(fdLock ?: this) {
+        withBusLock {
             if (!switchToDeviceBlocking()) {
                 throw IOException("Failed to switch to multiplexer 0x${multiplexerAddress.toString(16)}")
             }
@@ -189,7 +198,7 @@ open class TCA9548Multiplexer(
 
         val validMask = mask and ((1 shl maxChannels) - 1)
 
-        synchronized(fdLock ?: this) {
+        withBusLock {
             var errorCount = 0
             // this will repeat once if the i2c bus recovery succeeds in the catch block at tht end of the loop.
             // if the recovery fails, or the transaction fails a second time after one recovery attempt, then we
@@ -207,6 +216,7 @@ open class TCA9548Multiplexer(
                     }
                     // Update cached value and log success
                     currentChannelMask = validMask
+                    channelMaskKnown = true
                     Log.d(TAG, "Set multiplexer channel mask to 0x${validMask.toString(16)}")
                     break
                 } catch (e : IOException) {
@@ -224,7 +234,7 @@ open class TCA9548Multiplexer(
                 }
             }
         }
-        // Delay outside synchronized block — TCA9548 propagation delay is <30ns,
+        // Delay outside the bus lock — TCA9548 propagation delay is <30ns,
         // but allow a small stabilization window
         Thread.sleep(CHANNEL_SWITCH_DELAY_MS)
     }
@@ -242,7 +252,7 @@ open class TCA9548Multiplexer(
      * @param mask The channel mask (bit 0 = channel 0, bit 1 = channel 1, etc.)
      */
     fun setChannelMask(mask: Int) {
-        if (mask != currentChannelMask) {
+        if (mask != currentChannelMask || !channelMaskKnown) {
             writeChannelMask(mask)
         }
     }
@@ -287,7 +297,36 @@ open class TCA9548Multiplexer(
      */
     fun isChannelEnabled(channel: Int): Boolean {
         validateChannel(channel)
-        return (currentChannelMask and (1 shl channel)) != 0
+        return channelMaskKnown && (currentChannelMask and (1 shl channel)) != 0
+    }
+    
+    /**
+     * Check from the cached mask, without bus I/O, that [channel] is the only enabled channel.
+     */
+    fun isOnlyChannelSelected(channel: Int): Boolean {
+        return isChannelMask(1 shl channel)
+    }
+    
+    /**
+     * Check from the cached mask, without bus I/O, that all channels are disabled.
+     */
+    fun isAllDisabled(): Boolean {
+        return isChannelMask(0)
+    }
+    
+    /**
+     * Check from the cached mask, without bus I/O, that exactly [mask] is enabled.
+     */
+    fun isChannelMask(mask: Int): Boolean {
+        return channelMaskKnown && currentChannelMask == mask
+    }
+    
+    /**
+     * Forget the cached channel mask, e.g. after another process used the bus.
+     * The next channel selection writes the mask unconditionally.
+     */
+    fun invalidateChannelMask() {
+        channelMaskKnown = false
     }
     
     /**
@@ -387,6 +426,11 @@ open class TCA9548Multiplexer(
         }
     }
     
+    /**
+     * Run [block] while owning this multiplexer's bus.
+     */
+    internal fun <T> withBus(block: () -> T): T = withBusLock(block)
+    
     /**
      * Get the multiplexer address.
      * @return The I2C address of the multiplexer
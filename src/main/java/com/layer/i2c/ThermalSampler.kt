@@ -0,0 +1,258 @@
+package com.layer.i2c
+
+import android.os.SystemClock
+import android.util.Log
+import kotlinx.coroutines.CoroutineScope
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.Job
+import kotlinx.coroutines.awaitCancellation
+import kotlinx.coroutines.channels.Channel
+import kotlinx.coroutines.launch
+import kotlinx.coroutines.withTimeoutOrNull
+import java.io.IOException
+import java.io.RandomAccessFile
+
+/**
+ * One sampler for the sysfs thermal zones of every thermal sensor.
+ *
+ * Consumers subscribe with the zones they need and their period. Each tick reads
+ * the union of the zones of the consumers that are due, every zone once, and hands
+ * all of them the same [Snapshot], so consumers with overlapping zones neither read
+ * them twice nor see values from different instants. A consumer due within a
+ * quarter of its period is served early by a tick that is happening anyway, which
+ * keeps consumers with similar periods on the same ticks.
+ *
+ * Zone files stay open between ticks and are re-read from offset 0 into one
+ * buffer. A zone that cannot be opened is skipped until the subscriptions or the
+ * zones change. Consumers subscribed by [ThermalZones.Group] follow the zone index,
+ * which is refreshed every [RESCAN_MS] and whenever a zone read fails.
+ */
+object ThermalSampler {
+    private const val TAG = "ThermalSampler"
+
+    // How often the thermal zones are listed again to notice added or removed zones
+    private const val RESCAN_MS = 60_000L
+
+    /** Aggregate over the readable zones of a group, in °C */
+    data class Stats(
+        val count: Int,
+        val mean: Float,
+        val min: Float,
+        val max: Float,
+        /** Mean squared deviation from [mean] */
+        val variance: Float
+    )
+
+    /** Temperatures in °C of the zones read by one tick, by zone id */
+    class Snapshot(val timeNanos: Long, val temperatures: Map<Int, Float>) {
+        operator fun get(zone: Int): Float? = temperatures[zone]
+
+        /**
+         * Stats over those of [zones] that were read and pass [accept].
+         * @return null if there are none
+         */
+        fun stats(zones: Iterable<Int>, accept: (Float) -> Boolean = { true }): Stats? {
+            var count = 0
+            var sum = 0.0
+            var min = Float.POSITIVE_INFINITY
+            var max = Float.NEGATIVE_INFINITY
+            for (zone in zones) {
+                val temp = temperatures[zone] ?: continue
+                if (!accept(temp)) continue
+                count++
+                sum += temp
+                min = minOf(min, temp)
+                max = maxOf(max, temp)
+            }
+            if (count == 0) return null
+            val mean = (sum / count).toFloat()
+            var squares = 0.0
+            for (zone in zones) {
+                val temp = temperatures[zone] ?: continue
+                if (!accept(temp)) continue
+                squares += (temp - mean) * (temp - mean)
+            }
+            return Stats(count, mean, min, max, (squares / count).toFloat())
+        }
+
+        /** Stats over the zones of [group] (see [stats]) */
+        fun stats(group: ThermalZones.Group, accept: (Float) -> Boolean = { true }): Stats? =
+            stats(ThermalZones.zones(group), accept)
+    }
+
+    fun interface Consumer {
+        fun onSnapshot(snapshot: Snapshot)
+    }
+
+    private class Subscription(val zones: () -> Set<Int>, val periodMs: () -> Long, val consumer: Consumer) {
+        var nextNanos = 0L
+    }
+
+    private val lock = Any()
+    private val subscriptions = mutableListOf<Subscription>()
+    private var job: Job? = null
+    // Set when the subscriptions change: re-plan the next tick, retry unreadable zones
+    private var changed = false
+    private val wakeup = Channel<Unit>(Channel.CONFLATED)
+
+    // Only touched by the sampling coroutine. A null file marks an unreadable zone.
+    private val files = HashMap<Int, RandomAccessFile?>()
+    private val buffer = ByteArray(16)
+    private var lastScanNanos = 0L
+    private var readFailed = false
+
+    /** Snapshot of the last tick */
+    @Volatile
+    var latest = Snapshot(0L, emptyMap())
+        private set
+
+    /**
+     * Hands [consumer] a snapshot holding [zones] every [periodMs], starting now,
+     * until the calling coroutine is cancelled. [consumer] runs on the sampler's
+     * thread and must not block.
+     */
+    suspend fun subscribe(zones: Collection<Int>, periodMs: Long, consumer: Consumer) {
+        val fixed = zones.toSet()
+        subscribe(Subscription({ fixed }, { periodMs }, consumer))
+    }
+
+    /**
+     * Like [subscribe], for the zones of [group] as currently indexed.
+     */
+    suspend fun subscribe(group: ThermalZones.Group, periodMs: Long, consumer: Consumer) {
+        subscribe(group, { periodMs }, consumer)
+    }
+
+    /**
+     * Like [subscribe], with a period that may change between snapshots: [periodMs]
+     * is asked again after every snapshot handed to [consumer].
+     */
+    suspend fun subscribe(group: ThermalZones.Group, periodMs: () -> Long, consumer: Consumer) {
+        subscribe(Subscription({ ThermalZones.zones(group) }, periodMs, consumer))
+    }
+
+    private suspend fun subscribe(subscription: Subscription) {
+        synchronized(lock) {
+            subscriptions.add(subscription)
+            changed = true
+            if (job == null) {
+                job = CoroutineScope(Dispatchers.IO).launch { run() }
+            }
+        }
+        wakeup.trySend(Unit)
+        try {
+            awaitCancellation()
+        } finally {
+            synchronized(lock) {
+                subscriptions.remove(subscription)
+                changed = true
+            }
+            wakeup.trySend(Unit)
+        }
+    }
+
+    private suspend fun run() {
+        while (true) {
+            val now = SystemClock.elapsedRealtimeNanos()
+            if (readFailed || now - lastScanNanos >= RESCAN_MS * 1_000_000) {
+                readFailed = false
+                lastScanNanos = now
+                if (ThermalZones.refresh()) {
+                    synchronized(lock) { changed = true }
+                }
+            }
+            val due: List<Subscription>
+            val zones = sortedSetOf<Int>()
+            synchronized(lock) {
+                if (subscriptions.isEmpty()) {
+                    // Under the lock, so that a new sampler cannot start before the files are closed
+                    files.values.forEach { it?.close() }
+                    files.clear()
+                    job = null
+                    return
+                }
+                if (changed) {
+                    changed = false
+                    files.entries.removeAll { it.value == null }
+                }
+                due = subscriptions.filter { it.nextNanos - it.periodMs() * 250_000 <= now }
+                due.forEach { zones.addAll(it.zones()) }
+            }
+
+            if (due.isNotEmpty()) {
+                val snapshot = read(zones, now)
+                latest = snapshot
+                for (subscription in due) {
+                    try {
+                        subscription.consumer.onSnapshot(snapshot)
+                    } catch (e: Exception) {
+                        Log.e(TAG, "Thermal consumer failed: ${e.message}", e)
+                    }
+                }
+            }
+
+            // Scheduled after delivery, which may have changed the periods
+            var nextNanos = Long.MAX_VALUE
+            synchronized(lock) {
+                due.forEach { it.nextNanos = now + it.periodMs() * 1_000_000 }
+                subscriptions.forEach { nextNanos = minOf(nextNanos, it.nextNanos) }
+            }
+            val waitMs = (nextNanos - SystemClock.elapsedRealtimeNanos()) / 1_000_000
+            if (waitMs > 0) {
+                withTimeoutOrNull(waitMs) { wakeup.receive() }
+            }
+        }
+    }
+
+    private fun read(zones: Set<Int>, nowNanos: Long): Snapshot {
+        val temperatures = HashMap<Int, Float>(zones.size * 2)
+        for (zone in zones) {
+            val file = open(zone) ?: continue
+            try {
+                file.seek(0)
+                val millis = parseMillis(file.read(buffer)) ?: continue
+                temperatures[zone] = millis / 1000.0f
+            } catch (e: IOException) {
+                // Reopened next tick, after the zones are listed again
+                Log.e(TAG, "Error reading thermal zone $zone: ${e.message}")
+                file.close()
+                files.remove(zone)
+                readFailed = true
+            }
+        }
+        return Snapshot(nowNanos, temperatures)
+    }
+
+    private fun open(zone: Int): RandomAccessFile? {
+        if (files.containsKey(zone)) {
+            return files[zone]
+        }
+        val path = "/sys/class/thermal/thermal_zone$zone/temp"
+        val file = try {
+            RandomAccessFile(path, "r")
+        } catch (e: SecurityException) {
+            Log.e(TAG, "Cannot access thermal zone: $path")
+            null
+        } catch (e: IOException) {
+            Log.w(TAG, "Thermal zone not readable: $path")
+            null
+        }
+        files[zone] = file
+        return file
+    }
+
+    // Millidegrees from the first [length] bytes of [buffer], e.g. "45200\n"
+    private fun parseMillis(length: Int): Int? {
+        var i = 0
+        val negative = length > 0 && buffer[0].toInt().toChar() == '-'
+        if (negative) i++
+        var value = 0
+        val start = i
+        while (i < length && buffer[i].toInt().toChar() in '0'..'9') {
+            value = value * 10 + (buffer[i].toInt().toChar() - '0')
+            i++
+        }
+        if (i == start) return null
+        return if (negative) -value else value
+    }
+}
@@ -0,0 +1,146 @@
+package com.layer.i2c
+
+import android.util.Log
+import java.io.File
+import java.util.TreeMap
+import java.util.concurrent.ConcurrentHashMap
+
+/**
+ * Index of the sysfs thermal zones by type, so that consumers ask for "the GPU
+ * zones" instead of zone numbers that only hold on one SoC.
+ *
+ * The types under /sys/class/thermal are read once; [refresh] lists the directory
+ * again and only reads the types of zones it has not seen. Each [Group] is
+ * resolved against the index once and cached until the index changes, as are the
+ * trip points of each zone.
+ */
+object ThermalZones {
+    private const val TAG = "ThermalZones"
+    private const val ROOT = "/sys/class/thermal"
+    private const val PREFIX = "thermal_zone"
+    // Trip points looked for per zone; drivers number them from 0 without gaps
+    private const val MAX_TRIPS = 16
+
+    /** Trip types at which the kernel starts throttling or shuts down */
+    val THROTTLING_TRIPS = setOf("passive", "hot", "critical")
+
+    /** A trip point of a zone, in °C; [type] is e.g. "active", "passive" or "critical" */
+    data class Trip(val temperature: Float, val type: String)
+
+    /**
+     * Zones whose type matches one of [patterns], where '*' matches any run of
+     * characters. [fallback] is used when no zone matches, e.g. when the types
+     * cannot be read.
+     */
+    class Group(val name: String, patterns: List<String>, val fallback: List<Int> = emptyList()) {
+        private val regexes = patterns.map { pattern ->
+            Regex(pattern.split("*").joinToString(".*") { Regex.escape(it) })
+        }
+
+        fun matches(type: String): Boolean = regexes.any { it.matches(type) }
+
+        override fun toString(): String = name
+    }
+
+    // Qualcomm names them cpuss-N, cpu-C-N-N and gpuss-N; other SoCs cpu-thermal, gpu-thermal
+    val CPU = Group("cpu", listOf("cpu*"))
+    val GPU = Group("gpu", listOf("gpu*"), (63..69).toList())
+    val CHIP = Group("chip", listOf("cpu*", "gpu*"), ChipMaxThermalSensor.ZONE_IDS)
+
+    private class Index(val types: Map<Int, String>) {
+        val groups = ConcurrentHashMap<Group, Set<Int>>()
+        val trips = ConcurrentHashMap<Int, List<Trip>>()
+    }
+
+    private val lock = Any()
+    @Volatile
+    private var index: Index? = null
+
+    /** Type of every zone, by zone id */
+    fun types(): Map<Int, String> = current().types
+
+    /** Ids of the zones in [group], ascending */
+    fun zones(group: Group): Set<Int> {
+        val current = current()
+        return current.groups.getOrPut(group) { resolve(current.types, group) }
+    }
+
+    /** Trip points of [zone], coolest first; empty if it has none or they are unreadable */
+    fun trips(zone: Int): List<Trip> = current().trips.getOrPut(zone) { readTrips(zone) }
+
+    /**
+     * Lists the zones again, e.g. after a zone went away.
+     * @return true if the index changed
+     */
+    fun refresh(): Boolean = synchronized(lock) {
+        val old = index
+        val new = scan(old?.types ?: emptyMap())
+        if (old != null && new.types == old.types) {
+            return false
+        }
+        index = new
+        Log.i(TAG, "Thermal zones changed: ${new.types.size} zones")
+        return true
+    }
+
+    private fun current(): Index = index ?: synchronized(lock) {
+        index ?: scan(emptyMap()).also {
+            index = it
+            Log.i(TAG, "Indexed ${it.types.size} thermal zones")
+        }
+    }
+
+    private fun resolve(types: Map<Int, String>, group: Group): Set<Int> {
+        val matched = types.filterValues { group.matches(it) }.keys.toSortedSet()
+        if (matched.isEmpty() && group.fallback.isNotEmpty()) {
+            Log.w(TAG, "No thermal zone of group $group, using zones ${group.fallback}")
+            return group.fallback.toSortedSet()
+        }
+        return matched
+    }
+
+    // Reads the type of every zone missing from [known]
+    private fun scan(known: Map<Int, String>): Index {
+        val names = try {
+            File(ROOT).list() ?: emptyArray()
+        } catch (e: SecurityException) {
+            Log.e(TAG, "Cannot list thermal zones in $ROOT")
+            emptyArray()
+        }
+        val types = TreeMap<Int, String>()
+        for (name in names) {
+            if (!name.startsWith(PREFIX)) continue
+            val id = name.substring(PREFIX.length).toIntOrNull() ?: continue
+            types[id] = known[id] ?: readType(id) ?: continue
+        }
+        return Index(types)
+    }
+
+    private fun readType(id: Int): String? {
+        return try {
+            File("$ROOT/$PREFIX$id/type").readText().trim()
+        } catch (e: Exception) {
+            Log.w(TAG, "Cannot read type of thermal zone $id: ${e.message}")
+            null
+        }
+    }
+
+    // Trips with a temperature at or below 0 are disabled or placeholders
+    private fun readTrips(id: Int): List<Trip> {
+        val trips = mutableListOf<Trip>()
+        for (i in 0 until MAX_TRIPS) {
+            val file = File("$ROOT/$PREFIX$id/trip_point_${i}_temp")
+            try {
+                if (!file.exists()) break
+                val millis = file.readText().trim().toInt()
+                val type = File("$ROOT/$PREFIX$id/trip_point_${i}_type").readText().trim()
+                if (millis > 0) {
+                    trips.add(Trip(millis / 1000.0f, type))
+                }
+            } catch (e: Exception) {
+                Log.w(TAG, "Cannot read trip point $i of thermal zone $id: ${e.message}")
+            }
+        }
+        return trips.sortedBy { it.temperature }
+    }
+}
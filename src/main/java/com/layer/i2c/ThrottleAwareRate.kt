@@ -0,0 +1,152 @@
+package com.layer.i2c
+
+import kotlin.math.abs
+
+/**
+ * Picks a thermal poll interval from how close the zones are to their trip points.
+ *
+ * The headroom of a zone is its distance to the nearest of its trip points, and
+ * zero once it is at or past a throttling trip (see ThermalZones.THROTTLING_TRIPS).
+ * With the smallest headroom of all zones at or below [nearHeadroomC] the interval
+ * is [minIntervalMs]; at or above [farHeadroomC] it is [maxIntervalMs], and linear
+ * in between. Zones without trip points don't steer the rate; when no zone has
+ * any, the interval stays at its initial value.
+ *
+ * A line fitted to the last [trendSamples] margins to the first throttling trip
+ * predicts the time until throttling starts ([timeToTripMs]). The interval is
+ * kept short enough to take several samples before that.
+ *
+ * Attach to a sensor with ChipMaxThermalSensor.throttleRate.
+ */
+class ThrottleAwareRate(
+    val minIntervalMs: Long,
+    val maxIntervalMs: Long,
+    initialIntervalMs: Long = maxIntervalMs,
+    val nearHeadroomC: Float = DEFAULT_NEAR_HEADROOM_C,
+    val farHeadroomC: Float = DEFAULT_FAR_HEADROOM_C,
+    val trendSamples: Int = DEFAULT_TREND_SAMPLES
+) {
+    companion object {
+        const val DEFAULT_NEAR_HEADROOM_C = 3.0f
+        const val DEFAULT_FAR_HEADROOM_C = 20.0f
+        const val DEFAULT_TREND_SAMPLES = 8
+        // Fraction of the predicted time-to-trip to aim for, so several samples land before it
+        private const val TARGET_MARGIN = 0.25
+        // Fewest samples a trend is fitted to
+        private const val MIN_TREND_SAMPLES = 3
+    }
+
+    init {
+        require(minIntervalMs > 0 && maxIntervalMs >= minIntervalMs) {
+            "Invalid interval bounds $minIntervalMs..$maxIntervalMs"
+        }
+        require(farHeadroomC > nearHeadroomC) { "Far headroom must exceed near headroom" }
+        require(trendSamples >= MIN_TREND_SAMPLES) { "A trend needs at least $MIN_TREND_SAMPLES samples" }
+    }
+
+    private val initialIntervalMs = initialIntervalMs.coerceIn(minIntervalMs, maxIntervalMs)
+
+    // Ring of (time, margin to the first throttling trip) samples for the trend fit
+    private val times = LongArray(trendSamples)
+    private val margins = FloatArray(trendSamples)
+    private var count = 0
+    private var next = 0
+
+    /** Interval the zones should currently be read at */
+    @Volatile
+    var intervalMs: Long = this.initialIntervalMs
+        private set
+
+    /** Smallest headroom of all zones in °C, or null if no zone has trip points */
+    @Volatile
+    var headroomC: Float? = null
+        private set
+
+    /**
+     * Predicted time until the first zone reaches a throttling trip: 0 while one is
+     * throttling, null if none is heading for one.
+     */
+    @Volatile
+    var timeToTripMs: Long? = null
+        private set
+
+    /**
+     * Feed the temperatures of [zones] from [snapshot] and update [intervalMs].
+     */
+    @Synchronized
+    fun update(snapshot: ThermalSampler.Snapshot, zones: Collection<Int>) {
+        var headroom = Float.MAX_VALUE
+        // Smallest distance below a zone's first throttling trip; negative once past it
+        var margin = Float.MAX_VALUE
+        for (zone in zones) {
+            val temp = snapshot[zone] ?: continue
+            val trips = ThermalZones.trips(zone)
+            if (trips.isEmpty()) continue
+            trips.forEach { headroom = minOf(headroom, abs(it.temperature - temp)) }
+            val throttle = trips.firstOrNull { it.type in ThermalZones.THROTTLING_TRIPS } ?: continue
+            margin = minOf(margin, throttle.temperature - temp)
+        }
+        if (headroom == Float.MAX_VALUE) {
+            headroomC = null
+            timeToTripMs = null
+            intervalMs = initialIntervalMs
+            return
+        }
+        if (margin <= 0) {
+            headroom = 0f
+        }
+        headroomC = headroom
+
+        val tripMs = if (margin == Float.MAX_VALUE) null else predict(snapshot.timeNanos, margin)
+        timeToTripMs = tripMs
+
+        val fraction = ((headroom - nearHeadroomC) / (farHeadroomC - nearHeadroomC)).coerceIn(0f, 1f)
+        var interval = minIntervalMs + fraction * (maxIntervalMs - minIntervalMs)
+        if (tripMs != null) {
+            interval = minOf(interval, (tripMs * TARGET_MARGIN).toFloat())
+        }
+        intervalMs = interval.toLong().coerceIn(minIntervalMs, maxIntervalMs)
+    }
+
+    // Adds the sample and extrapolates the fitted margin to zero
+    private fun predict(timeNanos: Long, margin: Float): Long? {
+        times[next] = timeNanos
+        margins[next] = margin
+        next = (next + 1) % trendSamples
+        count = minOf(count + 1, trendSamples)
+        if (margin <= 0) return 0
+        if (count < MIN_TREND_SAMPLES) return null
+
+        // Least-squares slope in °C per ms, times relative to the first sample
+        val base = times[(next - count + trendSamples) % trendSamples]
+        var meanT = 0.0
+        var meanM = 0.0
+        for (i in 0 until count) {
+            meanT += (times[i] - base) / 1_000_000.0
+            meanM += margins[i]
+        }
+        meanT /= count
+        meanM /= count
+        var covariance = 0.0
+        var variance = 0.0
+        for (i in 0 until count) {
+            val t = (times[i] - base) / 1_000_000.0 - meanT
+            covariance += t * (margins[i] - meanM)
+            variance += t * t
+        }
+        if (variance <= 0.0) return null
+        val slope = covariance / variance
+        if (slope >= 0.0) return null
+        return (margin / -slope).toLong()
+    }
+
+    /** Forget the trend, e.g. after the sensor restarts */
+    @Synchronized
+    fun reset() {
+        count = 0
+        next = 0
+        headroomC = null
+        timeToTripMs = null
+        intervalMs = initialIntervalMs
+    }
+}
@@ -0,0 +1,101 @@
+package com.layer.i2c
+
+import android.util.Log
+import kotlinx.coroutines.delay
+import java.util.concurrent.atomic.AtomicLong
+
+/**
+ * Benchmarks the poll loop and the sensor drivers against a transfer capture
+ * (see I2cNative.dumpTrace) instead of hardware.
+ *
+ * While running, every transfer of this process is answered from the capture by
+ * the native replay backend, so the same sensors are found and read as when the
+ * capture was taken. [Timing.ORIGINAL] keeps the capture's transfer latencies;
+ * [Timing.FAST] answers at once and also drops bus pacing, the poll loop's update
+ * interval and the delays between reads, to measure the library's own cost.
+ * Sensors are then read as often as their own read intervals allow.
+ *
+ * Not available in client mode; there i2cd replays a capture itself (-R).
+ */
+class TraceReplay(val capturePath: String, val timing: Timing = Timing.ORIGINAL) {
+    companion object {
+        private const val TAG = "TraceReplay"
+        private val OP_NAMES = listOf("select", "smbus", "rdwr_read", "rdwr_write", "read", "write")
+    }
+
+    enum class Timing { ORIGINAL, FAST }
+
+    data class OpLatency(val count: Long, val meanNs: Long, val maxNs: Long)
+
+    data class Report(
+        val durationNs: Long,
+        val transfers: Long,
+        /** Transfers answered from the capture; the rest got a synthetic answer */
+        val matched: Long,
+        val unmatched: Long,
+        val transfersPerSecond: Double,
+        val samplesPerSecond: Double,
+        /** Per transfer kind, from asking for the bus to the answer (pacing included) */
+        val latency: Map<String, OpLatency>,
+        /** Schedule adherence of every sensor read during the replay */
+        val schedule: Map<String, PollStats.Snapshot>
+    )
+
+    /**
+     * Polls [busPaths] for [durationMs] with every transfer served from the capture.
+     * No bus may be open when this is called.
+     */
+    suspend fun run(busPaths: List<String>, durationMs: Long): Report {
+        val fast = timing == Timing.FAST
+        val records = I2cNative.startReplay(capturePath, fast)
+        if (records < 0) {
+            throw IllegalStateException("Cannot replay $capturePath")
+        }
+        Log.i(TAG, "Replaying $records transfers from $capturePath (timing $timing)")
+
+        val samples = AtomicLong()
+        val listener = MergedSampleStream.Listener { samples.incrementAndGet() }
+        val buses = busPaths.map { I2CSensorBus(it) }
+        I2CSensorBus.samples.addListener(listener)
+        try {
+            for (bus in buses) {
+                if (fast) {
+                    // The loop's wait between sensors is a share of the update interval
+                    bus.updateInterval = 0
+                    bus.readDelayMs = 0
+                    I2CBusManager.getInstance().setBusPacing(bus.busPath, 0)
+                }
+                bus.start()
+            }
+            delay(durationMs)
+
+            val stats = LongArray(4 + 3 * OP_NAMES.size)
+            val schedule = I2CSensorBus.getPollStats()
+            I2cNative.getReplayStats(stats)
+            val seconds = stats[3] / 1e9
+            val latency = OP_NAMES.withIndex().associate { (i, name) ->
+                val count = stats[4 + 3 * i]
+                name to OpLatency(count, if (count > 0) stats[5 + 3 * i] / count else 0, stats[6 + 3 * i])
+            }
+            return Report(
+                durationNs = stats[3],
+                transfers = stats[0],
+                matched = stats[1],
+                unmatched = stats[2],
+                transfersPerSecond = if (seconds > 0) stats[0] / seconds else 0.0,
+                samplesPerSecond = if (seconds > 0) samples.get() / seconds else 0.0,
+                latency = latency,
+                schedule = schedule
+            )
+        } finally {
+            I2CSensorBus.samples.removeListener(listener)
+            for (bus in buses) {
+                bus.cancelAndJoin()
+                if (fast) {
+                    I2CBusManager.getInstance().setBusPacing(bus.busPath, -1)
+                }
+            }
+            I2cNative.stopReplay()
+        }
+    }
+}